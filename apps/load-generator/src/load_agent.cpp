@@ -0,0 +1,406 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "load_agent.hpp"
+
+#include "clientmsg.hpp"
+#include "serialization.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+namespace load {
+
+namespace {
+  const Op all_ops[] = {Op::Connect, Op::Handshake, Op::Register, Op::Unregister, Op::Search, Op::Message, Op::Dialogue};
+
+  std::string label(Op op) {
+    return std::string{"op=\""} + to_string(op) + "\"";
+  }
+
+  /* Due time carried by messages and dialogues, process local */
+  std::string timestamp(Clock::time_point due, std::size_t size) {
+    uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(due.time_since_epoch()).count());
+    std::string content(std::max(size, sizeof(ns)), '\0');
+    std::memcpy(&content[0], &ns, sizeof(ns));
+    return content;
+  }
+
+  Clock::time_point timestamp(const std::string &content) {
+    uint64_t ns = 0;
+    if(content.size() >= sizeof(ns)) {
+      std::memcpy(&ns, content.data(), sizeof(ns));
+    }
+    return Clock::time_point{std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds{ns})};
+  }
+}
+
+const char *to_string(Op op) {
+  switch(op) {
+  case Op::Connect:    return "connect";
+  case Op::Handshake:  return "handshake";
+  case Op::Register:   return "register";
+  case Op::Unregister: return "unregister";
+  case Op::Search:     return "search";
+  case Op::Message:    return "message";
+  case Op::Dialogue:   return "dialogue";
+  }
+  return "unknown";
+}
+
+OpMetrics::OpMetrics(Op op)
+  : ops{"loadgen_ops_total", label(op), "Operations started"}
+  , errors{"loadgen_errors_total", label(op), "Operations failed or rejected"}
+  , latency{"loadgen_latency_us", label(op), "Operations latency from their due time"}
+{}
+
+OpMetrics &metrics(Op op) {
+  static std::vector<std::unique_ptr<OpMetrics>> all = []() {
+    std::vector<std::unique_ptr<OpMetrics>> v;
+    for(auto o : all_ops) {
+      v.emplace_back(std::make_unique<OpMetrics>(o));
+    }
+    return v;
+  }();
+  return *all[std::size_t(op)];
+}
+
+fetch::oef::Logger LoadAgent::logger = fetch::oef::Logger("load-agent");
+fetch::oef::Gauge LoadAgent::outstanding_{"loadgen_outstanding", "", "Searches, messages and dialogues not answered yet"};
+
+LoadAgent::LoadAgent(asio::io_context &io_context, std::string id, Peers peers)
+  : io_context_{io_context}, id_{std::move(id)}, peers_{std::move(peers)}
+{}
+
+bool LoadAgent::registered() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return bool(registered_);
+}
+
+void LoadAgent::failed_(Op op) {
+  metrics(op).errors.inc();
+}
+
+void LoadAgent::connect(const asio::ip::tcp::endpoint &endpoint, bool pipelined, Clock::time_point due,
+    std::function<void(bool)> done) {
+  metrics(Op::Connect).ops.inc();
+  closed_ = false;
+  auto socket = std::make_shared<asio::ip::tcp::socket>(io_context_);
+  auto self(shared_from_this());
+  socket->async_connect(endpoint, [this,self,socket,pipelined,due,done](std::error_code ec) {
+        if(ec) {
+          logger.debug("LoadAgent::connect {} failed: {}", id_, ec.message());
+          failed_(Op::Connect);
+          done(false);
+          return;
+        }
+        metrics(Op::Connect).latency.observe_since(due);
+        std::error_code ignored;
+        socket->set_option(asio::ip::tcp::no_delay(true), ignored);
+        comm_ = std::make_unique<AsioComm>(std::move(*socket));
+        handshake_(pipelined, Clock::now(), done);
+      });
+}
+
+void LoadAgent::handshake_(bool pipelined, Clock::time_point start, std::function<void(bool)> done) {
+  metrics(Op::Handshake).ops.inc();
+  fetch::oef::pb::Agent_Server_ID id;
+  id.set_public_key(id_);
+  id.set_pipelined(pipelined);
+  write_(pbs::serialize(id));
+  if(pipelined) {
+    fetch::oef::pb::Agent_Server_Answer answer;
+    answer.set_answer("");
+    write_(pbs::serialize(answer));
+    wait_connected_(start, done);
+    return;
+  }
+  auto self(shared_from_this());
+  comm_->receive_async([this,self,start,done](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+        bool status = false;
+        fetch::oef::pb::Server_Phrase phrase;
+        if(!ec) {
+          phrase = pbs::deserialize<fetch::oef::pb::Server_Phrase>(*buffer, status);
+        }
+        if(!status || !phrase.has_phrase()) {
+          logger.debug("LoadAgent::handshake_ {} got no phrase", id_);
+          failed_(Op::Handshake);
+          disconnect();
+          done(false);
+          return;
+        }
+        fetch::oef::pb::Agent_Server_Answer answer;
+        answer.set_answer(std::string(phrase.phrase().rbegin(), phrase.phrase().rend()));
+        write_(pbs::serialize(answer));
+        wait_connected_(start, done);
+      });
+}
+
+void LoadAgent::wait_connected_(Clock::time_point start, std::function<void(bool)> done) {
+  auto self(shared_from_this());
+  comm_->receive_async([this,self,start,done](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+        bool status = false;
+        fetch::oef::pb::Server_Connected connected;
+        if(!ec) {
+          connected = pbs::deserialize<fetch::oef::pb::Server_Connected>(*buffer, status);
+        }
+        if(!status || !connected.status()) {
+          logger.debug("LoadAgent::wait_connected_ {} not accepted", id_);
+          failed_(Op::Handshake);
+          disconnect();
+          done(false);
+          return;
+        }
+        metrics(Op::Handshake).latency.observe_since(start);
+        connected_ = true;
+        read_();
+        done(true);
+      });
+}
+
+void LoadAgent::disconnect() {
+  if(closed_.exchange(true)) {
+    return;
+  }
+  {
+    // under lock_: send_ counts nothing once connected_ is cleared
+    std::lock_guard<std::mutex> lock(lock_);
+    connected_ = false;
+    outstanding_.add(-int64_t(searches_.size() + pending_messages_ + pending_dialogues_));
+    searches_.clear();
+    pending_messages_ = 0;
+    pending_dialogues_ = 0;
+  }
+  if(comm_) {
+    comm_->disconnect();
+  }
+}
+
+void LoadAgent::register_service(const Instance &instance, Clock::time_point due) {
+  metrics(Op::Register).ops.inc();
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    registered_ = std::make_unique<Instance>(instance);
+  }
+  send_(Register(++msg_id_, instance).handle());
+}
+
+void LoadAgent::unregister_service(Clock::time_point due) {
+  std::unique_ptr<Instance> instance;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    instance.swap(registered_);
+  }
+  if(instance) {
+    metrics(Op::Unregister).ops.inc();
+    send_(Unregister(++msg_id_, *instance).handle());
+  }
+}
+
+void LoadAgent::search(const QueryModel &query, Clock::time_point due) {
+  metrics(Op::Search).ops.inc();
+  uint32_t msg_id = ++msg_id_;
+  send_(SearchServices(msg_id, query).handle(), [this,msg_id,due]() {
+        searches_[msg_id] = due;
+        outstanding_.add(1);
+      });
+}
+
+void LoadAgent::message(const std::string &destination, std::size_t size, Clock::time_point due) {
+  metrics(Op::Message).ops.inc();
+  // dialogue 0 tells messages from dialogues apart in dialogue errors
+  send_(Message(++msg_id_, 0, destination, timestamp(due, size)).handle(), [this]() {
+        ++pending_messages_;
+        outstanding_.add(1);
+      });
+}
+
+void LoadAgent::dialogue(const std::string &destination, Clock::time_point due) {
+  metrics(Op::Dialogue).ops.inc();
+  send_(CFP(++dialogue_id_, destination, CFPType{timestamp(due, 0)}, ++msg_id_, 0).handle(), [this]() {
+        ++pending_dialogues_;
+        outstanding_.add(1);
+      });
+}
+
+bool LoadAgent::answered_(uint32_t &pending) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if(pending == 0) {
+    return false;
+  }
+  --pending;
+  outstanding_.add(-1);
+  return true;
+}
+
+void LoadAgent::on_message_(const fetch::oef::pb::Server_AgentMessage &msg) {
+  switch(msg.payload_case()) {
+  case fetch::oef::pb::Server_AgentMessage::kAgents:
+  case fetch::oef::pb::Server_AgentMessage::kAgentsWide: {
+    Clock::time_point due;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      auto iter = searches_.find(uint32_t(msg.answer_id()));
+      if(iter == searches_.end()) {
+        return;
+      }
+      due = iter->second;
+      searches_.erase(iter);
+    }
+    outstanding_.add(-1);
+    metrics(Op::Search).latency.observe_since(due);
+    break;
+  }
+  case fetch::oef::pb::Server_AgentMessage::kOefError: {
+    // failed searches are reported as REGISTER_SERVICE errors: tell them by their msg_id first
+    bool search = false;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      search = searches_.erase(uint32_t(msg.answer_id())) > 0;
+    }
+    if(search) {
+      outstanding_.add(-1);
+      failed_(Op::Search);
+      break;
+    }
+    switch(msg.oef_error().operation()) {
+    case fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_SERVICE:
+      failed_(Op::Register);
+      break;
+    case fetch::oef::pb::Server_AgentMessage_OEFError::UNREGISTER_SERVICE:
+      failed_(Op::Unregister);
+      break;
+    default:
+      break;
+    }
+    break;
+  }
+  case fetch::oef::pb::Server_AgentMessage::kDialogueError:
+    if(msg.dialogue_error().dialogue_id() == 0) {
+      answered_(pending_messages_);
+      failed_(Op::Message);
+    } else {
+      answered_(pending_dialogues_);
+      failed_(Op::Dialogue);
+    }
+    break;
+  case fetch::oef::pb::Server_AgentMessage::kContent: {
+    const auto &content = msg.content();
+    if(content.has_content()) {
+      auto origin = peers_ ? peers_(content.origin()) : nullptr;
+      if(origin) {
+        origin->answered_(origin->pending_messages_);
+      }
+      metrics(Op::Message).latency.observe_since(timestamp(content.content()));
+      break;
+    }
+    if(!content.has_fipa()) {
+      break;
+    }
+    const auto &fipa = content.fipa();
+    if(fipa.has_cfp()) {
+      // answer with the initiator's timestamp
+      send_(Propose(uint32_t(content.dialogue_id()), content.origin(), ProposeType{fipa.cfp().content()},
+            ++msg_id_, 1).handle());
+    } else if(fipa.has_propose()) {
+      answered_(pending_dialogues_);
+      metrics(Op::Dialogue).latency.observe_since(timestamp(fipa.propose().content()));
+      send_(Accept(uint32_t(content.dialogue_id()), content.origin(), ++msg_id_, 2).handle());
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void LoadAgent::read_() {
+  auto self(shared_from_this());
+  comm_->receive_async([this,self](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+        if(ec) {
+          if(connected_) {
+            logger.debug("LoadAgent::read_ {} disconnected: {}", id_, ec.message());
+          }
+          disconnect();
+          return;
+        }
+        bool status = false;
+        auto msg = pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer, status);
+        if(status) {
+          on_message_(msg);
+        }
+        read_();
+      });
+}
+
+bool LoadAgent::send_(const fetch::oef::pb::Envelope &envelope, const std::function<void()> &queued) {
+  auto buffer = pbs::serialize(envelope);
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if(!connected_) {
+      return false;
+    }
+    if(queued) {
+      queued();
+    }
+    queue_.push_back(buffer);
+    if(queue_.size() > 1) {
+      return true; // written when the previous frames are
+    }
+  }
+  write_next_(buffer);
+  return true;
+}
+
+void LoadAgent::write_(std::shared_ptr<Buffer> buffer) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    queue_.push_back(buffer);
+    if(queue_.size() > 1) {
+      return; // written when the previous frames are
+    }
+  }
+  write_next_(buffer);
+}
+
+void LoadAgent::write_next_(std::shared_ptr<Buffer> buffer) {
+  auto self(shared_from_this());
+  comm_->send_async(buffer, [this,self](std::error_code ec, std::size_t) {
+        std::shared_ptr<Buffer> next;
+        {
+          std::lock_guard<std::mutex> lock(lock_);
+          if(ec) {
+            queue_.clear();
+            return;
+          }
+          queue_.pop_front();
+          if(queue_.empty()) {
+            return;
+          }
+          next = queue_.front();
+        }
+        write_next_(next);
+      });
+}
+
+} // load
+} // oef
+} // fetch
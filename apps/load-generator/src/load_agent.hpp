@@ -0,0 +1,127 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "asio_communicator.hpp"
+#include "metrics.hpp"
+#include "schema.hpp"
+
+#include "agent.pb.h"
+
+#include "asio.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace fetch {
+namespace oef {
+namespace load {
+  using Clock = std::chrono::steady_clock;
+
+  /* Operations measured by the load generator */
+  enum class Op { Connect, Handshake, Register, Unregister, Search, Message, Dialogue };
+  const char *to_string(Op op);
+
+  /* Per operation metrics, labelled op="<name>" */
+  struct OpMetrics {
+    explicit OpMetrics(Op op);
+    fetch::oef::Counter ops;
+    fetch::oef::Counter errors;
+    fetch::oef::Histogram latency; // microseconds from the intended start of the operation
+  };
+  OpMetrics &metrics(Op op);
+
+  /*
+   * One simulated agent. Everything is asynchronous so that a few io threads drive tens of
+   * thousands of agents. Frames are written one at a time, in order.
+   * Latencies are measured from the time an operation was due (coordinated omission
+   * correction): a generator falling behind its schedule shows as latency, not as lower load.
+   *   connect, handshake  TCP connection, then ID to Connected
+   *   search              request to answer
+   *   message             one-way, the due time travels in the content
+   *   dialogue            CFP to the Propose answering it, the Accept closes the dialogue
+   * The core doesn't acknowledge registrations: only their errors are counted.
+   * Operations are counted as outstanding only once their frame is queued, and by the agent which
+   * issued them: `peers` finds the origin of a message to credit its delivery back.
+   */
+  class LoadAgent : public std::enable_shared_from_this<LoadAgent> {
+  public:
+    using Peers = std::function<std::shared_ptr<LoadAgent>(const std::string &id)>;
+
+    explicit LoadAgent(asio::io_context &io_context, std::string id, Peers peers = nullptr);
+    LoadAgent(const LoadAgent &) = delete;
+    LoadAgent operator=(const LoadAgent &) = delete;
+
+    const std::string &id() const { return id_; }
+    bool connected() const { return connected_; }
+    bool registered() const;
+
+    /* Connect, then handshake (pipelined or not). `done` is called once, with the outcome */
+    void connect(const asio::ip::tcp::endpoint &endpoint, bool pipelined, Clock::time_point due,
+        std::function<void(bool)> done);
+    void disconnect();
+
+    void register_service(const Instance &instance, Clock::time_point due);
+    void unregister_service(Clock::time_point due);
+    void search(const QueryModel &query, Clock::time_point due);
+    void message(const std::string &destination, std::size_t size, Clock::time_point due);
+    void dialogue(const std::string &destination, Clock::time_point due);
+
+    /* Searches, messages and dialogues waiting for their answer, over all agents */
+    static int64_t outstanding() { return outstanding_.value(); }
+
+  private:
+    asio::io_context &io_context_;
+    const std::string id_;
+    const Peers peers_;
+    std::unique_ptr<AsioComm> comm_;
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> closed_{true};
+    mutable std::mutex lock_;
+    std::deque<std::shared_ptr<Buffer>> queue_;
+    std::unordered_map<uint32_t,Clock::time_point> searches_; // due time by msg_id
+    uint32_t pending_messages_ = 0;  // sent, neither delivered nor rejected yet
+    uint32_t pending_dialogues_ = 0; // CFPs sent, neither proposed to nor rejected yet
+    std::unique_ptr<Instance> registered_;
+    std::atomic<uint32_t> msg_id_{0};
+    std::atomic<uint32_t> dialogue_id_{0};
+
+    static fetch::oef::Logger logger;
+    static fetch::oef::Gauge outstanding_;
+
+    void handshake_(bool pipelined, Clock::time_point start, std::function<void(bool)> done);
+    void wait_connected_(Clock::time_point start, std::function<void(bool)> done);
+    void read_();
+    void on_message_(const fetch::oef::pb::Server_AgentMessage &msg);
+    /* Queue `envelope` if connected, running `queued` under lock_ then. Returns whether it was */
+    bool send_(const fetch::oef::pb::Envelope &envelope, const std::function<void()> &queued = nullptr);
+    /* Take one operation out of `pending`, false if the session it was counted in is gone */
+    bool answered_(uint32_t &pending);
+    void write_(std::shared_ptr<Buffer> buffer);
+    void write_next_(std::shared_ptr<Buffer> buffer);
+    void failed_(Op op);
+  };
+} // load
+} // oef
+} // fetch
@@ -0,0 +1,133 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+/*
+ * Load generator: simulates many agents of one OEF Core from a single process, following a
+ * scenario script (see scenario.hpp), e.g.
+ *   OEFLoadGenerator --port 3333 --agents 20000 --scenario connect-storm
+ *   OEFLoadGenerator --agents 5000 --script churn.txt --report-interval 1
+ * Prints one JSON line per step: throughput, errors and latency quantiles by operation.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include "scenario.hpp"
+#include "clara.hpp"
+
+namespace {
+  /* One socket per agent: allow as many descriptors as the hard limit does */
+  void raise_descriptors_limit(uint32_t agents) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < rlim_t(agents) + 64) {
+      std::cerr << "Warning: " << limit.rlim_cur << " file descriptors for " << agents << " agents\n";
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [thread %t] [%n] [%l] %v");
+  fetch::oef::load::Runner::Options options;
+  std::string scenario{"mixed"}, script, log_level{"warn"};
+  bool no_pipelining = false, list = false, show_help = false;
+  auto parser = clara::Help(show_help)
+      | clara::Opt(options.host, "host")["--host"]("OEF Core address (default 127.0.0.1)")
+      | clara::Opt(options.port, "port")["--port"]("OEF Core port (default 3333)")
+      | clara::Opt(options.agents, "n")["--agents"]("Number of agents (default 1000)")
+      | clara::Opt(options.threads, "n")["--threads"]("io threads (default 4)")
+      | clara::Opt(options.prefix, "prefix")["--prefix"]("Agents are named <prefix>-<index> (default load)")
+      | clara::Opt(scenario, "name")["--scenario"]("Built-in scenario (default mixed), see --list")
+      | clara::Opt(script, "path")["--script"]("Scenario script, instead of a built-in one")
+      | clara::Opt(list)["--list"]("Print the built-in scenarios")
+      | clara::Opt(no_pipelining)["--no-pipelining"]("Wait for the core phrase during handshakes")
+      | clara::Opt(options.seed, "seed")["--seed"]("Seed of services, queries and targets draws")
+      | clara::Opt(options.drain, "seconds")["--drain"]("Wait for answers at the end of each step (default 5)")
+      | clara::Opt(options.max_outstanding, "n")["--max-outstanding"]("Skip operations while <n> are unanswered (default 100000)")
+      | clara::Opt(options.report_interval, "seconds")["--report-interval"]("Progress on stderr every <seconds>")
+      | clara::Opt(log_level, "level")["--log-level"]("Log level (default warn)");
+  auto result = parser.parse(clara::Args(argc, argv));
+  LogLevel level;
+  if (!result || show_help || !fetch::oef::Logger::parse_level(log_level, level))
+  {
+    if (!result) {
+      std::cerr << "Error: " << result.errorMessage() << "\n";
+    }
+    std::cerr << parser << "\n";
+    return 1;
+  }
+  fetch::oef::Logger::level(level);
+  if (level > LogLevel::debug) {
+    // agents communicators report each disconnection as an error, the runner counts them
+    fetch::oef::Logger::level("asio-comm", LogLevel::off);
+  }
+  options.pipelined = !no_pipelining;
+
+  const auto &scripts = fetch::oef::load::builtin_scripts();
+  if (list) {
+    for (auto &s : scripts) {
+      std::cout << "# " << s.first << "\n" << s.second << "\n";
+    }
+    return 0;
+  }
+
+  std::vector<fetch::oef::load::Step> steps;
+  try
+  {
+    if (!script.empty()) {
+      std::ifstream file{script};
+      if (!file) {
+        std::cerr << "Error: cannot read " << script << "\n";
+        return 1;
+      }
+      steps = fetch::oef::load::parse_script(file);
+    } else {
+      auto iter = scripts.find(scenario);
+      if (iter == scripts.end()) {
+        std::cerr << "Error: unknown scenario " << scenario << ", see --list\n";
+        return 1;
+      }
+      std::istringstream builtin{iter->second};
+      steps = fetch::oef::load::parse_script(builtin);
+    }
+  } catch (std::invalid_argument& e)
+  {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+
+  raise_descriptors_limit(options.agents);
+  try
+  {
+    fetch::oef::load::Runner runner{options};
+    runner.run(steps, std::cout);
+    // agents disconnecting at teardown are not worth reporting
+    fetch::oef::Logger::level(LogLevel::off);
+  } catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
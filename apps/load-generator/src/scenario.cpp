@@ -0,0 +1,398 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "scenario.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace fetch {
+namespace oef {
+namespace load {
+
+namespace {
+  const char *actions[] = {"connect", "disconnect", "register", "unregister", "churn", "search",
+                           "message", "dialogue", "mix", "sleep"};
+  const char *mix_actions[] = {"churn", "search", "message", "dialogue"};
+  const Op all_ops[] = {Op::Connect, Op::Handshake, Op::Register, Op::Unregister, Op::Search, Op::Message, Op::Dialogue};
+
+  template <typename T>
+  bool contains(const T &values, const std::string &value) {
+    return std::find(std::begin(values), std::end(values), value) != std::end(values);
+  }
+
+  double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+}
+
+std::vector<Step> parse_script(std::istream &script) {
+  std::vector<Step> steps;
+  std::string line;
+  for(uint32_t number = 1; std::getline(script, line); ++number) {
+    auto text = line.substr(0, line.find('#'));
+    std::istringstream tokens{text};
+    Step step;
+    if(!(tokens >> step.action)) {
+      continue;
+    }
+    auto error = [number,&line](const std::string &what) {
+      return std::invalid_argument("line " + std::to_string(number) + " '" + line + "': " + what);
+    };
+    if(!contains(actions, step.action)) {
+      throw error("unknown action " + step.action);
+    }
+    std::string token;
+    while(tokens >> token) {
+      auto eq = token.find('=');
+      if(eq == std::string::npos) {
+        throw error("expected key=value, got " + token);
+      }
+      std::string key = token.substr(0, eq);
+      double value = 0.;
+      try {
+        value = std::stod(token.substr(eq + 1));
+      } catch(std::exception &) {
+        throw error("not a number: " + token);
+      }
+      if(value < 0.) {
+        throw error("negative value: " + token);
+      }
+      if(key == "rate") {
+        step.rate = value;
+      } else if(key == "duration") {
+        step.duration = value;
+      } else if(key == "count") {
+        step.count = uint64_t(value);
+      } else if(key == "size") {
+        step.size = uint32_t(value);
+      } else if(step.action == "mix" && contains(mix_actions, key)) {
+        step.weights[key] = value;
+      } else {
+        throw error("unknown key " + key);
+      }
+    }
+    bool repeated = contains(mix_actions, step.action) || step.action == "mix";
+    if(repeated && !step.count && (!step.duration || !step.rate)) {
+      throw error("count, or rate and duration, required");
+    }
+    if(step.action == "mix" && step.weights.empty()) {
+      throw error("mix of nothing");
+    }
+    auto start = text.find_first_not_of(" \t");
+    step.line = text.substr(start, text.find_last_not_of(" \t") - start + 1);
+    steps.emplace_back(std::move(step));
+  }
+  return steps;
+}
+
+const std::map<std::string,std::string> &builtin_scripts() {
+  static const std::map<std::string,std::string> scripts{
+    {"connect-storm",
+        "connect                      # all agents at once\n"
+        "sleep duration=1\n"
+        "disconnect\n"},
+    {"churn",
+        "connect rate=5000\n"
+        "churn rate=2000 duration=20\n"
+        "unregister\n"
+        "disconnect\n"},
+    {"search-mix",
+        "connect rate=5000\n"
+        "register rate=5000\n"
+        "search rate=1000 duration=20\n"
+        "unregister\n"
+        "disconnect\n"},
+    {"dialogues",
+        "connect rate=5000\n"
+        "message rate=20000 duration=10 size=128\n"
+        "dialogue rate=5000 duration=10\n"
+        "disconnect\n"},
+    {"mixed",
+        "connect rate=5000\n"
+        "register rate=5000\n"
+        "mix rate=10000 duration=30 message=60 dialogue=20 search=15 churn=5\n"
+        "unregister\n"
+        "disconnect\n"}};
+  return scripts;
+}
+
+fetch::oef::Logger Runner::logger = fetch::oef::Logger("load-runner");
+
+Runner::Runner(Options options)
+  : options_{std::move(options)}
+  , work_{asio::make_work_guard(io_context_)}
+  , random_{options_.seed}
+{
+  asio::ip::tcp::resolver resolver{io_context_};
+  endpoint_ = *resolver.resolve(options_.host, std::to_string(options_.port)).begin();
+  // agents are named <prefix>-<index>, agents_ doesn't change once built
+  auto peers = [this](const std::string &id) -> std::shared_ptr<LoadAgent> {
+    std::string prefix = options_.prefix + "-";
+    if(id.size() <= prefix.size() || id.compare(0, prefix.size(), prefix) != 0) {
+      return nullptr;
+    }
+    std::size_t index = 0;
+    for(std::size_t i = prefix.size(); i < id.size(); ++i) {
+      if(id[i] < '0' || id[i] > '9') {
+        return nullptr;
+      }
+      index = index * 10 + std::size_t(id[i] - '0');
+    }
+    return index < agents_.size() ? agents_[index] : nullptr;
+  };
+  agents_.reserve(options_.agents);
+  for(uint32_t i = 0; i < options_.agents; ++i) {
+    agents_.emplace_back(std::make_shared<LoadAgent>(io_context_, options_.prefix + "-" + std::to_string(i), peers));
+  }
+  Workload::Options workload;
+  workload.seed = options_.seed;
+  Workload generator{workload};
+  services_ = generator.instances(1024);
+  queries_ = generator.queries(256);
+  for(uint32_t i = 0; i < std::max(options_.threads, 1u); ++i) {
+    threads_.emplace_back([this]() { io_context_.run(); });
+  }
+}
+
+Runner::~Runner() {
+  for(auto &agent : agents_) {
+    agent->disconnect();
+  }
+  work_.reset();
+  io_context_.stop();
+  for(auto &t : threads_) {
+    t.join();
+  }
+}
+
+void Runner::run(const std::vector<Step> &steps, std::ostream &out) {
+  for(auto &step : steps) {
+    logger.info("Runner::run {}", step.line);
+    run_(step, out);
+  }
+}
+
+std::vector<std::size_t> Runner::select_(const std::function<bool(const LoadAgent &)> &filter) const {
+  std::vector<std::size_t> selected;
+  for(std::size_t i = 0; i < agents_.size(); ++i) {
+    if(filter(*agents_[i])) {
+      selected.push_back(i);
+    }
+  }
+  return selected;
+}
+
+LoadAgent *Runner::random_connected_() {
+  std::uniform_int_distribution<std::size_t> index{0, agents_.size() - 1};
+  for(int tries = 0; tries < 8; ++tries) {
+    auto *agent = agents_[index(random_)].get();
+    if(agent->connected()) {
+      return agent;
+    }
+  }
+  return nullptr;
+}
+
+bool Runner::churn_(Clock::time_point due) {
+  auto *agent = random_connected_();
+  if(!agent) {
+    return false;
+  }
+  auto self = agent->shared_from_this();
+  if(agent->registered()) {
+    asio::post(io_context_, [self,due]() { self->unregister_service(due); });
+  } else {
+    const Instance &service = services_[std::uniform_int_distribution<std::size_t>{0, services_.size() - 1}(random_)];
+    asio::post(io_context_, [self,&service,due]() { self->register_service(service, due); });
+  }
+  return true;
+}
+
+bool Runner::search_(Clock::time_point due) {
+  auto *agent = random_connected_();
+  if(!agent) {
+    return false;
+  }
+  const QueryModel &query = queries_[std::uniform_int_distribution<std::size_t>{0, queries_.size() - 1}(random_)];
+  auto self = agent->shared_from_this();
+  asio::post(io_context_, [self,&query,due]() { self->search(query, due); });
+  return true;
+}
+
+bool Runner::message_(uint32_t size, Clock::time_point due) {
+  auto *from = random_connected_();
+  auto *to = random_connected_();
+  if(!from || !to || from == to) {
+    return false;
+  }
+  auto self = from->shared_from_this();
+  asio::post(io_context_, [self,to=to->id(),size,due]() { self->message(to, size, due); });
+  return true;
+}
+
+bool Runner::dialogue_(Clock::time_point due) {
+  auto *from = random_connected_();
+  auto *to = random_connected_();
+  if(!from || !to || from == to) {
+    return false;
+  }
+  auto self = from->shared_from_this();
+  asio::post(io_context_, [self,to=to->id(),due]() { self->dialogue(to, due); });
+  return true;
+}
+
+uint64_t Runner::pace_(const Step &step, uint64_t count, const std::function<bool(uint64_t,Clock::time_point)> &op) {
+  uint64_t skipped = 0;
+  auto start = Clock::now();
+  auto next_report = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.report_interval));
+  for(uint64_t k = 0; k < count; ++k) {
+    Clock::time_point due = Clock::now();
+    if(step.rate > 0.) {
+      // open loop: operations keep their schedule, being late shows in their latency
+      due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(double(k) / step.rate));
+      if(due > Clock::now()) {
+        std::this_thread::sleep_until(due);
+      }
+    }
+    if(LoadAgent::outstanding() >= options_.max_outstanding || !op(k, due)) {
+      ++skipped;
+    }
+    if(options_.report_interval > 0. && Clock::now() >= next_report) {
+      next_report += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.report_interval));
+      std::cerr << step.action << ": " << k + 1 << "/" << count << " operations, " << skipped << " skipped, "
+                << LoadAgent::outstanding() << " outstanding, " << seconds_since(start) << "s" << std::endl;
+    }
+  }
+  return skipped;
+}
+
+void Runner::drain_(const std::function<bool()> &done) const {
+  auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.drain));
+  while(!done() && Clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+}
+
+void Runner::run_(const Step &step, std::ostream &out) {
+  auto before = Metrics::snapshot();
+  auto start = Clock::now();
+  uint64_t count = step.count ? step.count : uint64_t(step.rate * step.duration);
+  uint64_t skipped = 0;
+  auto pending = std::make_shared<std::atomic<int64_t>>(0);
+
+  if(step.action == "sleep") {
+    count = 0;
+    std::this_thread::sleep_for(std::chrono::duration<double>(step.duration));
+  } else if(step.action == "connect" || step.action == "disconnect" || step.action == "register"
+      || step.action == "unregister") {
+    std::vector<std::size_t> targets;
+    if(step.action == "connect") {
+      targets = select_([](const LoadAgent &a) { return !a.connected(); });
+    } else if(step.action == "disconnect") {
+      targets = select_([](const LoadAgent &a) { return a.connected(); });
+    } else if(step.action == "register") {
+      targets = select_([](const LoadAgent &a) { return a.connected() && !a.registered(); });
+    } else {
+      targets = select_([](const LoadAgent &a) { return a.connected() && a.registered(); });
+    }
+    if(step.count) {
+      targets.resize(std::min<std::size_t>(targets.size(), step.count));
+    }
+    count = targets.size();
+    skipped = pace_(step, count, [this,&step,&targets,pending](uint64_t k, Clock::time_point due) {
+          auto agent = agents_[targets[k]];
+          if(step.action == "connect") {
+            ++*pending;
+            agent->connect(endpoint_, options_.pipelined, due, [pending](bool) { --*pending; });
+          } else if(step.action == "disconnect") {
+            agent->disconnect();
+          } else if(step.action == "register") {
+            const Instance &service = services_[targets[k] % services_.size()];
+            asio::post(io_context_, [agent,&service,due]() { agent->register_service(service, due); });
+          } else {
+            asio::post(io_context_, [agent,due]() { agent->unregister_service(due); });
+          }
+          return true;
+        });
+  } else {
+    std::vector<std::pair<std::string,double>> weights;
+    if(step.action == "mix") {
+      double total = 0.;
+      for(auto &w : step.weights) {
+        total += w.second;
+        weights.emplace_back(w.first, total);
+      }
+    } else {
+      weights.emplace_back(step.action, 1.);
+    }
+    std::uniform_real_distribution<double> draw{0., weights.back().second};
+    skipped = pace_(step, count, [this,&step,&weights,&draw](uint64_t, Clock::time_point due) {
+          double d = draw(random_);
+          auto iter = std::find_if(weights.begin(), weights.end(),
+              [d](const std::pair<std::string,double> &w) { return d < w.second; });
+          const std::string &action = iter == weights.end() ? weights.back().first : iter->first;
+          if(action == "churn") {
+            return churn_(due);
+          }
+          if(action == "search") {
+            return search_(due);
+          }
+          if(action == "message") {
+            return message_(step.size, due);
+          }
+          return dialogue_(due);
+        });
+  }
+  double seconds = seconds_since(start);
+
+  auto drain_start = Clock::now();
+  drain_([pending]() { return *pending == 0 && LoadAgent::outstanding() <= 0; });
+  double drain_seconds = seconds_since(drain_start);
+
+  auto delta = Metrics::snapshot().since(before);
+  std::size_t connected = select_([](const LoadAgent &a) { return a.connected(); }).size();
+  out << "{\"step\":\"" << step.line << "\",\"ops\":" << count - skipped << ",\"skipped\":" << skipped
+      << ",\"seconds\":" << seconds << ",\"ops_per_s\":" << (seconds > 0. ? double(count - skipped) / seconds : 0.)
+      << ",\"drain_seconds\":" << drain_seconds << ",\"connected\":" << connected
+      << ",\"outstanding\":" << LoadAgent::outstanding();
+  std::string errors, latencies;
+  for(auto op : all_ops) {
+    std::string label = std::string{"op=\""} + to_string(op) + "\"";
+    const auto *e = delta.find("loadgen_errors_total", label);
+    if(e && e->value) {
+      errors += std::string(errors.empty() ? "" : ",") + "\"" + to_string(op) + "\":" + std::to_string(e->value);
+    }
+    const auto *l = delta.find("loadgen_latency_us", label);
+    if(l && l->count) {
+      std::ostringstream os;
+      os << (latencies.empty() ? "" : ",") << "\"" << to_string(op) << "\":{\"count\":" << l->count
+         << ",\"p50\":" << l->quantile(.5) << ",\"p99\":" << l->quantile(.99) << ",\"p999\":" << l->quantile(.999)
+         << ",\"max\":" << l->quantile(1.) << ",\"mean\":" << double(l->sum) / double(l->count) << "}";
+      latencies += os.str();
+    }
+  }
+  out << ",\"errors\":{" << errors << "},\"latency_us\":{" << latencies << "}}" << std::endl;
+}
+
+} // load
+} // oef
+} // fetch
@@ -0,0 +1,121 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "load_agent.hpp"
+#include "workload.hpp"
+
+#include "asio.hpp"
+
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+namespace load {
+  /*
+   * A scenario is a script of steps, run in order, one per line:
+   *   action [key=value ...]     # comment
+   * Actions:
+   *   connect     connect agents not connected yet (count, default all of them)
+   *   disconnect  disconnect connected agents (count, default all of them)
+   *   register    register a service for connected agents without one (count, default all of them)
+   *   unregister  unregister the services of agents (count, default all of them)
+   *   churn       a random agent registers its service, or unregisters it if it has one
+   *   search      a random agent searches services
+   *   message     a random agent sends `size` bytes to another one
+   *   dialogue    a random agent runs a CFP / Propose / Accept dialogue with another one
+   *   mix         any of churn, search, message and dialogue, by weight: mix search=1 message=4
+   *   sleep       wait for `duration` seconds
+   * Keys:
+   *   rate        operations per second, over all agents. 0 (default) for as fast as possible
+   *   duration    seconds, the number of operations being rate * duration
+   *   count       number of operations, instead of duration
+   *   size        message content bytes (default 64)
+   */
+  struct Step {
+    std::string line;
+    std::string action;
+    double rate = 0.;
+    double duration = 0.;
+    uint64_t count = 0;
+    uint32_t size = 64;
+    std::map<std::string,double> weights; // mix
+  };
+
+  /* Throws std::invalid_argument, naming the faulty line */
+  std::vector<Step> parse_script(std::istream &script);
+  /* Scripts by scenario name: connect-storm, churn, search-mix, dialogues, mixed */
+  const std::map<std::string,std::string> &builtin_scripts();
+
+  class Runner {
+  public:
+    struct Options {
+      std::string host = "127.0.0.1";
+      uint32_t port = 3333;
+      uint32_t agents = 1000;
+      uint32_t threads = 4;
+      std::string prefix = "load";      // agent ids are <prefix>-<index>
+      bool pipelined = true;            // pipelined handshakes
+      uint64_t seed = 42;               // services, queries and targets
+      double drain = 5.;                // seconds to wait for answers at the end of a step
+      int64_t max_outstanding = 100000; // operations are skipped beyond, see LoadAgent::outstanding
+      double report_interval = 0.;      // seconds between progress lines on stderr, 0 for none
+    };
+
+    explicit Runner(Options options);
+    Runner(const Runner &) = delete;
+    Runner operator=(const Runner &) = delete;
+    ~Runner();
+
+    /* Run the steps, writing one JSON line per step to `out` */
+    void run(const std::vector<Step> &steps, std::ostream &out);
+
+  private:
+    const Options options_;
+    asio::io_context io_context_;
+    asio::executor_work_guard<asio::io_context::executor_type> work_;
+    std::vector<std::thread> threads_;
+    asio::ip::tcp::endpoint endpoint_;
+    std::vector<std::shared_ptr<LoadAgent>> agents_;
+    std::vector<Instance> services_;
+    std::vector<QueryModel> queries_;
+    std::mt19937_64 random_;
+
+    static fetch::oef::Logger logger;
+
+    /* Issue `count` operations paced at `rate`, returns the number of skipped ones */
+    uint64_t pace_(const Step &step, uint64_t count, const std::function<bool(uint64_t,Clock::time_point)> &op);
+    void run_(const Step &step, std::ostream &out);
+    std::vector<std::size_t> select_(const std::function<bool(const LoadAgent &)> &filter) const;
+    LoadAgent *random_connected_();
+    bool churn_(Clock::time_point due);
+    bool search_(Clock::time_point due);
+    bool message_(uint32_t size, Clock::time_point due);
+    bool dialogue_(Clock::time_point due);
+    void drain_(const std::function<bool()> &done) const;
+  };
+} // load
+} // oef
+} // fetch
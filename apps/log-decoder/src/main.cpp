@@ -0,0 +1,62 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include <ctime>
+#include <iostream>
+#include "async_logger.hpp"
+#include "clara.hpp"
+
+int main(int argc, char* argv[])
+{
+  std::string path;
+  bool show_help = false;
+  auto parser = clara::Help(show_help)
+      | clara::Arg(path, "binary_log")("Binary log file written by OEFNodePluto --binary-log");
+  auto result = parser.parse(clara::Args(argc, argv));
+  if (!result || show_help || path.empty())
+  {
+    if (!result) {
+      std::cerr << "Error: " << result.errorMessage() << "\n";
+    }
+    std::cerr << "Usage: log-decoder <binary_log>\n";
+    return 1;
+  }
+
+  try
+  {
+    fetch::oef::BinaryLogReader reader{path};
+    fetch::oef::logrec::Record record;
+    std::string section, message;
+    while (reader.next(record, section, message)) {
+      std::time_t seconds = std::time_t(record.time / 1000000000);
+      std::tm tm;
+      localtime_r(&seconds, &tm);
+      char date[32];
+      std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+      auto level = spdlog::level::to_string_view(static_cast<spdlog::level::level_enum>(record.level));
+      std::cout << fmt::format("[{}.{:03}] [thread {}] [{}] [{}] {}\n", date, (record.time / 1000000) % 1000,
+          record.thread, section, fmt::string_view(level.data(), level.size()), message);
+    }
+  } catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,72 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include <csignal>
+#include <iostream>
+#include "mock_search.hpp"
+#include "clara.hpp"
+
+int main(int argc, char* argv[])
+{
+  spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [thread %t] [%n] [%l] %v");
+  fetch::oef::MockSearch::Options options;
+  options.port = static_cast<uint32_t>(fetch::oef::config::Ports::Search);
+  uint32_t latency = 0, jitter = 0;
+  bool show_help = false;
+  auto parser = clara::Help(show_help)
+      | clara::Opt(options.port, "port")["--port"]("Port cores connect to (default 7501)")
+      | clara::Opt(options.threads, "n")["--threads"]("io threads (default 1)")
+      | clara::Opt(latency, "us")["--latency"]("Latency added to every answer, in microseconds")
+      | clara::Opt(jitter, "us")["--jitter"]("Random extra latency, uniform in [0, jitter) microseconds")
+      | clara::Opt(options.error_rate, "rate")["--error-rate"]("Fraction of requests answered unsuccessfully")
+      | clara::Opt(options.extra_results, "n")["--extra-results"]("Synthetic agents added to every search result")
+      | clara::Opt(options.max_results, "n")["--max-results"]("Agents per search result, 0 for no limit")
+      | clara::Opt(options.seed, "seed")["--seed"]("Seed of the latency and errors draws");
+  auto result = parser.parse(clara::Args(argc, argv));
+  if (!result || show_help || options.error_rate < 0. || options.error_rate > 1.)
+  {
+    if (!result) {
+      std::cerr << "Error: " << result.errorMessage() << "\n";
+    }
+    std::cerr << parser << "\n";
+    return 1;
+  }
+  options.latency = std::chrono::microseconds{latency};
+  options.jitter = std::chrono::microseconds{jitter};
+
+  // serve until interrupted
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  try
+  {
+    fetch::oef::MockSearch search{options};
+    int signal = 0;
+    sigwait(&signals, &signal);
+    std::cerr << search.requests() << " requests, " << search.errors() << " errors, "
+              << search.size() << " registrations\n";
+  } catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
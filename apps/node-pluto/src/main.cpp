@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include "core_server.hpp"
+#include "clara.hpp"
 
 int main(int argc, char* argv[])
 {
@@ -25,20 +26,141 @@ int main(int argc, char* argv[])
   spdlog::set_level(spdlog::level::level_enum::trace);
   try
   {
-    if (argc != 6)
+    std::string core_key, core_ip, search_ip;
+    uint32_t core_port = 0, search_port = 0;
+    uint32_t admin_port = static_cast<uint32_t>(fetch::oef::config::Ports::ServiceDiscovery);
+    std::string admin_address{fetch::oef::config::default_ip};
+    uint32_t trace_sample = 0;
+    std::string journal, unix_socket, shm_socket;
+    uint32_t shm_spin = 0;
+    std::string io_backend{"asio"};
+    fetch::oef::OutboundLimits outbound;
+    std::string slow_consumer{"pause"};
+    fetch::oef::RateLimits rates;
+    uint32_t bulk_threads = 0;
+    std::vector<std::string> log_levels;
+    std::string async_log, binary_log;
+    bool show_help = false;
+    auto parser = clara::Help(show_help)
+        | clara::Arg(core_key, "core_key")("Key of this OEF Core")
+        | clara::Arg(core_ip, "core_ip")("IP address agents use to reach this OEF Core")
+        | clara::Arg(core_port, "core_port")("Port agents use to reach this OEF Core")
+        | clara::Arg(search_ip, "search_ip")("IP address of the OEF Search")
+        | clara::Arg(search_port, "search_port")("Port of the OEF Search")
+        | clara::Opt(unix_socket, "path")["--unix-socket"]("Also accept agents running on this host on the Unix domain socket <path>")
+        | clara::Opt(shm_socket, "path")["--shm-socket"]("Also accept agents running on this host through shared memory, set up on the Unix domain socket <path>")
+        | clara::Opt(shm_spin, "us")["--shm-spin"]("Poll idle shared memory connections for <us> microseconds before sleeping")
+        | clara::Opt(io_backend, "asio|io_uring")["--io-backend"]("Serve TCP agents through the asio reactor (default) or io_uring, falling back to asio")
+        | clara::Opt(outbound.high_bytes, "bytes")["--outbound-high"]("Bytes queued to an agent above which it is a slow consumer (default 8 MiB)")
+        | clara::Opt(outbound.low_bytes, "bytes")["--outbound-low"]("Bytes queued to a slow consumer below which it no longer is (default 2 MiB)")
+        | clara::Opt(outbound.high_frames, "n")["--outbound-high-frames"]("Messages queued to an agent above which it is a slow consumer (default 8192)")
+        | clara::Opt(outbound.low_frames, "n")["--outbound-low-frames"]("Messages queued to a slow consumer below which it no longer is (default 2048)")
+        | clara::Opt(slow_consumer, "pause|drop|disconnect")["--slow-consumer"]("Messages to slow consumers pause the reads from their senders (default), are dropped, or disconnect the consumer")
+        | clara::Opt(rates.messaging.rate, "n")["--rate-messaging"]("Messages each agent sends or broadcasts per second, beyond which its reads are delayed (default unlimited)")
+        | clara::Opt(rates.registration.rate, "n")["--rate-registration"]("(Un)registrations and (un)subscriptions per second of each agent, beyond which its reads are delayed (default unlimited)")
+        | clara::Opt(rates.search.rate, "n")["--rate-search"]("Searches per second of each agent, beyond which its reads are delayed (default unlimited)")
+        | clara::Opt(bulk_threads, "n")["--bulk-threads"]("Process the messages between agents on <n> threads of lower priority, apart from registrations and searches (default 0: with them)")
+        | clara::Opt(rates.fairness_budget, "n")["--fairness-budget"]("Envelopes of a batch processed before yielding to the other agents, 0 for no limit (default 64)")
+        | clara::Opt(journal, "path")["--journal"]("Journal agents registrations to <path>, replayed on restart")
+        | clara::Opt(admin_port, "port")["--admin-port"]("Port of the admin commands and metrics, 0 to disable (default 2222)")
+        | clara::Opt(admin_address, "ip")["--admin-address"]("Address the admin commands are served on, 0.0.0.0 for all interfaces (default 127.0.0.1)")
+        | clara::Opt(trace_sample, "n")["--trace-sample"]("Trace the stages of one agent frame out of <n>, dumped by the admin trace command")
+        | clara::Opt(log_levels, "[section=]level")["--log-level"]("Log level of all sections, or of one section (repeatable)")
+        | clara::Opt(async_log, "drop|block")["--async-log"]("Log from a background thread, dropping records or blocking when behind")
+        | clara::Opt(binary_log, "path")["--binary-log"]("Write binary log records to <path> (implies --async-log), see OEFLogDecoder");
+    auto result = parser.parse(clara::Args(argc, argv));
+    if (!result || show_help || search_port == 0)
     {
-      std::cerr << "Usage: node\n";
-      std::cerr << "Usage: node <core_key> <core_ip> <core_port> <search_ip> <search_port>\n";
+      if (!result) {
+        std::cerr << "Error: " << result.errorMessage() << "\n";
+      }
+      std::cerr << "Usage: node <core_key> <core_ip> <core_port> <search_ip> <search_port> [--unix-socket <path>] [--shm-socket <path>] [--shm-spin <us>]\n"
+                << "            [--io-backend asio|io_uring] [--outbound-high <bytes>] [--outbound-low <bytes>]\n"
+                << "            [--outbound-high-frames <n>] [--outbound-low-frames <n>] [--slow-consumer pause|drop|disconnect]\n"
+                << "            [--rate-messaging <n>] [--rate-registration <n>] [--rate-search <n>] [--fairness-budget <n>]\n"
+                << "            [--bulk-threads <n>]\n"
+                << "            [--journal <path>] [--admin-port <port>] [--admin-address <ip>] [--trace-sample <n>]\n"
+                << "            [--log-level [section=]level]... [--async-log drop|block] [--binary-log <path>]\n";
       return 1;
     }
 
-    fetch::oef::CoreServer s(argv[1], argv[2], std::stoi(argv[3]), argv[4], std::stoi(argv[5]));
+    for (auto &log_level : log_levels) {
+      auto eq = log_level.find('=');
+      LogLevel level;
+      if (!fetch::oef::Logger::parse_level(log_level.substr(eq == std::string::npos ? 0 : eq + 1), level)) {
+        std::cerr << "Error: unknown log level " << log_level << "\n";
+        return 1;
+      }
+      if (eq == std::string::npos) {
+        fetch::oef::Logger::level(level);
+      } else {
+        // sections are created with the first object logging in them, unknown ones are reported
+        if (!fetch::oef::Logger::level(log_level.substr(0, eq), level)) {
+          std::cerr << "Warning: no log section " << log_level.substr(0, eq) << "\n";
+        }
+      }
+    }
+
+    if (!async_log.empty() || !binary_log.empty()) {
+      fetch::oef::AsyncLogger::Options options;
+      if (async_log == "block") {
+        options.overflow = fetch::oef::AsyncLogger::Overflow::Block;
+      } else if (!async_log.empty() && async_log != "drop") {
+        std::cerr << "Error: unknown --async-log policy " << async_log << "\n";
+        return 1;
+      }
+      options.binary_path = binary_log;
+      fetch::oef::AsyncLogger::start(options);
+    }
+
+    if (io_backend != "asio" && io_backend != "io_uring") {
+      std::cerr << "Error: unknown --io-backend " << io_backend << "\n";
+      return 1;
+    }
+
+    if (!fetch::oef::OutboundLimits::parse_policy(slow_consumer, outbound.policy)) {
+      std::cerr << "Error: unknown --slow-consumer policy " << slow_consumer << "\n";
+      return 1;
+    }
+    if (outbound.low_bytes > outbound.high_bytes || outbound.low_frames > outbound.high_frames) {
+      std::cerr << "Error: outbound low water marks above the high ones\n";
+      return 1;
+    }
+    if (rates.messaging.rate < 0 || rates.registration.rate < 0 || rates.search.rate < 0) {
+      std::cerr << "Error: negative rate limit\n";
+      return 1;
+    }
+
+    fetch::oef::Tracer::sample_every(trace_sample);
+
+    fetch::oef::CoreServer s(core_key, core_ip, core_port, search_ip, search_port);
+    s.outbound_limits(outbound);
+    s.rate_limits(rates);
+    s.bulk_lane(bulk_threads);
+    if (io_backend == "io_uring") {
+      s.use_io_uring();
+    }
+    if (!unix_socket.empty()) {
+      s.listen_local(unix_socket);
+    }
+    if (!shm_socket.empty()) {
+      fetch::oef::ShmComm::Options options;
+      options.spin_us = shm_spin;
+      s.listen_shm(shm_socket, options);
+    }
+    if (!journal.empty()) {
+      s.open_journal(journal);
+    }
+    if (admin_port != 0) {
+      s.open_admin(admin_port, admin_address);
+    }
     s.run_in_thread();
 
   } catch (std::exception& e)
   {
     std::cerr << "Exception: " << e.what() << "\n";
   }
+  fetch::oef::AsyncLogger::stop();
 
   return 0;
 }
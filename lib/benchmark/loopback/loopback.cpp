@@ -0,0 +1,477 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+/*
+ * End to end benchmark: a CoreServer in process, a MockSearch as its OEF Search, and synthetic
+ * agents connected over loopback with AsioComm, exchanging messages through the core. With
+ * --transport unix, agents connect through a Unix domain socket, with --transport shm through the
+ * shared memory transport (--shm-spin to poll idle rings). With --transport io_uring, they connect
+ * over TCP but the core serves them through io_uring. With --transport inprocess, they
+ * connect through the core LoopbackAcceptor instead: no socket is involved, what is measured is the
+ * core own cost (the OEF Search link remains TCP).
+ * In a build with ENABLE_COROUTINES, the core handshakes and serves agents with coroutines; --sessions
+ * callback compares with the callbacks it uses otherwise.
+ * Prints one JSON object with the throughput and the latency quantiles, e.g.
+ *   oef-core-plutoLoopbackBenchmark --scenario fan-in --agents 64 --messages 2000 --window 4
+ * Scenarios:
+ *   ping-pong  agents are paired, the first of each pair sends, the second echoes back
+ *   fan-in     all agents send to the first one, which acknowledges each message
+ *   search     all agents register a service, then search services (all of them match)
+ *   mixed      fan-in, but for the last agent, which registers a service and searches services, one
+ *              search per millisecond at most, until the others are done: the search latency under a
+ *              messaging flood
+ * Each message carries its send time, the latency is measured when it is received. Searches
+ * latency is measured from the request to its answer. With --bulk-threads, the core processes
+ * the messages between agents on threads of their own.
+ */
+
+#include "core_server.hpp"
+#include "asio_communicator.hpp"
+#include "clientmsg.hpp"
+#include "loopback_communicator.hpp"
+#include "metrics.hpp"
+#include "mock_search.hpp"
+#include "serialization.hpp"
+#include "shm_communicator.hpp"
+
+#include "agent.pb.h"
+
+#include "asio.hpp"
+#include "clara.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <unistd.h>
+
+using asio::ip::tcp;
+using namespace fetch::oef;
+
+namespace {
+  uint64_t now_ns() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  /* Synthetic agent, writing one frame at a time */
+  class Agent : public std::enable_shared_from_this<Agent> {
+  public:
+    using Handler = std::function<void(Agent &, const fetch::oef::pb::Server_AgentMessage &)>;
+  private:
+    const std::string id_;
+    std::shared_ptr<communicator_t> comm_;
+    Handler handler_;
+    std::mutex lock_;
+    std::deque<std::shared_ptr<Buffer>> queue_;
+    std::unordered_map<uint32_t,uint64_t> searches_; // send time by msg_id
+    std::atomic<uint32_t> msg_id_{0};
+  public:
+    std::atomic<uint32_t> sent{0};
+
+    Agent(std::shared_ptr<communicator_t> comm, std::string id)
+      : id_{std::move(id)}, comm_{std::move(comm)} {}
+
+    const std::string &id() const { return id_; }
+
+    bool handshake() {
+      fetch::oef::pb::Agent_Server_ID id;
+      id.set_public_key(id_);
+      std::shared_ptr<Buffer> buffer;
+      if(comm_->send_sync(pbs::serialize(id)) || comm_->receive_sync(buffer)) {
+        return false;
+      }
+      auto phrase = pbs::deserialize<fetch::oef::pb::Server_Phrase>(*buffer);
+      if(!phrase.has_phrase()) {
+        return false;
+      }
+      fetch::oef::pb::Agent_Server_Answer answer;
+      answer.set_answer(std::string(phrase.phrase().rbegin(), phrase.phrase().rend()));
+      if(comm_->send_sync(pbs::serialize(answer)) || comm_->receive_sync(buffer)) {
+        return false;
+      }
+      return pbs::deserialize<fetch::oef::pb::Server_Connected>(*buffer).status();
+    }
+
+    void start(Handler handler) {
+      handler_ = std::move(handler);
+      read();
+    }
+
+    /* Message to `destination`, its content starting with the send time */
+    void send(const std::string &destination, std::size_t size) {
+      std::string content(std::max(size, sizeof(uint64_t)), '\0');
+      uint64_t time = now_ns();
+      std::memcpy(&content[0], &time, sizeof(time));
+      queue(Message(++msg_id_, 1, destination, content).handle());
+    }
+
+    void search(const QueryModel &query) {
+      uint32_t msg_id = ++msg_id_;
+      {
+        std::lock_guard<std::mutex> lock(lock_);
+        searches_[msg_id] = now_ns();
+      }
+      queue(SearchServices(msg_id, query).handle());
+    }
+
+    /* Send time of the search answered by `msg`, 0 if it is not an answer to a search */
+    uint64_t answered(const fetch::oef::pb::Server_AgentMessage &msg) {
+      std::lock_guard<std::mutex> lock(lock_);
+      auto iter = searches_.find(uint32_t(msg.answer_id()));
+      if(iter == searches_.end()) {
+        return 0;
+      }
+      uint64_t time = iter->second;
+      searches_.erase(iter);
+      return time;
+    }
+
+    void queue(const fetch::oef::pb::Envelope &envelope) {
+      auto buffer = pbs::serialize(envelope);
+      ++sent;
+      {
+        std::lock_guard<std::mutex> lock(lock_);
+        queue_.push_back(buffer);
+        if(queue_.size() > 1) {
+          return; // written when the previous frames are
+        }
+      }
+      write(buffer);
+    }
+
+    void disconnect() { comm_->disconnect(); }
+
+  private:
+    void write(std::shared_ptr<Buffer> buffer) {
+      auto self(shared_from_this());
+      comm_->send_async(buffer, [this,self](std::error_code ec, std::size_t) {
+            std::shared_ptr<Buffer> next;
+            {
+              std::lock_guard<std::mutex> lock(lock_);
+              queue_.pop_front();
+              if(ec || queue_.empty()) {
+                return;
+              }
+              next = queue_.front();
+            }
+            write(next);
+          });
+    }
+
+    void read() {
+      auto self(shared_from_this());
+      comm_->receive_async([this,self](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+            if(ec) {
+              return;
+            }
+            handler_(*this, pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer));
+            read();
+          });
+    }
+  };
+
+  uint64_t send_time(const fetch::oef::pb::Server_AgentMessage &msg) {
+    uint64_t time = 0;
+    const auto &content = msg.content().content();
+    if(content.size() >= sizeof(time)) {
+      std::memcpy(&time, content.data(), sizeof(time));
+    }
+    return time;
+  }
+
+  struct Options {
+    std::string scenario{"ping-pong"};
+    std::string transport{"tcp"};
+#ifdef OEF_CORE_COROUTINES
+    std::string sessions{"coroutine"};
+#else
+    std::string sessions{"callback"};
+#endif
+    MockSearch::Options search;
+    uint32_t agents = 16;
+    uint32_t messages = 1000;     // per sending agent
+    uint32_t window = 1;          // messages in flight per sending agent
+    uint32_t size = 64;           // content bytes
+    uint32_t core_threads = config::core_default_nb_threads;
+    uint32_t bulk_threads = 0;
+    uint32_t client_threads = 2;
+    uint32_t port = 13333;
+    uint32_t timeout = 60;        // seconds
+    uint32_t shm_spin = 0;        // microseconds
+  };
+}
+
+int main(int argc, char *argv[]) {
+  Options o;
+  std::string log_level{"warn"};
+  uint32_t search_latency = 0, search_jitter = 0;
+  bool show_help = false;
+  auto parser = clara::Help(show_help)
+      | clara::Opt(o.scenario, "ping-pong|fan-in|search|mixed")["--scenario"]("Messaging pattern (default ping-pong)")
+      | clara::Opt(o.transport, "tcp|io_uring|unix|shm|inprocess")["--transport"]("Agents connections (default tcp)")
+      | clara::Opt(o.sessions, "callback|coroutine")["--sessions"]("How the core serves agents (default coroutine when built with coroutines)")
+      | clara::Opt(o.shm_spin, "us")["--shm-spin"]("Shared memory rings polling before sleeping, both ends (default 0)")
+      | clara::Opt(o.agents, "n")["--agents"]("Number of agents (default 16)")
+      | clara::Opt(o.messages, "n")["--messages"]("Messages sent by each sending agent (default 1000)")
+      | clara::Opt(o.window, "n")["--window"]("Messages in flight per sending agent (default 1)")
+      | clara::Opt(o.size, "bytes")["--size"]("Message content size (default 64)")
+      | clara::Opt(o.core_threads, "n")["--core-threads"]("CoreServer io threads (default 4)")
+      | clara::Opt(o.bulk_threads, "n")["--bulk-threads"]("CoreServer threads processing messages between agents, 0 for the io threads (default 0)")
+      | clara::Opt(o.client_threads, "n")["--client-threads"]("Agents io threads (default 2)")
+      | clara::Opt(o.port, "port")["--port"]("CoreServer port (default 13333)")
+      | clara::Opt(o.timeout, "seconds")["--timeout"]("Give up after <seconds> (default 60)")
+      | clara::Opt(search_latency, "us")["--search-latency"]("OEF Search answers latency (default 0)")
+      | clara::Opt(search_jitter, "us")["--search-jitter"]("OEF Search answers extra random latency (default 0)")
+      | clara::Opt(o.search.error_rate, "rate")["--search-error-rate"]("Fraction of failed OEF Search requests (default 0)")
+      | clara::Opt(o.search.extra_results, "n")["--search-extra-results"]("Synthetic agents added to search results (default 0)")
+      | clara::Opt(log_level, "level")["--log-level"]("Log level (default warn)");
+  auto result = parser.parse(clara::Args(argc, argv));
+  bool ping_pong = o.scenario == "ping-pong";
+  bool searching = o.scenario == "search";
+  bool mixed = o.scenario == "mixed";
+  bool inprocess = o.transport == "inprocess";
+  bool local = o.transport == "unix";
+  bool shm = o.transport == "shm";
+  bool uring = o.transport == "io_uring";
+  if(!result || show_help || (!ping_pong && !searching && !mixed && o.scenario != "fan-in") || o.agents < (mixed ? 3 : 2) || o.window == 0
+      || (!inprocess && !local && !shm && !uring && o.transport != "tcp")
+      || (o.sessions != "callback" && o.sessions != "coroutine")) {
+    if(!result) {
+      std::cerr << "Error: " << result.errorMessage() << "\n";
+    }
+    std::cerr << parser << "\n";
+    return 1;
+  }
+  LogLevel level;
+  if(!Logger::parse_level(log_level, level)) {
+    std::cerr << "Error: unknown log level " << log_level << "\n";
+    return 1;
+  }
+  Logger::level(level);
+#ifndef OEF_CORE_COROUTINES
+  if(o.sessions == "coroutine") {
+    std::cerr << "Error: built without coroutines (ENABLE_COROUTINES)\n";
+    return 1;
+  }
+#endif
+
+  o.search.latency = std::chrono::microseconds{search_latency};
+  o.search.jitter = std::chrono::microseconds{search_jitter};
+  MockSearch search{o.search};
+  CoreServer core{"oef-core-loopback", config::default_ip, o.port, config::default_ip, search.port(), o.core_threads};
+  core.bulk_lane(o.bulk_threads);
+#ifdef OEF_CORE_COROUTINES
+  core.use_coroutines(o.sessions == "coroutine");
+#endif
+  std::string path = "/tmp/oef-core-loopback-" + std::to_string(::getpid()) + ".sock";
+  ShmComm::Options shm_options;
+  shm_options.spin_us = o.shm_spin;
+  if(local) {
+    core.listen_local(path);
+  } else if(shm) {
+    core.listen_shm(path, shm_options);
+  } else if(uring && !core.use_io_uring()) {
+    std::cerr << "Error: io_uring is not available\n";
+    return 1;
+  }
+  core.run();
+
+  asio::io_context io_context;
+  std::vector<std::shared_ptr<Agent>> agents;
+  try {
+    for(uint32_t i = 0; i < o.agents; ++i) {
+      std::shared_ptr<communicator_t> comm;
+      if(inprocess) {
+        comm = core.loopback()->connect(io_context);
+      } else if(local) {
+        comm = std::make_shared<AsioComm>(io_context, path);
+      } else if(shm) {
+        comm = ShmComm::connect(io_context, path, shm_options);
+      } else {
+        comm = std::make_shared<AsioComm>(io_context, "127.0.0.1", o.port);
+      }
+      agents.push_back(std::make_shared<Agent>(comm, "agent" + std::to_string(i)));
+      if(!agents.back()->handshake()) {
+        std::cerr << "Error: handshake of " << agents.back()->id() << " failed\n";
+        return 1;
+      }
+    }
+  } catch(std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+
+  DataModel station{"weather_station", {Attribute{"id", Type::Int, true}}};
+  QueryModel all_stations{{Constraint{"id", Relation{Relation::Op::GtEq, 0}}}, station};
+  if(searching || mixed) {
+    for(uint32_t i = mixed ? o.agents - 1 : 0; i < o.agents; ++i) {
+      agents[i]->queue(Register(0, Instance{station, {{"id", VariantType{int(i)}}}}).handle());
+    }
+  }
+
+  // senders: first agent of each pair (ping-pong), all but the first (fan-in), all (search), all but the
+  // first and the last (mixed)
+  uint32_t nb_senders = ping_pong ? o.agents / 2 : searching ? o.agents : mixed ? o.agents - 2 : o.agents - 1;
+  uint64_t expected = ping_pong ? 2ull * nb_senders * o.messages : uint64_t(nb_senders) * o.messages;
+  Histogram latency{"loopback_latency_ns"};
+  Histogram search_delay{"loopback_search_latency_ns"}; // mixed
+  std::atomic<uint64_t> received{0};
+  std::mutex done_lock;
+  std::condition_variable done;
+  auto count = [&](const fetch::oef::pb::Server_AgentMessage &msg) {
+    latency.observe(now_ns() - send_time(msg));
+    if(++received == expected) {
+      std::lock_guard<std::mutex> lock(done_lock);
+      done.notify_all();
+    }
+  };
+  auto is_sender = [&](const std::string &id) {
+    auto i = std::stoul(id.substr(5));
+    return ping_pong ? (i % 2 == 0 && i + 1 < o.agents) : searching || (i != 0 && !(mixed && i + 1 == o.agents));
+  };
+  auto searched = [&](Agent &self, const fetch::oef::pb::Server_AgentMessage &msg) {
+    uint64_t time = self.answered(msg);
+    if(!time) {
+      return; // registration error
+    }
+    latency.observe(now_ns() - time);
+    if(++received == expected) {
+      std::lock_guard<std::mutex> lock(done_lock);
+      done.notify_all();
+    }
+    if(self.sent <= o.messages) { // registration included
+      self.search(all_stations);
+    }
+  };
+
+  for(auto &agent : agents) {
+    agent->start([&](Agent &self, const fetch::oef::pb::Server_AgentMessage &msg) {
+          if(searching) {
+            searched(self, msg);
+            return;
+          }
+          if(mixed && msg.has_agents()) {
+            uint64_t time = self.answered(msg);
+            if(time) {
+              search_delay.observe(now_ns() - time);
+            }
+            auto timer = std::make_shared<asio::steady_timer>(io_context, std::chrono::milliseconds{1});
+            timer->async_wait([&, timer](std::error_code) {
+                  if(received < expected) {
+                    self.search(all_stations);
+                  }
+                });
+            return;
+          }
+          if(!msg.has_content()) {
+            return; // dialogue errors
+          }
+          const auto &origin = msg.content().origin();
+          if(!is_sender(self.id())) {
+            // ping-pong peer echoes, fan-in sink acknowledges
+            count(msg);
+            self.send(origin, ping_pong ? o.size : 0);
+            return;
+          }
+          if(ping_pong) {
+            count(msg);
+          }
+          if(self.sent < o.messages) {
+            self.send(origin, o.size);
+          }
+        });
+  }
+
+  std::vector<std::thread> threads;
+  auto work = asio::make_work_guard(io_context);
+  for(uint32_t t = 0; t < o.client_threads; ++t) {
+    threads.emplace_back([&io_context]() { io_context.run(); });
+  }
+
+  if(searching || mixed) { // registrations are not acknowledged
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{o.timeout};
+    while(search.size() < (mixed ? 1 : o.agents) && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  if(mixed) {
+    agents.back()->search(all_stations);
+  }
+  for(uint32_t i = 0; i < o.agents; ++i) {
+    if(!is_sender(agents[i]->id())) {
+      continue;
+    }
+    if(searching) {
+      for(uint32_t w = 0; w < o.window && w < o.messages; ++w) {
+        agents[i]->search(all_stations);
+      }
+      continue;
+    }
+    const std::string &peer = agents[ping_pong ? i + 1 : 0]->id();
+    for(uint32_t w = 0; w < o.window && w < o.messages; ++w) {
+      agents[i]->send(peer, o.size);
+    }
+  }
+  bool completed;
+  {
+    std::unique_lock<std::mutex> lock(done_lock);
+    completed = done.wait_for(lock, std::chrono::seconds{o.timeout}, [&]() { return received == expected; });
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // logs go to stdout too, the disconnection errors would get mixed with the results
+  Logger::level(LogLevel::off);
+  for(auto &agent : agents) {
+    agent->disconnect();
+  }
+  work.reset();
+  io_context.stop();
+  for(auto &t : threads) {
+    t.join();
+  }
+
+  auto snapshot = Metrics::snapshot();
+  const MetricValue *l = snapshot.find("loopback_latency_ns");
+  auto us = [l](double q) { return std::to_string(double(l->quantile(q)) / 1000.); };
+  std::cout << "{\"scenario\":\"" << o.scenario << "\",\"transport\":\"" << o.transport << "\",\"sessions\":\"" << o.sessions << "\",\"agents\":" << o.agents << ",\"window\":" << o.window
+            << ",\"size\":" << o.size << ",\"core_threads\":" << o.core_threads
+            << ",\"completed\":" << (completed ? "true" : "false") << ",\"messages\":" << received.load()
+            << ",\"seconds\":" << seconds << ",\"msgs_per_s\":" << double(received.load()) / seconds
+            << ",\"latency_us\":{\"p50\":" << us(0.5) << ",\"p99\":" << us(0.99) << ",\"p999\":" << us(0.999)
+            << ",\"max\":" << us(1.0) << ",\"mean\":" << (l->count ? double(l->sum) / double(l->count) / 1000. : 0.)
+            << "}";
+  if(mixed) {
+    const MetricValue *s = snapshot.find("loopback_search_latency_ns");
+    auto search_us = [s](double q) { return std::to_string(double(s->quantile(q)) / 1000.); };
+    std::cout << ",\"bulk_threads\":" << o.bulk_threads << ",\"searches\":" << s->count
+              << ",\"search_latency_us\":{\"p50\":" << search_us(0.5) << ",\"p99\":" << search_us(0.99)
+              << ",\"max\":" << search_us(1.0) << "}";
+  }
+  std::cout << "}" << std::endl;
+  return completed ? 0 : 2;
+}
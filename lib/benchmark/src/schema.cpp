@@ -0,0 +1,153 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include <hayai.hpp>
+#include "compiled_query.hpp"
+#include "serialization.hpp"
+#include "workload.hpp"
+
+#include <map>
+#include <unordered_set>
+
+using namespace fetch::oef;
+
+namespace {
+  /* Populations of the default workload, by size, with a fixed mix of queries */
+  struct Populations {
+    static constexpr std::size_t nb_queries = 64;
+    std::map<std::size_t,std::vector<Instance>> instances;
+    std::map<std::size_t,std::vector<std::shared_ptr<Buffer>>> buffers;
+    std::vector<QueryModel> queries;
+    std::vector<CompiledQuery> compiled;
+
+    Populations() {
+      Workload workload;
+      for(std::size_t n : {100, 1000, 10000}) {
+        auto &population = instances[n];
+        population = workload.instances(n);
+        for(auto &instance : population) {
+          buffers[n].emplace_back(pbs::serialize(instance.handle()));
+        }
+      }
+      queries = workload.queries(nb_queries);
+      for(auto &query : queries) {
+        compiled.emplace_back(CompiledQuery{query.handle()});
+      }
+    }
+    static Populations &get() {
+      static Populations populations;
+      return populations;
+    }
+  };
+  constexpr std::size_t Populations::nb_queries;
+
+  /* Generates the populations before the first run, rather than in it */
+  class SchemaWorkload : public ::hayai::Fixture {
+  public:
+    void SetUp() override { Populations::get(); }
+  protected:
+    std::size_t next_query_ = 0;
+    std::size_t next_query() { return next_query_++ % Populations::nb_queries; }
+  };
+
+  std::size_t matches = 0; // results are accumulated so that nothing is optimised away
+}
+
+BENCHMARK_P_F(SchemaWorkload, InstanceFromProto, 10, 10, (std::size_t n))
+{
+  for(auto &instance : Populations::get().instances[n]) {
+    Instance copy{instance.handle()};
+    matches += copy.handle().values_size();
+  }
+}
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceFromProto, (100));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceFromProto, (1000));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceFromProto, (10000));
+
+BENCHMARK_P_F(SchemaWorkload, InstanceFromBytes, 10, 10, (std::size_t n))
+{
+  for(auto &buffer : Populations::get().buffers[n]) {
+    Instance instance{pbs::deserialize<fetch::oef::pb::Query_Instance>(*buffer)};
+    matches += instance.handle().values_size();
+  }
+}
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceFromBytes, (100));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceFromBytes, (1000));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceFromBytes, (10000));
+
+BENCHMARK_P_F(SchemaWorkload, QueryCheck, 10, 100, (std::size_t n))
+{
+  const auto &query = Populations::get().queries[next_query()];
+  for(auto &instance : Populations::get().instances[n]) {
+    matches += query.check(instance);
+  }
+}
+BENCHMARK_P_INSTANCE(SchemaWorkload, QueryCheck, (100));
+BENCHMARK_P_INSTANCE(SchemaWorkload, QueryCheck, (1000));
+BENCHMARK_P_INSTANCE(SchemaWorkload, QueryCheck, (10000));
+
+BENCHMARK_P_F(SchemaWorkload, CompiledQueryCheck, 10, 100, (std::size_t n))
+{
+  const auto &query = Populations::get().compiled[next_query()];
+  for(auto &instance : Populations::get().instances[n]) {
+    matches += query.check(instance);
+  }
+}
+BENCHMARK_P_INSTANCE(SchemaWorkload, CompiledQueryCheck, (100));
+BENCHMARK_P_INSTANCE(SchemaWorkload, CompiledQueryCheck, (1000));
+BENCHMARK_P_INSTANCE(SchemaWorkload, CompiledQueryCheck, (10000));
+
+BENCHMARK_P_F(SchemaWorkload, InstanceHash, 10, 100, (std::size_t n))
+{
+  for(auto &instance : Populations::get().instances[n]) {
+    matches += instance.hash() & 1;
+  }
+}
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceHash, (100));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceHash, (1000));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceHash, (10000));
+
+BENCHMARK_P_F(SchemaWorkload, InstanceEqual, 10, 100, (std::size_t n))
+{
+  const auto &population = Populations::get().instances[n];
+  for(std::size_t i = 1; i < population.size(); ++i) {
+    matches += population[i] == population[i - 1];
+  }
+}
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceEqual, (100));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceEqual, (1000));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceEqual, (10000));
+
+/* Deduplication of a population, as a registry of instances does */
+BENCHMARK_P_F(SchemaWorkload, InstanceSet, 10, 10, (std::size_t n))
+{
+  std::unordered_set<Instance> set;
+  for(auto &instance : Populations::get().instances[n]) {
+    set.insert(instance);
+  }
+  matches += set.size();
+}
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceSet, (100));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceSet, (1000));
+BENCHMARK_P_INSTANCE(SchemaWorkload, InstanceSet, (10000));
+
+BENCHMARK_F(SchemaWorkload, QueryValid, 10, 1000)
+{
+  matches += Populations::get().queries[next_query()].valid();
+}
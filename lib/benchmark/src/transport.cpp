@@ -0,0 +1,129 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include <hayai.hpp>
+#include "asio_acceptor.hpp"
+#include "asio_communicator.hpp"
+#include "loopback_communicator.hpp"
+#include "shm_communicator.hpp"
+
+#include <unistd.h>
+
+#include <stdexcept>
+#include <thread>
+
+using namespace fetch::oef;
+
+namespace {
+  /* Round trips of a 64 bytes frame, echoed by a thread at the other end, both ends synchronous */
+  class Transport : public ::hayai::Fixture {
+  public:
+    void TearDown() override {
+      client_->disconnect();
+      echo_.join();
+      client_.reset();
+      server_.reset();
+    }
+  protected:
+    asio::io_context io_context_;
+    std::string path_ = "/tmp/oef-core-benchmark-" + std::to_string(::getpid()) + ".sock";
+    std::shared_ptr<communicator_t> client_;
+    std::shared_ptr<communicator_t> server_;
+    std::shared_ptr<Buffer> frame_ = std::make_shared<Buffer>(64);
+    std::thread echo_;
+
+    void echo() {
+      auto server = server_;
+      echo_ = std::thread([server]() {
+          std::shared_ptr<Buffer> frame;
+          while(!server->receive_sync(frame) && !server->send_sync(frame)) {
+          }
+        });
+    }
+    void round_trip() {
+      std::shared_ptr<Buffer> reply;
+      if(client_->send_sync(frame_) || client_->receive_sync(reply)) {
+        throw std::runtime_error("round trip failed");
+      }
+    }
+    void shm(uint32_t spin_us) {
+      ShmComm::Options options;
+      options.spin_us = spin_us;
+      ShmAcceptor acceptor{io_context_, path_, options};
+      acceptor.do_accept_async([this](std::error_code, std::shared_ptr<communicator_t> comm) { server_ = comm; });
+      std::thread connecting([this,options]() { client_ = ShmComm::connect(io_context_, path_, options); });
+      while(!server_ && io_context_.run_one()) {
+      }
+      connecting.join();
+      echo();
+    }
+  };
+
+  class InProcess : public Transport {
+  public:
+    void SetUp() override {
+      auto ends = LoopbackComm::pair(io_context_, io_context_);
+      client_ = ends.first;
+      server_ = ends.second;
+      echo();
+    }
+  };
+
+  class UnixSocket : public Transport {
+  public:
+    void SetUp() override {
+      AsioLocalAcceptor acceptor{io_context_, path_};
+      acceptor.do_accept_async([this](std::error_code, std::shared_ptr<communicator_t> comm) { server_ = comm; });
+      client_ = std::make_shared<AsioComm>(io_context_, path_);
+      while(!server_ && io_context_.run_one()) {
+      }
+      echo();
+    }
+  };
+
+  class SharedMemory : public Transport {
+  public:
+    void SetUp() override { shm(0); }
+  };
+
+  class SharedMemorySpin : public Transport {
+  public:
+    void SetUp() override { shm(20); }
+  };
+}
+
+BENCHMARK_F(InProcess, RoundTrip, 10, 10000)
+{
+  round_trip();
+}
+
+BENCHMARK_F(UnixSocket, RoundTrip, 10, 10000)
+{
+  round_trip();
+}
+
+BENCHMARK_F(SharedMemory, RoundTrip, 10, 10000)
+{
+  round_trip();
+}
+
+BENCHMARK_F(SharedMemorySpin, RoundTrip, 10, 10000)
+{
+  round_trip();
+}
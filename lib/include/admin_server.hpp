@@ -0,0 +1,86 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "agent_directory.hpp"
+#include "oef_search_client.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+
+#include "asio.hpp"
+
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Admin listener, serving the state of the node to operators on its own io thread, so that
+   * scraping never competes with agents I/O. Text commands, one per line, each answer being
+   * terminated by an empty line (e.g. `echo metrics | nc -q1 localhost 2222`):
+   *   metrics                       metrics in Prometheus text format
+   *   agents                        connected agents and their session queues
+   *   search                        OEF Search link status and pending requests
+   *   log-level                     level of each log section
+   *   log-level [section=]level     change the level of all sections or of one section
+   *   trace-sample [n]              trace one agent frame out of n, 0 to stop tracing
+   *   trace                         latest traces as Chrome trace events JSON
+   *   help, quit
+   * HTTP GET requests of /metrics, /agents, /search, /log-level and /trace are answered too (HTTP/1.0),
+   * for Prometheus to scrape /metrics.
+   */
+  class AdminServer {
+  private:
+    asio::io_context io_context_;
+    asio::ip::tcp::acceptor acceptor_;
+    const AgentDirectory &agentDirectory_;
+    std::shared_ptr<OefSearchClient> oef_search_;
+    std::unique_ptr<std::thread> thread_;
+
+    static fetch::oef::Logger logger;
+  public:
+    /* Listen on `address`:`port` (0 for any free port), throws if it cannot. Local connections
+     * only by default: the admin commands are not authenticated */
+    explicit AdminServer(const AgentDirectory &agentDirectory, std::shared_ptr<OefSearchClient> oef_search,
+        uint32_t port = static_cast<uint32_t>(config::Ports::ServiceDiscovery),
+        const std::string &address = config::default_ip);
+    AdminServer(const AdminServer &) = delete;
+    AdminServer operator=(const AdminServer &) = delete;
+    ~AdminServer();
+
+    uint32_t port() const { return acceptor_.local_endpoint().port(); }
+    void stop();
+    /* Answer of one command line, without the terminating empty line */
+    std::string execute(const std::string &command);
+
+    /* Metrics in Prometheus text format. Histogram buckets are merged by spans of
+     * prometheus_bucket_span, so that each is exposed with 148 buckets at most */
+    static std::string prometheus(const MetricsSnapshot &snapshot);
+  private:
+    static constexpr std::size_t prometheus_bucket_span = 4;
+
+    void do_accept();
+    std::string agents_() const;
+    std::string search_() const;
+    std::string log_level_(const std::string &argument) const;
+  };
+} // oef
+} // fetch
@@ -21,9 +21,11 @@
 #include "api/agent_session_t.hpp"
 
 #include "logger.hpp"
+#include "metrics.hpp"
 #include "schema.hpp"
 
 #include <memory>
+#include <vector>
 
 namespace fetch {
 namespace oef {
@@ -34,6 +36,7 @@ namespace oef {
             std::unordered_map<std::string,std::shared_ptr<agent_session_t>> sessions_;
 
             static fetch::oef::Logger logger;
+            static fetch::oef::Gauge agents;
         public:
             AgentDirectory() = default;
             
@@ -45,6 +48,7 @@ namespace oef {
                 if(exist(id))
                     return false;
                 sessions_[id] = std::move(session);
+                agents.set(int64_t(sessions_.size()));
                 return true;
             }
             bool exist(const std::string &id) const override {
@@ -52,7 +56,9 @@ namespace oef {
             }
             bool remove(const std::string &id) override {
                 std::lock_guard<std::mutex> lock(lock_);
-                return sessions_.erase(id) == 1;
+                bool erased = sessions_.erase(id) == 1;
+                agents.set(int64_t(sessions_.size()));
+                return erased;
             }
             std::shared_ptr<agent_session_t> session(const std::string &id) const override {
                 std::lock_guard<std::mutex> lock(lock_);
@@ -69,6 +75,17 @@ namespace oef {
             void clear() override {
                 std::lock_guard<std::mutex> lock(lock_);
                 sessions_.clear();
+                agents.set(0);
+            }
+            /* Copy of the connected sessions, for reporting */
+            std::vector<std::shared_ptr<agent_session_t>> sessions() const {
+                std::lock_guard<std::mutex> lock(lock_);
+                std::vector<std::shared_ptr<agent_session_t>> sessions;
+                sessions.reserve(sessions_.size());
+                for(auto &s : sessions_) {
+                    sessions.push_back(s.second);
+                }
+                return sessions;
             }
             
         };
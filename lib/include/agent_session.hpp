@@ -1,3 +1,4 @@
+#pragma once
 //------------------------------------------------------------------------------
 //
 //   Copyright 2018-2019 Fetch.AI Limited
@@ -21,32 +22,154 @@
 
 #include "agent_directory.hpp"
 #include "oef_search_client.hpp"
+#include "subscriptions.hpp"
 #include "asio_communicator.hpp"
 #include "serialization.hpp"
+#include "config.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
+#include "mpsc_queue.hpp"
+#include "tracing.hpp"
+#include "token_bucket.hpp"
+#include "coroutine.hpp"
 
 #include "agent.pb.h" // TOFIX
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
 namespace fetch {
 namespace oef {
+    /*
+     * Water marks of the frames queued to an agent and not written yet. Above a high mark the agent is a
+     * slow consumer (congested) until both are back below the low marks. Meanwhile, the messages other
+     * agents send to it are subject to the policy:
+     *   Pause       they are queued, but the core stops reading from their senders until it drains
+     *   Drop        they are dropped, and their senders get a dialogue error
+     *   Disconnect  the slow consumer is disconnected, they get a dialogue error
+     */
+    struct OutboundLimits {
+      enum class Policy { Pause, Drop, Disconnect };
+      uint64_t high_bytes = config::session_outbound_high_bytes;
+      uint64_t low_bytes = config::session_outbound_low_bytes;
+      uint32_t high_frames = config::session_outbound_high_frames;
+      uint32_t low_frames = config::session_outbound_low_frames;
+      Policy policy = Policy::Pause;
+
+      static bool parse_policy(const std::string &name, Policy &policy);
+    };
+
+    /*
+     * Rates, in operations per second, each agent is held to, per class of operation. Rather than refusing
+     * the operations above its rate, the core waits before reading the next ones from the agent. Bursts
+     * default to one second worth of operations, a rate of 0 is unlimited.
+     * A session also yields to the other sessions after processing `fairness_budget` envelopes of a batch.
+     */
+    struct RateLimits {
+      enum class Operation { Messaging, Registration, Search, Other };
+      struct Rate {
+        double rate = 0;
+        double burst = 0;
+      };
+      Rate messaging;    // send and broadcast messages
+      Rate registration; // (un)register descriptions and services, (un)subscribe
+      Rate search;       // search agents and services
+      uint32_t fairness_budget = config::session_fairness_budget;
+
+      static Operation operation(fetch::oef::pb::Envelope::PayloadCase payload);
+    };
+
     class AgentSession : public agent_session_t, public std::enable_shared_from_this<AgentSession> {
     private:
       const std::string publicKey_;
       stde::optional<Instance> description_;
       AgentDirectory &agentDirectory_;
       OefSearchClient& oef_search_; // could oef_search_client_t&
+      Subscriptions& subscriptions_;
       std::shared_ptr<communicator_t> comm_;
+      // batching agents exchange EnvelopeBatch / AgentMessageBatch frames
+      const bool batching_;
+      mutable std::mutex out_lock_;
+      bool holding_{false}; // replies are held while a batch is processed, then sent as one frame per Priority
+      std::shared_ptr<Buffer> pending_[2];
+      std::vector<LengthContinuation> pending_continuations_[2];
+      std::atomic<uint64_t> received_{0};
+      std::atomic<uint64_t> sent_{0};
+      std::atomic<uint64_t> sent_bytes_{0};
+      std::atomic<uint32_t> pending_sends_{0};
+      // frames are sent from any thread: they are queued, and the sender finding the queue idle
+      // writes them, along with whatever is queued meanwhile, one grouped write at a time
+      struct Outbound {
+        std::shared_ptr<Buffer> frame;
+        LengthContinuation continuation;
+        std::shared_ptr<Trace> trace;
+      };
+      MpscQueue<Outbound> outbound_[2];        // per Priority
+      std::atomic<uint32_t> outbound_size_{0}; // frames queued or being written
+      std::vector<Outbound> writing_;          // by the writer only
+      const OutboundLimits limits_;
+      std::atomic<uint64_t> pending_bytes_{0}; // of the frames not written yet
+      std::atomic<bool> congested_{false};
+      std::atomic<bool> disconnecting_{false};
+      std::mutex drained_lock_;                // congested_ changes, and the senders waiting for them
+      std::vector<VoidContinuation> drained_;
+      std::shared_ptr<agent_session_t> congested_destination_; // by the reader only, see Policy::Pause
+      // from here, by the reader only
+      const uint32_t fairness_budget_;
+      TokenBucket buckets_[3]; // per RateLimits::Operation but Other
+      TokenBucket::Clock::duration delay_{TokenBucket::Clock::duration::zero()}; // before reading on
+      asio::io_context *io_context_{nullptr};
+      asio::io_context *bulk_lane_{nullptr};
+      fetch::oef::pb::EnvelopeBatch batch_; // being processed, from envelope next_
+      int next_{0};
+#ifdef OEF_CORE_COROUTINES
+      bool coroutines_{false};
+      std::shared_ptr<FramePool> frames_;
+#endif
 
       static fetch::oef::Logger logger;
+      static fetch::oef::Counter routed_messages;
+      static fetch::oef::Counter routed_bytes;
+      static fetch::oef::Counter dialogue_errors;
+      static fetch::oef::Counter paused_reads;
+      static fetch::oef::Counter dropped_messages;
+      static fetch::oef::Counter disconnected_consumers;
+      static fetch::oef::Gauge congested_sessions;
+      static fetch::oef::Counter delayed_reads;
+      static fetch::oef::Counter yielded_reads;
+      static fetch::oef::Counter bulk_frames;
     public:
+      struct Stats {
+        uint64_t received;      // frames
+        uint64_t sent;          // frames
+        uint64_t sent_bytes;
+        uint32_t pending_sends; // frames not written yet
+        uint64_t pending_bytes;
+        bool congested;
+        uint32_t batched;       // messages waiting for their batch frame
+      };
+
       explicit AgentSession(
           std::string agent_id, std::shared_ptr<communicator_t> comm, 
           AgentDirectory& agentDirectory, 
-          OefSearchClient& oef_search) 
+          OefSearchClient& oef_search,
+          Subscriptions& subscriptions,
+          bool batching = false,
+          OutboundLimits limits = OutboundLimits{},
+          RateLimits rates = RateLimits{}) 
         : publicKey_{std::move(agent_id)} 
         , agentDirectory_{agentDirectory}
         , oef_search_{oef_search} 
+        , subscriptions_{subscriptions}
         , comm_{std::move(comm)}
+        , batching_{batching}
+        , limits_{limits}
+        , fairness_budget_{rates.fairness_budget}
+        , buckets_{TokenBucket{rates.messaging.rate, rates.messaging.burst},
+                   TokenBucket{rates.registration.rate, rates.registration.burst},
+                   TokenBucket{rates.search.rate, rates.search.burst}}
       {}
       
       AgentSession(const AgentSession &) = delete;
@@ -57,23 +180,56 @@ namespace oef {
       }
       
       void start() override {
+#ifdef OEF_CORE_COROUTINES
+        if(coroutines_) {
+          serve(shared_from_this());
+          return;
+        }
+#endif
         read();
       }
+      /* Where the reads delayed by the rate limits, or yielded to the other sessions, resume. Without it,
+       * they resume right away. Frames carrying messages for other agents are processed on `bulk_lane`,
+       * if any, rather than ahead of the registrations and searches of other agents. Call before start() */
+      void schedule_on(asio::io_context &io_context, asio::io_context *bulk_lane = nullptr) {
+        io_context_ = &io_context;
+        bulk_lane_ = bulk_lane;
+      }
+#ifdef OEF_CORE_COROUTINES
+      /* Serve the agent, and answer its OEF Search queries, with coroutines. Call before start() */
+      void use_coroutines(bool coroutines) {
+        coroutines_ = coroutines;
+        frames_ = coroutines ? std::make_shared<FramePool>() : nullptr;
+      }
+      /* Where the frames of the coroutines of the session come from */
+      const std::shared_ptr<FramePool> &frame_pool() const {
+        return frames_;
+      }
+#endif
 
       std::string agent_id() const override {
         return publicKey_;
       }
       
       void send(std::shared_ptr<Buffer> buffer) { // TOFIX needed to send status messages at handshake
-        comm_->send_async(std::move(buffer));
+        write(std::move(buffer), nullptr, Priority::Control);
       }
+      void send(std::shared_ptr<Buffer> buffer, LengthContinuation continuation,
+          Priority priority = Priority::Control) override;
       void send(const fetch::oef::pb::Server_AgentMessage &msg) override {
-        comm_->send_async(pbs::serialize(msg));
+        send(pbs::serialize(msg), [](std::error_code, std::size_t) {});
       }
       void send(const fetch::oef::pb::Server_AgentMessage& msg, LengthContinuation continuation) override {
-        comm_->send_async(pbs::serialize(msg), continuation);
+        send(pbs::serialize(msg), std::move(continuation));
       }
       void send_error(uint32_t msg_id, fetch::oef::pb::Server_AgentMessage_OEFError_Operation error) override;
+      bool congested() const override {
+        return congested_.load(std::memory_order_relaxed);
+      }
+      void when_drained(VoidContinuation continuation) override;
+      void disconnect() override;
+
+      Stats stats() const;
 
       bool match(const QueryModel &query) const {
         if(!description_) {
@@ -89,11 +245,64 @@ namespace oef {
       void process_search_agents(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search) override;
       void process_search_service(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search) override;
       void process_search_service_wide(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search);
+      void process_subscribe_services(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search) override;
+      void process_unsubscribe_services(uint32_t msg_id, const fetch::oef::pb::AgentUnsubscribe &unsubscribe) override;
+      /* Send the agents found by an OEF Search query */
+      void answer_agents(uint32_t msg_id, const OefSearchResponse &response);
+      void answer_agents_wide(uint32_t msg_id, const OefSearchResponse &response);
+      /* Push a newly registered instance to the agents subscribed to it */
+      void notify_subscribers(const Instance &instance);
       void send_dialog_error(uint32_t msg_id, uint32_t dialogue_id, const std::string &origin) override;
       void process_message(uint32_t msg_id, fetch::oef::pb::Agent_Message *msg) override;
+      void process_broadcast(uint32_t msg_id, const fetch::oef::pb::AgentBroadcast &broadcast) override;
+      /* Write the same serialized message to each destination session */
+      void deliver(uint32_t msg_id, uint32_t dialogue_id, const std::shared_ptr<Buffer> &buffer, 
+          const std::vector<std::string> &destinations);
+      /* Bulk for a frame carrying messages for other agents, Control otherwise */
+      static Priority priority(const Buffer &frame, bool batching);
       void process(const std::shared_ptr<Buffer> &buffer) override;
+      void process(fetch::oef::pb::Envelope &envelope);
+      /* Process the envelopes of batch_ from next_, until the fairness budget is spent or there is a reason
+       * to wait before reading on */
+      void process_batch();
+      bool batch_pending() const {
+        return next_ < batch_.envelopes_size();
+      }
+      /* Send held replies as one AgentMessageBatch frame per Priority, Control first */
+      void flush();
+      void write(std::shared_ptr<Buffer> frame, LengthContinuation continuation, Priority priority);
+      /* Write the queued frames, by the sender which found the queue idle */
+      void drain();
+      void written(std::error_code ec);
+      /* Above a high water mark: a slow consumer */
+      void congest(uint32_t frames, uint64_t bytes);
+      /* Back below the low water marks, or gone: resume the senders waiting for it */
+      void drained();
+      /* Whether `destination` gets the message of msg_id: if it is a slow consumer, according to the policy */
+      bool admit(const std::shared_ptr<agent_session_t> &destination, uint32_t msg_id, uint32_t dialogue_id,
+          const std::string &destination_id);
       
       void read();
+      /* read(), or resume() once there is no reason to wait anymore */
+      void read_next();
+      /* Whether to wait before reading on: for the destination congested by the latest frame (Policy::Pause),
+       * for the rate limits, or after spending the fairness budget on a batch */
+      bool waiting() const {
+        return congested_destination_ || delay_ > TokenBucket::Clock::duration::zero() || batch_pending();
+      }
+      /* Call continuation once done waiting */
+      void wait(VoidContinuation continuation);
+      /* Carry on with the batch being processed, or read() */
+      void resume();
+      /* The agent disconnected, or its connection failed */
+      void disconnected(std::error_code ec);
+#ifdef OEF_CORE_COROUTINES
+      /* read() as a coroutine. Static: its frame lives as long as the session, it is not taken from the pool */
+      static Detached serve(std::shared_ptr<AgentSession> self);
+      /* An OEF Search query (agents, services or services wide) and its answer, as a coroutine */
+      Detached await_search(std::shared_ptr<AgentSession> self, uint32_t msg_id, QueryModel query,
+          fetch::oef::pb::Envelope::PayloadCase payload);
+#endif
 };
 
 } //oef
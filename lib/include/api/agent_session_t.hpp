@@ -29,6 +29,10 @@
 
 namespace fetch {
 namespace oef {
+    /* What the core sends to agents: its own answers and notifications (Control) before the messages
+     * agents send each other (Bulk) */
+    enum class Priority { Control, Bulk };
+
     /* 
      * Define API for Agent Session object.
      * Agent Session is responsible for:
@@ -52,7 +56,18 @@ namespace oef {
         virtual void send(const fetch::oef::pb::Server_AgentMessage& msg, LengthContinuation continuation) = 0;
         /* Send a message to managed agent */
         virtual void send(const fetch::oef::pb::Server_AgentMessage& msg) = 0;
+        /* Send an already serialized Server_AgentMessage to managed agent, 
+         * the buffer can be shared with other sessions and must not be modified.
+         * Bulk frames are written after the Control ones, even those queued after them */
+        virtual void send(std::shared_ptr<Buffer> buffer, LengthContinuation continuation,
+            Priority priority = Priority::Control) = 0;
         virtual void send_error(uint32_t msg_id, fetch::oef::pb::Server_AgentMessage_OEFError_Operation error) = 0;
+        /* Whether the agent is a slow consumer: too many messages queued to it and not written yet */
+        virtual bool congested() const = 0;
+        /* Call continuation once the agent is no longer congested, or is gone: at once if it is not congested */
+        virtual void when_drained(VoidContinuation continuation) = 0;
+        /* Drop the connection with the agent, from any thread */
+        virtual void disconnect() = 0;
         
         virtual ~agent_session_t() {}
     private:
@@ -63,7 +78,10 @@ namespace oef {
         virtual void process_unregister_service(uint32_t msg_id, const fetch::oef::pb::AgentDescription &desc) = 0;
         virtual void process_search_agents(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search) = 0;
         virtual void process_search_service(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search) = 0;
+        virtual void process_subscribe_services(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search) = 0;
+        virtual void process_unsubscribe_services(uint32_t msg_id, const fetch::oef::pb::AgentUnsubscribe &unsubscribe) = 0;
         virtual void process_message(uint32_t msg_id, fetch::oef::pb::Agent_Message *msg) = 0;
+        virtual void process_broadcast(uint32_t msg_id, const fetch::oef::pb::AgentBroadcast &broadcast) = 0;
         virtual void send_dialog_error(uint32_t msg_id, uint32_t dialogue_id, const std::string &origin) = 0;
         /* Process received serialized data from agent */
         virtual void process(const std::shared_ptr<Buffer> &buffer) = 0;
@@ -20,6 +20,7 @@
 #include "api/continuation_t.hpp"
 #include "api/buffer_t.hpp"
 
+#include <exception>
 #include <memory>
 
 namespace fetch {
@@ -37,6 +38,18 @@ namespace oef {
         /* Establish a new connection */
         virtual void connect() = 0;
         
+        /* Establish a new connection without blocking, `continuation` gets the outcome.
+         * Communicators that connect without waiting (in process ones) just connect() */
+        virtual void connect_async(ErrorContinuation continuation) {
+          std::error_code ec;
+          try {
+            connect();
+          } catch(std::exception &) {
+            ec = std::make_error_code(std::errc::connection_refused);
+          }
+          continuation(ec);
+        }
+        
         /* Disconnect from the communication. Usually, this implies disconnecting Communicators at both ends */
         virtual void disconnect() = 0;
         
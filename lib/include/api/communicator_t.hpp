@@ -21,6 +21,7 @@
 #include "api/buffer_t.hpp"
 
 #include <memory>
+#include <vector>
 
 namespace fetch {
 namespace oef {
@@ -43,6 +44,11 @@ namespace oef {
         /* Disconnect from the communication. Usually, this implies disconnecting Communicators at both ends */
         virtual void disconnect() = 0;
         
+        /* Disconnect from another thread than the ones operating the Communicator: the operations in flight
+         * complete with an error, the connection itself is released with the Communicator. Communicators
+         * whose disconnect() releases what concurrent operations use must override it */
+        virtual void shutdown() { disconnect(); }
+        
         /* Send data synchronously through Communicator. Will block until all data has been sent or an error occured
          * params: 
          *   - [overload1][in] buffer: serialized message to be sent
@@ -63,6 +69,9 @@ namespace oef {
          *   - [overload][in] continuation: callback function to handle successful transmission, or errors */
         virtual void send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) = 0;
         virtual void send_async(std::shared_ptr<Buffer> buffer) = 0;
+        /* Send data asynchronously as a grouped send: the buffers are sent in order, as one write where
+         * possible, and the continuation called once with their total length */
+        virtual void send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) = 0;
         
         /* Receive data asynchronously. Will not black.
          * params:
@@ -19,6 +19,7 @@
 
 #include "api/buffer_t.hpp"
 #include "api/oef_search_response_t.hpp"
+#include "unique_function.hpp"
 
 #include <functional>
 #include <system_error>
@@ -29,11 +30,14 @@ namespace oef {
     /*
      * Defines type aliases for different continuation functions (callbacks) needed to handle asynchrounous
      * operations responses. All parameters are [in]. 
+     * The per message ones are move-only (see UniqueFunction): move them along, do not copy them.
      */
-    using BufferContinuation = std::function<void(std::error_code,std::shared_ptr<Buffer>)>;
+    using BufferContinuation = UniqueFunction<void(std::error_code,std::shared_ptr<Buffer>)>;
     using VoidBuffContinuation = std::function<void(std::error_code,std::shared_ptr<void>)>;
-    using LengthContinuation = std::function<void(std::error_code,std::size_t)>;
-    using AgentSessionContinuation = std::function<void(std::error_code,oef::OefSearchResponse)>;
+    using LengthContinuation = UniqueFunction<void(std::error_code,std::size_t)>;
+    using AgentSessionContinuation = UniqueFunction<void(std::error_code,oef::OefSearchResponse)>;
+    using VoidContinuation = UniqueFunction<void()>;
+    using ErrorContinuation = UniqueFunction<void(std::error_code)>;
     class communicator_t;
     using CommunicatorContinuation = std::function<void(std::error_code,std::shared_ptr<communicator_t>)>;
 } // oef
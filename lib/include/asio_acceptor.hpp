@@ -21,10 +21,12 @@
 #include "api/communicator_t.hpp"
 
 #include "config.hpp"
+#include "logger.hpp"
 
 #include "asio.hpp"
 
 #include <memory>
+#include <string>
 
 using asio::ip::tcp;
 
@@ -44,5 +46,26 @@ namespace oef {
       uint32_t local_port();
       ~AsioAcceptor() {}
     };
+
+    /* Unix domain socket at `path`, for agents on the same host: no TCP/IP stack involved */
+    class AsioLocalAcceptor : public comm_acceptor_t {
+    private:
+      asio::local::stream_protocol::acceptor acceptor_;
+      const std::string path_;
+
+      static fetch::oef::Logger logger;
+    public:
+      /* Throws if another process listens on `path` already */
+      explicit AsioLocalAcceptor(asio::io_context& io_context, std::string path, uint32_t backlog = 256);
+      AsioLocalAcceptor(const AsioLocalAcceptor &) = delete;
+      AsioLocalAcceptor operator=(const AsioLocalAcceptor &) = delete;
+      void do_accept_async(CommunicatorContinuation continuation) override;
+      const std::string &path() const { return path_; }
+      /* Removes the socket file */
+      ~AsioLocalAcceptor();
+      /* Bind `acceptor` to `path` and listen, see the constructor. For other transports set up
+       * through a Unix domain socket */
+      static void listen(asio::local::stream_protocol::acceptor& acceptor, const std::string& path, uint32_t backlog);
+    };
 } // oef
 } // fetch
@@ -19,6 +19,8 @@
 
 #include "api/basic_communicator_t.hpp"
 
+#include "logger.hpp"
+
 #include "asio.hpp"
 
 #include <vector>
@@ -33,27 +35,58 @@ namespace oef {
       explicit AsioBasicComm(asio::io_context& io_context) : socket_{io_context} {}
       explicit AsioBasicComm(tcp::socket socket) : socket_(std::move(socket)) {}
       explicit AsioBasicComm(asio::io_context& io_context, std::string to_ip_addr, uint32_t to_port)
-        : socket_{io_context} 
+        : socket_{io_context}, to_ip_addr_{std::move(to_ip_addr)}, to_port_{to_port}
       {
-        tcp::resolver resolver(io_context);
-        try {
-          asio::connect(socket_, resolver.resolve(to_ip_addr,std::to_string(to_port)));
-        } catch (std::exception& e) {
-          std::cerr << "AsioBasicComm::AsioBasicComm: error connecting to " 
-                    << to_ip_addr << ":" << std::to_string(to_port) 
-                    << " : " << e.what() << std::endl;
-          throw;
-        }
+        connect();
       }
       
       //
-      explicit AsioBasicComm(AsioBasicComm&& asio_comm) : socket_(std::move(asio_comm.socket_)) {}
+      explicit AsioBasicComm(AsioBasicComm&& asio_comm) 
+        : socket_(std::move(asio_comm.socket_))
+        , to_ip_addr_{std::move(asio_comm.to_ip_addr_)}
+        , to_port_{asio_comm.to_port_} 
+      {}
       
       //
-      void connect() override {}
+      /* (Re)connect to the address given at construction. Throws on failure */
+      void connect() override {
+        if (socket_.is_open()) {
+          disconnect();
+        }
+        tcp::resolver resolver(socket_.get_executor().context());
+        try {
+          asio::connect(socket_, resolver.resolve(to_ip_addr_,std::to_string(to_port_)));
+        } catch (std::exception& e) {
+          logger.error("AsioBasicComm::connect: error connecting to {}:{} : {}", to_ip_addr_, to_port_, e.what());
+          throw;
+        }
+      }
+      /* Resolve and connect on the io_context, for reconnections from io threads */
+      void connect_async(ErrorContinuation continuation) override {
+        if (socket_.is_open()) {
+          disconnect();
+        }
+        auto resolver = std::make_shared<tcp::resolver>(socket_.get_executor().context());
+        resolver->async_resolve(to_ip_addr_, std::to_string(to_port_),
+            [this,resolver,continuation=std::move(continuation)](std::error_code ec, tcp::resolver::results_type endpoints) mutable {
+              if (ec) {
+                logger.error("AsioBasicComm::connect_async: cannot resolve {}:{} : {}", to_ip_addr_, to_port_, ec.message());
+                continuation(ec);
+                return;
+              }
+              asio::async_connect(socket_, endpoints,
+                  [this,continuation=std::move(continuation)](std::error_code ec, const tcp::endpoint&) {
+                    if (ec) {
+                      logger.error("AsioBasicComm::connect_async: error connecting to {}:{} : {}", to_ip_addr_, to_port_, ec.message());
+                    }
+                    continuation(ec);
+                  });
+            });
+      }
       void disconnect() override {
-        socket_.shutdown(asio::socket_base::shutdown_type::shutdown_both);
-        socket_.close();
+        std::error_code ec;
+        socket_.shutdown(asio::socket_base::shutdown_type::shutdown_both, ec);
+        socket_.close(ec);
       }
       
       // sync operations
@@ -63,8 +96,7 @@ namespace oef {
         std::error_code ec;
         auto len = asio_send_sync_(std::vector<asio::const_buffer>{asio::buffer(buffer, nbytes)}, ec);
         if (len != nbytes) {
-          std::cerr << "AsioBasicComm::send_sync error sent " << len << " expected " << nbytes
-                    << " : " << ec.value() << std::endl;
+          logger.error("AsioBasicComm::send_sync error sent {} expected {} : {}", len, nbytes, ec.value());
           // TOFIX should connection be closed?
         }
         return ec;
@@ -83,8 +115,7 @@ namespace oef {
         }
         auto len = asio_send_sync_(asio_buffers, ec);
         if (len != nbytes_acc) {
-          std::cerr << "AsioBasicComm::send_sync error grouped sent " << len << " expected " << nbytes_acc 
-                    << " : " << ec.value() << std::endl;
+          logger.error("AsioBasicComm::send_sync error grouped sent {} expected {} : {}", len, nbytes_acc, ec.value());
           // TOFIX should connection be closed?
         }
         return ec;
@@ -96,8 +127,8 @@ namespace oef {
         auto asio_buffer = asio::buffer(buffer, nbytes);
         auto len = asio_receive_sync_(asio_buffer, ec);
         if (len != nbytes) {
-          std::cerr << "AsioBasicComm::receive_sync error while receiving data - got " << len 
-                    << " expected " << nbytes << " : " << ec.value() << std::endl;
+          logger.error("AsioBasicComm::receive_sync error while receiving data - got {} expected {} : {}", 
+              len, nbytes, ec.value());
           // TOFIX should connection be closed?
         }
         return ec;
@@ -116,10 +147,10 @@ namespace oef {
           nbytes_acc+=nbytes[i];
         }
         asio::async_write(socket_, asio_buffers,
-            [nbytes_acc,continuation](std::error_code ec, std::size_t length) {
+            [nbytes_acc,continuation=std::move(continuation)](std::error_code ec, std::size_t length) {
               if(ec) {
-                std::cerr << "AsioBasicComm::send_async: error while sending data (grouped) sent " 
-                    << length << " expected " << nbytes_acc << " : " << ec.value() << std::endl;
+                logger.error("AsioBasicComm::send_async: error while sending data (grouped) sent {} expected {} : {}", 
+                    length, nbytes_acc, ec.value());
               }
               continuation(ec, length);
             });
@@ -128,10 +159,10 @@ namespace oef {
       void send_async(std::shared_ptr<Buffer> buffer, std::size_t nbytes, LengthContinuation continuation) override 
       {
         asio::async_write(socket_, asio::buffer(buffer->data(), nbytes),
-            [nbytes,continuation](std::error_code ec, std::size_t length) {
+            [nbytes,continuation=std::move(continuation)](std::error_code ec, std::size_t length) {
               if(ec) {
-                std::cerr << "AsioBasicComm::send_async: error while sending data sent " 
-                    << length << " expected " << nbytes << " : " << ec.value() << std::endl;
+                logger.error("AsioBasicComm::send_async: error while sending data sent {} expected {} : {}", 
+                    length, nbytes, ec.value());
               }
               continuation(ec, length);
             });
@@ -141,10 +172,10 @@ namespace oef {
       {
         std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>(nbytes);
         asio::async_read(socket_, asio::buffer(buffer->data(), nbytes), 
-            [buffer,nbytes,continuation](std::error_code ec, std::size_t length) {
+            [buffer,nbytes,continuation=std::move(continuation)](std::error_code ec, std::size_t length) {
               if(ec) {
-                std::cerr << "AsioBasicComm::receive_async: error while receiving data, expected " 
-                          << nbytes << " got " << length << " : " << ec.value() << std::endl;
+                logger.error("AsioBasicComm::receive_async: error while receiving data, expected {} got {} : {}", 
+                    nbytes, length, ec.value());
                 continuation(ec, std::make_shared<Buffer>());
               } else {
                 continuation(ec, buffer);
@@ -168,7 +199,10 @@ namespace oef {
     
     private:
       tcp::socket socket_; 
-        
+      std::string to_ip_addr_;
+      uint32_t to_port_{0};
+
+      static fetch::oef::Logger logger;
     };
 } // oef
 } // fetch
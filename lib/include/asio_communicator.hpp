@@ -19,25 +19,35 @@
 
 #include "api/communicator_t.hpp"
 
+#include "logger.hpp"
+#include "metrics.hpp"
+
 #include "asio.hpp"
 
+#include <atomic>
 #include <vector>
 
 using asio::ip::tcp;
 
 namespace fetch {
 namespace oef {
+    /* Frames over a stream socket: TCP, or Unix domain for agents running on the same host as the core */
     class AsioComm : public communicator_t {
     public:
         //
         explicit AsioComm(asio::io_context& io_context) : socket_{io_context} {}
         explicit AsioComm(tcp::socket socket) : socket_(std::move(socket)) {}
+        explicit AsioComm(asio::local::stream_protocol::socket socket) : socket_(std::move(socket)) {}
         explicit AsioComm(asio::io_context& io_context, std::string to_ip_addr, uint32_t to_port);
+        /* Connect to the Unix domain socket at `path` */
+        explicit AsioComm(asio::io_context& io_context, const std::string& path);
         //
-        explicit AsioComm(AsioComm&& asio_comm) : socket_(std::move(asio_comm.socket_)) {}
+        explicit AsioComm(AsioComm&& asio_comm) : socket_(std::move(asio_comm.socket_)), pending_sends_{asio_comm.pending_sends_} {}
         //
         void connect() override {};
         void disconnect() override;
+        /* Shut the socket down without closing it: closing races with operations started by other threads */
+        void shutdown() override;
         //
         std::error_code send_sync(std::shared_ptr<Buffer> buffer) override;
         std::error_code send_sync(std::vector<std::shared_ptr<Buffer>> buffers) override;
@@ -45,16 +55,24 @@ namespace oef {
         //
         void send_async(std::shared_ptr<Buffer> buffer) override;
         void send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) override;
-        void send_async(std::vector<std::shared_ptr<Buffer>> buffer, LengthContinuation continuation);// override;
+        void send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) override;
         void receive_async(BufferContinuation continuation) override;
         //
         std::error_code send_sync(asio::const_buffer& buffer);
+        /* Asynchronous sends not completed yet */
+        uint32_t pending_sends() const { return pending_sends_->load(std::memory_order_relaxed); }
         //
         ~AsioComm() {
           disconnect();
         }
     private:
-        tcp::socket socket_; 
+        asio::generic::stream_protocol::socket socket_; 
+        // shared with the write handlers, which can outlive the communicator
+        std::shared_ptr<std::atomic<uint32_t>> pending_sends_{std::make_shared<std::atomic<uint32_t>>(0)};
+
+        static fetch::oef::Logger logger;
+        static fetch::oef::Gauge queued_sends;
+        static fetch::oef::Histogram send_queue_depth;
     };
 
     namespace as {
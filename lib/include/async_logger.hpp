@@ -0,0 +1,227 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "config.hpp"
+
+#include <spdlog/fmt/ostr.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+namespace logrec {
+  /*
+   * Binary log records, as pushed by the io threads and stored in binary log files:
+   *   [u32 size][u64 time ns][u64 thread][u8 level][u16 section][u32 format][u8 nb args] args...
+   * each argument being a type tag followed by its raw value. Arguments of other types than
+   * numbers, booleans and strings are rendered to strings by the calling thread.
+   */
+  enum class Tag : uint8_t { Int = 'i', UInt = 'u', Double = 'd', Bool = 'b', String = 's' };
+
+  struct Arg {
+    Tag tag;
+    int64_t i;
+    uint64_t u;
+    double d;
+    std::string s;
+  };
+
+  struct Record {
+    uint64_t time;
+    uint64_t thread;
+    uint8_t level;
+    uint16_t section;
+    uint32_t format;
+    std::vector<Arg> args;
+  };
+
+  constexpr std::size_t header_size = sizeof(uint32_t) + 2*sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint8_t);
+  constexpr std::size_t nb_args_offset = header_size - sizeof(uint8_t);
+
+  class Writer {
+  private:
+    std::vector<uint8_t> data_;
+    uint8_t nb_args_{0};
+
+    template <typename T>
+    void put_(const T &v) {
+      auto *p = reinterpret_cast<const uint8_t *>(&v);
+      data_.insert(data_.end(), p, p + sizeof(T));
+    }
+    void put_string_(const char *s, std::size_t len) {
+      put_(Tag::String);
+      put_(uint32_t(len));
+      data_.insert(data_.end(), s, s + len);
+    }
+  public:
+    void begin(uint64_t time, uint64_t thread, uint8_t level, uint16_t section, uint32_t format) {
+      data_.clear();
+      nb_args_ = 0;
+      put_(uint32_t(0));
+      put_(time);
+      put_(thread);
+      put_(level);
+      put_(section);
+      put_(format);
+      put_(nb_args_);
+    }
+    const std::vector<uint8_t> &end() {
+      uint32_t size = uint32_t(data_.size());
+      std::memcpy(data_.data(), &size, sizeof(size));
+      data_[nb_args_offset] = nb_args_;
+      return data_;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<T,bool>::value>::type add(const T &v) {
+      ++nb_args_; put_(Tag::Bool); put_(uint8_t(v));
+    }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value && !std::is_same<T,bool>::value && !std::is_same<T,char>::value>::type
+    add(const T &v) {
+      ++nb_args_; put_(Tag::Int); put_(int64_t(v));
+    }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T,bool>::value>::type
+    add(const T &v) {
+      ++nb_args_; put_(Tag::UInt); put_(uint64_t(v));
+    }
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type add(const T &v) {
+      ++nb_args_; put_(Tag::Double); put_(double(v));
+    }
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type add(const T &v) {
+      add(static_cast<typename std::underlying_type<T>::type>(v));
+    }
+    template <typename T>
+    typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_enum<T>::value>::type add(const T &v) {
+      ++nb_args_;
+      auto s = fmt::format("{}", v);
+      put_string_(s.data(), s.size());
+    }
+    void add(const std::string &s) { ++nb_args_; put_string_(s.data(), s.size()); }
+    void add(const char *s) { ++nb_args_; put_string_(s, std::strlen(s)); }
+    void add(char c) { ++nb_args_; put_string_(&c, 1); }
+    void add(const std::error_code &ec) { add(ec.value()); }
+  };
+
+  /* Parse the record at `data`, returns its size or 0 if it is truncated or corrupted */
+  std::size_t read(const uint8_t *data, std::size_t size, Record &record);
+  /* Substitute the {} of `format` with the arguments. Format specifications are ignored */
+  std::string format(const char *format, const std::vector<Arg> &args);
+} // logrec
+
+  /*
+   * Single producer single consumer byte ring of length-prefixed records. Each thread logging
+   * through the AsyncLogger owns one, the AsyncLogger thread drains them all.
+   */
+  class LogRing {
+  private:
+    std::vector<uint8_t> buffer_;
+    const uint64_t mask_;
+    alignas(64) std::atomic<uint64_t> head_{0}; // written by the producer
+    alignas(64) std::atomic<uint64_t> tail_{0}; // written by the consumer
+  public:
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> closed{false}; // producer thread exited
+
+    explicit LogRing(std::size_t capacity); // rounded up to a power of two
+    LogRing(const LogRing &) = delete;
+    LogRing operator=(const LogRing &) = delete;
+
+    std::size_t capacity() const { return buffer_.size(); }
+    /* Producer: returns false if there is not enough space */
+    bool try_write(const std::vector<uint8_t> &record);
+    /* Consumer: append all available records to `out`, returns the number of bytes */
+    std::size_t read(std::vector<uint8_t> &out);
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+  };
+
+  /*
+   * Logging backend moving formatting and I/O off the calling threads.
+   * Once started, Logger pushes its records into a per-thread LogRing, and a background thread
+   * formats them to the Logger sinks and/or appends them to a binary log file, to be decoded
+   * with OEFLogDecoder. When a ring is full, records are either dropped (and counted) or the
+   * calling thread waits for space.
+   */
+  class AsyncLogger {
+  public:
+    enum class Overflow { Drop, Block };
+    struct Options {
+      std::size_t ring_size = config::async_log_ring_size;
+      Overflow overflow = Overflow::Drop;
+      bool text = true;         // format records to the Logger sinks
+      std::string binary_path;  // also append binary records to this file if not empty
+    };
+
+    static void start(Options options);
+    /* Drain all pending records and stop the background thread */
+    static void stop();
+    static bool started() noexcept { return started_.load(std::memory_order_acquire); }
+    static uint64_t dropped();
+
+    static uint16_t section_id(const std::string &section);
+    /* ID of `format`, registered by contents. Each thread then caches it by address, so `format`
+     * must be a string literal: a buffer reused for another format would keep the first ID */
+    static uint32_t format_id(const char *format);
+
+    template <typename Arg1, typename... Args>
+    static void push(spdlog::level::level_enum level, uint16_t section, const char *fmt,
+        const Arg1 &arg1, const Args &... args) {
+      thread_local logrec::Writer writer;
+      auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+      writer.begin(uint64_t(now), uint64_t(spdlog::details::os::thread_id()), uint8_t(level), section, format_id(fmt));
+      writer.add(arg1);
+      (void)std::initializer_list<int>{(writer.add(args), 0)...};
+      write_(writer.end());
+    }
+
+    /* Binary log file layout */
+    static constexpr const char *magic = "OEFBLOG1";
+    enum class Entry : uint8_t { Format = 1, Section = 2, Record = 3 };
+
+  private:
+    static std::atomic<bool> started_;
+    static void write_(const std::vector<uint8_t> &record);
+  };
+
+  /* Reads back a binary log file written by AsyncLogger */
+  class BinaryLogReader {
+  private:
+    std::ifstream in_;
+    std::vector<std::string> formats_;
+    std::vector<std::string> sections_;
+    std::vector<uint8_t> data_;
+  public:
+    explicit BinaryLogReader(const std::string &path);
+    /* Next record, formatted. Returns false at end of file */
+    bool next(logrec::Record &record, std::string &section, std::string &message);
+  };
+} // oef
+} // fetch
@@ -73,6 +73,31 @@ namespace fetch {
       const fetch::oef::pb::Envelope &handle() const { return envelope_; }
     };
     
+    class SubscribeServices {
+    private:
+      fetch::oef::pb::Envelope envelope_;
+    public:
+      explicit SubscribeServices(uint32_t msg_id, const QueryModel &model) {
+        envelope_.set_msg_id(msg_id);
+        auto *desc = envelope_.mutable_subscribe_services();
+        auto *mod = desc->mutable_query();
+        mod->CopyFrom(model.handle());
+      }
+      const fetch::oef::pb::Envelope &handle() const { return envelope_; }
+    };
+    
+    class UnsubscribeServices {
+    private:
+      fetch::oef::pb::Envelope envelope_;
+    public:
+      explicit UnsubscribeServices(uint32_t msg_id, uint32_t subscription_id) {
+        envelope_.set_msg_id(msg_id);
+        auto *unsubscribe = envelope_.mutable_unsubscribe_services();
+        unsubscribe->set_subscription_id(subscription_id);
+      }
+      const fetch::oef::pb::Envelope &handle() const { return envelope_; }
+    };
+    
     class Message {
     private:
       fetch::oef::pb::Envelope envelope_;
@@ -87,6 +112,35 @@ namespace fetch {
       const fetch::oef::pb::Envelope &handle() const { return envelope_; }
     };
     
+    class Broadcast {
+    private:
+      fetch::oef::pb::Envelope envelope_;
+    public:
+      explicit Broadcast(uint32_t msg_id, uint32_t dialogueId, const std::vector<std::string> &dests, const std::string &msg) {
+        envelope_.set_msg_id(msg_id);
+        auto *broadcast = envelope_.mutable_broadcast_message();
+        broadcast->set_dialogue_id(dialogueId);
+        for(auto &dest : dests) {
+          broadcast->add_destinations(dest);
+        }
+        broadcast->set_content(msg);
+      }
+      explicit Broadcast(uint32_t msg_id, uint32_t dialogueId, const QueryModel &model, const std::string &msg) 
+        : Broadcast(msg_id, dialogueId, std::vector<std::string>{}, msg) {
+        envelope_.mutable_broadcast_message()->mutable_query()->CopyFrom(model.handle());
+      }
+      fetch::oef::pb::Envelope &handle() { return envelope_; }
+    };
+    
+    class Batch {
+    private:
+      fetch::oef::pb::EnvelopeBatch batch_;
+    public:
+      Batch() = default;
+      void add(const fetch::oef::pb::Envelope &envelope) { batch_.add_envelopes()->CopyFrom(envelope); }
+      const fetch::oef::pb::EnvelopeBatch &handle() const { return batch_; }
+    };
+    
     class CFP {
     private:
       fetch::oef::pb::Envelope envelope_;
@@ -0,0 +1,72 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "schema.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+  /*
+   * A Query.Model flattened once for repeated evaluation against Instances.
+   * Expressions are stored in pre-order in a single vector, each node knowing the size of its
+   * subtree. String and int sets are turned into hash sets, and string equalities are compared
+   * in place. Evaluation gives the same result as QueryModel::check.
+   */
+  class CompiledQuery {
+  public:
+    explicit CompiledQuery(const fetch::oef::pb::Query_Model &model);
+
+    bool check(const Instance &instance) const;
+    /* Data model name the query is restricted to, empty if none */
+    const std::string &model_name() const { return model_name_; }
+    /* A top level string equality constraint, usable as an index key. Empty attribute if none */
+    const std::pair<std::string,std::string> &equality_key() const { return equality_key_; }
+    const fetch::oef::pb::Query_Model &handle() const { return *model_; }
+
+  private:
+    enum class Kind : uint8_t { And, Or, Not, Constraint, StringEq, StringNotEq, SetLookup };
+    struct Node {
+      Kind kind;
+      uint32_t size; // number of nodes in the subtree, this one included
+      uint32_t nb_children;
+      const fetch::oef::pb::Query_ConstraintExpr_Constraint *constraint;
+      std::string attribute;
+      std::string value;
+      bool negate;
+      std::unordered_set<std::string> strings;
+      std::unordered_set<int64_t> ints;
+    };
+
+    void compile_(const fetch::oef::pb::Query_ConstraintExpr &expr);
+    void compile_constraint_(const fetch::oef::pb::Query_ConstraintExpr_Constraint &constraint);
+    bool eval_(std::size_t idx, const Instance &instance) const;
+    bool eval_leaf_(const Node &node, const Instance &instance) const;
+
+    std::shared_ptr<const fetch::oef::pb::Query_Model> model_;
+    std::string model_name_;
+    std::pair<std::string,std::string> equality_key_;
+    std::vector<std::size_t> roots_;
+    std::vector<Node> nodes_;
+  };
+} // oef
+} // fetch
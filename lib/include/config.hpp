@@ -29,6 +29,26 @@ namespace config {
 constexpr auto default_ip{"127.0.0.1"};
 constexpr uint32_t core_default_backlog{256};
 constexpr uint32_t core_default_nb_threads{4};
+constexpr int core_bulk_lane_nice{5}; // of the threads processing messages between agents, see CoreServer::bulk_lane()
+constexpr uint32_t search_reconnect_interval_ms{2000};
+constexpr uint32_t ledger_detached_expiry_s{7 * 24 * 3600}; // registrations of agents not reconnecting are then forgotten
+// the registrations journal is compacted at runtime once its dead records are more than ratio times the live ones,
+// and more than min
+constexpr std::size_t ledger_compaction_ratio{2};
+constexpr std::size_t ledger_compaction_min{1024};
+constexpr std::size_t async_log_ring_size{1 << 20}; // bytes per logging thread
+constexpr uint32_t metrics_snapshot_interval_ms{10000};
+constexpr std::size_t trace_ring_size{4096}; // latest traces kept
+constexpr std::size_t admin_max_request{4096}; // bytes of an admin command line, or of an HTTP request headers
+constexpr std::size_t session_write_batch{64}; // frames per write to an agent
+// frames queued to an agent, and not written yet, above which it is a slow consumer, until back below the low marks
+constexpr uint64_t session_outbound_high_bytes{8 << 20};
+constexpr uint64_t session_outbound_low_bytes{2 << 20};
+constexpr uint32_t session_outbound_high_frames{8192};
+constexpr uint32_t session_outbound_low_frames{2048};
+constexpr uint32_t session_fairness_budget{64}; // envelopes of a batch processed before yielding to other sessions
+constexpr std::size_t coroutine_frame_size{640}; // bytes, larger coroutine frames are not pooled
+constexpr std::size_t coroutine_frames_kept{8}; // free frames per pool
 
 enum class Ports {
   ServiceDiscovery = 2222, Agents = 3333, Search = 7501
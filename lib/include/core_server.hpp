@@ -20,19 +20,29 @@
 #include "api/core_server_t.hpp"
 #include "api/communicator_t.hpp"
 
+#include "admin_server.hpp"
 #include "agent_directory.hpp"
+#include "agent_session.hpp"
 #include "asio_communicator.hpp"
 #include "asio_acceptor.hpp"
 #include "asio_basic_communicator.hpp"
+#include "loopback_communicator.hpp"
+#include "shm_communicator.hpp"
+#include "uring_communicator.hpp"
 #include "oef_search_client.hpp"
+#include "subscriptions.hpp"
 #include "serialization.hpp"
 #include "config.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
+#include "coroutine.hpp"
 
 #include "agent.pb.h"
 #include "asio.hpp"
 
+#include <chrono>
 #include <memory>
+#include <mutex>
 
 namespace fetch {
 namespace oef {      
@@ -40,16 +50,36 @@ namespace oef {
     class CoreServer : public core_server_t {
     private:
       asio::io_context io_context_;
-      AsioAcceptor acceptor_;
+      // messages between agents, processed apart from the rest when bulk_lane() is given threads
+      asio::io_context bulk_context_;
+      asio::executor_work_guard<asio::io_context::executor_type> bulk_work_{asio::make_work_guard(bulk_context_)};
+      std::vector<std::unique_ptr<std::thread>> bulk_threads_;
+      std::shared_ptr<IoUring> uring_; // when agents are served through io_uring
+      std::shared_ptr<LoopbackAcceptor> loopback_;
+      std::vector<std::shared_ptr<comm_acceptor_t>> acceptors_; // TCP, in process, then Unix domain and shared memory
       AgentDirectory agentDirectory_;
+      Subscriptions subscriptions_;
       std::shared_ptr<OefSearchClient> oef_search_; 
       std::vector<std::unique_ptr<std::thread>> threads_;
+      asio::steady_timer search_watchdog_;
+      asio::steady_timer metrics_timer_;
+      std::unique_ptr<AdminServer> admin_;
+      mutable std::mutex metrics_lock_;
+      MetricsSnapshot metrics_;          // latest snapshot
+      MetricsSnapshot metrics_interval_; // accumulated during the last interval
       //
       std::string core_key_;
       std::string core_ip_addr_;
       uint32_t core_port_;
+      OutboundLimits outbound_limits_;
+      RateLimits rate_limits_;
+#ifdef OEF_CORE_COROUTINES
+      bool coroutines_{true};
+      std::shared_ptr<FramePool> frames_{std::make_shared<FramePool>()};
+#endif
 
       static fetch::oef::Logger logger;
+      static fetch::oef::Histogram handshake_duration;
     public:
       explicit CoreServer(
           std::string core_key      = "oef-core-pluto",
@@ -60,11 +90,15 @@ namespace oef {
           uint32_t nbThreads        = config::core_default_nb_threads, 
           uint32_t backlog          = config::core_default_backlog) 
           : 
-            acceptor_{io_context_, core_port}
+            loopback_{std::make_shared<LoopbackAcceptor>(io_context_)}
+          , search_watchdog_{io_context_}
+          , metrics_timer_{io_context_}
           , core_key_{core_key}
           , core_ip_addr_{core_ip_addr}
           , core_port_{core_port}
       {
+        acceptors_.push_back(std::make_shared<AsioAcceptor>(io_context_, core_port));
+        acceptors_.push_back(loopback_);
         threads_.resize(nbThreads);
         try {
           auto s_comm = std::make_shared<AsioBasicComm>(io_context_, s_ip_addr, s_port);
@@ -74,6 +108,8 @@ namespace oef {
           logger.error("CoreServer::CoreServer error while initializing OefSearchClient {}", e.what());
           stop();
         }
+        watch_search_link();
+        snapshot_metrics();
       }
       
       CoreServer(const CoreServer &) = delete;
@@ -84,13 +120,69 @@ namespace oef {
       void run_in_thread() override;
       size_t nb_agents() const override { return agentDirectory_.size(); }
       void stop() override;
+      /* Back agents registrations with the journal at `path`. Call before run() */
+      void open_journal(const std::string &path);
+      /* Also accept agents on the Unix domain socket at `path`. Call before run() */
+      void listen_local(const std::string &path);
+      /* Also accept agents through the shared memory transport, set up on the Unix domain socket at `path`.
+       * Call before run() */
+      void listen_shm(const std::string &path, ShmComm::Options options = ShmComm::Options{});
+      /* Serve the TCP agents through io_uring rather than the asio reactor. Falls back to the asio reactor,
+       * and returns false, when the kernel lacks io_uring or one of the features used. Call before run() */
+      bool use_io_uring(IoUring::Options options = IoUring::Options{});
+      /* Water marks of the messages queued to each agent, and what to do with slow consumers. Call before run() */
+      void outbound_limits(OutboundLimits limits) { outbound_limits_ = limits; }
+      /* Rates each agent is held to, per class of operation. Call before run() */
+      void rate_limits(RateLimits limits) { rate_limits_ = limits; }
+      /* Process the messages agents send each other on `nb_threads` threads of their own, so that a flood
+       * of them does not hold up handshakes, registrations and searches. 0 processes them with the rest.
+       * Call before run() */
+      void bulk_lane(uint32_t nb_threads) { bulk_threads_.resize(nb_threads); }
+      /* Serve the admin commands on `address`:`port`, from its own thread */
+      void open_admin(uint32_t port = static_cast<uint32_t>(config::Ports::ServiceDiscovery),
+          const std::string &address = config::default_ip);
+      /* Latest periodic metrics snapshot, or what was accumulated during the last period only */
+      MetricsSnapshot metrics(bool interval = false) const;
+      /* In process transport, for the lifetime of the server: agents connect with loopback()->connect() */
+      const std::shared_ptr<LoopbackAcceptor> &loopback() const { return loopback_; }
+#ifdef OEF_CORE_COROUTINES
+      /* Handshake and serve the agents with coroutines (the default), or with callbacks. Call before run() */
+      void use_coroutines(bool coroutines) { coroutines_ = coroutines; }
+      /* Where the frames of the handshake coroutines come from */
+      const std::shared_ptr<FramePool> &frame_pool() const { return frames_; }
+#endif
+      /* Handshake and serve an agent connected through another transport than the TCP acceptor */
+      void process_agent_connection(const std::shared_ptr<communicator_t> communicator) override {
+        newSession(communicator);
+      }
     private:
       void do_accept(CommunicatorContinuation continuation) override;
-      void process_agent_connection(const std::shared_ptr<communicator_t> communicator) override {}
       void do_accept();
+      void do_accept(comm_acceptor_t &acceptor); // owned by acceptors_
+      /* Start the bulk_lane() threads */
+      void run_bulk_lane();
       
       void newSession(std::shared_ptr<communicator_t> comm);
-      void secretHandshake(const std::string &publicKey, std::shared_ptr<communicator_t> comm);
+      void secretHandshake(const std::string &publicKey, bool batching, bool pipelined, std::shared_ptr<communicator_t> comm,
+          std::chrono::steady_clock::time_point start);
+#ifdef OEF_CORE_COROUTINES
+      /* newSession() and secretHandshake() as a coroutine */
+      Detached handshake(std::shared_ptr<communicator_t> comm);
+#endif
+      /* Steps shared by both handshakes. Parse the ID of a new connection into `id`, false if it is
+       * invalid or its agent is connected already, the connection being answered so */
+      bool accept_id(const Buffer &buffer, communicator_t &comm, fetch::oef::pb::Agent_Server_ID &id);
+      /* Check the `answer` of the agent, then create, register and start its session */
+      void start_session(const Buffer &answer, const std::string &publicKey, bool batching, bool coroutines,
+          const std::shared_ptr<communicator_t> &comm, std::chrono::steady_clock::time_point start);
+      /* Handshake messages never change, they are serialized once */
+      static const std::shared_ptr<Buffer> &phrase_buffer();
+      static const std::shared_ptr<Buffer> &phrase_failure_buffer();
+      static const std::shared_ptr<Buffer> &connected_buffer(bool status);
+      /* Periodically reconnect the OEF Search link if it dropped */
+      void watch_search_link();
+      /* Every config::metrics_snapshot_interval_ms */
+      void snapshot_metrics();
     };
 } // oef
 } // fetch
@@ -0,0 +1,177 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#ifdef OEF_CORE_COROUTINES
+
+#include "config.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+    /*
+     * Recycles the frames of the coroutines of one owner (an AgentSession, the CoreServer handshakes).
+     * Frames up to `block` bytes are taken from, and given back to, a free list of at most `kept` blocks.
+     * Larger frames, and frames without a pool, come from the heap.
+     * Each frame holds its pool, which therefore outlives the owner of the coroutine if needed.
+     */
+    class FramePool {
+    private:
+      mutable std::mutex lock_;
+      std::vector<void*> free_;
+      const std::size_t block_;
+      const std::size_t kept_;
+
+    public:
+      explicit FramePool(std::size_t block = config::coroutine_frame_size,
+          std::size_t kept = config::coroutine_frames_kept)
+        : block_{block}, kept_{kept} {}
+      FramePool(const FramePool &) = delete;
+      FramePool operator=(const FramePool &) = delete;
+      ~FramePool();
+
+      /* Free blocks */
+      std::size_t kept() const;
+
+      static void *allocate(std::shared_ptr<FramePool> pool, std::size_t size);
+      static void deallocate(void *frame);
+    };
+
+    /*
+     * Fire and forget coroutine: it runs until its first suspension when called, then is resumed by
+     * the completions it awaits, and frees itself when done.
+     * When its first parameter (`*this` for a member function) has a frame_pool(), its frame is
+     * allocated from that pool.
+     */
+    struct Detached {
+      struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() { throw; } // as from a callback: to whoever resumed the coroutine
+
+        template <typename Owner, typename... Args>
+        static void *operator new(std::size_t size, Owner &owner, Args &...) {
+          if constexpr(requires { owner.frame_pool(); }) {
+            return FramePool::allocate(owner.frame_pool(), size);
+          } else {
+            return FramePool::allocate(nullptr, size);
+          }
+        }
+        static void *operator new(std::size_t size) {
+          return FramePool::allocate(nullptr, size);
+        }
+        static void operator delete(void *frame) {
+          FramePool::deallocate(frame);
+        }
+      };
+    };
+
+    /*
+     * Awaits an asynchronous operation taking a continuation(std::error_code, Value), such as
+     * communicator_t::receive_async or the OefSearchClient requests:
+     *   std::tie(ec, buffer) = co_await completion<std::shared_ptr<Buffer>>([&](auto continuation) {
+     *       comm->receive_async(std::move(continuation)); });
+     * The continuation only refers to the awaiter, it is stored inline. It may be called from any
+     * thread, before the operation is even started. If it is dropped without being called, the
+     * awaiting coroutine is destroyed, as a dropped callback would release what it holds.
+     */
+    template <typename Value, typename Initiate>
+    class Completion {
+    private:
+      Initiate initiate_;
+      std::coroutine_handle<> handle_;
+      std::error_code ec_;
+      Value value_{};
+      bool dropped_{false};
+      std::atomic<bool> ready_{false}; // set by the first of await_suspend and the continuation
+
+      void complete() {
+        if(ready_.exchange(true, std::memory_order_acq_rel)) {
+          if(dropped_) {
+            handle_.destroy();
+          } else {
+            handle_.resume();
+          }
+        }
+      }
+
+      class Resume {
+      private:
+        Completion *completion_;
+      public:
+        explicit Resume(Completion *completion) noexcept : completion_{completion} {}
+        Resume(Resume &&other) noexcept : completion_{other.completion_} {
+          other.completion_ = nullptr;
+        }
+        Resume(const Resume &) = delete;
+        Resume &operator=(const Resume &) = delete;
+        ~Resume() {
+          if(completion_) {
+            completion_->dropped_ = true;
+            completion_->complete();
+          }
+        }
+        void operator()(std::error_code ec, Value value) {
+          Completion *completion = completion_;
+          completion_ = nullptr;
+          completion->ec_ = ec;
+          completion->value_ = std::move(value);
+          completion->complete();
+        }
+      };
+
+    public:
+      explicit Completion(Initiate initiate) : initiate_{std::move(initiate)} {}
+
+      bool await_ready() const noexcept { return false; }
+      bool await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        initiate_(Resume{this});
+        if(!ready_.exchange(true, std::memory_order_acq_rel)) {
+          return true; // the continuation resumes it
+        }
+        if(dropped_) {
+          handle.destroy();
+          return true;
+        }
+        return false; // completed already
+      }
+      std::pair<std::error_code,Value> await_resume() {
+        return {ec_, std::move(value_)};
+      }
+    };
+
+    template <typename Value, typename Initiate>
+    Completion<Value,Initiate> completion(Initiate initiate) {
+      return Completion<Value,Initiate>{std::move(initiate)};
+    }
+} // oef
+} // fetch
+
+#endif
@@ -17,9 +17,13 @@
 //
 //------------------------------------------------------------------------------
 
+#include "async_logger.hpp"
+
 #include <spdlog/fmt/ostr.h>
 #include <spdlog/spdlog.h>
+#include <ostream>
 #include <string>
+#include <vector>
 
 enum class LogLevel {trace = spdlog::level::level_enum::trace,
                      debug = spdlog::level::level_enum::debug,
@@ -41,8 +45,10 @@ enum class LogLevel {trace = spdlog::level::level_enum::trace,
 #else
 #define TRACE(logger, ...)
 #endif
-#ifdef DEBUG_ON
-#define DEBUG(logger, ...) logger.debug(__VA_ARGS__)
+// DEBUG arguments are only evaluated when the section of `logger` is at debug level or lower.
+// Define DEBUG_OFF to compile them out.
+#ifndef DEBUG_OFF
+#define DEBUG(logger, ...) do { if((logger).enabled(LogLevel::debug)) { (logger).debug(__VA_ARGS__); } } while(0)
 //#define DEBUG_IF(logger, flag, ...) logger.debug_if(flag, __VA_ARGS__)
 #else
 #define DEBUG(logger, ...)
@@ -50,21 +56,60 @@ enum class LogLevel {trace = spdlog::level::level_enum::trace,
 
 namespace fetch {
   namespace oef {
+    /*
+     * Argument rendered only if the message is actually logged, for expensive renderings:
+     *   logger.debug("received {}", lazy([&msg]() { return pbs::to_string(msg); }));
+     */
+    template <typename F>
+    class Lazy {
+    private:
+      F render_;
+    public:
+      explicit Lazy(F render) : render_{std::move(render)} {}
+      friend std::ostream &operator<<(std::ostream &os, const Lazy &l) {
+        return os << l.render_();
+      }
+    };
+
+    template <typename F>
+    Lazy<F> lazy(F render) {
+      return Lazy<F>{std::move(render)};
+    }
+
+    /*
+     * Each section logs through its own spdlog logger, named after the section and sharing the
+     * same sinks, so that the section is printed by the pattern (%n) instead of being prepended
+     * to every message, and its level can be changed at runtime independently of the others.
+     * The level is checked before anything is formatted. Once the AsyncLogger is started,
+     * records are formatted and written by its thread instead of the calling one.
+     */
     class Logger {
-      static constexpr const char * const logger_name = "fetch::oef::logger";
     private:
       std::string section_{""};
       std::shared_ptr<spdlog::logger> logger_{nullptr};
+      uint16_t section_id_{0};
     public:
       explicit Logger(std::string section);
       
       std::string section() const noexcept { return section_; }
+
+      bool enabled(const LogLevel level) const noexcept {
+        return logger_->should_log(static_cast<spdlog::level::level_enum>(level));
+      }
       
+      /* `fmt` must be a string literal (or outlive the process logging): once started, the
+       * AsyncLogger identifies formats by address, see AsyncLogger::format_id() */
       template <typename Arg1, typename... Args>
       void log(const LogLevel level, const char *fmt, const Arg1 &arg1, const Args &... args) {
-        auto new_fmt = "[{}] " + std::string(fmt);
-        logger_->log(static_cast<spdlog::level::level_enum>(level), new_fmt.c_str(), section(),
-                     arg1, args...);
+        auto lvl = static_cast<spdlog::level::level_enum>(level);
+        if(!logger_->should_log(lvl)) {
+          return;
+        }
+        if(AsyncLogger::started()) {
+          AsyncLogger::push(lvl, section_id_, fmt, arg1, args...);
+          return;
+        }
+        logger_->log(lvl, fmt, arg1, args...);
       }
 
       template <typename Arg1, typename... Args>
@@ -127,10 +172,17 @@ namespace fetch {
         critical("{}", arg1);
       }
 
+      /* Set the level of all sections */
       static void level(const LogLevel level) noexcept {
         spdlog::set_level(static_cast<spdlog::level::level_enum>(level));
       }
-
+      /* Set the level of one section, returns false if there is no such section */
+      static bool level(const std::string &section, const LogLevel level);
+      /* Level name of one section, empty if there is no such section */
+      static std::string level(const std::string &section);
+      /* Parse a level name (trace, debug, info, warn, error, critical, off) */
+      static bool parse_level(const std::string &name, LogLevel &level);
+      static std::vector<std::string> sections();
     };
   } // namespace oef
 } // namespace fetch
@@ -0,0 +1,139 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "api/basic_communicator_t.hpp"
+#include "api/communicator_acceptor_t.hpp"
+#include "api/communicator_t.hpp"
+
+#include "asio.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+    /*
+     * In process transports, for tests and benchmarks: both ends of a connection live in the same
+     * process and exchange buffers through memory, no socket nor system call involved.
+     * As with asio, continuations never run from the call which starts an operation, they are
+     * posted to the io_context of the end which started it. With single threaded io_contexts,
+     * runs are deterministic.
+     * Closing one end (disconnect(), or destruction) fails the pending and further receives of the
+     * other end with asio::error::eof, once what was sent before is received, and its sends with
+     * asio::error::broken_pipe.
+     */
+
+    /* One end of an in memory duplex connection carrying whole frames. Frames are handed over
+     * without copies: a buffer must not be modified once sent. */
+    class LoopbackComm : public communicator_t {
+    public:
+      struct Pipe; // one direction of the connection
+
+      LoopbackComm(asio::io_context &io_context, std::shared_ptr<Pipe> in, std::shared_ptr<Pipe> out)
+        : io_context_(io_context), in_{std::move(in)}, out_{std::move(out)} {}
+      LoopbackComm(const LoopbackComm &) = delete;
+      LoopbackComm operator=(const LoopbackComm &) = delete;
+      ~LoopbackComm() {
+        disconnect();
+      }
+
+      /* Connected ends, the continuations of each one running on its io_context */
+      static std::pair<std::shared_ptr<LoopbackComm>,std::shared_ptr<LoopbackComm>> pair(
+          asio::io_context &first, asio::io_context &second);
+
+      void connect() override {}
+      void disconnect() override;
+      //
+      std::error_code send_sync(std::shared_ptr<Buffer> buffer) override;
+      std::error_code send_sync(std::vector<std::shared_ptr<Buffer>> buffers) override;
+      /* Blocks until a frame is received, don't call it from the io_context of the other end */
+      std::error_code receive_sync(std::shared_ptr<Buffer>& buffer) override;
+      //
+      void send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) override;
+      void send_async(std::shared_ptr<Buffer> buffer) override;
+      void send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) override;
+      void receive_async(BufferContinuation continuation) override;
+
+    private:
+      asio::io_context &io_context_;
+      std::shared_ptr<Pipe> in_;
+      std::shared_ptr<Pipe> out_;
+    };
+
+    /* One end of an in memory duplex byte stream, e.g. the OefSearchClient link to an OEF Search */
+    class LoopbackBasicComm : public basic_communicator_t {
+    public:
+      struct Pipe;
+
+      LoopbackBasicComm(asio::io_context &io_context, std::shared_ptr<Pipe> in, std::shared_ptr<Pipe> out)
+        : io_context_(io_context), in_{std::move(in)}, out_{std::move(out)} {}
+      LoopbackBasicComm(const LoopbackBasicComm &) = delete;
+      LoopbackBasicComm operator=(const LoopbackBasicComm &) = delete;
+      ~LoopbackBasicComm() {
+        disconnect();
+      }
+
+      static std::pair<std::shared_ptr<LoopbackBasicComm>,std::shared_ptr<LoopbackBasicComm>> pair(
+          asio::io_context &first, asio::io_context &second);
+
+      /* A closed in process connection can't be reestablished: throws if closed */
+      void connect() override;
+      void disconnect() override;
+      //
+      std::error_code send_sync(const void* buffer, std::size_t nbytes) override;
+      std::error_code send_sync(std::vector<void*> buffers, std::vector<std::size_t> nbytes) override;
+      /* Blocks until nbytes are received, don't call it from the io_context of the other end */
+      std::error_code receive_sync(void* buffer, const std::size_t& nbytes) override;
+      //
+      void send_async(std::vector<std::shared_ptr<Buffer>> buffers, std::vector<std::size_t> nbytes,
+                      LengthContinuation continuation) override;
+      void send_async(std::shared_ptr<Buffer> buffer, std::size_t nbytes, LengthContinuation continuation) override;
+      void receive_async(std::size_t nbytes, BufferContinuation continuation) override;
+
+    private:
+      asio::io_context &io_context_;
+      std::shared_ptr<Pipe> in_;
+      std::shared_ptr<Pipe> out_;
+    };
+
+    /* Accepts LoopbackComm connections made with connect() */
+    class LoopbackAcceptor : public comm_acceptor_t {
+    public:
+      /* Accepted ends run their continuations on `io_context` */
+      explicit LoopbackAcceptor(asio::io_context &io_context) : io_context_(io_context) {}
+      LoopbackAcceptor(const LoopbackAcceptor &) = delete;
+      LoopbackAcceptor operator=(const LoopbackAcceptor &) = delete;
+
+      void do_accept_async(CommunicatorContinuation continuation) override;
+      /* Connect to the acceptor. The returned end runs its continuations on `io_context`.
+       * Connections are queued until accepted. */
+      std::shared_ptr<LoopbackComm> connect(asio::io_context &io_context);
+
+    private:
+      asio::io_context &io_context_;
+      std::mutex lock_;
+      std::deque<CommunicatorContinuation> accepting_;
+      std::deque<std::shared_ptr<communicator_t>> backlog_;
+    };
+} // oef
+} // fetch
@@ -0,0 +1,159 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Process wide metrics. Like loggers, metrics are usually static members of the class they
+   * instrument, registered by name (and optional Prometheus labels) when constructed:
+   *   fetch::oef::Counter AgentSession::routed_messages{"oef_routed_messages_total", "", "..."};
+   * Updates are lock-free atomics on shards: threads are assigned shards round robin, 16 per
+   * counter (one cache line each) and 8 per histogram, so that past 16 (or 8) threads several
+   * threads share, and contend on, a shard. Metrics::snapshot() sums the shards.
+   */
+  class Metric {
+  public:
+    enum class Type { Counter, Gauge, Histogram };
+
+    Metric(Type type, std::string name, std::string labels, std::string help);
+    Metric(const Metric &) = delete;
+    Metric operator=(const Metric &) = delete;
+    virtual ~Metric();
+
+    Type type() const { return type_; }
+    const std::string &name() const { return name_; }
+    const std::string &labels() const { return labels_; }
+    const std::string &help() const { return help_; }
+
+  protected:
+    static constexpr std::size_t nb_shards = 16;
+    /* Shard of the calling thread */
+    static std::size_t shard();
+
+  private:
+    const Type type_;
+    const std::string name_;
+    const std::string labels_; // e.g. operation="update"
+    const std::string help_;
+  };
+
+  class Counter : public Metric {
+  private:
+    struct alignas(64) Shard { std::atomic<uint64_t> value{0}; };
+    std::array<Shard,nb_shards> shards_;
+  public:
+    explicit Counter(std::string name, std::string labels = "", std::string help = "")
+      : Metric{Type::Counter, std::move(name), std::move(labels), std::move(help)} {}
+
+    void inc(uint64_t n = 1) { shards_[shard()].value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const;
+  };
+
+  class Gauge : public Metric {
+  private:
+    std::atomic<int64_t> value_{0};
+  public:
+    explicit Gauge(std::string name, std::string labels = "", std::string help = "")
+      : Metric{Type::Gauge, std::move(name), std::move(labels), std::move(help)} {}
+
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+  };
+
+  /*
+   * Log-linear histogram of non negative integer values (typically microseconds), in the
+   * spirit of HDR histograms: each power of two is split in 16 buckets, so that any recorded
+   * value is known within 1/16th. Values up to 2^40 are recorded, larger ones are clamped.
+   */
+  class Histogram : public Metric {
+  public:
+    static constexpr uint32_t sub_bits = 4;
+    static constexpr uint32_t max_bits = 40;
+    static constexpr std::size_t nb_buckets = (max_bits - sub_bits + 1) << sub_bits;
+
+    explicit Histogram(std::string name, std::string labels = "", std::string help = "")
+      : Metric{Type::Histogram, std::move(name), std::move(labels), std::move(help)}
+      , shards_{new Shard[nb_histogram_shards]} {}
+
+    void observe(uint64_t value);
+    /* Record the microseconds elapsed since `start` */
+    void observe_since(std::chrono::steady_clock::time_point start) {
+      observe(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start).count()));
+    }
+    /* Bucket counts, count and sum over all shards */
+    void collect(std::vector<uint64_t> &buckets, uint64_t &count, uint64_t &sum) const;
+
+    static std::size_t bucket(uint64_t value);
+    /* Highest value recorded in `bucket` */
+    static uint64_t upper_bound(std::size_t bucket);
+
+  private:
+    static constexpr std::size_t nb_histogram_shards = 8;
+    struct Shard { // large enough for false sharing not to matter
+      std::atomic<uint64_t> count{0};
+      std::atomic<uint64_t> sum{0};
+      std::array<std::atomic<uint64_t>,nb_buckets> buckets{};
+    };
+    std::unique_ptr<Shard[]> shards_;
+  };
+
+  struct MetricValue {
+    Metric::Type type;
+    std::string name;
+    std::string labels;
+    std::string help;
+    int64_t value{0};  // counters and gauges
+    uint64_t count{0}; // histograms
+    uint64_t sum{0};
+    std::vector<uint64_t> buckets;
+
+    /* Value under which a fraction q of the histogram values are */
+    uint64_t quantile(double q) const;
+  };
+
+  struct MetricsSnapshot {
+    std::chrono::system_clock::time_point time;
+    std::vector<MetricValue> metrics;
+
+    /* Counters and histograms accumulated since `previous`, gauges as they are now */
+    MetricsSnapshot since(const MetricsSnapshot &previous) const;
+    const MetricValue *find(const std::string &name, const std::string &labels = "") const;
+  };
+
+  class Metrics {
+  public:
+    /* All registered metrics, sorted by name */
+    static MetricsSnapshot snapshot();
+  private:
+    friend class Metric;
+    static void add(Metric *metric);
+    static void remove(Metric *metric);
+  };
+} // oef
+} // fetch
@@ -0,0 +1,109 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "compiled_query.hpp"
+#include "logger.hpp"
+
+#include "search_query.pb.h"
+#include "search_remove.pb.h"
+#include "search_response.pb.h"
+#include "search_transport.pb.h"
+#include "search_update.pb.h"
+
+#include "asio.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Stand-in for an OEF Search node, speaking the search_transport.proto framing:
+   *   [u32 header length][u32 body length] (network order) TransportHeader body
+   * Registrations (update / remove) are kept in an in-memory index, searches are evaluated
+   * against it. Answers can be delayed (latency plus uniform jitter), failed at random, and
+   * padded with synthetic agents to produce larger result sets.
+   * As with the OEF Search, a remove of a data model removes it for all agents of the core.
+   */
+  class MockSearch {
+  public:
+    struct Options {
+      uint32_t port = 0;                          // 0 for any free port, see port()
+      uint32_t threads = 1;
+      std::chrono::microseconds latency{0};       // added to every answer
+      std::chrono::microseconds jitter{0};        // uniformly distributed in [0, jitter)
+      double error_rate = 0.;                     // fraction of requests answered unsuccessfully
+      uint32_t extra_results = 0;                 // synthetic agents added to every search result
+      uint32_t max_results = 0;                   // agents per search result, 0 for no limit
+      uint64_t seed = 42;
+    };
+
+    explicit MockSearch(Options options);
+    MockSearch(const MockSearch &) = delete;
+    MockSearch operator=(const MockSearch &) = delete;
+    ~MockSearch();
+
+    uint32_t port() const { return acceptor_.local_endpoint().port(); }
+    void stop();
+    /* Registered data model instances */
+    std::size_t size() const;
+    uint64_t requests() const { return requests_.load(std::memory_order_relaxed); }
+    uint64_t errors() const { return errors_.load(std::memory_order_relaxed); }
+
+    /* Answer (header and body) to one request, no delay nor errors */
+    std::pair<fetch::oef::pb::TransportHeader,std::string> answer(const fetch::oef::pb::TransportHeader &header,
+        const std::string &body);
+
+  private:
+    class Session;
+    struct Registration {
+      std::string agent;
+      Instance instance;
+    };
+    struct Core {
+      std::string ip;
+      uint32_t port = 0;
+      std::vector<Registration> registrations;
+    };
+
+    const Options options_;
+    asio::io_context io_context_;
+    asio::ip::tcp::acceptor acceptor_;
+    std::vector<std::thread> threads_;
+    mutable std::mutex lock_;
+    std::unordered_map<std::string,Core> cores_;
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> errors_{0};
+    std::atomic<uint64_t> sessions_{0};
+
+    static fetch::oef::Logger logger;
+
+    void do_accept();
+    fetch::oef::pb::UpdateResponse update_(const fetch::oef::pb::Update &update);
+    fetch::oef::pb::RemoveResponse remove_(const fetch::oef::pb::Remove &remove);
+    fetch::oef::pb::SearchResponse search_(const fetch::oef::pb::SearchQuery &query);
+  };
+} // oef
+} // fetch
@@ -0,0 +1,83 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include <atomic>
+#include <utility>
+
+namespace fetch {
+namespace oef {
+    /*
+     * Unbounded multi-producer single-consumer queue (Vyukov's intrusive node queue). push() is
+     * wait-free: one exchange, from any thread. pop() belongs to a single consumer at a time, which
+     * may see the queue empty for a moment while a producer is between its exchange and its link:
+     * a consumer knowing an element is there (counted elsewhere) retries.
+     * One allocation per element, the first node is part of the queue.
+     */
+    template <typename T>
+    class MpscQueue {
+    private:
+      struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+      };
+
+      Node stub_;
+      std::atomic<Node*> head_; // last pushed
+      Node *tail_;              // consumed, its value moved out already
+
+      void release(Node *node) {
+        if(node != &stub_) {
+          delete node;
+        }
+      }
+
+    public:
+      MpscQueue() : head_{&stub_}, tail_{&stub_} {}
+      MpscQueue(const MpscQueue &) = delete;
+      MpscQueue operator=(const MpscQueue &) = delete;
+      ~MpscQueue() {
+        while(tail_) {
+          Node *next = tail_->next.load(std::memory_order_relaxed);
+          release(tail_);
+          tail_ = next;
+        }
+      }
+
+      void push(T value) {
+        Node *node = new Node{};
+        node->value = std::move(value);
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+      }
+
+      /* Consumer only. False when empty, or when the next element is not linked yet */
+      bool pop(T &value) {
+        Node *next = tail_->next.load(std::memory_order_acquire);
+        if(!next) {
+          return false;
+        }
+        value = std::move(next->value);
+        release(tail_);
+        tail_ = next;
+        return true;
+      }
+    };
+} // oef
+} // fetch
@@ -20,6 +20,10 @@
 #include "api/continuation_t.hpp"
 #include "api/oef_search_response_t.hpp"
 
+#include "tracing.hpp"
+
+#include <chrono>
+
 namespace fetch {
 namespace oef {
   struct MsgHandle {
@@ -33,18 +37,29 @@ namespace oef {
       , agent_id{"NoOne"}
     {}
     explicit MsgHandle(std::string op, AgentSessionContinuation cont)
-      : operation{op}, continuation{cont}
+      : operation{std::move(op)}, continuation{std::move(cont)}
     {}
     explicit MsgHandle(std::string op, AgentSessionContinuation cont, 
         uint32_t amsg_id, const std::string& agent = "")
-      : operation{op}, continuation{cont}, amsg_id{amsg_id}, agent_id{agent}
+      : operation{std::move(op)}, continuation{std::move(cont)}, amsg_id{amsg_id}, agent_id{agent}
     {}
+    MsgHandle(MsgHandle&&) = default;
+    MsgHandle& operator=(MsgHandle&&) = default;
+    /* The continuation is moved out of the handle by the answer, a copy describes the request only */
+    MsgHandle describe() const {
+      MsgHandle handle{operation, nullptr, amsg_id, agent_id};
+      handle.created = created;
+      handle.trace = trace;
+      return handle;
+    }
     //
     std::string operation;
     AgentSessionContinuation continuation;
     // not needed, only for debug
     uint32_t amsg_id;
     std::string agent_id;
+    std::chrono::steady_clock::time_point created{std::chrono::steady_clock::now()};
+    std::shared_ptr<Trace> trace{Tracer::current()}; // of the agent frame which caused the request
   };
   
 } //oef
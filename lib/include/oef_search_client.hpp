@@ -17,12 +17,15 @@
 //
 //------------------------------------------------------------------------------
 
+#include "api/basic_communicator_t.hpp"
 #include "api/oef_search_client_t.hpp"
 
 #include "agent_directory.hpp"
 #include "asio_basic_communicator.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
 #include "msg_handle.hpp"
+#include "registration_ledger.hpp"
 
 #include "search_message.pb.h"
 #include "search_query.pb.h"
@@ -31,6 +34,8 @@
 #include "search_update.pb.h"
 #include "search_transport.pb.h"
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <unordered_map>
 
@@ -39,31 +44,67 @@ namespace oef {
   class OefSearchClient : public oef_search_client_t {
   private:
     mutable std::mutex lock_;
-    std::shared_ptr<AsioBasicComm> comm_;
+    std::shared_ptr<basic_communicator_t> comm_;
     std::string core_ip_addr_;
     uint32_t core_port_ ;
     std::string core_id_;
     bool updated_address_;
     std::unordered_map<uint32_t, MsgHandle> handles_;
     mutable std::mutex handles_lock_;
+    RegistrationLedger ledger_;
+    std::atomic<bool> connected_;
+    std::atomic<bool> connecting_;
+    std::atomic<uint32_t> resync_id_;
 
     static fetch::oef::Logger logger;
+    static fetch::oef::Gauge pending_requests;
+    static fetch::oef::Histogram rtt_update;
+    static fetch::oef::Histogram rtt_remove;
+    static fetch::oef::Histogram rtt_search_local;
+    static fetch::oef::Histogram rtt_search_wide;
   public:
-    explicit OefSearchClient(std::shared_ptr<AsioBasicComm> comm, const std::string& core_id, 
+    explicit OefSearchClient(std::shared_ptr<basic_communicator_t> comm, const std::string& core_id, 
         const std::string& core_ip_addr, uint32_t core_port)
         : comm_(std::move(comm))
         , core_ip_addr_{core_ip_addr}
         , core_port_{core_port}
         , core_id_{core_id}
         , updated_address_{true}
+        , connected_{true}
+        , connecting_{false}
+        , resync_id_{0}
     {
       handle_messages();
     }
     
     virtual ~OefSearchClient() {}
     
-    /* TODO */
-    void connect() override {};
+    /* Reconnect to the OEF Search, then resynchronize it with the registrations ledger. Throws on failure */
+    void connect() override;
+    /* Same as connect(), without blocking the calling io thread: the resync runs once connected.
+     * Does nothing while a previous attempt is still going on */
+    void connect_async();
+    bool connected() const { return connected_; }
+    /* Requests waiting for an answer from the OEF Search, by search message id */
+    std::vector<std::pair<uint32_t,MsgHandle>> pending() const {
+      std::lock_guard<std::mutex> lock(handles_lock_);
+      std::vector<std::pair<uint32_t,MsgHandle>> pending;
+      pending.reserve(handles_.size());
+      for(auto &handle : handles_) {
+        pending.emplace_back(handle.first, handle.second.describe());
+      }
+      return pending;
+    }
+    
+    /* Registrations ledger, optionally backed by a journal replayed at core restart */
+    void open_journal(const std::string& path) { ledger_.open_journal(path); }
+    const RegistrationLedger& ledger() const { return ledger_; }
+    /* Agent (re)connected: restore its registrations replayed from the journal, if any */
+    void agent_attached(const std::string& agent);
+    /* Agent disconnected: its registrations are kept, but won't be part of a resync until it reattaches */
+    void agent_detached(const std::string& agent) { ledger_.detach(agent); }
+    /* Forget the registrations of agents that did not reconnect in time */
+    std::size_t expire_detached(std::chrono::seconds max_detached) { return ledger_.expire(max_detached); }
 
     void register_description(const Instance& desc, const std::string& agent, uint32_t msg_id, AgentSessionContinuation continuation) override;
     void unregister_description(const Instance& desc, const std::string& agent, uint32_t msg_id, AgentSessionContinuation continuation) override;
@@ -81,6 +122,7 @@ namespace oef {
     void generate_update_add_naddr_(fetch::oef::pb::Update &update); // TOFIX to merge in generate_update_()
     pb::SearchQuery generate_search_(const QueryModel& query, uint32_t ttl);
     pb::Remove generate_remove_(const Instance& instance);
+    pb::Update generate_bulk_update_(const std::vector<RegistrationLedger::Entry>& entries);
     //
     /* check lib/proto/search_transport.proto for Oef Search communication protocol */
     void send_(std::shared_ptr<Buffer> header, std::shared_ptr<Buffer> payload, LengthContinuation continuation);
@@ -89,13 +131,22 @@ namespace oef {
     void schedule_rcv_callback_(uint32_t smsg_id, std::string operation, AgentSessionContinuation continuation, 
         uint32_t msg_id, const std::string& agent);
     void process_message_(pb::TransportHeader header, std::shared_ptr<Buffer> payload);
+    void resync_(const std::vector<RegistrationLedger::Entry>& entries, const std::string& reason);
+    /* Connection (re)established: listen to the OEF Search and resync it */
+    void reconnected_();
+    /* Request could not be sent: fail it, unless it was already answered */
+    void fail_(uint32_t smsg_id, std::error_code ec);
+    void fail_pending_(std::error_code ec);
     //
     void handle_messages() {
       logger.debug("::handles_messages listening for messages from Oef Search ...");
       receive_(
           [this](std::error_code ec, pb::TransportHeader header, std::shared_ptr<Buffer> payload) {
             if (ec) {
-              return; // TOFIX how to handle errors?
+              connected_ = false;
+              logger.error("::handle_messages connection to Oef Search lost : {}", ec.value());
+              fail_pending_(ec);
+              return;
             }
             process_message_(header, payload);
             handle_messages();
@@ -108,20 +159,21 @@ namespace oef {
         logger.error("::msg_handle_save a handle for msg_id {} is already registered. abort", smsg_id);
         return false;
       }
-      handles_[smsg_id] = handle;
+      handles_.emplace(smsg_id, std::move(handle));
+      pending_requests.set(int64_t(handles_.size()));
       return true;
     }
-    bool msg_handle_erase(uint32_t smsg_id) {
-      std::lock_guard<std::mutex> lock(handles_lock_);
-      return handles_.erase(smsg_id) == 1;
-    }
-    MsgHandle msg_handle_get(uint32_t smsg_id) {
+    /* Remove the handle of an answered request */
+    MsgHandle msg_handle_take(uint32_t smsg_id) {
       std::lock_guard<std::mutex> lock(handles_lock_);
       auto iter = handles_.find(smsg_id);
-      if(iter != handles_.end()) {
-        return iter->second;
+      if(iter == handles_.end()) {
+        return MsgHandle{smsg_id};
       }
-      return MsgHandle{smsg_id};
+      MsgHandle handle = std::move(iter->second);
+      handles_.erase(iter);
+      pending_requests.set(int64_t(handles_.size()));
+      return handle;
     }
   };
   
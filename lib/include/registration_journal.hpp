@@ -0,0 +1,75 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "api/buffer_t.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Append-only, memory-mapped journal of agents registrations.
+   * File layout: 8 bytes magic, then records of
+   *   [u32 record length][u8 op][u32 agent length][agent][serialized Query.Instance]
+   * A zero record length marks the end of the journal (the file is grown with zeros).
+   * Throws std::runtime_error if the file cannot be opened or mapped.
+   */
+  class RegistrationJournal {
+  public:
+    enum class Op : uint8_t { Add = 1, Remove = 2 };
+    using RecordVisitor = std::function<void(Op,const std::string&,const uint8_t*,std::size_t)>;
+
+    explicit RegistrationJournal(std::string path);
+    RegistrationJournal(const RegistrationJournal &) = delete;
+    RegistrationJournal operator=(const RegistrationJournal &) = delete;
+    ~RegistrationJournal();
+
+    /* Append a record, growing the mapping if needed */
+    void append(Op op, const std::string &agent, const Buffer &instance);
+    /* Visit all records, in order */
+    void replay(const RecordVisitor &visitor) const;
+    /* Flush the records to disk, waiting for it */
+    void sync();
+    /* Atomically replace the file at `path` with this journal, which is then at `path`. Used to
+     * compact a journal: the live entries are written to a new journal, synced, then renamed over
+     * the old one, so that a crash leaves either of them whole */
+    void rename(const std::string &path);
+
+    const std::string &path() const { return path_; }
+    /* Number of bytes used by records (header excluded) */
+    std::size_t size() const { return tail_ - header_size; }
+
+  private:
+    static constexpr std::size_t header_size = 8;
+    static constexpr std::size_t min_capacity = 1 << 20;
+
+    void map_(std::size_t capacity);
+    void unmap_();
+    std::size_t find_tail_() const;
+
+    std::string path_;
+    int fd_;
+    uint8_t *data_;
+    std::size_t capacity_;
+    std::size_t tail_;
+  };
+} // oef
+} // fetch
@@ -0,0 +1,99 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "registration_journal.hpp"
+#include "logger.hpp"
+#include "schema.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Record of the services and descriptions successfully registered to the OEF Search
+   * by this core's agents. It is used to resynchronize the OEF Search after it restarts,
+   * and, when backed by a journal, to restore agents registrations after the core restarts.
+   * Agents are attached while connected. Entries replayed from the journal stay detached
+   * until their agent reconnects; the entries of agents that stay detached longer than
+   * config::ledger_detached_expiry_s are forgotten by expire().
+   * The journal only grows while running: it is compacted again once its dead records outnumber
+   * the live ones config::ledger_compaction_ratio times.
+   */
+  class RegistrationLedger {
+  public:
+    using Entry = std::pair<std::string,Instance>;
+
+    RegistrationLedger() = default;
+    RegistrationLedger(const RegistrationLedger &) = delete;
+    RegistrationLedger operator=(const RegistrationLedger &) = delete;
+
+    using Clock = std::chrono::steady_clock;
+
+    /* Back the ledger with the journal at `path`: replay it then compact it to the live entries,
+     * written to `path`.tmp then renamed over `path` */
+    void open_journal(const std::string &path);
+    bool journaled() const;
+
+    void add(const std::string &agent, const Instance &instance);
+    void remove(const std::string &agent, const Instance &instance);
+    /* Mark `agent` as connected, returns its registrations */
+    std::vector<Instance> attach(const std::string &agent);
+    /* Mark `agent` as disconnected, its registrations are kept */
+    void detach(const std::string &agent);
+    /* Registrations of all attached agents */
+    std::vector<Entry> snapshot() const;
+    /* Number of registrations, attached or not */
+    std::size_t size() const;
+    /* Number of records in the journal, live or dead */
+    std::size_t journal_records() const;
+    /* Forget the registrations of agents detached for more than `max_detached`, returns the number
+     * of agents forgotten. They are not unregistered from the OEF Search, only no longer restored */
+    std::size_t expire(Clock::duration max_detached, Clock::time_point now = Clock::now());
+
+  private:
+    struct AgentRecord {
+      bool attached{false};
+      Clock::time_point detached_since;
+      std::unordered_set<Instance> instances;
+    };
+
+    void write_journal_(RegistrationJournal::Op op, const std::string &agent, const Instance &instance);
+    /* Write the live entries to `journal_path_`.tmp, renamed over `journal_path_` once on disk. lock_ held */
+    void compact_();
+    /* compact_() if dead records are above the thresholds. lock_ held */
+    void maybe_compact_();
+
+    mutable std::mutex lock_;
+    std::unordered_map<std::string,AgentRecord> agents_;
+    std::unique_ptr<RegistrationJournal> journal_;
+    std::string journal_path_;
+    std::size_t nb_live_ = 0;    // registrations in agents_
+    std::size_t nb_records_ = 0; // records in journal_
+
+    static fetch::oef::Logger logger;
+  };
+} // oef
+} // fetch
@@ -659,6 +659,13 @@ namespace fetch {
         }
         return stde::optional<VariantType>{iter->second};
       }
+      const VariantType *find(const std::string &name) const {
+        auto iter = values_.find(name);
+        if(iter == values_.end()) {
+          return nullptr;
+        }
+        return &iter->second;
+      }
     };
 
     class ConstraintExpr;
@@ -686,8 +693,8 @@ namespace fetch {
       }
       explicit Constraint(std::string attribute_name, const Distance &distance) : attribute_name_{std::move(attribute_name)} {
         constraint_.set_attribute_name(attribute_name_);
-        auto *s = constraint_.mutable_set_();
-        s->CopyFrom(distance.handle());
+        auto *d = constraint_.mutable_distance();
+        d->CopyFrom(distance.handle());
       }
       operator ConstraintExpr() const;
       const fetch::oef::pb::Query_ConstraintExpr_Constraint &handle() const { return constraint_; }
@@ -18,6 +18,7 @@
 //------------------------------------------------------------------------------
 
 #include "api/buffer_t.hpp"
+#include "logger.hpp"
 
 #include <google/protobuf/text_format.h>
 
@@ -37,12 +38,10 @@ T from_string(const std::string &s) {
 
 template <typename T>
 std::shared_ptr<Buffer> serialize(const T &t) {
-  size_t size = t.ByteSize();
-  Buffer data;
-  data.resize(size);
-  auto status = t.SerializeWithCachedSizesToArray(data.data());
-  std::cout << "Serialize size=" << size << ", response: "<<status << std::endl;
-  return std::make_shared<Buffer>(data);
+  size_t size = t.ByteSizeLong();
+  auto data = std::make_shared<Buffer>(size);
+  t.SerializeWithCachedSizesToArray(data->data());
+  return data;
 }
 
 template <typename T>
@@ -72,6 +71,19 @@ std::string to_string(const google::protobuf::Message &msg);
 
 std::string diagnostic(void *p, size_t sz);
 
+/* Lazy renderings for log arguments, only computed if the message is logged */
+inline auto text(const google::protobuf::Message &msg) {
+  return lazy([&msg]() { return to_string(msg); });
+}
+
+inline auto diagnostic(const Buffer &buffer) {
+  return lazy([&buffer]() { return diagnostic((void *)buffer.data(), buffer.size()); });
+}
+
+/* Append an already serialized message as the length-delimited field `field` of an enclosing
+ * message, e.g. to build a repeated field without parsing its elements again */
+void append_field(Buffer &frame, uint32_t field, const Buffer &message);
+
 } // pbs 
 
 std::shared_ptr<Buffer> serialize(uint32_t size);
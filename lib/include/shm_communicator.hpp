@@ -0,0 +1,179 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "api/communicator_acceptor_t.hpp"
+#include "api/communicator_t.hpp"
+#include "logger.hpp"
+
+#include "asio.hpp"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+    /*
+     * Shared memory transport, for agents running on the same host as the core.
+     * Each connection maps a segment holding, for each direction, a single producer single consumer
+     * ring of frames. Sending copies the frame into the ring, receiving copies it out: as long as
+     * the receiving end is busy, no system call is involved. An end which finds its ring empty
+     * sleeps on its eventfd, which the other end rings after its next send; the same goes for a
+     * sender waiting for room. Options::spin_us makes an end poll its empty ring before sleeping,
+     * trading CPU for latency: it pays off for an agent waiting on one connection, not for an
+     * io_context serving many, which a polling connection delays.
+     * Connections are set up through a Unix domain socket: the accepting end creates the segment
+     * (memfd) and both eventfds, and passes them to the connecting end. The socket then stays open
+     * for each end to notice the death of the other one.
+     * As with asio, continuations are posted to, or run from, the io_context of the end. Closing
+     * one end fails the receives of the other end with asio::error::eof, once what was sent before
+     * is received, and its sends with asio::error::broken_pipe.
+     * The segment is writable by the other end: the positions and sizes read from it are checked,
+     * an end finding them inconsistent disconnects and fails its receives with
+     * std::errc::protocol_error.
+     */
+    class ShmComm : public communicator_t, public std::enable_shared_from_this<ShmComm> {
+    public:
+      struct Options {
+        uint32_t capacity = 1 << 20; // bytes of each ring, rounded up to a power of two, set by the accepting end
+        uint32_t spin_us = 0;        // polling of an empty ring before sleeping
+      };
+
+      /*
+       * Frames are laid out as in the stream of AsioComm, size first, and wrap around the end of the
+       * ring. head and tail are byte counts since the connection was set up: they never wrap.
+       */
+      struct Ring {
+        alignas(64) std::atomic<uint64_t> head;            // written by the producer
+        alignas(64) std::atomic<uint64_t> tail;            // written by the consumer
+        alignas(64) std::atomic<uint32_t> reader_sleeping; // set by the consumer, cleared by the producer
+        std::atomic<uint32_t> writer_waiting;              // set by the producer, cleared by the consumer
+      };
+      /* Shared memory segment of a connection, followed by the data of its two rings */
+      struct Segment {
+        alignas(64) std::atomic<uint32_t> closed; // by either end
+        uint32_t capacity;                        // as set up, each end keeps its own copy
+        Ring rings[2];                            // from the connecting end, then to it
+
+        uint8_t *data(uint32_t ring, uint32_t capacity) {
+          return reinterpret_cast<uint8_t *>(this + 1) + std::size_t(ring) * capacity;
+        }
+        static std::size_t size(uint32_t capacity) {
+          return sizeof(Segment) + 2 * std::size_t(capacity);
+        }
+      };
+
+      /* Connect to the ShmAcceptor listening on `path`. Throws on failure */
+      static std::shared_ptr<ShmComm> connect(asio::io_context &io_context, const std::string &path,
+          Options options);
+      /* Set up the connection accepted on `socket`. Throws on failure */
+      static std::shared_ptr<ShmComm> accept(asio::io_context &io_context, 
+          asio::local::stream_protocol::socket socket, Options options);
+
+      /* Use connect() or accept() */
+      ShmComm(asio::io_context &io_context, asio::local::stream_protocol::socket socket, Segment *segment,
+          uint32_t capacity, bool accepting, int doorbell, int peer_doorbell, Options options);
+      ShmComm(const ShmComm &) = delete;
+      ShmComm operator=(const ShmComm &) = delete;
+      ~ShmComm();
+
+      void connect() override {}
+      void disconnect() override;
+      //
+      std::error_code send_sync(std::shared_ptr<Buffer> buffer) override;
+      std::error_code send_sync(std::vector<std::shared_ptr<Buffer>> buffers) override;
+      std::error_code receive_sync(std::shared_ptr<Buffer>& buffer) override;
+      //
+      void send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) override;
+      void send_async(std::shared_ptr<Buffer> buffer) override;
+      void send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) override;
+      void receive_async(BufferContinuation continuation) override;
+
+      /* The segment shared with the other end */
+      Segment &segment() { return *segment_; }
+
+    private:
+      void start();
+      void wait_doorbell();
+      void watch_peer();
+      /* Doorbell rung or peer gone: serve the pending receive, then the sends waiting for room */
+      void wake();
+      void flush();
+      bool closed() const;
+      /* Ring operations, pop() under in_lock_, push() under out_lock_. Both flag their end as
+       * waiting for the other one when they fail, or the segment as corrupt */
+      bool pop(std::shared_ptr<Buffer> &frame, bool spin);
+      bool push(const Buffer &frame);
+      /* The other end broke the ring protocol: the connection is to be disconnected */
+      void corrupted(const char *what, uint64_t head, uint64_t tail);
+      /* Error of receives failing for the connection being closed */
+      std::error_code read_error() const;
+      void notify_reader();
+      void notify_writer();
+
+      asio::io_context &io_context_;
+      asio::local::stream_protocol::socket socket_;
+      asio::posix::stream_descriptor doorbell_; // eventfd rung by the other end
+      int peer_doorbell_;
+      Segment *segment_;
+      const uint32_t capacity_; // as set up, segment_->capacity may be overwritten by the other end
+      uint32_t in_;  // ring we consume
+      uint32_t out_; // ring we produce
+      const Options options_;
+      std::atomic<bool> closed_{false};
+      std::atomic<bool> peer_gone_{false};
+      std::atomic<bool> corrupt_{false};
+
+      std::mutex in_lock_;
+      BufferContinuation reader_;
+      std::mutex out_lock_;
+      std::deque<std::pair<std::shared_ptr<Buffer>,LengthContinuation>> pending_; // waiting for room
+
+      static fetch::oef::Logger logger;
+    };
+
+    /* Accepts ShmComm connections on a Unix domain socket */
+    class ShmAcceptor : public comm_acceptor_t {
+    public:
+      /* Binds `path` as AsioLocalAcceptor does. Accepted ends run their continuations on `io_context` */
+      ShmAcceptor(asio::io_context &io_context, std::string path, ShmComm::Options options,
+          uint32_t backlog = 256);
+      ShmAcceptor(const ShmAcceptor &) = delete;
+      ShmAcceptor operator=(const ShmAcceptor &) = delete;
+      /* Removes the socket file */
+      ~ShmAcceptor();
+
+      void do_accept_async(CommunicatorContinuation continuation) override;
+      const std::string &path() const { return path_; }
+
+    private:
+      asio::io_context &io_context_;
+      asio::local::stream_protocol::acceptor acceptor_;
+      const std::string path_;
+      const ShmComm::Options options_;
+
+      static fetch::oef::Logger logger;
+    };
+} // oef
+} // fetch
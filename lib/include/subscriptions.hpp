@@ -0,0 +1,84 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "compiled_query.hpp"
+#include "logger.hpp"
+#include "schema.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Continuous queries of agents waiting for matching services to be registered.
+   * A subscription is identified by its agent and the msg_id of the subscribe envelope.
+   * Queries are compiled once, and indexed by data model name then, when they have one,
+   * by a top level string equality, so that a registration is only checked against
+   * the subscriptions it can possibly match.
+   */
+  class Subscriptions {
+  public:
+    /* agent, subscription id */
+    using Subscriber = std::pair<std::string,uint32_t>;
+
+    Subscriptions() = default;
+    Subscriptions(const Subscriptions &) = delete;
+    Subscriptions operator=(const Subscriptions &) = delete;
+
+    /* Returns false if the query isn't valid or the subscription already exists */
+    bool add(const std::string &agent, uint32_t id, const fetch::oef::pb::Query_Model &query);
+    bool remove(const std::string &agent, uint32_t id);
+    /* Remove all subscriptions of `agent`, returns how many */
+    std::size_t remove_all(const std::string &agent);
+    /* Subscribers whose query matches `instance` */
+    std::vector<Subscriber> match(const Instance &instance) const;
+    std::size_t size() const;
+
+  private:
+    struct Subscription {
+      std::string agent;
+      uint32_t id;
+      CompiledQuery query;
+    };
+    using SubscriptionPtr = std::shared_ptr<const Subscription>;
+    using SubscriptionSet = std::unordered_map<std::string,SubscriptionPtr>;
+    struct Bucket {
+      SubscriptionSet unindexed;
+      // attribute -> value -> subscriptions
+      std::unordered_map<std::string,std::unordered_map<std::string,SubscriptionSet>> equalities;
+    };
+
+    static std::string key_(const std::string &agent, uint32_t id) { return agent + "#" + std::to_string(id); }
+    void erase_(const SubscriptionPtr &subscription);
+    void match_(const Bucket &bucket, const Instance &instance, std::vector<Subscriber> &matches) const;
+
+    mutable std::mutex lock_;
+    std::unordered_map<std::string,Bucket> buckets_; // by data model name, "" for any
+    std::unordered_map<std::string,SubscriptionSet> agents_;
+    std::size_t size_{0};
+
+    static fetch::oef::Logger logger;
+  };
+} // oef
+} // fetch
@@ -0,0 +1,66 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <chrono>
+
+namespace fetch {
+namespace oef {
+    /*
+     * Token bucket: `rate` tokens per second, up to `burst` of them saved up, by default one second worth.
+     * take() never refuses: without a token, the bucket goes into debt, and the caller is told how long to
+     * wait until the debt is paid. A rate of 0 is unlimited. Not thread safe.
+     */
+    class TokenBucket {
+    public:
+      using Clock = std::chrono::steady_clock;
+    private:
+      double rate_;
+      double burst_;
+      double tokens_;
+      Clock::time_point last_;
+
+    public:
+      explicit TokenBucket(double rate = 0, double burst = 0, Clock::time_point now = Clock::now())
+        : rate_{rate}, burst_{burst > 0 ? burst : std::max(rate, 1.0)}, tokens_{burst_}, last_{now} {}
+
+      bool limited() const {
+        return rate_ > 0;
+      }
+
+      /* Take a token. Returns how long to wait before the next one, zero if the bucket is not in debt */
+      Clock::duration take(Clock::time_point now = Clock::now()) {
+        if(!limited()) {
+          return Clock::duration::zero();
+        }
+        if(now > last_) {
+          tokens_ = std::min(burst_, tokens_ + rate_ * std::chrono::duration<double>(now - last_).count());
+          last_ = now;
+        }
+        tokens_ -= 1;
+        if(tokens_ >= 0) {
+          return Clock::duration::zero();
+        }
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens_ / rate_));
+      }
+    };
+} // oef
+} // fetch
@@ -0,0 +1,130 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "config.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Timestamps of the stages of one sampled agent frame, from its reception to the writes it
+   * caused. The trace is shared by the continuations handling the frame, and recorded by the
+   * Tracer when the last of them releases it.
+   */
+  class Trace {
+  public:
+    enum class Stage : uint8_t {
+      FrameReceived, Parsed, DirectoryLookup, SearchSent, SearchReplyParsed, ResponseSerialized, WriteCompleted
+    };
+    struct Mark {
+      Stage stage;
+      uint64_t time;   // steady clock, nanoseconds
+      uint64_t thread;
+    };
+
+    Trace(uint64_t id, std::string agent) : id_{id}, agent_{std::move(agent)} {}
+    Trace(const Trace &) = delete;
+    Trace operator=(const Trace &) = delete;
+    ~Trace();
+
+    void mark(Stage stage);
+    /* What the frame was, e.g. its envelope payload */
+    void name(std::string name);
+
+    static const char *stage_name(Stage stage);
+  private:
+    const uint64_t id_;
+    const std::string agent_;
+    std::mutex lock_; // marks come from the agents and the OEF Search io threads
+    std::string name_;
+    std::vector<Mark> marks_;
+  };
+
+  struct TraceRecord {
+    uint64_t id;
+    std::string agent;
+    std::string name;
+    std::vector<Trace::Mark> marks;
+  };
+
+  /*
+   * Opt-in sampled tracing: one frame out of sample_every() is traced, the trace being the
+   * current one of the thread handling it (see TraceScope) so that the code it goes through can
+   * mark stages without passing it around. Finished traces are kept in a ring of the
+   * config::trace_ring_size latest ones, exported as Chrome trace events (chrome://tracing).
+   */
+  class Tracer {
+  public:
+    /* Trace one frame out of n, 0 disables tracing */
+    static void sample_every(uint32_t n) { sample_every_.store(n, std::memory_order_relaxed); }
+    static uint32_t sample_every() { return sample_every_.load(std::memory_order_relaxed); }
+    /* A new trace if this frame is sampled, nullptr otherwise */
+    static std::shared_ptr<Trace> sample(const std::string &agent) {
+      uint32_t n = sample_every_.load(std::memory_order_relaxed);
+      if(n == 0 || counter_.fetch_add(1, std::memory_order_relaxed) % n != 0) {
+        return nullptr;
+      }
+      return std::make_shared<Trace>(next_id_.fetch_add(1, std::memory_order_relaxed), agent);
+    }
+    static const std::shared_ptr<Trace> &current() { return current_; }
+    static void mark(Trace::Stage stage) {
+      if(current_) {
+        current_->mark(stage);
+      }
+    }
+
+    /* Finished traces, oldest first */
+    static std::vector<TraceRecord> traces();
+    static void clear();
+    static std::string chrome_json();
+
+  private:
+    friend class Trace;
+    friend class TraceScope;
+    static void record(TraceRecord record);
+
+    static std::atomic<uint32_t> sample_every_;
+    static std::atomic<uint32_t> counter_;
+    static std::atomic<uint64_t> next_id_;
+    static thread_local std::shared_ptr<Trace> current_;
+  };
+
+  /* Makes `trace` the current trace of the thread for the scope */
+  class TraceScope {
+  private:
+    std::shared_ptr<Trace> previous_;
+  public:
+    explicit TraceScope(std::shared_ptr<Trace> trace) : previous_{std::move(trace)} {
+      previous_.swap(Tracer::current_);
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope operator=(const TraceScope &) = delete;
+    ~TraceScope() {
+      previous_.swap(Tracer::current_);
+    }
+  };
+} // oef
+} // fetch
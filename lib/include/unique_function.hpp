@@ -0,0 +1,145 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace fetch {
+namespace oef {
+    /*
+     * Move-only std::function. Callables of up to `Capacity` bytes which move without throwing are
+     * stored inline, larger ones on the heap. A continuation capturing a few shared_ptrs and ids is
+     * therefore handed from one asynchronous hop to the next without allocating, and moved instead
+     * of copied (no reference count traffic for what it captures).
+     */
+    template <typename Signature, std::size_t Capacity = 64>
+    class UniqueFunction;
+
+    template <typename R, typename... Args, std::size_t Capacity>
+    class UniqueFunction<R(Args...), Capacity> {
+    private:
+      using Storage = typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type;
+      struct Operations {
+        R (*invoke)(Storage &, Args&&...);
+        void (*move)(Storage &from, Storage &to); // leaves `from` to be forgotten, not destroyed
+        void (*destroy)(Storage &);
+      };
+
+      template <typename F>
+      struct Inline {
+        static F &get(Storage &storage) { return *reinterpret_cast<F*>(&storage); }
+        static R invoke(Storage &storage, Args&&... args) { return get(storage)(std::forward<Args>(args)...); }
+        static void move(Storage &from, Storage &to) {
+          new(&to) F(std::move(get(from)));
+          get(from).~F();
+        }
+        static void destroy(Storage &storage) { get(storage).~F(); }
+        static const Operations *operations() {
+          static const Operations operations{&invoke, &move, &destroy};
+          return &operations;
+        }
+      };
+
+      template <typename F>
+      struct Heap {
+        static F *&get(Storage &storage) { return *reinterpret_cast<F**>(&storage); }
+        static R invoke(Storage &storage, Args&&... args) { return (*get(storage))(std::forward<Args>(args)...); }
+        static void move(Storage &from, Storage &to) { new(&to) F*(get(from)); }
+        static void destroy(Storage &storage) { delete get(storage); }
+        static const Operations *operations() {
+          static const Operations operations{&invoke, &move, &destroy};
+          return &operations;
+        }
+      };
+
+      template <typename F>
+      using fits = std::integral_constant<bool, sizeof(F) <= sizeof(Storage) && alignof(F) <= alignof(Storage)
+        && std::is_nothrow_move_constructible<F>::value>;
+
+      mutable Storage storage_;
+      const Operations *operations_ = nullptr;
+
+      template <typename F>
+      void store(F &&f, std::true_type) {
+        using Callable = typename std::decay<F>::type;
+        new(&storage_) Callable(std::forward<F>(f));
+        operations_ = Inline<Callable>::operations();
+      }
+      template <typename F>
+      void store(F &&f, std::false_type) {
+        using Callable = typename std::decay<F>::type;
+        new(&storage_) Callable*(new Callable(std::forward<F>(f)));
+        operations_ = Heap<Callable>::operations();
+      }
+      void reset() {
+        if(operations_) {
+          operations_->destroy(storage_);
+          operations_ = nullptr;
+        }
+      }
+
+    public:
+      UniqueFunction() = default;
+      UniqueFunction(std::nullptr_t) {}
+      template <typename F, typename Callable = typename std::decay<F>::type,
+        typename = typename std::enable_if<!std::is_same<Callable, UniqueFunction>::value>::type,
+        typename = decltype(std::declval<Callable&>()(std::declval<Args>()...))>
+      UniqueFunction(F &&f) {
+        store(std::forward<F>(f), fits<Callable>{});
+      }
+      UniqueFunction(UniqueFunction &&other) noexcept : operations_{other.operations_} {
+        if(operations_) {
+          operations_->move(other.storage_, storage_);
+          other.operations_ = nullptr;
+        }
+      }
+      UniqueFunction(const UniqueFunction &) = delete;
+      UniqueFunction operator=(const UniqueFunction &) = delete;
+      ~UniqueFunction() {
+        reset();
+      }
+
+      UniqueFunction &operator=(UniqueFunction &&other) noexcept {
+        if(this != &other) {
+          reset();
+          if(other.operations_) {
+            other.operations_->move(other.storage_, storage_);
+            operations_ = other.operations_;
+            other.operations_ = nullptr;
+          }
+        }
+        return *this;
+      }
+      UniqueFunction &operator=(std::nullptr_t) {
+        reset();
+        return *this;
+      }
+
+      explicit operator bool() const {
+        return operations_ != nullptr;
+      }
+      R operator()(Args... args) const {
+        return operations_->invoke(storage_, std::forward<Args>(args)...);
+      }
+    };
+} // oef
+} // fetch
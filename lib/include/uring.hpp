@@ -0,0 +1,139 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "logger.hpp"
+#include "metrics.hpp"
+
+#include "asio.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+    /*
+     * Linux io_uring, driven from an asio io_context through raw system calls (no liburing).
+     * Operations are queued from any thread and submitted together by a handler posted once per
+     * batch: all the sends and receives which became ready while the io_context ran other
+     * handlers cost a single io_uring_enter. Completions are reaped, and operations completed,
+     * from a handler waiting for the ring to become readable. It waits again before completing its
+     * batch, so that the io threads complete the operations of different batches in parallel.
+     * Sends are copied into registered buffers (IORING_OP_WRITE_FIXED). Receives pick one of the
+     * provided buffers when data arrives (IOSQE_BUFFER_SELECT), so no memory is set aside for idle
+     * connections. Provided buffers are given back with IORING_OP_PROVIDE_BUFFERS, submitted with
+     * the next batch: provided buffer rings are not available, or not working, on every kernel.
+     */
+    class IoUring : public std::enable_shared_from_this<IoUring> {
+    public:
+      struct Options {
+        uint32_t entries = 256;             // of the submission queue, the completion queue is 16 times larger
+        uint32_t send_buffers = 256;        // registered
+        uint32_t send_buffer_size = 16384;
+        uint32_t recv_buffers = 256;        // provided, at most 65536
+        uint32_t recv_buffer_size = 16384;
+      };
+
+      /* Queued operation, completed from the reaping handler. Not owned by the ring: it must
+       * live until completed */
+      class Operation {
+      public:
+        /* result: bytes or file descriptor, or -errno. flags: of the completion queue entry */
+        virtual void complete(int32_t result, uint32_t flags) = 0;
+      protected:
+        ~Operation() = default;
+      private:
+        friend class IoUring;
+        Operation *prev_ = nullptr; // in flight operations
+        Operation *next_ = nullptr;
+      };
+
+      /* Throws std::system_error when the kernel does not provide io_uring or one of the features used */
+      static std::shared_ptr<IoUring> create(asio::io_context &io_context, Options options);
+
+      IoUring(asio::io_context &io_context, Options options);
+      IoUring(const IoUring &) = delete;
+      IoUring operator=(const IoUring &) = delete;
+      ~IoUring();
+
+      void accept(int fd, Operation &operation);
+      /* Into a provided buffer: see recv_buffer() */
+      void recv(int fd, Operation &operation);
+      /* `length` bytes at `offset` of the registered send buffer `index` */
+      void write_fixed(int fd, uint32_t index, uint32_t offset, uint32_t length, Operation &operation);
+      /* `iov` must live until completed */
+      void writev(int fd, const iovec *iov, uint32_t count, Operation &operation);
+
+      /* Registered send buffer index, or -1 if none is available */
+      int32_t acquire_send_buffer();
+      void release_send_buffer(uint32_t index);
+      uint8_t *send_buffer(uint32_t index) { return send_memory_ + std::size_t(index) * options_.send_buffer_size; }
+      uint32_t send_buffer_size() const { return options_.send_buffer_size; }
+      /* Provided buffer a receive completed into, if `flags` has IORING_CQE_F_BUFFER. To be given
+       * back from the completion */
+      const uint8_t *recv_buffer(uint32_t flags) const;
+      void release_recv_buffer(uint32_t flags);
+
+      /* Cancel the operations in flight, completing them with -ECANCELED. Call once the io_context stopped */
+      void shutdown();
+
+    private:
+      void close(); // unmap and close what was set up
+      void queue(const io_uring_sqe &sqe, Operation *operation); // nullptr: completion ignored
+      void flush();
+      void wait();
+      void reap();
+      void provide(uint16_t id);
+
+      asio::io_context &io_context_;
+      const Options options_;
+      int fd_ = -1;
+      asio::posix::stream_descriptor ring_; // readable when completions are available
+      // submission and completion queues, shared with the kernel
+      void *sq_ring_ = nullptr;
+      std::size_t sq_ring_size_ = 0;
+      io_uring_sqe *sqes_ = nullptr;
+      std::size_t sqes_size_ = 0;
+      unsigned *sq_head_, *sq_tail_, *sq_array_;
+      unsigned sq_mask_, sq_entries_;
+      unsigned *cq_head_, *cq_tail_;
+      io_uring_cqe *cqes_;
+      unsigned cq_mask_;
+      // buffers
+      uint8_t *send_memory_ = nullptr;
+      std::vector<uint32_t> free_send_buffers_;
+      uint8_t *recv_memory_ = nullptr;
+
+      std::mutex lock_; // submissions, send buffers, in flight operations
+      std::vector<io_uring_sqe> pending_;
+      bool flushing_ = false;
+      Operation *in_flight_ = nullptr;
+      bool closed_ = false;
+      std::mutex reap_lock_; // completion queue head
+
+      static fetch::oef::Logger logger;
+      static fetch::oef::Counter submissions;
+      static fetch::oef::Counter operations;
+    };
+} // oef
+} // fetch
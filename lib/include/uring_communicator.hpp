@@ -0,0 +1,148 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "api/communicator_acceptor_t.hpp"
+#include "api/communicator_t.hpp"
+#include "logger.hpp"
+#include "uring.hpp"
+
+#include "asio.hpp"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+    /*
+     * Frames over a TCP connection driven by IoUring, laid out as AsioComm lays them out, so that
+     * agents can't tell. One receive and one write are in flight at most: frames sent while a
+     * write is in flight are coalesced into the next one, in a registered buffer when they fit.
+     * A receive may bring several frames, queued for the next receive_async().
+     * As with asio, continuations are posted to the io_context.
+     */
+    class UringComm : public communicator_t, public std::enable_shared_from_this<UringComm> {
+    public:
+      /* Takes ownership of the connected socket `fd` */
+      UringComm(std::shared_ptr<IoUring> uring, asio::io_context &io_context, int fd);
+      UringComm(const UringComm &) = delete;
+      UringComm operator=(const UringComm &) = delete;
+      ~UringComm();
+
+      void connect() override {}
+      void disconnect() override;
+      //
+      /* Don't mix synchronous and asynchronous operations in flight */
+      std::error_code send_sync(std::shared_ptr<Buffer> buffer) override;
+      std::error_code send_sync(std::vector<std::shared_ptr<Buffer>> buffers) override;
+      std::error_code receive_sync(std::shared_ptr<Buffer>& buffer) override;
+      //
+      void send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) override;
+      void send_async(std::shared_ptr<Buffer> buffer) override;
+      void send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) override;
+      void receive_async(BufferContinuation continuation) override;
+
+    private:
+      /* Operations keep the communicator alive while in flight */
+      struct Receive : public IoUring::Operation {
+        std::shared_ptr<UringComm> self;
+        void complete(int32_t result, uint32_t flags) override;
+      };
+      struct Write : public IoUring::Operation {
+        std::shared_ptr<UringComm> self;
+        void complete(int32_t result, uint32_t flags) override;
+      };
+      struct Send {
+        std::shared_ptr<Buffer> buffer;
+        LengthContinuation continuation;
+      };
+
+      void receive();
+      void received(int32_t result, uint32_t flags);
+      /* Split frames out of received bytes, in_lock_ held */
+      void append(const uint8_t *data, std::size_t size);
+      void write();
+      void written(int32_t result);
+      void complete(std::vector<Send> sends, std::error_code ec);
+
+      std::shared_ptr<IoUring> uring_;
+      asio::io_context &io_context_;
+      const int fd_;
+      std::atomic<bool> closed_{false};
+
+      std::mutex in_lock_;
+      Receive receive_;
+      bool receiving_ = false;
+      Buffer partial_; // bytes of the frames not received entirely yet
+      std::deque<std::shared_ptr<Buffer>> frames_;
+      BufferContinuation reader_;
+      std::error_code in_error_;
+
+      std::mutex out_lock_;
+      Write write_;
+      bool writing_ = false;
+      std::deque<Send> queued_;
+      std::vector<Send> sent_;     // in the write in flight
+      int32_t send_buffer_ = -1;   // registered buffer of the write in flight, if any
+      uint32_t write_offset_ = 0;
+      uint32_t write_length_ = 0;
+      std::vector<uint32_t> lengths_; // or its vector
+      std::vector<iovec> iov_;
+      std::size_t iov_first_ = 0;
+      std::error_code out_error_;
+
+      static fetch::oef::Logger logger;
+    };
+
+    /* Accepts UringComm connections on a TCP port */
+    class UringAcceptor : public comm_acceptor_t {
+    public:
+      /* Listens on `port` of all IPv4 addresses as AsioAcceptor does. Throws on failure */
+      UringAcceptor(std::shared_ptr<IoUring> uring, asio::io_context &io_context, uint32_t port, 
+          uint32_t backlog = 256);
+      UringAcceptor(const UringAcceptor &) = delete;
+      UringAcceptor operator=(const UringAcceptor &) = delete;
+      ~UringAcceptor();
+
+      void do_accept_async(CommunicatorContinuation continuation) override;
+      uint32_t local_port() const;
+
+    private:
+      /* One per do_accept_async(), as several may be in flight. Outlives the acceptor while in flight */
+      struct Accept : public IoUring::Operation {
+        std::shared_ptr<IoUring> uring;
+        asio::io_context *io_context;
+        CommunicatorContinuation continuation;
+        std::shared_ptr<Accept> self;
+        std::shared_ptr<std::atomic<bool>> closed;
+        void complete(int32_t result, uint32_t flags) override;
+      };
+
+      std::shared_ptr<IoUring> uring_;
+      asio::io_context &io_context_;
+      int fd_;
+      std::shared_ptr<std::atomic<bool>> closed_;
+
+      static fetch::oef::Logger logger;
+    };
+} // oef
+} // fetch
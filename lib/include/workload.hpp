@@ -0,0 +1,90 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "schema.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fetch {
+namespace oef {
+  /*
+   * Synthetic, reproducible schema workloads, to size cores and compare query engines.
+   * Data models mix all attribute types. Instance values are skewed: strings and ints follow
+   * a Zipf distribution over `distinct_values` values, locations are clustered around
+   * Zipf-popular cities. Queries mix Relation, Set, Range and Distance constraints in nested
+   * And / Or / Not expressions, drawing their operands from the same distributions, so that
+   * popular values match many instances.
+   */
+  class Workload {
+  public:
+    struct Options {
+      uint64_t seed = 42;
+      uint32_t models = 4;
+      uint32_t attributes = 8;         // per data model
+      uint32_t distinct_values = 1000; // per string or int attribute
+      double skew = 1.;                // Zipf exponent of values, models and cities popularity
+      double optional_rate = .3;       // fraction of missing optional attribute values
+      uint32_t cities = 64;
+      double city_radius_km = 30.;     // standard deviation of locations around their city
+      uint32_t max_depth = 3;          // of query expressions
+      uint32_t max_constraints = 3;    // top level constraints per query
+    };
+
+    explicit Workload(Options options);
+    explicit Workload() : Workload{Options{}} {}
+
+    const std::vector<DataModel> &models() const { return models_; }
+    /* Instance of a data model drawn by popularity */
+    Instance instance();
+    std::vector<Instance> instances(std::size_t n);
+    /* Query restricted to a data model drawn by popularity. Always valid() */
+    QueryModel query();
+    std::vector<QueryModel> queries(std::size_t n);
+
+  private:
+    /* Zipf distributed ranks in [0, n) */
+    class Zipf {
+    public:
+      explicit Zipf(std::size_t n, double s);
+      std::size_t operator()(std::mt19937_64 &random) const;
+    private:
+      std::vector<double> cdf_;
+    };
+
+    const Options options_;
+    std::mt19937_64 random_;
+    Zipf models_zipf_;
+    Zipf values_zipf_;
+    Zipf cities_zipf_;
+    std::vector<DataModel> models_;
+    std::vector<Location> cities_;
+
+    const DataModel &model_();
+    VariantType value_(const fetch::oef::pb::Query_Attribute &attribute);
+    std::string string_();
+    Location location_();
+    ConstraintExpr expr_(const DataModel &model, uint32_t depth);
+    Constraint constraint_(const fetch::oef::pb::Query_Attribute &attribute);
+    bool draw_(double p) { return std::bernoulli_distribution{p}(random_); }
+    uint32_t draw_(uint32_t min, uint32_t max) { return std::uniform_int_distribution<uint32_t>{min, max}(random_); }
+  };
+} // oef
+} // fetch
@@ -0,0 +1,276 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "admin_server.hpp"
+#include "agent_session.hpp"
+
+#include <sstream>
+
+namespace fetch {
+namespace oef {
+
+fetch::oef::Logger AdminServer::logger = fetch::oef::Logger("admin-server");
+
+namespace {
+  class AdminConnection : public std::enable_shared_from_this<AdminConnection> {
+  private:
+    asio::ip::tcp::socket socket_;
+    asio::streambuf input_;
+    AdminServer &server_;
+  public:
+    AdminConnection(asio::ip::tcp::socket socket, AdminServer &server)
+      : socket_{std::move(socket)}, input_{config::admin_max_request}, server_{server} {}
+
+    void read() {
+      auto self(shared_from_this());
+      asio::async_read_until(socket_, input_, '\n', [this,self](std::error_code ec, std::size_t) {
+            if(ec) {
+              close();
+              return;
+            }
+            std::string line;
+            std::istream is(&input_);
+            std::getline(is, line);
+            if(!line.empty() && line.back() == '\r') {
+              line.pop_back();
+            }
+            if(line.compare(0, 4, "GET ") == 0) {
+              http(line);
+              return;
+            }
+            if(line == "quit") {
+              socket_.close();
+              return;
+            }
+            write(std::make_shared<std::string>(line.empty() ? "\n" : server_.execute(line) + "\n"), false);
+          });
+    }
+
+  private:
+    /* After a read failure, including not_found for a request longer than config::admin_max_request */
+    void close() {
+      std::error_code ignored;
+      socket_.close(ignored);
+    }
+
+    void write(std::shared_ptr<std::string> answer, bool close) {
+      auto self(shared_from_this());
+      asio::async_write(socket_, asio::buffer(*answer), [this,self,answer,close](std::error_code ec, std::size_t) {
+            if(ec || close) {
+              std::error_code ignored;
+              socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+              return;
+            }
+            read();
+          });
+    }
+
+    /* Discard the request headers, then answer and close */
+    void http(const std::string &request_line) {
+      auto self(shared_from_this());
+      asio::async_read_until(socket_, input_, "\r\n\r\n", [this,self,request_line](std::error_code ec, std::size_t) {
+            if(ec) {
+              close();
+              return;
+            }
+            std::istringstream is{request_line};
+            std::string method, path;
+            is >> method >> path;
+            static const std::vector<std::string> commands{"metrics", "agents", "search", "log-level", "trace"};
+            std::string status = "404 Not Found";
+            std::string body = "unknown path " + path + "\n";
+            for(auto &command : commands) {
+              if(path == "/" + command) {
+                status = "200 OK";
+                body = server_.execute(command);
+              }
+            }
+            auto answer = std::make_shared<std::string>("HTTP/1.0 " + status + "\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+            write(answer, true);
+          });
+    }
+  };
+
+  std::string with_label(const std::string &labels, const std::string &label) {
+    return "{" + labels + (labels.empty() ? "" : ",") + label + "}";
+  }
+}
+
+AdminServer::AdminServer(const AgentDirectory &agentDirectory, std::shared_ptr<OefSearchClient> oef_search, uint32_t port,
+    const std::string &address)
+  : acceptor_{io_context_, asio::ip::tcp::endpoint(asio::ip::make_address(address), uint16_t(port))}
+  , agentDirectory_{agentDirectory}
+  , oef_search_{std::move(oef_search)}
+{
+  do_accept();
+  thread_ = std::make_unique<std::thread>([this]() { io_context_.run(); });
+  logger.info("AdminServer::AdminServer listening on {}:{}", address, this->port());
+}
+
+AdminServer::~AdminServer() {
+  stop();
+}
+
+void AdminServer::stop() {
+  io_context_.stop();
+  if(thread_ && thread_->joinable()) {
+    thread_->join();
+  }
+}
+
+void AdminServer::do_accept() {
+  acceptor_.async_accept([this](std::error_code ec, asio::ip::tcp::socket socket) {
+        if(ec) {
+          logger.error("AdminServer::do_accept error {}", ec.value());
+          return;
+        }
+        std::make_shared<AdminConnection>(std::move(socket), *this)->read();
+        do_accept();
+      });
+}
+
+std::string AdminServer::execute(const std::string &line) {
+  std::istringstream is{line};
+  std::string command, argument;
+  is >> command >> argument;
+  DEBUG(logger, "AdminServer::execute {}", line);
+  if(command == "metrics") {
+    return prometheus(Metrics::snapshot());
+  }
+  if(command == "agents") {
+    return agents_();
+  }
+  if(command == "search") {
+    return search_();
+  }
+  if(command == "log-level") {
+    return log_level_(argument);
+  }
+  if(command == "trace") {
+    return Tracer::chrome_json();
+  }
+  if(command == "trace-sample") {
+    if(!argument.empty()) {
+      try {
+        Tracer::sample_every(uint32_t(std::stoul(argument)));
+      } catch(std::exception &e) {
+        return "error: invalid sampling " + argument + "\n";
+      }
+    }
+    return "trace-sample " + std::to_string(Tracer::sample_every()) + "\n";
+  }
+  if(command == "help") {
+    return "metrics\nagents\nsearch\nlog-level [[section=]level]\ntrace-sample [n]\ntrace\nquit\n";
+  }
+  return "error: unknown command " + command + ", try help\n";
+}
+
+std::string AdminServer::prometheus(const MetricsSnapshot &snapshot) {
+  static const char *types[] = {"counter", "gauge", "histogram"};
+  std::string out;
+  const std::string *previous = nullptr;
+  for(auto &m : snapshot.metrics) {
+    if(!previous || *previous != m.name) { // same name, different labels
+      if(!m.help.empty()) {
+        out += "# HELP " + m.name + " " + m.help + "\n";
+      }
+      out += "# TYPE " + m.name + " " + types[int(m.type)] + "\n";
+    }
+    previous = &m.name;
+    if(m.type != Metric::Type::Histogram) {
+      out += m.name + (m.labels.empty() ? "" : "{" + m.labels + "}") + " " + std::to_string(m.value) + "\n";
+      continue;
+    }
+    // the same buckets every time, as Prometheus expects: those ending a quarter of a power of two
+    uint64_t cumulative = 0;
+    for(std::size_t b = 0; b < m.buckets.size(); ++b) {
+      cumulative += m.buckets[b];
+      if((b + 1) % prometheus_bucket_span != 0) {
+        continue;
+      }
+      out += m.name + "_bucket" + with_label(m.labels, "le=\"" + std::to_string(Histogram::upper_bound(b)) + "\"") 
+        + " " + std::to_string(cumulative) + "\n";
+    }
+    out += m.name + "_bucket" + with_label(m.labels, "le=\"+Inf\"") + " " + std::to_string(m.count) + "\n";
+    out += m.name + "_sum" + (m.labels.empty() ? "" : "{" + m.labels + "}") + " " + std::to_string(m.sum) + "\n";
+    out += m.name + "_count" + (m.labels.empty() ? "" : "{" + m.labels + "}") + " " + std::to_string(m.count) + "\n";
+  }
+  return out;
+}
+
+std::string AdminServer::agents_() const {
+  auto sessions = agentDirectory_.sessions();
+  std::string out = "agents " + std::to_string(sessions.size()) + "\n";
+  for(auto &s : sessions) {
+    out += s->agent_id();
+    auto session = std::dynamic_pointer_cast<AgentSession>(s);
+    if(session) {
+      auto stats = session->stats();
+      out += " received=" + std::to_string(stats.received) + " sent=" + std::to_string(stats.sent)
+        + " sent_bytes=" + std::to_string(stats.sent_bytes) + " pending_sends=" + std::to_string(stats.pending_sends)
+        + " pending_bytes=" + std::to_string(stats.pending_bytes) + " batched=" + std::to_string(stats.batched)
+        + (stats.congested ? " congested" : "");
+    }
+    out += "\n";
+  }
+  return out;
+}
+
+std::string AdminServer::search_() const {
+  if(!oef_search_) {
+    return "connected no\npending 0\n";
+  }
+  auto pending = oef_search_->pending();
+  std::string out = std::string("connected ") + (oef_search_->connected() ? "yes" : "no") + "\n"
+    + "pending " + std::to_string(pending.size()) + "\n";
+  auto now = std::chrono::steady_clock::now();
+  for(auto &p : pending) {
+    auto age = std::chrono::duration_cast<std::chrono::microseconds>(now - p.second.created).count();
+    out += std::to_string(p.first) + " " + p.second.operation + " agent=" + p.second.agent_id
+      + " msg_id=" + std::to_string(p.second.amsg_id) + " age_us=" + std::to_string(age) + "\n";
+  }
+  return out;
+}
+
+std::string AdminServer::log_level_(const std::string &argument) const {
+  if(argument.empty()) {
+    std::string out;
+    for(auto &section : Logger::sections()) {
+      out += section + " " + Logger::level(section) + "\n";
+    }
+    return out;
+  }
+  auto eq = argument.find('=');
+  LogLevel level;
+  if(!Logger::parse_level(argument.substr(eq == std::string::npos ? 0 : eq + 1), level)) {
+    return "error: unknown log level " + argument + "\n";
+  }
+  if(eq == std::string::npos) {
+    Logger::level(level);
+  } else if(!Logger::level(argument.substr(0, eq), level)) {
+    return "error: no log section " + argument.substr(0, eq) + "\n";
+  }
+  logger.info("AdminServer::log_level_ set {}", argument);
+  return "ok\n";
+}
+
+} // oef
+} // fetch
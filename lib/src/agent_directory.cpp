@@ -22,6 +22,7 @@ namespace fetch {
 namespace oef {
 
 fetch::oef::Logger AgentDirectory::logger = fetch::oef::Logger("agent-directory");
+fetch::oef::Gauge AgentDirectory::agents{"oef_agents", "", "Agents connected"};
 
 } // oef
 } // fetch
@@ -16,13 +16,93 @@
 //
 //------------------------------------------------------------------------------
 
-#define DEBUG_ON 1
 #include "agent_session.hpp"
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <algorithm>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
 namespace fetch {
 namespace oef {
 
 fetch::oef::Logger AgentSession::logger = fetch::oef::Logger("agent-session");
+fetch::oef::Counter AgentSession::routed_messages{"oef_routed_messages_total", "",
+  "Messages delivered from an agent to another"};
+fetch::oef::Counter AgentSession::routed_bytes{"oef_routed_bytes_total", "",
+  "Bytes of the messages delivered from an agent to another"};
+fetch::oef::Counter AgentSession::dialogue_errors{"oef_dialogue_errors_total", "",
+  "Messages that couldn't be delivered"};
+fetch::oef::Counter AgentSession::paused_reads{"oef_backpressure_actions_total", "action=\"pause\"",
+  "Actions taken on messages sent to slow consumers"};
+fetch::oef::Counter AgentSession::dropped_messages{"oef_backpressure_actions_total", "action=\"drop\"",
+  "Actions taken on messages sent to slow consumers"};
+fetch::oef::Counter AgentSession::disconnected_consumers{"oef_backpressure_actions_total", "action=\"disconnect\"",
+  "Actions taken on messages sent to slow consumers"};
+fetch::oef::Gauge AgentSession::congested_sessions{"oef_congested_sessions", "",
+  "Agents above their outbound high water marks"};
+fetch::oef::Counter AgentSession::delayed_reads{"oef_paced_reads_total", "reason=\"rate\"",
+  "Reads from agents put off, to hold them to their rate limits or to let other agents in"};
+fetch::oef::Counter AgentSession::yielded_reads{"oef_paced_reads_total", "reason=\"fairness\"",
+  "Reads from agents put off, to hold them to their rate limits or to let other agents in"};
+fetch::oef::Counter AgentSession::bulk_frames{"oef_bulk_lane_frames_total", "",
+  "Frames from agents processed on the bulk lane"};
+
+bool OutboundLimits::parse_policy(const std::string &name, Policy &policy) {
+  static const std::unordered_map<std::string,Policy> policies{
+    {"pause", Policy::Pause}, {"drop", Policy::Drop}, {"disconnect", Policy::Disconnect}};
+  auto iter = policies.find(name);
+  if(iter == policies.end()) {
+    return false;
+  }
+  policy = iter->second;
+  return true;
+}
+
+RateLimits::Operation RateLimits::operation(fetch::oef::pb::Envelope::PayloadCase payload) {
+  switch(payload) {
+    case fetch::oef::pb::Envelope::kSendMessage:
+    case fetch::oef::pb::Envelope::kBroadcastMessage:
+      return Operation::Messaging;
+    case fetch::oef::pb::Envelope::kRegisterService:
+    case fetch::oef::pb::Envelope::kUnregisterService:
+    case fetch::oef::pb::Envelope::kRegisterDescription:
+    case fetch::oef::pb::Envelope::kUnregisterDescription:
+    case fetch::oef::pb::Envelope::kSubscribeServices:
+    case fetch::oef::pb::Envelope::kUnsubscribeServices:
+      return Operation::Registration;
+    case fetch::oef::pb::Envelope::kSearchAgents:
+    case fetch::oef::pb::Envelope::kSearchServices:
+    case fetch::oef::pb::Envelope::kSearchServicesWide:
+      return Operation::Search;
+    default:
+      return Operation::Other;
+  }
+}
+
+namespace {
+  /* one counter per Envelope payload, labelled with the payload field name */
+  fetch::oef::Counter &envelope_counter(int payload_case) {
+    static const auto counters = []() {
+      std::unordered_map<int,std::unique_ptr<fetch::oef::Counter>> c;
+      const char *help = "Envelopes received from agents";
+      const auto *payload = fetch::oef::pb::Envelope::descriptor()->FindOneofByName("payload");
+      for(int i = 0; i < payload->field_count(); ++i) {
+        const auto *field = payload->field(i);
+        c[field->number()] = std::make_unique<fetch::oef::Counter>("oef_envelopes_total",
+            "payload=\"" + field->name() + "\"", help);
+      }
+      c[fetch::oef::pb::Envelope::PAYLOAD_NOT_SET] = std::make_unique<fetch::oef::Counter>("oef_envelopes_total",
+          "payload=\"none\"", help);
+      return c;
+    }();
+    auto iter = counters.find(payload_case);
+    return iter != counters.end() ? *iter->second : *counters.at(fetch::oef::pb::Envelope::PAYLOAD_NOT_SET);
+  }
+}
     
 void AgentSession::process_register_description(uint32_t msg_id, const fetch::oef::pb::AgentDescription &desc) 
 {
@@ -32,13 +112,14 @@ void AgentSession::process_register_description(uint32_t msg_id, const fetch::oe
   
   auto self(shared_from_this()); 
   oef_search_.register_description(*description_, publicKey_, msg_id,
-      [this, self, msg_id](std::error_code ec, OefSearchResponse response) {
+      [this, self, msg_id, description = *description_](std::error_code ec, OefSearchResponse response) {
         if (ec) {
           DEBUG(logger, "::processRegisterDescription failed operation for msg {} of agent {}", msg_id, publicKey_);
           send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_DESCRIPTION);
         } else {
           DEBUG(logger, "::processRegisterDescription operation successful for msg {} of agent {}", msg_id, publicKey_);
           // TOFIX should add a status answer, even in the case of no error 
+          notify_subscribers(description);
         }
       });
 }
@@ -70,13 +151,14 @@ void AgentSession::process_register_service(uint32_t msg_id, const fetch::oef::p
  
   auto self(shared_from_this()); 
   oef_search_.register_service(service_desc, publicKey_, msg_id,
-      [this, self, msg_id](std::error_code ec, OefSearchResponse response) {
+      [this, self, msg_id, service_desc](std::error_code ec, OefSearchResponse response) {
         if (ec) {
           DEBUG(logger, "::processRegisterService failed operation for msg {} of agent {}", msg_id, publicKey_);
           send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_SERVICE);
         } else {
           DEBUG(logger, "::processRegisterService operation successful for msg {} of agent {}", msg_id, publicKey_);
           // TOFIX should add a status answer, even in the case of no error 
+          notify_subscribers(service_desc);
         }
       });
 }
@@ -104,6 +186,12 @@ void AgentSession::process_search_agents(uint32_t msg_id, const fetch::oef::pb::
   auto query = QueryModel(search.query());
   DEBUG(logger, "AgentSession::processSearchAgents from agent {} : {}", publicKey_, pbs::to_string(search));
   
+#ifdef OEF_CORE_COROUTINES
+  if(coroutines_) {
+    await_search(shared_from_this(), msg_id, std::move(query), fetch::oef::pb::Envelope::kSearchAgents);
+    return;
+  }
+#endif
   auto self(shared_from_this()); 
   oef_search_.search_agents(query, publicKey_, msg_id,
       [this, self, msg_id](std::error_code ec, OefSearchResponse response) {
@@ -112,14 +200,7 @@ void AgentSession::process_search_agents(uint32_t msg_id, const fetch::oef::pb::
           send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_SERVICE);
         } else {
           DEBUG(logger, "::processSearchAgents operation successful for msg {} of agent {}", msg_id, publicKey_);
-          fetch::oef::pb::Server_AgentMessage answer;
-          answer.set_answer_id(msg_id);
-          auto answer_agents = answer.mutable_agents();
-          for(auto &a : response.agents) {
-            answer_agents->add_agents(a);
-          }
-          logger.trace("AgentSession::processSearchAgents sending {} agents to {}", answer_agents->agents().size(), publicKey_);
-          send(answer);
+          answer_agents(msg_id, response);
         }
       });
 }
@@ -129,6 +210,12 @@ void AgentSession::process_search_service(uint32_t msg_id, const fetch::oef::pb:
   auto query = QueryModel(search.query());
   DEBUG(logger, "AgentSession::processQuery from agent {} : {}", publicKey_, pbs::to_string(search));
   
+#ifdef OEF_CORE_COROUTINES
+  if(coroutines_) {
+    await_search(shared_from_this(), msg_id, std::move(query), fetch::oef::pb::Envelope::kSearchServices);
+    return;
+  }
+#endif
   auto self(shared_from_this()); 
   oef_search_.search_service(query, publicKey_, msg_id,
       [this, self, msg_id](std::error_code ec, OefSearchResponse response) {
@@ -137,14 +224,7 @@ void AgentSession::process_search_service(uint32_t msg_id, const fetch::oef::pb:
           send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_SERVICE);
         } else {
           DEBUG(logger, "::processQuery operation successful for msg {} of agent {}", msg_id, publicKey_);
-          fetch::oef::pb::Server_AgentMessage answer;
-          answer.set_answer_id(msg_id);
-          auto answer_agents = answer.mutable_agents();
-          for(auto &a : response.agents) {
-            answer_agents->add_agents(a);
-          }
-          logger.trace("AgentSession::processQuery sending {} agents to {}", answer_agents->agents().size(), publicKey_);
-          send(answer);
+          answer_agents(msg_id, response);
         }
       });
 }
@@ -154,6 +234,12 @@ void AgentSession::process_search_service_wide(uint32_t msg_id, const fetch::oef
   auto query = QueryModel(search.query());
   DEBUG(logger, "AgentSession::processQueryWide from agent {} : {}", publicKey_, pbs::to_string(search));
   
+#ifdef OEF_CORE_COROUTINES
+  if(coroutines_) {
+    await_search(shared_from_this(), msg_id, std::move(query), fetch::oef::pb::Envelope::kSearchServicesWide);
+    return;
+  }
+#endif
   auto self(shared_from_this()); 
   oef_search_.search_service_wide(query, publicKey_, msg_id,
       [this, self, msg_id](std::error_code ec, OefSearchResponse response) {
@@ -162,22 +248,103 @@ void AgentSession::process_search_service_wide(uint32_t msg_id, const fetch::oef
           send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_SERVICE);
         } else {
           DEBUG(logger, "::processQueryWide operation successful for msg {} of agent {}", msg_id, publicKey_);
-          fetch::oef::pb::Server_AgentMessage answer;
-          answer.set_answer_id(msg_id);
-          answer.mutable_agents_wide()->CopyFrom(response.search_result_wide);
-          //
-          int agents_nbr = 0;
-          auto items = response.search_result_wide.result();
-          for (auto& item : items) {
-            agents_nbr+= item.agents().size();
-          }
-          logger.trace("AgentSession::processQueryWide sending {} agents to {}", agents_nbr, publicKey_);
-          send(answer);
+          answer_agents_wide(msg_id, response);
+        }
+      });
+}
+
+#ifdef OEF_CORE_COROUTINES
+Detached AgentSession::await_search(std::shared_ptr<AgentSession> self, uint32_t msg_id, QueryModel query,
+    fetch::oef::pb::Envelope::PayloadCase payload)
+{
+  std::error_code ec;
+  OefSearchResponse response;
+  std::tie(ec, response) = co_await completion<OefSearchResponse>([&](AgentSessionContinuation continuation) {
+        if(payload == fetch::oef::pb::Envelope::kSearchAgents) {
+          oef_search_.search_agents(query, publicKey_, msg_id, std::move(continuation));
+        } else if(payload == fetch::oef::pb::Envelope::kSearchServices) {
+          oef_search_.search_service(query, publicKey_, msg_id, std::move(continuation));
+        } else {
+          oef_search_.search_service_wide(query, publicKey_, msg_id, std::move(continuation));
         }
       });
+  if(ec) {
+    DEBUG(logger, "AgentSession::await_search failed operation for msg {} of agent {}", msg_id, publicKey_);
+    send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_SERVICE);
+  } else if(payload == fetch::oef::pb::Envelope::kSearchServicesWide) {
+    answer_agents_wide(msg_id, response);
+  } else {
+    answer_agents(msg_id, response);
+  }
+}
+#endif
+
+void AgentSession::answer_agents(uint32_t msg_id, const OefSearchResponse &response)
+{
+  fetch::oef::pb::Server_AgentMessage answer;
+  answer.set_answer_id(msg_id);
+  auto answer_agents = answer.mutable_agents();
+  for(auto &a : response.agents) {
+    answer_agents->add_agents(a);
+  }
+  logger.trace("AgentSession::answer_agents sending {} agents to {}", answer_agents->agents().size(), publicKey_);
+  send(answer);
+}
+
+void AgentSession::answer_agents_wide(uint32_t msg_id, const OefSearchResponse &response)
+{
+  fetch::oef::pb::Server_AgentMessage answer;
+  answer.set_answer_id(msg_id);
+  answer.mutable_agents_wide()->CopyFrom(response.search_result_wide);
+  //
+  int agents_nbr = 0;
+  for (auto& item : response.search_result_wide.result()) {
+    agents_nbr+= item.agents().size();
+  }
+  logger.trace("AgentSession::answer_agents_wide sending {} agents to {}", agents_nbr, publicKey_);
+  send(answer);
+}
+
+void AgentSession::process_subscribe_services(uint32_t msg_id, const fetch::oef::pb::AgentSearch &search) 
+{
+  DEBUG(logger, "AgentSession::processSubscribeServices from agent {} : {}", publicKey_, pbs::to_string(search));
+  if(!subscriptions_.add(publicKey_, msg_id, search.query())) {
+    logger.info("AgentSession::processSubscribeServices rejected subscription {} of agent {}", msg_id, publicKey_);
+    send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::SUBSCRIBE_SERVICES);
+  }
+}
+
+void AgentSession::process_unsubscribe_services(uint32_t msg_id, const fetch::oef::pb::AgentUnsubscribe &unsubscribe) 
+{
+  uint32_t subscription_id = unsubscribe.subscription_id();
+  logger.trace("AgentSession::processUnsubscribeServices subscription {} of agent {}", subscription_id, publicKey_);
+  if(!subscriptions_.remove(publicKey_, subscription_id)) {
+    send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::UNSUBSCRIBE_SERVICES);
+  }
+}
+
+void AgentSession::notify_subscribers(const Instance &instance) 
+{
+  auto subscribers = subscriptions_.match(instance);
+  if(subscribers.empty()) {
+    return;
+  }
+  logger.trace("AgentSession::notify_subscribers registration of {} matches {} subscriptions", 
+      publicKey_, subscribers.size());
+  for(auto &subscriber : subscribers) {
+    auto session = agentDirectory_.session(subscriber.first);
+    if(!session) {
+      continue;
+    }
+    fetch::oef::pb::Server_AgentMessage notification;
+    notification.set_answer_id(subscriber.second);
+    notification.mutable_agents()->add_agents(publicKey_);
+    session->send(notification);
+  }
 }
 
 void AgentSession::send_dialog_error(uint32_t msg_id, uint32_t dialogue_id, const std::string &origin) {
+  dialogue_errors.inc();
   fetch::oef::pb::Server_AgentMessage answer;
   answer.set_answer_id(msg_id);
   auto *error = answer.mutable_dialogue_error();
@@ -199,10 +366,12 @@ void AgentSession::send_error(uint32_t msg_id, fetch::oef::pb::Server_AgentMessa
 void AgentSession::process_message(uint32_t msg_id, fetch::oef::pb::Agent_Message *msg) 
 {
   auto session = agentDirectory_.session(msg->destination());
+  Tracer::mark(Trace::Stage::DirectoryLookup);
   DEBUG(logger, "AgentSession::process_message from agent {} : {}", publicKey_, pbs::to_string(*msg));
   logger.trace("AgentSession::process_message to {} from {}", msg->destination(), publicKey_);
+  std::unique_ptr<fetch::oef::pb::Agent_Message> owner{msg};
   uint32_t did = msg->dialogue_id();
-  if(session) {
+  if(session && admit(session, msg_id, did, msg->destination())) {
     fetch::oef::pb::Server_AgentMessage message;
     message.set_answer_id(msg_id);
     auto content = message.mutable_content();
@@ -215,20 +384,396 @@ void AgentSession::process_message(uint32_t msg_id, fetch::oef::pb::Agent_Messag
       content->set_allocated_fipa(msg->release_fipa());
     }
     DEBUG(logger, "AgentSession::process_message to agent {} : {}", msg->destination(), pbs::to_string(message));
-    session->send(message, 
-        [this,did,msg_id,msg](std::error_code ec, std::size_t length) {
+    auto self(shared_from_this()); 
+    session->send(pbs::serialize(message), 
+        [this,self,did,msg_id,destination=msg->destination()](std::error_code ec, std::size_t length) {
           if(ec) {
-            send_dialog_error(msg_id, did, msg->destination());
+            send_dialog_error(msg_id, did, destination);
+          } else {
+            routed_messages.inc();
+            routed_bytes.inc(length);
           }
-        }); 
-  } else {
+        }, Priority::Bulk); 
+  } else if(!session) {
     send_dialog_error(msg_id, did, msg->destination());
   }
 }
 
+void AgentSession::process_broadcast(uint32_t msg_id, const fetch::oef::pb::AgentBroadcast &broadcast) 
+{
+  DEBUG(logger, "AgentSession::process_broadcast from agent {} : {}", publicKey_, pbs::to_string(broadcast));
+  uint32_t did = broadcast.dialogue_id();
+  // Nothing in the delivered message depends on the recipient, so it is serialized only once
+  fetch::oef::pb::Server_AgentMessage message;
+  message.set_answer_id(msg_id);
+  auto content = message.mutable_content();
+  content->set_dialogue_id(did);
+  content->set_origin(publicKey_);
+  if(broadcast.has_content()) {
+    content->set_content(broadcast.content());
+  }
+  if(broadcast.has_fipa()) {
+    content->mutable_fipa()->CopyFrom(broadcast.fipa());
+  }
+  auto buffer = pbs::serialize(message);
+  std::vector<std::string> destinations{broadcast.destinations().begin(), broadcast.destinations().end()};
+  // each agent gets the message once, however many times it is listed or found
+  auto unique = [](std::vector<std::string> &agents) {
+    std::sort(agents.begin(), agents.end());
+    agents.erase(std::unique(agents.begin(), agents.end()), agents.end());
+  };
+  if(!broadcast.has_query()) {
+    unique(destinations);
+    deliver(msg_id, did, buffer, destinations);
+    return;
+  }
+  auto self(shared_from_this()); 
+  oef_search_.search_service(QueryModel{broadcast.query()}, publicKey_, msg_id,
+      [this, self, msg_id, did, buffer, destinations, unique](std::error_code ec, OefSearchResponse response) mutable {
+        if (ec) {
+          DEBUG(logger, "::process_broadcast failed search for msg {} of agent {}", msg_id, publicKey_);
+          send_error(msg_id, fetch::oef::pb::Server_AgentMessage_OEFError::REGISTER_SERVICE);
+        } else {
+          for(auto &a : response.agents) {
+            if(a != publicKey_) {
+              destinations.emplace_back(a);
+            }
+          }
+        }
+        unique(destinations);
+        deliver(msg_id, did, buffer, destinations);
+      });
+}
+
+void AgentSession::deliver(uint32_t msg_id, uint32_t dialogue_id, const std::shared_ptr<Buffer> &buffer, 
+    const std::vector<std::string> &destinations) 
+{
+  logger.trace("AgentSession::deliver message {} of {} to {} agents", msg_id, publicKey_, destinations.size());
+  auto self(shared_from_this()); 
+  for(auto &destination : destinations) {
+    auto session = agentDirectory_.session(destination);
+    Tracer::mark(Trace::Stage::DirectoryLookup);
+    if(!session) {
+      send_dialog_error(msg_id, dialogue_id, destination);
+      continue;
+    }
+    if(!admit(session, msg_id, dialogue_id, destination)) {
+      continue;
+    }
+    session->send(buffer, 
+        [this,self,dialogue_id,msg_id,destination](std::error_code ec, std::size_t length) {
+          if(ec) {
+            send_dialog_error(msg_id, dialogue_id, destination);
+          } else {
+            routed_messages.inc();
+            routed_bytes.inc(length);
+          }
+        }, Priority::Bulk); 
+  }
+}
+
+void AgentSession::send(std::shared_ptr<Buffer> buffer, LengthContinuation continuation, Priority priority) {
+  Tracer::mark(Trace::Stage::ResponseSerialized);
+  if(!batching_) {
+    write(std::move(buffer), std::move(continuation), priority);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    auto &pending = pending_[static_cast<int>(priority)];
+    if(!pending) {
+      pending = std::make_shared<Buffer>();
+    }
+    pbs::append_field(*pending, 1, *buffer); // AgentMessageBatch.messages
+    pending_continuations_[static_cast<int>(priority)].push_back(std::move(continuation));
+    if(holding_) {
+      return;
+    }
+  }
+  flush();
+}
+
+void AgentSession::flush() {
+  for(auto priority : {Priority::Control, Priority::Bulk}) {
+    std::shared_ptr<Buffer> frame;
+    std::vector<LengthContinuation> continuations;
+    {
+      std::lock_guard<std::mutex> lock(out_lock_);
+      if(!pending_[static_cast<int>(priority)]) {
+        continue;
+      }
+      frame.swap(pending_[static_cast<int>(priority)]);
+      continuations.swap(pending_continuations_[static_cast<int>(priority)]);
+    }
+    logger.trace("AgentSession::flush sending {} messages to {} in {} bytes", continuations.size(), publicKey_, frame->size());
+    write(std::move(frame), 
+        [continuations=std::move(continuations)](std::error_code ec, std::size_t length) {
+          for(auto &continuation : continuations) {
+            continuation(ec, length);
+          }
+        }, priority);
+  }
+}
+
+bool AgentSession::admit(const std::shared_ptr<agent_session_t> &destination, uint32_t msg_id, uint32_t dialogue_id,
+    const std::string &destination_id) {
+  if(!destination->congested()) {
+    return true;
+  }
+  switch(limits_.policy) {
+    case OutboundLimits::Policy::Pause:
+      congested_destination_ = destination;
+      return true;
+    case OutboundLimits::Policy::Drop:
+      dropped_messages.inc();
+      break;
+    case OutboundLimits::Policy::Disconnect:
+      disconnected_consumers.inc();
+      destination->disconnect();
+      break;
+  }
+  send_dialog_error(msg_id, dialogue_id, destination_id);
+  return false;
+}
+
+void AgentSession::when_drained(VoidContinuation continuation) {
+  {
+    std::lock_guard<std::mutex> lock(drained_lock_);
+    if(congested_.load(std::memory_order_relaxed)) {
+      drained_.push_back(std::move(continuation));
+      return;
+    }
+  }
+  continuation();
+}
+
+void AgentSession::disconnect() {
+  if(!disconnecting_.exchange(true)) {
+    logger.warn("AgentSession::disconnect slow consumer {}: {} frames, {} bytes not written", publicKey_,
+        pending_sends_.load(std::memory_order_relaxed), pending_bytes_.load(std::memory_order_relaxed));
+    // called from a sender's thread, while this session's own threads may be starting reads and writes:
+    // they fail, and the read path tears the session down
+    comm_->shutdown();
+  }
+}
+
+void AgentSession::congest(uint32_t frames, uint64_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(drained_lock_);
+    if(congested_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    congested_.store(true, std::memory_order_relaxed);
+  }
+  congested_sessions.add(1);
+  logger.info("AgentSession::congest {} is a slow consumer: {} frames, {} bytes not written", publicKey_, frames, bytes);
+}
+
+void AgentSession::drained() {
+  std::vector<VoidContinuation> waiting;
+  {
+    std::lock_guard<std::mutex> lock(drained_lock_);
+    if(!congested_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    congested_.store(false, std::memory_order_relaxed);
+    waiting.swap(drained_);
+  }
+  congested_sessions.add(-1);
+  logger.debug("AgentSession::drained {} resuming {} senders", publicKey_, waiting.size());
+  for(auto &continuation : waiting) {
+    continuation();
+  }
+}
+
+void AgentSession::write(std::shared_ptr<Buffer> frame, LengthContinuation continuation, Priority priority) {
+  uint64_t size = frame->size() + sizeof(uint32_t);
+  uint32_t frames = pending_sends_.fetch_add(1, std::memory_order_relaxed) + 1;
+  uint64_t bytes = pending_bytes_.fetch_add(size, std::memory_order_relaxed) + size;
+  if((frames > limits_.high_frames || bytes > limits_.high_bytes) && !congested()) {
+    congest(frames, bytes);
+  }
+  outbound_[static_cast<int>(priority)].push(Outbound{std::move(frame), std::move(continuation), Tracer::current()});
+  if(outbound_size_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+    drain();
+  }
+}
+
+void AgentSession::drain() {
+  // no more frames than counted, so that written() never takes off one its sender has not added yet
+  std::size_t counted = std::min(std::size_t(outbound_size_.load(std::memory_order_acquire)),
+      config::session_write_batch);
+  // Control frames first: they overtake the Bulk ones not being written yet
+  auto pop = [this,counted]() {
+    Outbound outbound;
+    while(writing_.size() < counted && (outbound_[static_cast<int>(Priority::Control)].pop(outbound)
+          || outbound_[static_cast<int>(Priority::Bulk)].pop(outbound))) {
+      writing_.push_back(std::move(outbound));
+    }
+  };
+  pop();
+  // fewer popped than counted: a sender is between its push() and its link. What was popped is
+  // written, written() drains the rest. With nothing popped, drain again once the sender is done
+  if(writing_.empty()) {
+    if(io_context_) {
+      auto self(shared_from_this());
+      asio::post(*io_context_, [self]() { self->drain(); });
+      return;
+    }
+    // not scheduled: nowhere to drain later, the sender is a few instructions away from linking
+    do {
+      std::this_thread::yield();
+      pop();
+    } while(writing_.empty());
+  }
+  // the session alone fits the inline storage of LengthContinuation (a UniqueFunction), no allocation
+  auto continuation = [self = shared_from_this()](std::error_code ec, std::size_t) { self->written(ec); };
+  if(writing_.size() == 1) {
+    comm_->send_async(writing_.front().frame, continuation);
+    return;
+  }
+  std::vector<std::shared_ptr<Buffer>> frames;
+  frames.reserve(writing_.size());
+  for(auto &queued : writing_) {
+    frames.push_back(queued.frame);
+  }
+  comm_->send_async(std::move(frames), continuation);
+}
+
+void AgentSession::written(std::error_code ec) {
+  uint32_t nb_frames = uint32_t(writing_.size());
+  uint64_t nb_bytes = 0;
+  for(auto &outbound : writing_) {
+    nb_bytes += outbound.frame->size() + sizeof(uint32_t);
+  }
+  uint32_t frames = pending_sends_.fetch_sub(nb_frames, std::memory_order_relaxed) - nb_frames;
+  uint64_t bytes = pending_bytes_.fetch_sub(nb_bytes, std::memory_order_relaxed) - nb_bytes;
+  if(congested() && frames <= limits_.low_frames && bytes <= limits_.low_bytes) {
+    drained();
+  }
+  std::vector<Outbound> writing;
+  writing.swap(writing_);
+  for(auto &outbound : writing) {
+    if(outbound.trace) {
+      outbound.trace->mark(Trace::Stage::WriteCompleted);
+    }
+    std::size_t length = ec ? 0 : outbound.frame->size() + sizeof(uint32_t);
+    if(!ec) {
+      sent_.fetch_add(1, std::memory_order_relaxed);
+      sent_bytes_.fetch_add(length, std::memory_order_relaxed);
+    }
+    if(outbound.continuation) {
+      outbound.continuation(ec, length);
+    }
+  }
+  writing.clear();
+  writing_.swap(writing); // keeps the capacity
+  if(outbound_size_.fetch_sub(nb_frames, std::memory_order_acq_rel) != nb_frames) {
+    drain();
+  }
+}
+
+AgentSession::Stats AgentSession::stats() const {
+  Stats stats{received_.load(std::memory_order_relaxed), sent_.load(std::memory_order_relaxed),
+    sent_bytes_.load(std::memory_order_relaxed), pending_sends_.load(std::memory_order_relaxed),
+    pending_bytes_.load(std::memory_order_relaxed), congested(), 0};
+  std::lock_guard<std::mutex> lock(out_lock_);
+  stats.batched = uint32_t(pending_continuations_[0].size() + pending_continuations_[1].size());
+  return stats;
+}
+
+namespace {
+  /* Whether the Envelope read from `input` carries a message for other agents, without parsing it */
+  bool bulk_envelope(google::protobuf::io::CodedInputStream &input) {
+    using google::protobuf::internal::WireFormatLite;
+    while(uint32_t tag = input.ReadTag()) {
+      auto field = WireFormatLite::GetTagFieldNumber(tag);
+      if(field == fetch::oef::pb::Envelope::kSendMessageFieldNumber
+          || field == fetch::oef::pb::Envelope::kBroadcastMessageFieldNumber) {
+        return true;
+      }
+      if(!WireFormatLite::SkipField(&input, tag)) {
+        break;
+      }
+    }
+    return false;
+  }
+}
+
+Priority AgentSession::priority(const Buffer &frame, bool batching) {
+  using google::protobuf::internal::WireFormatLite;
+  google::protobuf::io::CodedInputStream input{frame.data(), int(frame.size())};
+  if(!batching) {
+    return bulk_envelope(input) ? Priority::Bulk : Priority::Control;
+  }
+  // a batch is Bulk as soon as one of its envelopes is
+  while(uint32_t tag = input.ReadTag()) {
+    uint32_t length = 0;
+    if(WireFormatLite::GetTagFieldNumber(tag) != 1 // EnvelopeBatch.envelopes
+        || WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if(!WireFormatLite::SkipField(&input, tag)) {
+        break;
+      }
+    } else if(!input.ReadVarint32(&length)) {
+      break;
+    } else {
+      auto limit = input.PushLimit(int(length));
+      if(bulk_envelope(input)) {
+        return Priority::Bulk;
+      }
+      input.PopLimit(limit);
+    }
+  }
+  return Priority::Control;
+}
+
 void AgentSession::process(const std::shared_ptr<Buffer> &buffer) {
-  auto envelope = pbs::deserialize<fetch::oef::pb::Envelope>(*buffer);
+  if(!batching_) {
+    auto envelope = pbs::deserialize<fetch::oef::pb::Envelope>(*buffer);
+    Tracer::mark(Trace::Stage::Parsed);
+    process(envelope);
+    return;
+  }
+  batch_ = pbs::deserialize<fetch::oef::pb::EnvelopeBatch>(*buffer);
+  next_ = 0;
+  Tracer::mark(Trace::Stage::Parsed);
+  logger.trace("AgentSession::process batch of {} envelopes from {}", batch_.envelopes_size(), publicKey_);
+  process_batch();
+}
+
+void AgentSession::process_batch() {
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    holding_ = true;
+  }
+  for(uint32_t processed = 1; batch_pending(); ++processed) {
+    process(*batch_.mutable_envelopes(next_++));
+    if(processed == fairness_budget_ || congested_destination_ || delay_ > TokenBucket::Clock::duration::zero()) {
+      break;
+    }
+  }
+  if(!batch_pending()) {
+    batch_.Clear();
+    next_ = 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    holding_ = false;
+  }
+  flush();
+}
+
+void AgentSession::process(fetch::oef::pb::Envelope &envelope) {
   auto payload_case = envelope.payload_case();
+  envelope_counter(payload_case).inc();
+  auto operation = RateLimits::operation(payload_case);
+  if(operation != RateLimits::Operation::Other && io_context_) {
+    delay_ = std::max(delay_, buckets_[static_cast<int>(operation)].take());
+  }
+  if(Tracer::current()) {
+    const auto *field = fetch::oef::pb::Envelope::descriptor()->FindFieldByNumber(payload_case);
+    Tracer::current()->name(field ? field->name() : "none");
+  }
   uint32_t msg_id = envelope.msg_id();
   switch(payload_case) {
     case fetch::oef::pb::Envelope::kSendMessage:
@@ -255,6 +800,15 @@ void AgentSession::process(const std::shared_ptr<Buffer> &buffer) {
     case fetch::oef::pb::Envelope::kSearchServicesWide:
       process_search_service_wide(msg_id, envelope.search_services_wide());
       break;
+    case fetch::oef::pb::Envelope::kSubscribeServices:
+      process_subscribe_services(msg_id, envelope.subscribe_services());
+      break;
+    case fetch::oef::pb::Envelope::kUnsubscribeServices:
+      process_unsubscribe_services(msg_id, envelope.unsubscribe_services());
+      break;
+    case fetch::oef::pb::Envelope::kBroadcastMessage:
+      process_broadcast(msg_id, envelope.broadcast_message());
+      break;
     case fetch::oef::pb::Envelope::PAYLOAD_NOT_SET:
       logger.error("AgentSession::process cannot process payload {} from {}", payload_case, publicKey_);
   }
@@ -264,14 +818,115 @@ void AgentSession::read() {
         auto self(shared_from_this());
         comm_->receive_async([this, self](std::error_code ec, std::shared_ptr<Buffer> buffer) {
                                 if(ec) {
-                                  agentDirectory_.remove(publicKey_);
-                                  logger.info("AgentSession::read error on id {} ec {}", publicKey_, ec);
+                                  disconnected(ec);
                                 } else {
+                                  received_.fetch_add(1, std::memory_order_relaxed);
+                                  TraceScope scope{Tracer::sample(publicKey_)};
+                                  Tracer::mark(Trace::Stage::FrameReceived);
+                                  if(bulk_lane_ && priority(*buffer, batching_) == Priority::Bulk) {
+                                    bulk_frames.inc();
+                                    asio::post(*bulk_lane_, [this, self, buffer, trace = Tracer::current()]() {
+                                          TraceScope scope{trace};
+                                          process(buffer);
+                                          read_next();
+                                        });
+                                    return;
+                                  }
                                   process(buffer);
-                                  read();
+                                  read_next();
                                 }
                              });
 }
 
+void AgentSession::read_next() {
+  if(!waiting()) {
+    read();
+    return;
+  }
+  wait([self = shared_from_this()]() { self->resume(); });
+}
+
+void AgentSession::wait(VoidContinuation continuation) {
+  if(congested_destination_) {
+    paused_reads.inc();
+    auto destination = std::move(congested_destination_);
+    logger.debug("AgentSession::wait pausing {} until {} drains", publicKey_, destination->agent_id());
+    destination->when_drained(std::move(continuation));
+    return;
+  }
+  auto delay = delay_;
+  delay_ = TokenBucket::Clock::duration::zero();
+  if(delay > TokenBucket::Clock::duration::zero()) {
+    delayed_reads.inc();
+    logger.trace("AgentSession::wait delaying {} by {} us", publicKey_,
+        std::chrono::duration_cast<std::chrono::microseconds>(delay).count());
+    auto timer = std::make_shared<asio::steady_timer>(*io_context_, delay);
+    timer->async_wait([timer, continuation = std::move(continuation)](std::error_code) mutable { continuation(); });
+    return;
+  }
+  if(io_context_) {
+    yielded_reads.inc();
+    asio::post(*io_context_, std::move(continuation));
+    return;
+  }
+  continuation();
+}
+
+void AgentSession::resume() {
+  if(!batch_pending()) {
+    read();
+    return;
+  }
+  process_batch();
+  read_next();
+}
+
+void AgentSession::disconnected(std::error_code ec) {
+  agentDirectory_.remove(publicKey_);
+  oef_search_.agent_detached(publicKey_);
+  subscriptions_.remove_all(publicKey_);
+  logger.info("AgentSession::read error on id {} ec {}", publicKey_, ec);
+  drained(); // its paused senders won't wait for it
+}
+
+#ifdef OEF_CORE_COROUTINES
+Detached AgentSession::serve(std::shared_ptr<AgentSession> self) {
+  for(;;) {
+    std::error_code ec;
+    std::shared_ptr<Buffer> buffer;
+    std::tie(ec, buffer) = co_await completion<std::shared_ptr<Buffer>>([&self](BufferContinuation continuation) {
+          self->comm_->receive_async(std::move(continuation));
+        });
+    if(ec) {
+      self->disconnected(ec);
+      co_return;
+    }
+    self->received_.fetch_add(1, std::memory_order_relaxed);
+    auto trace = Tracer::sample(self->publicKey_);
+    if(trace) {
+      trace->mark(Trace::Stage::FrameReceived);
+    }
+    if(self->bulk_lane_ && priority(*buffer, self->batching_) == Priority::Bulk) {
+      bulk_frames.inc();
+      co_await completion<bool>([&self](auto resume) {
+            asio::post(*self->bulk_lane_, [resume = std::move(resume)]() mutable { resume(std::error_code{}, true); });
+          });
+    }
+    {
+      TraceScope scope{std::move(trace)};
+      self->process(buffer);
+    }
+    while(self->waiting()) {
+      co_await completion<bool>([&self](auto resume) {
+            self->wait([resume = std::move(resume)]() mutable { resume(std::error_code{}, true); });
+          });
+      if(self->batch_pending()) {
+        self->process_batch();
+      }
+    }
+  }
+}
+#endif
+
 } // oef
 } // fetch
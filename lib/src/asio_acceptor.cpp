@@ -20,9 +20,14 @@
 #include "asio_communicator.hpp"
 
 #include <iostream>
+#include <system_error>
+
+#include <unistd.h>
 
 namespace fetch {
 namespace oef {
+
+  fetch::oef::Logger AsioLocalAcceptor::logger = fetch::oef::Logger("asio-local-acceptor");
     
   void AsioAcceptor::do_accept_async(
       CommunicatorContinuation continuation) {
@@ -36,6 +41,48 @@ namespace oef {
                              });
 
   }
+  AsioLocalAcceptor::AsioLocalAcceptor(asio::io_context& io_context, std::string path, uint32_t backlog)
+    : acceptor_{io_context}
+    , path_{std::move(path)}
+  {
+    listen(acceptor_, path_, backlog);
+  }
+
+  void AsioLocalAcceptor::listen(asio::local::stream_protocol::acceptor& acceptor, const std::string& path, 
+      uint32_t backlog) {
+    asio::local::stream_protocol::endpoint endpoint{path};
+    // a core which did not stop cleanly leaves its socket file behind: remove it, unless it is still served
+    asio::local::stream_protocol::socket probe{acceptor.get_executor().context()};
+    std::error_code ec;
+    probe.connect(endpoint, ec);
+    if (!ec) {
+      throw std::system_error(asio::error::make_error_code(asio::error::address_in_use), path);
+    }
+    if (ec == asio::error::connection_refused) {
+      ::unlink(path.c_str());
+    }
+    acceptor.open(endpoint.protocol());
+    acceptor.bind(endpoint);
+    acceptor.listen(backlog);
+  }
+
+  AsioLocalAcceptor::~AsioLocalAcceptor() {
+    std::error_code ec;
+    acceptor_.close(ec);
+    ::unlink(path_.c_str());
+  }
+
+  void AsioLocalAcceptor::do_accept_async(
+      CommunicatorContinuation continuation) {
+    acceptor_.async_accept([continuation](std::error_code ec, asio::local::stream_protocol::socket socket) {
+                               if (ec) {
+                                 logger.error("AsioLocalAcceptor::do_accept_async error {}", ec.value());
+                               } else {
+                                 continuation(ec,std::make_shared<AsioComm>(std::move(socket)));
+                               }
+                             });
+  }
+
   std::string AsioAcceptor::local_address() {
     return acceptor_.local_endpoint().address().to_string();
   }
@@ -18,23 +18,42 @@
 
 #include "asio_communicator.hpp"
 
-#include <iostream>
 #include <string>
 
 namespace fetch {
 namespace oef {
 
+fetch::oef::Logger AsioComm::logger = fetch::oef::Logger("asio-comm");
+fetch::oef::Gauge AsioComm::queued_sends{"oef_send_queue_depth", "",
+  "Asynchronous sends not completed yet, all connections"};
+fetch::oef::Histogram AsioComm::send_queue_depth{"oef_session_send_queue_depth", "",
+  "Asynchronous sends not completed yet on a connection, when queueing a new one"};
+
 AsioComm::AsioComm(asio::io_context& io_context, std::string to_ip_addr, uint32_t to_port) 
   : socket_(io_context) 
 {
   tcp::resolver resolver(io_context);
+  tcp::socket socket(io_context);
   try {
-    asio::connect(socket_, resolver.resolve(to_ip_addr,std::to_string(to_port)));
+    asio::connect(socket, resolver.resolve(to_ip_addr,std::to_string(to_port)));
   } catch (std::exception& e) {
-    std::cerr << "AsioComm::AsioComm: error connecting to " << to_ip_addr << ":" << std::to_string(to_port) 
-              << " : " << e.what() << std::endl;
+    logger.error("AsioComm::AsioComm: error connecting to {}:{} : {}", to_ip_addr, to_port, e.what());
     throw;
   }
+  socket_ = std::move(socket);
+}
+
+AsioComm::AsioComm(asio::io_context& io_context, const std::string& path) 
+  : socket_(io_context) 
+{
+  asio::local::stream_protocol::socket socket(io_context);
+  try {
+    socket.connect(asio::local::stream_protocol::endpoint(path));
+  } catch (std::exception& e) {
+    logger.error("AsioComm::AsioComm: error connecting to {} : {}", path, e.what());
+    throw;
+  }
+  socket_ = std::move(socket);
 }
 
 void AsioComm::disconnect() {
@@ -42,24 +61,63 @@ void AsioComm::disconnect() {
     socket_.shutdown(asio::socket_base::shutdown_type::shutdown_both);
     socket_.close();
   } catch (std::exception& e) {
-    std::cerr << "Exception during disconnect: " << e.what() << std::endl;
+    logger.error("AsioComm::disconnect exception during disconnect: {}", e.what());
   }
 }
 
+void AsioComm::shutdown() {
+  std::error_code ec;
+  socket_.shutdown(asio::socket_base::shutdown_type::shutdown_both, ec);
+}
+
 void AsioComm::send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) {
   std::vector<asio::const_buffer> buffers;
-  uint32_t len = uint32_t(buffer->size());
-  buffers.emplace_back(asio::buffer(&len, sizeof(len)));
-  buffers.emplace_back(asio::buffer(buffer->data(), len));
-  uint32_t total = len+sizeof(len);
+  // size and data have to outlive the asynchronous write
+  auto len = std::make_shared<uint32_t>(uint32_t(buffer->size()));
+  buffers.emplace_back(asio::buffer(len.get(), sizeof(uint32_t)));
+  buffers.emplace_back(asio::buffer(buffer->data(), *len));
+  uint32_t total = *len+sizeof(uint32_t);
+  send_queue_depth.observe(pending_sends_->fetch_add(1, std::memory_order_relaxed) + 1);
+  queued_sends.add(1);
   asio::async_write(socket_, buffers,
-      [total,continuation](std::error_code ec, std::size_t length) {
+      [total,len,buffer,continuation=std::move(continuation),pending=pending_sends_](std::error_code ec, 
+          std::size_t length) {
+        pending->fetch_sub(1, std::memory_order_relaxed);
+        queued_sends.add(-1);
         if(ec) {
-          std::cerr << "AsioComm::send_async: error while sending data and its size (grouped): " 
-                    << length << " expected " << total << std::endl;
-        } else {
-          continuation(ec, length);
+          logger.error("AsioComm::send_async: error while sending data and its size (grouped): {} expected {}", 
+              length, total);
+        }
+        continuation(ec, length);
+      });
+}
+
+void AsioComm::send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) {
+  // sizes and data have to outlive the asynchronous write
+  auto lens = std::make_shared<std::vector<uint32_t>>();
+  lens->reserve(buffers.size()); // buffers_all points into it
+  std::vector<asio::const_buffer> buffers_all;
+  buffers_all.reserve(2*buffers.size());
+  std::size_t total = 0;
+  for(auto& buffer : buffers) {
+    lens->emplace_back(uint32_t(buffer->size()));
+    buffers_all.emplace_back(asio::buffer(&lens->back(), sizeof(uint32_t)));
+    buffers_all.emplace_back(asio::buffer(buffer->data(), buffer->size()));
+    total += buffer->size()+sizeof(uint32_t);
+  }
+  auto nb_buffers = uint32_t(buffers.size());
+  send_queue_depth.observe(pending_sends_->fetch_add(nb_buffers, std::memory_order_relaxed) + nb_buffers);
+  queued_sends.add(nb_buffers);
+  asio::async_write(socket_, buffers_all,
+      [total,lens,buffers=std::move(buffers),continuation=std::move(continuation),pending=pending_sends_,
+          nb_buffers](std::error_code ec, std::size_t length) {
+        pending->fetch_sub(nb_buffers, std::memory_order_relaxed);
+        queued_sends.add(-int64_t(nb_buffers));
+        if(ec) {
+          logger.error("AsioComm::send_async: error while sending {} buffers: {} expected {}", 
+              nb_buffers, length, total);
         }
+        continuation(ec, length);
       });
 }
 
@@ -70,19 +128,17 @@ void AsioComm::send_async(std::shared_ptr<Buffer> buffer) {
 void AsioComm::receive_async(BufferContinuation continuation) {
   auto len = std::make_shared<uint32_t>();
   asio::async_read(socket_, asio::buffer(len.get(), sizeof(uint32_t)), 
-      [this,len,continuation](std::error_code ec, std::size_t length) {
+      [this,len,continuation=std::move(continuation)](std::error_code ec, std::size_t length) mutable {
         if(ec) {
-          std::cerr << "AsioComm::receive_async: error while receiving the size of data " 
-                    << ec.value() << std::endl;
+          logger.error("AsioComm::receive_async: error while receiving the size of data {}", ec.value());
           continuation(ec, std::make_shared<Buffer>());
         } else {
           assert(length == sizeof(uint32_t));
           auto buffer = std::make_shared<Buffer>(*len);
           asio::async_read(socket_, asio::buffer(buffer->data(), *len), 
-              [buffer,continuation](std::error_code ec, std::size_t length) {
+              [buffer,continuation=std::move(continuation)](std::error_code ec, std::size_t length) {
                 if(ec) {
-                  std::cerr << "AsioComm::receive_async: error while receiving the data " 
-                            << ec.value() << std::endl;
+                  logger.error("AsioComm::receive_async: error while receiving the data {}", ec.value());
                 }
                 continuation(ec, buffer);
               });
@@ -99,8 +155,7 @@ std::error_code AsioComm::send_sync(std::shared_ptr<Buffer> buffer) {
   std::error_code ec;
   std::size_t length = asio::write(socket_, buffers, ec);
   if (length != total) {
-    std::cerr << "AsioComm::send_sync error sent " << length << " expected " << total 
-      << " : " << ec.value() << std::endl;
+    logger.error("AsioComm::send_sync error sent {} expected {} : {}", length, total, ec.value());
     // TOFIX should connection be closed?
   }
   return ec;
@@ -109,6 +164,7 @@ std::error_code AsioComm::send_sync(std::shared_ptr<Buffer> buffer) {
 std::error_code AsioComm::send_sync(std::vector<std::shared_ptr<Buffer>> buffers) {
   std::vector<asio::const_buffer> buffers_all;
   std::vector<uint32_t> len_all;
+  len_all.reserve(buffers.size()); // buffers_all points into it
   uint32_t total = 0;
   for(auto& buffer : buffers) {
     len_all.emplace_back(uint32_t(buffer->size()));
@@ -120,8 +176,7 @@ std::error_code AsioComm::send_sync(std::vector<std::shared_ptr<Buffer>> buffers
   std::error_code ec;
   std::size_t length = asio::write(socket_, buffers_all, ec);
   if (length != total) {
-    std::cerr << "AsioComm::send_sync error sent " << length << " expected " << total 
-      << " : " << ec.value() << std::endl;
+    logger.error("AsioComm::send_sync error sent {} expected {} : {}", length, total, ec.value());
     // TOFIX should connection be closed?
   }
   return ec;
@@ -132,16 +187,14 @@ std::error_code AsioComm::receive_sync(std::shared_ptr<Buffer>& buffer) {
   std::error_code ec;
   auto length = asio::read(socket_, asio::buffer(len.get(), sizeof(uint32_t)), ec);
   if (ec || length!=sizeof(uint32_t)) { // TOFIX testing length is not needed
-    std::cerr << "AsioComm::receive_sync error while receivin lenght of data, got " << length 
-              << " : ec " << ec.value() << std::endl;
+    logger.error("AsioComm::receive_sync error while receiving length of data, got {} : ec {}", length, ec.value());
     // TOFIX should connection be closed?
     return ec;
   }
   buffer = std::make_shared<Buffer>(*len);
   length = asio::read(socket_, asio::buffer(buffer->data(), *len), ec);
   if (ec || length!=*len) { // TOFIX testing length is not needed
-    std::cerr << "AsioComm::receive_sync error while receiving data " << ec.value() 
-              << " - got " << length << "expected " << len << std::endl;
+    logger.error("AsioComm::receive_sync error while receiving data {} - got {} expected {}", ec.value(), length, *len);
     // TOFIX should connection be closed?
     return ec;
   }
@@ -157,8 +210,7 @@ std::error_code AsioComm::send_sync(asio::const_buffer& buffer) {
   std::error_code ec;
   std::size_t length = asio::write(socket_, buffers, ec);
   if (length != total) {
-    std::cerr << "AsioComm::send_sync error sent " << length << " expected " << total 
-      << " : " << ec.value() << std::endl;
+    logger.error("AsioComm::send_sync error sent {} expected {} : {}", length, total, ec.value());
     // TOFIX should connection be closed?
   }
   return ec;
@@ -0,0 +1,519 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "async_logger.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace fetch {
+namespace oef {
+namespace logrec {
+
+template <typename T>
+static bool get(const uint8_t *&p, const uint8_t *end, T &v) {
+  if(std::size_t(end - p) < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+std::size_t read(const uint8_t *data, std::size_t size, Record &record) {
+  const uint8_t *p = data;
+  uint32_t record_size = 0;
+  uint8_t nb_args = 0;
+  if(!get(p, data + size, record_size) || record_size < header_size || record_size > size) {
+    return 0;
+  }
+  const uint8_t *end = data + record_size;
+  get(p, end, record.time);
+  get(p, end, record.thread);
+  get(p, end, record.level);
+  get(p, end, record.section);
+  get(p, end, record.format);
+  get(p, end, nb_args);
+  record.args.resize(nb_args);
+  for(auto &arg : record.args) {
+    if(!get(p, end, arg.tag)) {
+      return 0;
+    }
+    uint8_t b = 0;
+    uint32_t len = 0;
+    bool ok = false;
+    switch(arg.tag) {
+    case Tag::Int:
+      ok = get(p, end, arg.i);
+      break;
+    case Tag::UInt:
+      ok = get(p, end, arg.u);
+      break;
+    case Tag::Double:
+      ok = get(p, end, arg.d);
+      break;
+    case Tag::Bool:
+      ok = get(p, end, b);
+      arg.u = b;
+      break;
+    case Tag::String:
+      ok = get(p, end, len) && std::size_t(end - p) >= len;
+      if(ok) {
+        arg.s.assign(reinterpret_cast<const char *>(p), len);
+        p += len;
+      }
+      break;
+    }
+    if(!ok) {
+      return 0;
+    }
+  }
+  return record_size;
+}
+
+static void append(std::string &out, const Arg &arg) {
+  switch(arg.tag) {
+  case Tag::Int:
+    out += std::to_string(arg.i);
+    break;
+  case Tag::UInt:
+    out += std::to_string(arg.u);
+    break;
+  case Tag::Double:
+    out += fmt::format("{}", arg.d);
+    break;
+  case Tag::Bool:
+    out += arg.u ? "true" : "false";
+    break;
+  case Tag::String:
+    out += arg.s;
+    break;
+  }
+}
+
+std::string format(const char *format, const std::vector<Arg> &args) {
+  std::string out;
+  std::size_t next = 0;
+  for(const char *p = format; *p; ++p) {
+    if((p[0] == '{' && p[1] == '{') || (p[0] == '}' && p[1] == '}')) {
+      out += *p++;
+    } else if(p[0] == '{') {
+      const char *close = std::strchr(p, '}');
+      if(!close || next >= args.size()) {
+        out += p;
+        break;
+      }
+      append(out, args[next++]);
+      p = close;
+    } else {
+      out += *p;
+    }
+  }
+  return out;
+}
+} // logrec
+
+static uint64_t round_up_pow2(std::size_t v) {
+  uint64_t p = 64;
+  while(p < v) {
+    p <<= 1;
+  }
+  return p;
+}
+
+LogRing::LogRing(std::size_t capacity)
+  : buffer_(round_up_pow2(capacity))
+  , mask_{buffer_.size() - 1}
+{
+}
+
+bool LogRing::try_write(const std::vector<uint8_t> &record) {
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  uint64_t tail = tail_.load(std::memory_order_acquire);
+  if(buffer_.size() - (head - tail) < record.size()) {
+    return false;
+  }
+  std::size_t pos = head & mask_;
+  std::size_t first = std::min(record.size(), buffer_.size() - pos);
+  std::memcpy(&buffer_[pos], record.data(), first);
+  std::memcpy(&buffer_[0], record.data() + first, record.size() - first);
+  head_.store(head + record.size(), std::memory_order_release);
+  return true;
+}
+
+std::size_t LogRing::read(std::vector<uint8_t> &out) {
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  uint64_t head = head_.load(std::memory_order_acquire);
+  std::size_t size = head - tail;
+  if(!size) {
+    return 0;
+  }
+  std::size_t pos = tail & mask_;
+  std::size_t first = std::min(size, buffer_.size() - pos);
+  out.insert(out.end(), &buffer_[pos], &buffer_[pos] + first);
+  out.insert(out.end(), &buffer_[0], &buffer_[0] + (size - first));
+  tail_.store(head, std::memory_order_release);
+  return size;
+}
+
+namespace {
+  struct Registry {
+    std::mutex lock;
+    std::vector<std::string> sections;
+    std::unordered_map<std::string,uint16_t> section_ids;
+    std::vector<std::string> formats;
+    std::unordered_map<std::string,uint32_t> format_ids;
+  };
+
+  Registry &registry() {
+    static Registry r;
+    return r;
+  }
+
+  struct Backend {
+    std::mutex lock;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    AsyncLogger::Options options;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<uint64_t> dropped{0};
+    // used by the background thread only
+    std::ofstream binary;
+    std::vector<std::string> formats;
+    std::vector<std::string> sections;
+    std::vector<std::shared_ptr<spdlog::logger>> loggers;
+    std::size_t written_formats{0};
+    std::size_t written_sections{0};
+  };
+
+  Backend &backend() {
+    static Backend b;
+    return b;
+  }
+
+  struct RingHandle {
+    std::shared_ptr<LogRing> ring;
+    uint32_t generation{0};
+    ~RingHandle() {
+      if(ring) {
+        ring->closed = true;
+      }
+    }
+  };
+
+  LogRing &thread_ring() {
+    thread_local RingHandle handle;
+    auto &b = backend();
+    uint32_t generation = b.generation.load(std::memory_order_acquire);
+    if(!handle.ring || handle.generation != generation) {
+      if(handle.ring) {
+        handle.ring->closed = true;
+      }
+      std::lock_guard<std::mutex> lock(b.lock);
+      handle.ring = std::make_shared<LogRing>(b.options.ring_size);
+      handle.generation = generation;
+      b.rings.push_back(handle.ring);
+    }
+    return *handle.ring;
+  }
+
+  template <typename T>
+  void write_raw(std::ofstream &out, const T &v) {
+    out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+  }
+
+  void write_definitions(Backend &b, std::vector<std::string> &names, std::size_t &written, AsyncLogger::Entry entry) {
+    for(; written < names.size(); ++written) {
+      write_raw(b.binary, entry);
+      write_raw(b.binary, uint32_t(written));
+      write_raw(b.binary, uint32_t(names[written].size()));
+      b.binary.write(names[written].data(), names[written].size());
+    }
+  }
+
+  void refresh_names(Backend &b, const logrec::Record &record) {
+    if(record.format < b.formats.size() && record.section < b.sections.size()) {
+      return;
+    }
+    auto &r = registry();
+    std::lock_guard<std::mutex> lock(r.lock);
+    b.formats = r.formats;
+    b.sections = r.sections;
+  }
+
+  void process(Backend &b, const uint8_t *data, std::size_t size) {
+    logrec::Record record;
+    while(size) {
+      std::size_t record_size = logrec::read(data, size, record);
+      if(!record_size) {
+        return; // can't happen, records are written whole
+      }
+      refresh_names(b, record);
+      if(b.binary.is_open()) {
+        write_definitions(b, b.formats, b.written_formats, AsyncLogger::Entry::Format);
+        write_definitions(b, b.sections, b.written_sections, AsyncLogger::Entry::Section);
+        write_raw(b.binary, AsyncLogger::Entry::Record);
+        b.binary.write(reinterpret_cast<const char *>(data), record_size);
+      }
+      if(b.options.text && record.section < b.sections.size() && record.format < b.formats.size()) {
+        if(b.loggers.size() <= record.section) {
+          b.loggers.resize(b.sections.size());
+        }
+        auto &logger = b.loggers[record.section];
+        if(!logger) {
+          logger = spdlog::get(b.sections[record.section]);
+        }
+        if(logger) {
+          auto message = logrec::format(b.formats[record.format].c_str(), record.args);
+          auto level = static_cast<spdlog::level::level_enum>(record.level);
+          spdlog::details::log_msg msg{&b.sections[record.section], level, spdlog::string_view_t{message}};
+          msg.time = spdlog::log_clock::time_point{std::chrono::duration_cast<spdlog::log_clock::duration>(
+                std::chrono::nanoseconds{record.time})};
+          msg.thread_id = record.thread;
+          for(auto &sink : logger->sinks()) {
+            if(sink->should_log(level)) {
+              sink->log(msg);
+            }
+          }
+        }
+      }
+      data += record_size;
+      size -= record_size;
+    }
+  }
+
+  void flush(Backend &b) {
+    if(b.binary.is_open()) {
+      b.binary.flush();
+    }
+    for(auto &logger : b.loggers) {
+      if(logger) {
+        logger->flush();
+        break; // sections share their sinks
+      }
+    }
+  }
+
+  void run(Backend &b) {
+    static const char *dropped_format = "{} log records dropped (ring full)";
+    std::vector<uint8_t> data;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    bool dirty = false;
+    while(true) {
+      bool stopping = !b.running.load(std::memory_order_acquire);
+      {
+        std::lock_guard<std::mutex> lock(b.lock);
+        rings = b.rings;
+      }
+      bool any = false;
+      for(auto &ring : rings) {
+        data.clear();
+        bool closed = ring->closed.load(std::memory_order_acquire);
+        if(ring->read(data)) {
+          any = true;
+          process(b, data.data(), data.size());
+        }
+        uint64_t dropped = ring->dropped.exchange(0);
+        if(dropped) {
+          b.dropped += dropped;
+          logrec::Writer writer;
+          auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count();
+          writer.begin(uint64_t(now), uint64_t(spdlog::details::os::thread_id()), uint8_t(spdlog::level::warn),
+              AsyncLogger::section_id("async-logger"), AsyncLogger::format_id(dropped_format));
+          writer.add(dropped);
+          auto &record = writer.end();
+          process(b, record.data(), record.size());
+        }
+        if(closed && ring->empty()) {
+          std::lock_guard<std::mutex> lock(b.lock);
+          b.rings.erase(std::remove(b.rings.begin(), b.rings.end(), ring), b.rings.end());
+        }
+      }
+      dirty |= any;
+      if(any) {
+        continue;
+      }
+      if(dirty) {
+        flush(b);
+        dirty = false;
+      }
+      if(stopping) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+  }
+}
+
+constexpr const char *AsyncLogger::magic;
+std::atomic<bool> AsyncLogger::started_{false};
+
+void AsyncLogger::start(Options options) {
+  auto &b = backend();
+  if(started()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(b.lock);
+    b.options = std::move(options);
+    b.rings.clear();
+    b.loggers.clear();
+    b.written_formats = 0;
+    b.written_sections = 0;
+    if(!b.options.binary_path.empty()) {
+      b.binary.open(b.options.binary_path, std::ios::binary | std::ios::trunc);
+      if(!b.binary) {
+        throw std::runtime_error("AsyncLogger: cannot open " + b.options.binary_path);
+      }
+      b.binary.write(magic, std::strlen(magic));
+    }
+  }
+  ++b.generation;
+  b.running = true;
+  b.thread = std::thread([&b]() { run(b); });
+  started_.store(true, std::memory_order_release);
+}
+
+void AsyncLogger::stop() {
+  auto &b = backend();
+  if(!started()) {
+    return;
+  }
+  started_.store(false, std::memory_order_release);
+  b.running = false;
+  b.thread.join();
+  std::lock_guard<std::mutex> lock(b.lock);
+  b.rings.clear();
+  if(b.binary.is_open()) {
+    b.binary.close();
+  }
+}
+
+uint64_t AsyncLogger::dropped() {
+  return backend().dropped.load();
+}
+
+uint16_t AsyncLogger::section_id(const std::string &section) {
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.lock);
+  auto iter = r.section_ids.find(section);
+  if(iter != r.section_ids.end()) {
+    return iter->second;
+  }
+  uint16_t id = uint16_t(r.sections.size());
+  r.sections.push_back(section);
+  r.section_ids[section] = id;
+  return id;
+}
+
+uint32_t AsyncLogger::format_id(const char *format) {
+  thread_local std::unordered_map<const char *,uint32_t> cache;
+  auto cached = cache.find(format);
+  if(cached != cache.end()) {
+    return cached->second;
+  }
+  // the same format may be at several addresses (e.g. a literal in several translation units)
+  std::string contents{format};
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.lock);
+  auto iter = r.format_ids.find(contents);
+  uint32_t id = 0;
+  if(iter != r.format_ids.end()) {
+    id = iter->second;
+  } else {
+    id = uint32_t(r.formats.size());
+    r.formats.push_back(contents);
+    r.format_ids.emplace(std::move(contents), id);
+  }
+  cache[format] = id;
+  return id;
+}
+
+void AsyncLogger::write_(const std::vector<uint8_t> &record) {
+  auto &b = backend();
+  auto &ring = thread_ring();
+  if(record.size() > ring.capacity()) {
+    ++ring.dropped;
+    return;
+  }
+  if(ring.try_write(record)) {
+    return;
+  }
+  if(b.options.overflow == Overflow::Drop) {
+    ++ring.dropped;
+    return;
+  }
+  while(!ring.try_write(record)) {
+    if(!started()) {
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+BinaryLogReader::BinaryLogReader(const std::string &path)
+  : in_{path, std::ios::binary}
+{
+  std::string magic(std::strlen(AsyncLogger::magic), '\0');
+  if(!in_ || !in_.read(&magic[0], magic.size()) || magic != AsyncLogger::magic) {
+    throw std::runtime_error("BinaryLogReader: " + path + " is not a binary log file");
+  }
+}
+
+bool BinaryLogReader::next(logrec::Record &record, std::string &section, std::string &message) {
+  AsyncLogger::Entry entry;
+  while(in_.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+    if(entry == AsyncLogger::Entry::Record) {
+      uint32_t size = 0;
+      if(!in_.read(reinterpret_cast<char *>(&size), sizeof(size)) || size < sizeof(size)) {
+        return false;
+      }
+      data_.resize(size);
+      std::memcpy(data_.data(), &size, sizeof(size));
+      if(!in_.read(reinterpret_cast<char *>(data_.data() + sizeof(size)), size - sizeof(size))
+          || !logrec::read(data_.data(), data_.size(), record)) {
+        return false;
+      }
+      section = record.section < sections_.size() ? sections_[record.section] : "?";
+      message = record.format < formats_.size() ? logrec::format(formats_[record.format].c_str(), record.args) : "?";
+      return true;
+    }
+    uint32_t id = 0, len = 0;
+    if(!in_.read(reinterpret_cast<char *>(&id), sizeof(id)) || !in_.read(reinterpret_cast<char *>(&len), sizeof(len))) {
+      return false;
+    }
+    std::string name(len, '\0');
+    if(!in_.read(&name[0], len)) {
+      return false;
+    }
+    auto &names = entry == AsyncLogger::Entry::Format ? formats_ : sections_;
+    if(names.size() <= id) {
+      names.resize(id + 1);
+    }
+    names[id] = std::move(name);
+  }
+  return false;
+}
+
+} // oef
+} // fetch
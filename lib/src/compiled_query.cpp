@@ -0,0 +1,170 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "compiled_query.hpp"
+
+namespace fetch {
+namespace oef {
+
+CompiledQuery::CompiledQuery(const fetch::oef::pb::Query_Model &model)
+  : model_{std::make_shared<const fetch::oef::pb::Query_Model>(model)}
+{
+  if(model_->has_model()) {
+    model_name_ = model_->model().name();
+  }
+  for(auto &c : model_->constraints()) {
+    roots_.push_back(nodes_.size());
+    compile_(c);
+  }
+  for(auto root : roots_) {
+    const Node &node = nodes_[root];
+    if(node.kind == Kind::StringEq) {
+      equality_key_ = std::make_pair(node.attribute, node.value);
+      break;
+    }
+  }
+}
+
+void CompiledQuery::compile_(const fetch::oef::pb::Query_ConstraintExpr &expr) {
+  std::size_t idx = nodes_.size();
+  nodes_.emplace_back(Node{Kind::Constraint, 1, 0, nullptr, "", "", false, {}, {}});
+  switch(expr.expression_case()) {
+  case fetch::oef::pb::Query_ConstraintExpr::kOr:
+    nodes_[idx].kind = Kind::Or;
+    nodes_[idx].nb_children = expr.or_().expr_size();
+    for(auto &c : expr.or_().expr()) {
+      compile_(c);
+    }
+    break;
+  case fetch::oef::pb::Query_ConstraintExpr::kAnd:
+    nodes_[idx].kind = Kind::And;
+    nodes_[idx].nb_children = expr.and_().expr_size();
+    for(auto &c : expr.and_().expr()) {
+      compile_(c);
+    }
+    break;
+  case fetch::oef::pb::Query_ConstraintExpr::kNot:
+    nodes_[idx].kind = Kind::Not;
+    nodes_[idx].nb_children = 1;
+    compile_(expr.not_().expr());
+    break;
+  case fetch::oef::pb::Query_ConstraintExpr::kConstraint:
+    compile_constraint_(expr.constraint());
+    break;
+  case fetch::oef::pb::Query_ConstraintExpr::EXPRESSION_NOT_SET:
+    // leaf without constraint, never matches
+    break;
+  }
+  nodes_[idx].size = static_cast<uint32_t>(nodes_.size() - idx);
+}
+
+void CompiledQuery::compile_constraint_(const fetch::oef::pb::Query_ConstraintExpr_Constraint &constraint) {
+  Node &node = nodes_.back();
+  node.constraint = &constraint;
+  node.attribute = constraint.attribute_name();
+  if(constraint.has_relation() && constraint.relation().val().has_s()) {
+    auto op = constraint.relation().op();
+    if(op == fetch::oef::pb::Query_Relation_Operator_EQ || op == fetch::oef::pb::Query_Relation_Operator_NOTEQ) {
+      node.kind = op == fetch::oef::pb::Query_Relation_Operator_EQ ? Kind::StringEq : Kind::StringNotEq;
+      node.value = constraint.relation().val().s();
+    }
+    return;
+  }
+  if(constraint.has_set_()) {
+    const auto &vals = constraint.set_().vals();
+    if(vals.has_s() || vals.has_i()) {
+      node.kind = Kind::SetLookup;
+      node.negate = constraint.set_().op() == fetch::oef::pb::Query_Set_Operator_NOTIN;
+      node.strings.insert(vals.s().vals().begin(), vals.s().vals().end());
+      node.ints.insert(vals.i().vals().begin(), vals.i().vals().end());
+    }
+  }
+}
+
+bool CompiledQuery::check(const Instance &instance) const {
+  if(!model_name_.empty() && model_name_ != instance.model().name()) {
+    return false;
+  }
+  for(auto root : roots_) {
+    if(!eval_(root, instance)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CompiledQuery::eval_(std::size_t idx, const Instance &instance) const {
+  const Node &node = nodes_[idx];
+  std::size_t child = idx + 1;
+  switch(node.kind) {
+  case Kind::And:
+    for(uint32_t n = 0; n < node.nb_children; ++n, child += nodes_[child].size) {
+      if(!eval_(child, instance)) {
+        return false;
+      }
+    }
+    return true;
+  case Kind::Or:
+    for(uint32_t n = 0; n < node.nb_children; ++n, child += nodes_[child].size) {
+      if(eval_(child, instance)) {
+        return true;
+      }
+    }
+    return false;
+  case Kind::Not:
+    return !eval_(child, instance);
+  default:
+    return eval_leaf_(node, instance);
+  }
+}
+
+bool CompiledQuery::eval_leaf_(const Node &node, const Instance &instance) const {
+  if(!node.constraint) {
+    return false;
+  }
+  const VariantType *v = instance.find(node.attribute);
+  if(!v) {
+    return false;
+  }
+  switch(node.kind) {
+  case Kind::StringEq:
+    if(v->is<std::string>()) {
+      return v->get<std::string>() == node.value;
+    }
+    break;
+  case Kind::StringNotEq:
+    if(v->is<std::string>()) {
+      return v->get<std::string>() != node.value;
+    }
+    break;
+  case Kind::SetLookup:
+    if(v->is<std::string>()) {
+      return (node.strings.count(v->get<std::string>()) == 1) != node.negate;
+    }
+    if(v->is<int>()) {
+      return (node.ints.count(v->get<int>()) == 1) != node.negate;
+    }
+    break;
+  default:
+    break;
+  }
+  return Constraint::check(*node.constraint, *v);
+}
+
+} // oef
+} // fetch
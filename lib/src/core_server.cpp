@@ -16,15 +16,24 @@
 //
 //------------------------------------------------------------------------------
 
-#define DEBUG_ON 1
 #include "core_server.hpp"
 #include "agent_session.hpp"
 
+#include <cerrno>
+#include <tuple>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 namespace fetch {
 namespace oef {
     fetch::oef::Logger CoreServer::logger = fetch::oef::Logger("oef-node");
+    fetch::oef::Histogram CoreServer::handshake_duration{"oef_handshake_duration_us", "",
+      "Time from the connection of an agent to its Connected answer in microseconds"};
     
     void CoreServer::run() {
+      run_bulk_lane();
       for(auto &t : threads_) {
         if(!t) {
           t = std::make_unique<std::thread>([this]() {do_accept(); io_context_.run();});
@@ -33,18 +42,38 @@ namespace oef {
     }
 
     void CoreServer::run_in_thread() {
+      run_bulk_lane();
       do_accept();
       io_context_.run();
     }
 
+    void CoreServer::run_bulk_lane() {
+      for(auto &t : bulk_threads_) {
+        if(!t) {
+          t = std::make_unique<std::thread>([this]() {
+                // weighted against the io threads by the kernel scheduler
+                if(::setpriority(PRIO_PROCESS, id_t(::syscall(SYS_gettid)), config::core_bulk_lane_nice) != 0) {
+                  logger.warn("CoreServer::run_bulk_lane cannot lower the priority of the bulk lane: {}", errno);
+                }
+                bulk_context_.run();
+              });
+        }
+      }
+    }
+
     void CoreServer::do_accept() {
       logger.trace("CoreServer::do_accept (port {})", core_port_);
-      
-      do_accept([this](std::error_code ec, std::shared_ptr<communicator_t> comm) {
+      for(auto &acceptor : acceptors_) {
+        do_accept(*acceptor);
+      }
+    }
+
+    void CoreServer::do_accept(comm_acceptor_t &acceptor) {
+      acceptor.do_accept_async([this,&acceptor](std::error_code ec, std::shared_ptr<communicator_t> comm) {
                                if (!ec) {
                                  logger.trace("CoreServer::do_accept starting new session");
                                  newSession(std::move(comm));
-                                 do_accept();
+                                 do_accept(acceptor);
                                } else {
                                  logger.error("CoreServer::do_accept error {}", ec.value());
                                }
@@ -52,84 +81,263 @@ namespace oef {
     }
 
     void CoreServer::do_accept(CommunicatorContinuation continuation) {
-      acceptor_.do_accept_async(continuation);
+      for(auto &acceptor : acceptors_) {
+        acceptor->do_accept_async(continuation);
+      }
+    }
+
+    const std::shared_ptr<Buffer> &CoreServer::phrase_buffer() {
+      static const std::shared_ptr<Buffer> buffer = []() {
+        fetch::oef::pb::Server_Phrase phrase;
+        phrase.set_phrase("RandomlyGeneratedString");
+        return pbs::serialize(phrase);
+      }();
+      return buffer;
+    }
+
+    const std::shared_ptr<Buffer> &CoreServer::phrase_failure_buffer() {
+      static const std::shared_ptr<Buffer> buffer = []() {
+        fetch::oef::pb::Server_Phrase failure;
+        (void)failure.mutable_failure();
+        return pbs::serialize(failure);
+      }();
+      return buffer;
+    }
+
+    const std::shared_ptr<Buffer> &CoreServer::connected_buffer(bool status) {
+      static const std::shared_ptr<Buffer> buffers[2] = {
+        []() { fetch::oef::pb::Server_Connected c; c.set_status(false); return pbs::serialize(c); }(),
+        []() { fetch::oef::pb::Server_Connected c; c.set_status(true); return pbs::serialize(c); }()
+      };
+      return buffers[status ? 1 : 0];
     }
 
     void CoreServer::newSession(std::shared_ptr<communicator_t> comm_agent) {
+#ifdef OEF_CORE_COROUTINES
+      if(coroutines_) {
+        handshake(std::move(comm_agent));
+        return;
+      }
+#endif
+      auto start = std::chrono::steady_clock::now();
       comm_agent->receive_async(
-          [this,comm_agent](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+          [this,comm_agent,start](std::error_code ec, std::shared_ptr<Buffer> buffer) {
             if(ec) {
               logger.error("CoreServer::newSession read failure {}", ec.value());
-            } else {
-              try {
-                logger.trace("CoreServer::newSession received {} bytes", buffer->size());
-                auto id = pbs::deserialize<fetch::oef::pb::Agent_Server_ID>(*buffer);
-                logger.trace("Debug {}", pbs::to_string(id));
-                logger.trace("CoreServer::newSession connection from {}", id.public_key());
-                if(!agentDirectory_.exist(id.public_key())) { // not yet connected
-                  secretHandshake(id.public_key(), comm_agent);
-                } else {
-                  logger.info("CoreServer::newSession ID {} already connected", id.public_key());
-                  fetch::oef::pb::Server_Phrase failure;
-                  (void)failure.mutable_failure();
-                  comm_agent->send_async(pbs::serialize(failure));
-                }
-              } catch(std::exception &) {
-                logger.error("CoreServer::newSession error parsing ID");
-                fetch::oef::pb::Server_Phrase failure;
-                (void)failure.mutable_failure();
-                comm_agent->send_async(pbs::serialize(failure));
-              }
+              return;
+            }
+            logger.trace("CoreServer::newSession received {} bytes", buffer->size());
+            fetch::oef::pb::Agent_Server_ID id;
+            if(accept_id(*buffer, *comm_agent, id)) {
+              secretHandshake(id.public_key(), id.batching(), id.pipelined(), comm_agent, start);
             }
           });
     }
 
-    void CoreServer::secretHandshake(const std::string &publicKey, std::shared_ptr<communicator_t> comm) {
-      fetch::oef::pb::Server_Phrase phrase;
-      phrase.set_phrase("RandomlyGeneratedString");
-      auto phrase_buffer = pbs::serialize(phrase);
-      logger.trace("CoreServer::secretHandshake sending phrase size {}", phrase_buffer->size());
-      comm->send_async(phrase_buffer);
+    void CoreServer::secretHandshake(const std::string &publicKey, bool batching, bool pipelined, std::shared_ptr<communicator_t> comm,
+        std::chrono::steady_clock::time_point start) {
+      if(!pipelined) {
+        logger.trace("CoreServer::secretHandshake sending phrase size {}", phrase_buffer()->size());
+        comm->send_async(phrase_buffer());
+      }
       logger.trace("CoreServer::secretHandshake waiting answer");
       comm->receive_async(
-          [this,publicKey,comm](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+          [this,publicKey,batching,comm,start](std::error_code ec, std::shared_ptr<Buffer> buffer) {
             if(ec) {
               logger.error("CoreServer::secretHandshake read failure {}", ec.value());
-            } else {
-              try {
-                auto ans = pbs::deserialize<fetch::oef::pb::Agent_Server_Answer>(*buffer);
-                logger.trace("CoreServer::secretHandshake secret [{}]", ans.answer());
-                auto session = std::make_shared<AgentSession>(publicKey, std::move(comm), agentDirectory_, *oef_search_);
-                if(agentDirectory_.add(publicKey, std::static_pointer_cast<agent_session_t>(session))) {
-                // everything is fine -> send connection OK.
-                  session->start();
-                  fetch::oef::pb::Server_Connected status;
-                  status.set_status(true);
-                  session->send(pbs::serialize(status));
-                } else {
-                  fetch::oef::pb::Server_Connected status;
-                  status.set_status(false);
-                  logger.info("CoreServer::secretHandshake PublicKey already connected (interleaved) publicKey {}", publicKey);
-                  session->send(pbs::serialize(status));
-                }
-              // should check the secret with the public key i.e. ID.
-              } catch(std::exception &) {
-                logger.error("CoreServer::secretHandshake error on Answer publicKey {}", publicKey);
-                fetch::oef::pb::Server_Connected status;
-                status.set_status(false);
-                comm->send_async(pbs::serialize(status));
-              }
+              return;
             }
+            start_session(*buffer, publicKey, batching, false, comm, start);
           });
     }
+
+    bool CoreServer::accept_id(const Buffer &buffer, communicator_t &comm, fetch::oef::pb::Agent_Server_ID &id) {
+      bool status = false;
+      id = pbs::deserialize<fetch::oef::pb::Agent_Server_ID>(buffer, status);
+      if(!status) {
+        logger.error("CoreServer::accept_id error parsing ID");
+        comm.send_async(phrase_failure_buffer());
+        return false;
+      }
+      logger.trace("CoreServer::accept_id connection from {}", id.public_key());
+      if(agentDirectory_.exist(id.public_key())) {
+        logger.info("CoreServer::accept_id ID {} already connected", id.public_key());
+        // a pipelining agent only waits for Connected
+        comm.send_async(id.pipelined() ? connected_buffer(false) : phrase_failure_buffer());
+        return false;
+      }
+      return true;
+    }
+
+    void CoreServer::start_session(const Buffer &answer, const std::string &publicKey, bool batching, bool coroutines,
+        const std::shared_ptr<communicator_t> &comm, std::chrono::steady_clock::time_point start) {
+      bool status = false;
+      auto ans = pbs::deserialize<fetch::oef::pb::Agent_Server_Answer>(answer, status);
+      if(!status) {
+        logger.error("CoreServer::start_session error on Answer publicKey {}", publicKey);
+        comm->send_async(connected_buffer(false));
+        return;
+      }
+      logger.trace("CoreServer::start_session secret [{}]", ans.answer());
+      // should check the secret with the public key i.e. ID.
+      auto session = std::make_shared<AgentSession>(publicKey, comm, agentDirectory_, *oef_search_, 
+          subscriptions_, batching, outbound_limits_, rate_limits_);
+      session->schedule_on(io_context_, bulk_threads_.empty() ? nullptr : &bulk_context_);
+#ifdef OEF_CORE_COROUTINES
+      session->use_coroutines(coroutines);
+#endif
+      if(agentDirectory_.add(publicKey, std::static_pointer_cast<agent_session_t>(session))) {
+        // everything is fine -> send connection OK before any answer to the agent envelopes.
+        session->send(connected_buffer(true));
+        handshake_duration.observe_since(start);
+        oef_search_->agent_attached(publicKey);
+        session->start();
+      } else {
+        logger.info("CoreServer::start_session PublicKey already connected (interleaved) publicKey {}", publicKey);
+        session->send(connected_buffer(false));
+      }
+    }
     
+#ifdef OEF_CORE_COROUTINES
+    Detached CoreServer::handshake(std::shared_ptr<communicator_t> comm) {
+      auto start = std::chrono::steady_clock::now();
+      auto receive = [&comm](BufferContinuation continuation) { comm->receive_async(std::move(continuation)); };
+      std::error_code ec;
+      std::shared_ptr<Buffer> buffer;
+      std::tie(ec, buffer) = co_await completion<std::shared_ptr<Buffer>>(receive);
+      if(ec) {
+        logger.error("CoreServer::handshake read failure {}", ec.value());
+        co_return;
+      }
+      logger.trace("CoreServer::handshake received {} bytes", buffer->size());
+      fetch::oef::pb::Agent_Server_ID id;
+      if(!accept_id(*buffer, *comm, id)) {
+        co_return;
+      }
+      if(!id.pipelined()) {
+        logger.trace("CoreServer::handshake sending phrase size {}", phrase_buffer()->size());
+        comm->send_async(phrase_buffer());
+      }
+      std::tie(ec, buffer) = co_await completion<std::shared_ptr<Buffer>>(receive);
+      if(ec) {
+        logger.error("CoreServer::handshake read failure {}", ec.value());
+        co_return;
+      }
+      start_session(*buffer, id.public_key(), id.batching(), true, comm, start);
+    }
+#endif
+
+    void CoreServer::open_journal(const std::string &path) {
+      if(!oef_search_) {
+        logger.error("CoreServer::open_journal no OefSearchClient to journal registrations of");
+        return;
+      }
+      oef_search_->open_journal(path);
+    }
+
+    void CoreServer::listen_local(const std::string &path) {
+      try {
+        acceptors_.push_back(std::make_shared<AsioLocalAcceptor>(io_context_, path));
+        logger.info("CoreServer::listen_local accepting agents on {}", path);
+      } catch(std::exception &e) {
+        logger.error("CoreServer::listen_local cannot listen on {}: {}", path, e.what());
+      }
+    }
+
+    bool CoreServer::use_io_uring(IoUring::Options options) {
+      try {
+        uring_ = IoUring::create(io_context_, options);
+        acceptors_[0].reset(); // frees the port
+        acceptors_[0] = std::make_shared<UringAcceptor>(uring_, io_context_, core_port_);
+        logger.info("CoreServer::use_io_uring serving agents through io_uring");
+        return true;
+      } catch(std::exception &e) {
+        logger.warn("CoreServer::use_io_uring falling back to the asio reactor: {}", e.what());
+        if(uring_) {
+          uring_->shutdown();
+          uring_.reset();
+        }
+        if(!acceptors_[0]) {
+          acceptors_[0] = std::make_shared<AsioAcceptor>(io_context_, core_port_);
+        }
+        return false;
+      }
+    }
+
+    void CoreServer::listen_shm(const std::string &path, ShmComm::Options options) {
+      try {
+        acceptors_.push_back(std::make_shared<ShmAcceptor>(io_context_, path, options));
+        logger.info("CoreServer::listen_shm accepting agents through shared memory on {}", path);
+      } catch(std::exception &e) {
+        logger.error("CoreServer::listen_shm cannot listen on {}: {}", path, e.what());
+      }
+    }
+
+    void CoreServer::open_admin(uint32_t port, const std::string &address) {
+      try {
+        admin_ = std::make_unique<AdminServer>(agentDirectory_, oef_search_, port, address);
+      } catch(std::exception &e) {
+        logger.error("CoreServer::open_admin cannot listen on {}:{}: {}", address, port, e.what());
+      }
+    }
+
+    void CoreServer::watch_search_link() {
+      search_watchdog_.expires_after(std::chrono::milliseconds{config::search_reconnect_interval_ms});
+      search_watchdog_.async_wait([this](std::error_code ec) {
+            if(ec) {
+              return;
+            }
+            // never block this io thread on an unreachable OEF Search: resolve and connect asynchronously
+            if(oef_search_ && !oef_search_->connected()) {
+              oef_search_->connect_async();
+            }
+            if(oef_search_) {
+              oef_search_->expire_detached(std::chrono::seconds{config::ledger_detached_expiry_s});
+            }
+            watch_search_link();
+          });
+    }
+
+    void CoreServer::snapshot_metrics() {
+      auto snapshot = Metrics::snapshot();
+      {
+        std::lock_guard<std::mutex> lock(metrics_lock_);
+        metrics_interval_ = snapshot.since(metrics_);
+        metrics_ = std::move(snapshot);
+      }
+      DEBUG(logger, "CoreServer::snapshot_metrics {}", lazy([this]() {
+            auto interval = metrics(true);
+            std::string summary;
+            for(auto &m : interval.metrics) {
+              summary += " " + m.name + (m.labels.empty() ? "" : "{" + m.labels + "}") + "=";
+              summary += m.type == Metric::Type::Histogram 
+                ? std::to_string(m.count) + "/p99:" + std::to_string(m.quantile(0.99))
+                : std::to_string(m.value);
+            }
+            return summary;
+          }));
+      metrics_timer_.expires_after(std::chrono::milliseconds{config::metrics_snapshot_interval_ms});
+      metrics_timer_.async_wait([this](std::error_code ec) {
+            if(!ec) {
+              snapshot_metrics();
+            }
+          });
+    }
+
+    MetricsSnapshot CoreServer::metrics(bool interval) const {
+      std::lock_guard<std::mutex> lock(metrics_lock_);
+      return interval ? metrics_interval_ : metrics_;
+    }
+
     void CoreServer::stop() {
       std::this_thread::sleep_for(std::chrono::seconds{1});
       io_context_.stop();
+      bulk_context_.stop();
     }
     
     CoreServer::~CoreServer() {
       logger.trace("~CoreServer stopping");
+      admin_.reset();
       stop();
       logger.trace("~CoreServer stopped");
       agentDirectory_.clear();
@@ -140,7 +348,15 @@ namespace oef {
           t->join();
         }
       }
+      for(auto &t : bulk_threads_) {
+        if(t) {
+          t->join();
+        }
+      }
       logger.trace("~CoreServer threads stopped");
+      if(uring_) {
+        uring_->shutdown();
+      }
     }
 } // oef
 } // fetch
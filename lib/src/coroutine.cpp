@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "coroutine.hpp"
+
+#ifdef OEF_CORE_COROUTINES
+
+#include <new>
+
+namespace fetch {
+namespace oef {
+    namespace {
+      /* in front of each frame: where to give it back, if anywhere */
+      struct alignas(alignof(std::max_align_t)) FrameHeader {
+        std::shared_ptr<FramePool> pool;
+      };
+    }
+
+    FramePool::~FramePool() {
+      for(void *block : free_) {
+        ::operator delete(block);
+      }
+    }
+
+    std::size_t FramePool::kept() const {
+      std::lock_guard<std::mutex> lock(lock_);
+      return free_.size();
+    }
+
+    void *FramePool::allocate(std::shared_ptr<FramePool> pool, std::size_t size) {
+      void *block = nullptr;
+      if(pool && size <= pool->block_) {
+        {
+          std::lock_guard<std::mutex> lock(pool->lock_);
+          if(!pool->free_.empty()) {
+            block = pool->free_.back();
+            pool->free_.pop_back();
+          }
+        }
+        if(!block) {
+          block = ::operator new(sizeof(FrameHeader) + pool->block_);
+        }
+      } else {
+        pool.reset();
+        block = ::operator new(sizeof(FrameHeader) + size);
+      }
+      auto *header = new (block) FrameHeader{std::move(pool)};
+      return header + 1;
+    }
+
+    void FramePool::deallocate(void *frame) {
+      auto *header = static_cast<FrameHeader*>(frame) - 1;
+      std::shared_ptr<FramePool> pool = std::move(header->pool);
+      header->~FrameHeader();
+      if(pool) {
+        std::lock_guard<std::mutex> lock(pool->lock_);
+        if(pool->free_.size() < pool->kept_) {
+          pool->free_.push_back(header);
+          return;
+        }
+      }
+      ::operator delete(header);
+    }
+} // oef
+} // fetch
+
+#endif
@@ -17,6 +17,9 @@
 //------------------------------------------------------------------------------
 
 #include "logger.hpp"
+
+#include <mutex>
+
 #include <spdlog/sinks/dist_sink.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 
@@ -30,25 +33,85 @@
 #include <spdlog/sinks/msvc_sink.h>
 #endif  // _DEBUG && _MSC_VER
 
-fetch::oef::Logger::Logger(std::string section) : section_{std::move(section)} {
-  std::string log_name{fetch::oef::Logger::logger_name};
-  logger_ = spdlog::get(log_name);
+namespace {
+  std::mutex &registry_lock() {
+    static std::mutex lock;
+    return lock;
+  }
 
-  if (logger_ == nullptr) {
+  std::shared_ptr<spdlog::sinks::sink> shared_sink() {
+    static std::shared_ptr<spdlog::sinks::sink> sink = []() {
 #ifdef _WIN32
-    auto color_sink = std::make_shared<spdlog::sinks::wincolor_stdout_sink_mt>();
+      auto color_sink = std::make_shared<spdlog::sinks::wincolor_stdout_sink_mt>();
 #else
-    auto color_sink = std::make_shared<spdlog::sinks::ansicolor_stdout_sink_mt>();
+      auto color_sink = std::make_shared<spdlog::sinks::ansicolor_stdout_sink_mt>();
 #endif
-    auto dist_sink = std::make_shared<spdlog::sinks::dist_sink_st>();
-    auto rotating_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>("log.txt", 1024*1024*10, 10);
-    dist_sink->add_sink(color_sink);
-    dist_sink->add_sink(rotating_sink);
+      auto dist_sink = std::make_shared<spdlog::sinks::dist_sink_st>();
+      auto rotating_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>("log.txt", 1024*1024*10, 10);
+      dist_sink->add_sink(color_sink);
+      dist_sink->add_sink(rotating_sink);
 #if defined(_DEBUG) && defined(_MSC_VER)
-    auto debug_sink = std::make_shared<spdlog::sinks::msvc_sink_st>();
-    dist_sink->add_sink(debug_sink);
+      auto debug_sink = std::make_shared<spdlog::sinks::msvc_sink_st>();
+      dist_sink->add_sink(debug_sink);
 #endif  // _DEBUG && _MSC_VER
-    logger_ = std::make_shared<spdlog::logger>(log_name, dist_sink);
-    spdlog::register_logger(logger_);
+      return dist_sink;
+    }();
+    return sink;
+  }
+
+  std::vector<std::string> &section_names() {
+    static std::vector<std::string> names;
+    return names;
+  }
+}
+
+fetch::oef::Logger::Logger(std::string section) 
+  : section_{std::move(section)} 
+  , section_id_{fetch::oef::AsyncLogger::section_id(section_)}
+{
+  std::lock_guard<std::mutex> lock(registry_lock());
+  logger_ = spdlog::get(section_);
+
+  if (logger_ == nullptr) {
+    logger_ = std::make_shared<spdlog::logger>(section_, shared_sink());
+    spdlog::details::registry::instance().initialize_logger(logger_); // global pattern and level, registered
+    section_names().push_back(section_);
   }
 }
+
+bool fetch::oef::Logger::level(const std::string &section, const LogLevel level) {
+  auto logger = spdlog::get(section);
+  if(!logger) {
+    return false;
+  }
+  logger->set_level(static_cast<spdlog::level::level_enum>(level));
+  return true;
+}
+
+std::string fetch::oef::Logger::level(const std::string &section) {
+  auto logger = spdlog::get(section);
+  if(!logger) {
+    return "";
+  }
+  auto name = spdlog::level::to_string_view(logger->level());
+  return std::string(name.data(), name.size());
+}
+
+bool fetch::oef::Logger::parse_level(const std::string &name, LogLevel &level) {
+  static const std::pair<const char *, LogLevel> names[] = {
+    {"trace", LogLevel::trace}, {"debug", LogLevel::debug}, {"info", LogLevel::info},
+    {"warn", LogLevel::warn}, {"warning", LogLevel::warn}, {"error", LogLevel::error},
+    {"critical", LogLevel::critical}, {"off", LogLevel::off}};
+  for(auto &n : names) {
+    if(name == n.first) {
+      level = n.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<std::string> fetch::oef::Logger::sections() {
+  std::lock_guard<std::mutex> lock(registry_lock());
+  return section_names();
+}
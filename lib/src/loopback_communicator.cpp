@@ -0,0 +1,382 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "loopback_communicator.hpp"
+
+#include <condition_variable>
+#include <cstring>
+#include <system_error>
+
+namespace fetch {
+namespace oef {
+
+namespace {
+  std::error_code eof() {
+    return asio::error::make_error_code(asio::error::eof);
+  }
+  std::error_code broken_pipe() {
+    return asio::error::make_error_code(asio::error::broken_pipe);
+  }
+  std::error_code in_progress() {
+    return asio::error::make_error_code(asio::error::in_progress);
+  }
+}
+
+/*
+ * LoopbackComm
+ */
+
+struct LoopbackComm::Pipe {
+  std::mutex lock;
+  std::condition_variable readable;
+  std::deque<std::shared_ptr<Buffer>> frames;
+  BufferContinuation reader; // only pending while there is no frame
+  asio::io_context *reader_context = nullptr;
+  bool closed = false;
+
+  std::error_code push(std::shared_ptr<Buffer> frame) {
+    BufferContinuation continuation;
+    asio::io_context *context = nullptr;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(closed) {
+        return broken_pipe();
+      }
+      if(!reader) {
+        frames.push_back(std::move(frame));
+        readable.notify_one();
+        return {};
+      }
+      continuation = std::move(reader);
+      reader = nullptr;
+      context = reader_context;
+    }
+    asio::post(*context, [continuation=std::move(continuation),frame]() { continuation(std::error_code{}, frame); });
+    return {};
+  }
+
+  void close() {
+    BufferContinuation continuation;
+    asio::io_context *context = nullptr;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(closed) {
+        return;
+      }
+      closed = true;
+      continuation = std::move(reader);
+      reader = nullptr;
+      context = reader_context;
+      readable.notify_all();
+    }
+    if(continuation) {
+      asio::post(*context, [continuation=std::move(continuation)]() { continuation(eof(), std::make_shared<Buffer>()); });
+    }
+  }
+};
+
+std::pair<std::shared_ptr<LoopbackComm>,std::shared_ptr<LoopbackComm>> LoopbackComm::pair(
+    asio::io_context &first, asio::io_context &second) {
+  auto forward = std::make_shared<Pipe>();
+  auto backward = std::make_shared<Pipe>();
+  return {std::make_shared<LoopbackComm>(first, backward, forward), 
+    std::make_shared<LoopbackComm>(second, forward, backward)};
+}
+
+void LoopbackComm::disconnect() {
+  in_->close();
+  out_->close();
+}
+
+std::error_code LoopbackComm::send_sync(std::shared_ptr<Buffer> buffer) {
+  return out_->push(std::move(buffer));
+}
+
+std::error_code LoopbackComm::send_sync(std::vector<std::shared_ptr<Buffer>> buffers) {
+  for(auto &buffer : buffers) {
+    auto ec = out_->push(std::move(buffer));
+    if(ec) {
+      return ec;
+    }
+  }
+  return {};
+}
+
+std::error_code LoopbackComm::receive_sync(std::shared_ptr<Buffer>& buffer) {
+  std::unique_lock<std::mutex> lock(in_->lock);
+  in_->readable.wait(lock, [this]() { return !in_->frames.empty() || in_->closed; });
+  if(in_->frames.empty()) {
+    return eof();
+  }
+  buffer = std::move(in_->frames.front());
+  in_->frames.pop_front();
+  return {};
+}
+
+void LoopbackComm::send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) {
+  std::size_t length = buffer->size() + sizeof(uint32_t); // as AsioComm reports it, size included
+  auto ec = out_->push(std::move(buffer));
+  asio::post(io_context_, [continuation=std::move(continuation),ec,length]() { continuation(ec, ec ? 0 : length); });
+}
+
+void LoopbackComm::send_async(std::shared_ptr<Buffer> buffer) {
+  out_->push(std::move(buffer));
+}
+
+void LoopbackComm::send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) {
+  std::size_t length = 0;
+  std::error_code ec;
+  for(auto &buffer : buffers) {
+    length += buffer->size() + sizeof(uint32_t);
+    ec = out_->push(std::move(buffer));
+    if(ec) {
+      break;
+    }
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec,length]() { continuation(ec, ec ? 0 : length); });
+}
+
+void LoopbackComm::receive_async(BufferContinuation continuation) {
+  std::shared_ptr<Buffer> frame;
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(in_->lock);
+    if(!in_->frames.empty()) {
+      frame = std::move(in_->frames.front());
+      in_->frames.pop_front();
+    } else if(in_->closed) {
+      ec = eof();
+    } else if(in_->reader) {
+      ec = in_progress();
+    } else {
+      in_->reader = std::move(continuation);
+      in_->reader_context = &io_context_;
+      return;
+    }
+  }
+  if(!frame) {
+    frame = std::make_shared<Buffer>();
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec,frame]() { continuation(ec, frame); });
+}
+
+/*
+ * LoopbackBasicComm
+ */
+
+struct LoopbackBasicComm::Pipe {
+  std::mutex lock;
+  std::condition_variable readable;
+  std::vector<uint8_t> bytes;
+  std::size_t offset = 0;    // of the first byte not received yet
+  BufferContinuation reader; // only pending while less than `wanted` bytes are available
+  std::size_t wanted = 0;
+  asio::io_context *reader_context = nullptr;
+  bool closed = false;
+
+  std::size_t available() const { return bytes.size() - offset; }
+
+  /* Copy out the next nbytes, lock held */
+  void take(void *data, std::size_t nbytes) {
+    std::memcpy(data, bytes.data() + offset, nbytes);
+    offset += nbytes;
+    if(offset == bytes.size()) {
+      bytes.clear();
+      offset = 0;
+    } else if(offset > 4096 && 2*offset > bytes.size()) {
+      bytes.erase(bytes.begin(), bytes.begin() + long(offset));
+      offset = 0;
+    }
+  }
+
+  /* Append all chunks at once, so that concurrent writers don't interleave */
+  std::error_code push(const std::vector<std::pair<const void*,std::size_t>> &chunks) {
+    BufferContinuation continuation;
+    asio::io_context *context = nullptr;
+    std::shared_ptr<Buffer> buffer;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(closed) {
+        return broken_pipe();
+      }
+      for(auto &chunk : chunks) {
+        auto *data = static_cast<const uint8_t*>(chunk.first);
+        bytes.insert(bytes.end(), data, data + chunk.second);
+      }
+      readable.notify_one();
+      if(!reader || available() < wanted) {
+        return {};
+      }
+      buffer = std::make_shared<Buffer>(wanted);
+      take(buffer->data(), wanted);
+      continuation = std::move(reader);
+      reader = nullptr;
+      context = reader_context;
+    }
+    asio::post(*context, [continuation=std::move(continuation),buffer]() { continuation(std::error_code{}, buffer); });
+    return {};
+  }
+
+  void close() {
+    BufferContinuation continuation;
+    asio::io_context *context = nullptr;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(closed) {
+        return;
+      }
+      closed = true;
+      continuation = std::move(reader);
+      reader = nullptr;
+      context = reader_context;
+      readable.notify_all();
+    }
+    if(continuation) {
+      asio::post(*context, [continuation=std::move(continuation)]() { continuation(eof(), std::make_shared<Buffer>()); });
+    }
+  }
+};
+
+std::pair<std::shared_ptr<LoopbackBasicComm>,std::shared_ptr<LoopbackBasicComm>> LoopbackBasicComm::pair(
+    asio::io_context &first, asio::io_context &second) {
+  auto forward = std::make_shared<Pipe>();
+  auto backward = std::make_shared<Pipe>();
+  return {std::make_shared<LoopbackBasicComm>(first, backward, forward), 
+    std::make_shared<LoopbackBasicComm>(second, forward, backward)};
+}
+
+void LoopbackBasicComm::connect() {
+  bool closed;
+  {
+    std::lock_guard<std::mutex> lock(in_->lock);
+    closed = in_->closed;
+  }
+  if(closed) {
+    throw std::system_error(asio::error::make_error_code(asio::error::not_connected), 
+        "LoopbackBasicComm::connect in process connection closed");
+  }
+}
+
+void LoopbackBasicComm::disconnect() {
+  in_->close();
+  out_->close();
+}
+
+std::error_code LoopbackBasicComm::send_sync(const void* buffer, std::size_t nbytes) {
+  return out_->push({{buffer, nbytes}});
+}
+
+std::error_code LoopbackBasicComm::send_sync(std::vector<void*> buffers, std::vector<std::size_t> nbytes) {
+  std::vector<std::pair<const void*,std::size_t>> chunks;
+  for(std::size_t i = 0; i < buffers.size(); ++i) {
+    chunks.emplace_back(buffers[i], nbytes[i]);
+  }
+  return out_->push(chunks);
+}
+
+std::error_code LoopbackBasicComm::receive_sync(void* buffer, const std::size_t& nbytes) {
+  std::unique_lock<std::mutex> lock(in_->lock);
+  in_->readable.wait(lock, [this,nbytes]() { return in_->available() >= nbytes || in_->closed; });
+  if(in_->available() < nbytes) {
+    return eof();
+  }
+  in_->take(buffer, nbytes);
+  return {};
+}
+
+void LoopbackBasicComm::send_async(std::vector<std::shared_ptr<Buffer>> buffers, std::vector<std::size_t> nbytes, 
+    LengthContinuation continuation) {
+  std::vector<std::pair<const void*,std::size_t>> chunks;
+  std::size_t length = 0;
+  for(std::size_t i = 0; i < buffers.size(); ++i) {
+    chunks.emplace_back(buffers[i]->data(), nbytes[i]);
+    length += nbytes[i];
+  }
+  auto ec = out_->push(chunks);
+  asio::post(io_context_, [continuation=std::move(continuation),ec,length]() { continuation(ec, ec ? 0 : length); });
+}
+
+void LoopbackBasicComm::send_async(std::shared_ptr<Buffer> buffer, std::size_t nbytes, 
+    LengthContinuation continuation) {
+  auto ec = out_->push({{buffer->data(), nbytes}});
+  asio::post(io_context_, [continuation=std::move(continuation),ec,nbytes]() { continuation(ec, ec ? 0 : nbytes); });
+}
+
+void LoopbackBasicComm::receive_async(std::size_t nbytes, BufferContinuation continuation) {
+  std::shared_ptr<Buffer> buffer;
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(in_->lock);
+    if(in_->available() >= nbytes) {
+      buffer = std::make_shared<Buffer>(nbytes);
+      in_->take(buffer->data(), nbytes);
+    } else if(in_->closed) {
+      ec = eof();
+    } else if(in_->reader) {
+      ec = in_progress();
+    } else {
+      in_->reader = std::move(continuation);
+      in_->wanted = nbytes;
+      in_->reader_context = &io_context_;
+      return;
+    }
+  }
+  if(!buffer) {
+    buffer = std::make_shared<Buffer>();
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec,buffer]() { continuation(ec, buffer); });
+}
+
+/*
+ * LoopbackAcceptor
+ */
+
+void LoopbackAcceptor::do_accept_async(CommunicatorContinuation continuation) {
+  std::shared_ptr<communicator_t> comm;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if(backlog_.empty()) {
+      accepting_.push_back(std::move(continuation));
+      return;
+    }
+    comm = std::move(backlog_.front());
+    backlog_.pop_front();
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),comm]() { continuation(std::error_code{}, comm); });
+}
+
+std::shared_ptr<LoopbackComm> LoopbackAcceptor::connect(asio::io_context &io_context) {
+  auto ends = LoopbackComm::pair(io_context_, io_context);
+  CommunicatorContinuation continuation;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if(accepting_.empty()) {
+      backlog_.push_back(ends.first);
+      return ends.second;
+    }
+    continuation = std::move(accepting_.front());
+    accepting_.pop_front();
+  }
+  std::shared_ptr<communicator_t> accepted = ends.first;
+  asio::post(io_context_, [continuation=std::move(continuation),accepted]() { continuation(std::error_code{}, accepted); });
+  return ends.second;
+}
+
+} // oef
+} // fetch
@@ -0,0 +1,201 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+namespace fetch {
+namespace oef {
+
+namespace {
+  struct Registry {
+    std::mutex lock;
+    std::vector<Metric *> metrics;
+  };
+
+  Registry &registry() {
+    static Registry r;
+    return r;
+  }
+}
+
+constexpr std::size_t Metric::nb_shards;
+constexpr uint32_t Histogram::sub_bits;
+constexpr uint32_t Histogram::max_bits;
+constexpr std::size_t Histogram::nb_buckets;
+constexpr std::size_t Histogram::nb_histogram_shards;
+
+Metric::Metric(Type type, std::string name, std::string labels, std::string help)
+  : type_{type}
+  , name_{std::move(name)}
+  , labels_{std::move(labels)}
+  , help_{std::move(help)}
+{
+  Metrics::add(this);
+}
+
+Metric::~Metric() {
+  Metrics::remove(this);
+}
+
+std::size_t Metric::shard() {
+  static std::atomic<std::size_t> next{0};
+  thread_local std::size_t shard = next++ % nb_shards;
+  return shard;
+}
+
+uint64_t Counter::value() const {
+  uint64_t v = 0;
+  for(auto &s : shards_) {
+    v += s.value.load(std::memory_order_relaxed);
+  }
+  return v;
+}
+
+std::size_t Histogram::bucket(uint64_t value) {
+  constexpr uint64_t sub_count = uint64_t(1) << sub_bits;
+  if(value < sub_count) {
+    return std::size_t(value);
+  }
+  uint32_t msb = 63 - uint32_t(__builtin_clzll(value));
+  if(msb >= max_bits) {
+    return nb_buckets - 1;
+  }
+  uint64_t mantissa = (value >> (msb - sub_bits)) & (sub_count - 1);
+  return std::size_t(((msb - sub_bits + 1) << sub_bits) + mantissa);
+}
+
+uint64_t Histogram::upper_bound(std::size_t bucket) {
+  constexpr uint64_t sub_count = uint64_t(1) << sub_bits;
+  if(bucket < sub_count) {
+    return bucket;
+  }
+  uint32_t msb = uint32_t(bucket >> sub_bits) + sub_bits - 1;
+  uint64_t mantissa = bucket & (sub_count - 1);
+  uint64_t lower = (sub_count + mantissa) << (msb - sub_bits);
+  return lower + (uint64_t(1) << (msb - sub_bits)) - 1;
+}
+
+void Histogram::observe(uint64_t value) {
+  auto &s = shards_[shard() % nb_histogram_shards];
+  s.buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+  s.sum.fetch_add(value, std::memory_order_relaxed);
+  s.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Histogram::collect(std::vector<uint64_t> &buckets, uint64_t &count, uint64_t &sum) const {
+  buckets.assign(nb_buckets, 0);
+  count = 0;
+  sum = 0;
+  for(std::size_t i = 0; i < nb_histogram_shards; ++i) {
+    auto &s = shards_[i];
+    for(std::size_t b = 0; b < nb_buckets; ++b) {
+      buckets[b] += s.buckets[b].load(std::memory_order_relaxed);
+    }
+    count += s.count.load(std::memory_order_relaxed);
+    sum += s.sum.load(std::memory_order_relaxed);
+  }
+}
+
+uint64_t MetricValue::quantile(double q) const {
+  uint64_t total = 0;
+  for(auto c : buckets) {
+    total += c;
+  }
+  if(!total) {
+    return 0;
+  }
+  uint64_t rank = uint64_t(q * double(total));
+  if(rank >= total) {
+    rank = total - 1;
+  }
+  uint64_t seen = 0;
+  for(std::size_t b = 0; b < buckets.size(); ++b) {
+    seen += buckets[b];
+    if(seen > rank) {
+      return Histogram::upper_bound(b);
+    }
+  }
+  return Histogram::upper_bound(buckets.size() - 1);
+}
+
+MetricsSnapshot MetricsSnapshot::since(const MetricsSnapshot &previous) const {
+  MetricsSnapshot delta{time, metrics};
+  for(auto &m : delta.metrics) {
+    const MetricValue *before = previous.find(m.name, m.labels);
+    if(!before || m.type == Metric::Type::Gauge) {
+      continue;
+    }
+    m.value -= before->value;
+    m.count -= before->count;
+    m.sum -= before->sum;
+    for(std::size_t b = 0; b < m.buckets.size() && b < before->buckets.size(); ++b) {
+      m.buckets[b] -= before->buckets[b];
+    }
+  }
+  return delta;
+}
+
+const MetricValue *MetricsSnapshot::find(const std::string &name, const std::string &labels) const {
+  auto iter = std::find_if(metrics.begin(), metrics.end(),
+      [&name,&labels](const MetricValue &m) { return m.name == name && m.labels == labels; });
+  return iter == metrics.end() ? nullptr : &*iter;
+}
+
+MetricsSnapshot Metrics::snapshot() {
+  MetricsSnapshot snapshot;
+  snapshot.time = std::chrono::system_clock::now();
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.lock);
+  snapshot.metrics.reserve(r.metrics.size());
+  for(auto *metric : r.metrics) {
+    MetricValue v{metric->type(), metric->name(), metric->labels(), metric->help()};
+    switch(metric->type()) {
+    case Metric::Type::Counter:
+      v.value = int64_t(static_cast<const Counter *>(metric)->value());
+      break;
+    case Metric::Type::Gauge:
+      v.value = static_cast<const Gauge *>(metric)->value();
+      break;
+    case Metric::Type::Histogram:
+      static_cast<const Histogram *>(metric)->collect(v.buckets, v.count, v.sum);
+      break;
+    }
+    snapshot.metrics.emplace_back(std::move(v));
+  }
+  std::stable_sort(snapshot.metrics.begin(), snapshot.metrics.end(),
+      [](const MetricValue &a, const MetricValue &b) { return a.name < b.name; });
+  return snapshot;
+}
+
+void Metrics::add(Metric *metric) {
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.lock);
+  r.metrics.push_back(metric);
+}
+
+void Metrics::remove(Metric *metric) {
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.lock);
+  r.metrics.erase(std::remove(r.metrics.begin(), r.metrics.end(), metric), r.metrics.end());
+}
+
+} // oef
+} // fetch
@@ -0,0 +1,296 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "mock_search.hpp"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <random>
+
+namespace fetch {
+namespace oef {
+
+fetch::oef::Logger MockSearch::logger = fetch::oef::Logger("mock-search");
+
+/* One connection from an OEF Core. Answers may be delayed and reordered, writes are serialized */
+class MockSearch::Session : public std::enable_shared_from_this<MockSearch::Session> {
+private:
+  MockSearch &search_;
+  asio::ip::tcp::socket socket_;
+  asio::io_context::strand strand_;
+  std::mt19937_64 random_;
+  uint32_t sizes_[2];
+  std::vector<char> data_;
+  std::deque<std::shared_ptr<std::vector<char>>> out_;
+public:
+  Session(MockSearch &search, asio::ip::tcp::socket socket, uint64_t seed)
+    : search_{search}, socket_{std::move(socket)}, strand_{search.io_context_}, random_{seed} {}
+
+  void read() {
+    auto self(shared_from_this());
+    asio::async_read(socket_, asio::buffer(sizes_, sizeof(sizes_)), asio::bind_executor(strand_, 
+        [this,self](std::error_code ec, std::size_t) {
+          if(ec) {
+            return;
+          }
+          data_.resize(ntohl(sizes_[0]) + ntohl(sizes_[1]));
+          asio::async_read(socket_, asio::buffer(data_), asio::bind_executor(strand_, 
+              [this,self](std::error_code ec, std::size_t) {
+                if(ec) {
+                  return;
+                }
+                process();
+                read();
+              }));
+        }));
+  }
+
+private:
+  void process() {
+    uint32_t header_size = ntohl(sizes_[0]);
+    fetch::oef::pb::TransportHeader header;
+    if(!header.ParseFromArray(data_.data(), int(header_size))) {
+      logger.error("MockSearch::Session::process cannot parse header, closing connection");
+      socket_.close();
+      return;
+    }
+    std::string body(data_.data() + header_size, data_.size() - header_size);
+    search_.requests_.fetch_add(1, std::memory_order_relaxed);
+
+    std::pair<fetch::oef::pb::TransportHeader,std::string> answer;
+    const auto &o = search_.options_;
+    if(o.error_rate > 0. && std::uniform_real_distribution<double>{0., 1.}(random_) < o.error_rate) {
+      search_.errors_.fetch_add(1, std::memory_order_relaxed);
+      answer.first.set_uri(header.uri());
+      answer.first.set_id(header.id());
+      answer.first.mutable_status()->set_success(false);
+      answer.first.mutable_status()->set_error_code(1);
+      answer.first.mutable_status()->add_narrative("mock search error");
+    } else {
+      answer = search_.answer(header, body);
+    }
+    auto frame = std::make_shared<std::vector<char>>();
+    std::string serialized = answer.first.SerializeAsString();
+    uint32_t sizes[2] = {htonl(uint32_t(serialized.size())), htonl(uint32_t(answer.second.size()))};
+    frame->resize(sizeof(sizes));
+    std::memcpy(frame->data(), sizes, sizeof(sizes));
+    frame->insert(frame->end(), serialized.begin(), serialized.end());
+    frame->insert(frame->end(), answer.second.begin(), answer.second.end());
+
+    auto delay = o.latency;
+    if(o.jitter.count() > 0) {
+      delay += std::chrono::microseconds{std::uniform_int_distribution<int64_t>{0, o.jitter.count() - 1}(random_)};
+    }
+    if(delay.count() == 0) {
+      send(frame);
+      return;
+    }
+    auto timer = std::make_shared<asio::steady_timer>(search_.io_context_, delay);
+    auto self(shared_from_this());
+    timer->async_wait(asio::bind_executor(strand_, [this,self,timer,frame](std::error_code ec) {
+          if(!ec) {
+            send(frame);
+          }
+        }));
+  }
+
+  void send(std::shared_ptr<std::vector<char>> frame) {
+    out_.push_back(std::move(frame));
+    if(out_.size() == 1) {
+      write();
+    }
+  }
+
+  void write() {
+    auto self(shared_from_this());
+    asio::async_write(socket_, asio::buffer(*out_.front()), asio::bind_executor(strand_, 
+        [this,self](std::error_code ec, std::size_t) {
+          out_.pop_front();
+          if(!ec && !out_.empty()) {
+            write();
+          }
+        }));
+  }
+};
+
+MockSearch::MockSearch(Options options)
+  : options_{std::move(options)}
+  , acceptor_{io_context_, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), uint16_t(options_.port))}
+{
+  do_accept();
+  for(uint32_t i = 0; i < std::max(options_.threads, 1u); ++i) {
+    threads_.emplace_back([this]() { io_context_.run(); });
+  }
+  logger.info("MockSearch::MockSearch listening on port {}", port());
+}
+
+MockSearch::~MockSearch() {
+  stop();
+}
+
+void MockSearch::stop() {
+  io_context_.stop();
+  for(auto &t : threads_) {
+    if(t.joinable()) {
+      t.join();
+    }
+  }
+}
+
+void MockSearch::do_accept() {
+  acceptor_.async_accept([this](std::error_code ec, asio::ip::tcp::socket socket) {
+        if(ec) {
+          logger.error("MockSearch::do_accept error {}", ec.value());
+          return;
+        }
+        socket.set_option(asio::ip::tcp::no_delay(true));
+        std::make_shared<Session>(*this, std::move(socket), options_.seed + sessions_++)->read();
+        do_accept();
+      });
+}
+
+std::size_t MockSearch::size() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::size_t size = 0;
+  for(auto &core : cores_) {
+    size += core.second.registrations.size();
+  }
+  return size;
+}
+
+std::pair<fetch::oef::pb::TransportHeader,std::string> MockSearch::answer(const fetch::oef::pb::TransportHeader &header,
+    const std::string &body) {
+  std::pair<fetch::oef::pb::TransportHeader,std::string> answer;
+  answer.first.set_uri(header.uri());
+  answer.first.set_id(header.id());
+  answer.first.mutable_status()->set_success(true);
+  bool parsed = false;
+  if(header.uri() == "update") {
+    fetch::oef::pb::Update update;
+    parsed = update.ParseFromString(body);
+    answer.second = update_(update).SerializeAsString();
+  } else if(header.uri() == "remove") {
+    fetch::oef::pb::Remove remove;
+    parsed = remove.ParseFromString(body);
+    answer.second = remove_(remove).SerializeAsString();
+  } else if(header.uri() == "search") {
+    fetch::oef::pb::SearchQuery query;
+    parsed = query.ParseFromString(body);
+    answer.second = search_(query).SerializeAsString();
+  }
+  if(!parsed) {
+    logger.warn("MockSearch::answer cannot process {} request {}", header.uri(), header.id());
+    answer.first.mutable_status()->set_success(false);
+    answer.first.mutable_status()->add_narrative("cannot process " + header.uri());
+    answer.second.clear();
+  }
+  return answer;
+}
+
+fetch::oef::pb::UpdateResponse MockSearch::update_(const fetch::oef::pb::Update &update) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto &core = cores_[update.key()];
+  for(auto &attribute : update.attributes()) {
+    if(attribute.name() == fetch::oef::pb::Update_Attribute_Name_NETWORK_ADDRESS) {
+      core.ip = attribute.value().a().ip();
+      core.port = attribute.value().a().port();
+    }
+  }
+  for(auto &dm : update.data_models()) {
+    fetch::oef::pb::Query_Instance instance;
+    instance.mutable_model()->CopyFrom(dm.model());
+    instance.mutable_values()->CopyFrom(dm.values());
+    // an agent registers one instance per data model
+    auto iter = std::find_if(core.registrations.begin(), core.registrations.end(), [&dm](const Registration &r) {
+          return r.agent == dm.key() && r.instance.model().name() == dm.model().name();
+        });
+    if(iter != core.registrations.end()) {
+      iter->instance = Instance{instance};
+    } else {
+      core.registrations.push_back(Registration{dm.key(), Instance{instance}});
+    }
+  }
+  fetch::oef::pb::UpdateResponse response;
+  response.set_status(fetch::oef::pb::UpdateResponse_ResponseType_SUCCESS);
+  return response;
+}
+
+fetch::oef::pb::RemoveResponse MockSearch::remove_(const fetch::oef::pb::Remove &remove) {
+  std::lock_guard<std::mutex> lock(lock_);
+  fetch::oef::pb::RemoveResponse response;
+  response.set_status(fetch::oef::pb::RemoveResponse_ResponseType_NOT_FOUND);
+  auto core = cores_.find(remove.key());
+  if(core == cores_.end()) {
+    return response;
+  }
+  auto &registrations = core->second.registrations;
+  auto removed = std::remove_if(registrations.begin(), registrations.end(), [&remove](const Registration &r) {
+        return remove.all() || std::any_of(remove.data_models().begin(), remove.data_models().end(), 
+            [&r](const fetch::oef::pb::Query_DataModel &model) { return model.name() == r.instance.model().name(); });
+      });
+  if(removed != registrations.end()) {
+    registrations.erase(removed, registrations.end());
+    response.set_status(fetch::oef::pb::RemoveResponse_ResponseType_SUCCESS);
+  }
+  return response;
+}
+
+fetch::oef::pb::SearchResponse MockSearch::search_(const fetch::oef::pb::SearchQuery &query) {
+  CompiledQuery compiled{query.model()};
+  fetch::oef::pb::SearchResponse response;
+  std::lock_guard<std::mutex> lock(lock_);
+  for(auto &core : cores_) {
+    fetch::oef::pb::SearchResponse_Item *item = nullptr;
+    uint32_t nb_agents = 0;
+    for(auto &r : core.second.registrations) {
+      if(options_.max_results && nb_agents >= options_.max_results) {
+        break;
+      }
+      if(!compiled.check(r.instance)) {
+        continue;
+      }
+      if(!item) {
+        item = response.add_result();
+        item->set_key(core.first);
+        item->set_ip(core.second.ip);
+        item->set_port(core.second.port);
+      }
+      auto *agent = item->add_agents();
+      agent->set_key(r.agent);
+      agent->set_score(1.0);
+      ++nb_agents;
+    }
+  }
+  if(options_.extra_results) {
+    auto *item = response.add_result();
+    item->set_key("mock-search");
+    for(uint32_t i = 0; i < options_.extra_results; ++i) {
+      auto *agent = item->add_agents();
+      agent->set_key("mock-agent-" + std::to_string(i));
+      agent->set_score(0.5);
+    }
+  }
+  return response;
+}
+
+} // oef
+} // fetch
@@ -27,6 +27,16 @@ namespace fetch {
 namespace oef {
     
 fetch::oef::Logger OefSearchClient::logger = fetch::oef::Logger("oef-search-client");
+fetch::oef::Gauge OefSearchClient::pending_requests{"oef_search_pending_requests", "",
+  "Requests sent to the OEF Search waiting for their answer"};
+fetch::oef::Histogram OefSearchClient::rtt_update{"oef_search_rtt_us", "operation=\"update\"",
+  "Round trip time of the OEF Search requests in microseconds"};
+fetch::oef::Histogram OefSearchClient::rtt_remove{"oef_search_rtt_us", "operation=\"remove\"",
+  "Round trip time of the OEF Search requests in microseconds"};
+fetch::oef::Histogram OefSearchClient::rtt_search_local{"oef_search_rtt_us", "operation=\"search-local\"",
+  "Round trip time of the OEF Search requests in microseconds"};
+fetch::oef::Histogram OefSearchClient::rtt_search_wide{"oef_search_rtt_us", "operation=\"search-wide\"",
+  "Round trip time of the OEF Search requests in microseconds"};
 
 
 /*
@@ -40,21 +50,21 @@ void OefSearchClient::register_description(const Instance& desc,
     const std::string& agent, uint32_t msg_id, AgentSessionContinuation continuation) 
 {
   logger.warn("::register_description implemented using ::register_service");
-  register_service(desc, agent, msg_id, continuation);
+  register_service(desc, agent, msg_id, std::move(continuation));
 }
 
 void OefSearchClient::unregister_description(const Instance& desc, 
     const std::string& agent, uint32_t msg_id, AgentSessionContinuation continuation) 
 {
   logger.warn("::unregister_description implemented using ::unregister_service"); 
-  unregister_service(desc, agent, msg_id, continuation);
+  unregister_service(desc, agent, msg_id, std::move(continuation));
 }
 
 void OefSearchClient::search_agents(const QueryModel& query, 
     const std::string& agent, uint32_t msg_id, AgentSessionContinuation continuation) 
 {
   logger.warn("::search_agents implemented using ::search_service"); 
-  search_service(query, agent, msg_id, continuation);
+  search_service(query, agent, msg_id, std::move(continuation));
 }
 
 void OefSearchClient::register_service(const Instance& service, 
@@ -69,20 +79,29 @@ void OefSearchClient::register_service(const Instance& service,
   auto update = generate_update_(service, agent);
   auto update_buffer = pbs::serialize(update);
  
+  // record successful registrations in the ledger
+  AgentSessionContinuation recorded = 
+      [this,service,agent,continuation=std::move(continuation)](std::error_code ec, OefSearchResponse response) {
+        if (!ec) {
+          ledger_.add(agent, service);
+        }
+        continuation(ec, response);
+      };
+
   // send message
-  logger.debug("::register_service sending update from agent {} to OefSearch: {} - {}", 
-        agent, pbs::to_string(header), pbs::to_string(update));
+  DEBUG(logger, "::register_service sending update from agent {} to OefSearch: {} - {}", 
+        agent, pbs::text(header), pbs::text(update));
   
+  // expect the answer before sending, the OEF Search may answer before the send completes
+  schedule_rcv_callback_(smsg_id, "update", std::move(recorded), msg_id, agent);
   send_(header_buffer, update_buffer, 
-      [this,agent,smsg_id,msg_id,continuation](std::error_code ec, uint32_t length) {
+      [this,agent,smsg_id](std::error_code ec, uint32_t length) {
         if (ec) {
           logger.debug("::register_service error while sending update from agent {} to OefSearch: {}",
               agent, ec.value());
-          continuation(ec, OefSearchResponse{});          
+          fail_(smsg_id, ec);
         } else {
-          // schedule reception of answer
           logger.debug("::register_service update message sent to OefSearch");
-          schedule_rcv_callback_(smsg_id, "update", continuation, msg_id, agent);
         }
       });
 }
@@ -99,20 +118,29 @@ void OefSearchClient::unregister_service(const Instance& service,
   auto remove = generate_remove_(service);
   auto remove_buffer = pbs::serialize(remove);
   
+  // forget successful unregistrations in the ledger
+  AgentSessionContinuation recorded = 
+      [this,service,agent,continuation=std::move(continuation)](std::error_code ec, OefSearchResponse response) {
+        if (!ec) {
+          ledger_.remove(agent, service);
+        }
+        continuation(ec, response);
+      };
+
   // send message
-  logger.debug("::unregister_service sending remove from agent {} to OefSearch: {} - {}", 
-        agent, pbs::to_string(header), pbs::to_string(remove));
+  DEBUG(logger, "::unregister_service sending remove from agent {} to OefSearch: {} - {}", 
+        agent, pbs::text(header), pbs::text(remove));
   
+  // expect the answer before sending, the OEF Search may answer before the send completes
+  schedule_rcv_callback_(smsg_id, "remove", std::move(recorded), msg_id, agent);
   send_(header_buffer, remove_buffer, 
-      [this,agent,smsg_id,msg_id,continuation](std::error_code ec, uint32_t length) {
+      [this,agent,smsg_id](std::error_code ec, uint32_t length) {
         if (ec) {
           logger.debug("::unregister_service error while sending remove from agent {} to OefSearch: {}",
               agent, ec.value());
-          continuation(ec, OefSearchResponse{});          
+          fail_(smsg_id, ec);
         } else {
-          // schedule reception of answer
           logger.debug("::unregister_service remove message sent to OefSearch");
-          schedule_rcv_callback_(smsg_id, "remove", continuation, msg_id, agent);
         }
       });
 }
@@ -130,19 +158,19 @@ void OefSearchClient::search_service(const QueryModel& query,
   auto search_buffer = pbs::serialize(search);
   
   // send message
-  logger.debug("::search_service sending search from agent {} to OefSearch: {} - {}", 
-        agent, pbs::to_string(header), pbs::to_string(search));
+  DEBUG(logger, "::search_service sending search from agent {} to OefSearch: {} - {}", 
+        agent, pbs::text(header), pbs::text(search));
   
+  // expect the answer before sending, the OEF Search may answer before the send completes
+  schedule_rcv_callback_(smsg_id, "search-local", std::move(continuation), msg_id, agent);
   send_(header_buffer, search_buffer, 
-      [this,agent,smsg_id,msg_id,continuation](std::error_code ec, uint32_t length) {
+      [this,agent,smsg_id](std::error_code ec, uint32_t length) {
         if (ec) {
           logger.debug("::search_service error while sending search from agent {} to OefSearch: {}",
               agent, ec.value());
-          continuation(ec, OefSearchResponse{});          
+          fail_(smsg_id, ec);
         } else {
-          // schedule reception of answer
           logger.debug("::search_service search message sent to OefSearch");
-          schedule_rcv_callback_(smsg_id, "search-local", continuation, msg_id, agent);
         }
       });
 }
@@ -160,24 +188,139 @@ void OefSearchClient::search_service_wide(const QueryModel& query,
   auto search_buffer = pbs::serialize(search);
   
   // send message
-  logger.debug("::search_service_wide sending search from agent {} to OefSearch: {} - {}", 
-        agent, pbs::to_string(header), pbs::to_string(search));
+  DEBUG(logger, "::search_service_wide sending search from agent {} to OefSearch: {} - {}", 
+        agent, pbs::text(header), pbs::text(search));
   
+  // expect the answer before sending, the OEF Search may answer before the send completes
+  schedule_rcv_callback_(smsg_id, "search-wide", std::move(continuation), msg_id, agent);
   send_(header_buffer, search_buffer, 
-      [this,agent,smsg_id,msg_id,continuation](std::error_code ec, uint32_t length) {
+      [this,agent,smsg_id](std::error_code ec, uint32_t length) {
         if (ec) {
           logger.debug("::search_service_wide error while sending search from agent {} to OefSearch: {}",
               agent, ec.value());
-          continuation(ec, OefSearchResponse{});          
+          fail_(smsg_id, ec);
         } else {
-          // schedule reception of answer
           logger.debug("::search_service_wide search message sent to OefSearch");
-          schedule_rcv_callback_(smsg_id, "search-wide", continuation, msg_id, agent);
         }
       });
 }
   
 
+/*
+ * *********************************
+ * Connection and registrations resync
+ * *********************************
+*/
+
+
+void OefSearchClient::connect()
+{
+  comm_->connect();
+  reconnected_();
+}
+
+void OefSearchClient::connect_async()
+{
+  if (connecting_.exchange(true)) {
+    return;
+  }
+  comm_->connect_async([this](std::error_code ec) {
+        if (ec) {
+          logger.warn("::connect_async OefSearch still unreachable: {}", ec.message());
+        } else {
+          reconnected_();
+        }
+        connecting_ = false;
+      });
+}
+
+void OefSearchClient::reconnected_()
+{
+  // OefSearch may have restarted and forgotten this core's address
+  updated_address_ = true;
+  connected_ = true;
+  logger.info("::connect reconnected to OefSearch");
+  handle_messages();
+  resync_(ledger_.snapshot(), "reconnect");
+}
+
+void OefSearchClient::agent_attached(const std::string& agent)
+{
+  auto instances = ledger_.attach(agent);
+  if (instances.empty() || !connected_) {
+    return;
+  }
+  std::vector<RegistrationLedger::Entry> entries;
+  for (auto& instance : instances) {
+    entries.emplace_back(agent, instance);
+  }
+  resync_(entries, "agent " + agent + " reattached");
+}
+
+void OefSearchClient::resync_(const std::vector<RegistrationLedger::Entry>& entries, const std::string& reason)
+{
+  if (entries.empty()) {
+    return;
+  }
+  // one bulk update carries all registrations
+  size_t smsg_id = generate_smsg_id_(core_id_, resync_id_++);
+  auto header_buffer = pbs::serialize(generate_header_("update", smsg_id));
+  auto update_buffer = pbs::serialize(generate_bulk_update_(entries));
+  std::size_t nb_entries = entries.size();
+  logger.info("::resync_ ({}) sending {} registrations to OefSearch ({} bytes)", 
+      reason, nb_entries, update_buffer->size());
+  
+  AgentSessionContinuation continuation = 
+      [nb_entries](std::error_code ec, OefSearchResponse response) {
+        if (ec) {
+          logger.error("::resync_ OefSearch rejected resync of {} registrations : {}", nb_entries, ec.value());
+        } else {
+          logger.info("::resync_ {} registrations resynchronized", nb_entries);
+        }
+      };
+  // expect the answer before sending, the OEF Search may answer before the send completes
+  schedule_rcv_callback_(smsg_id, "update", std::move(continuation), 0, core_id_);
+  send_(header_buffer, update_buffer, 
+      [this,smsg_id](std::error_code ec, uint32_t length) {
+        if (ec) {
+          fail_(smsg_id, ec);
+        }
+      });
+}
+
+void OefSearchClient::fail_(uint32_t smsg_id, std::error_code ec)
+{
+  MsgHandle handle;
+  {
+    std::lock_guard<std::mutex> lock(handles_lock_);
+    auto iter = handles_.find(smsg_id);
+    if (iter == handles_.end()) { // already answered, or failed with the connection
+      return;
+    }
+    handle = std::move(iter->second);
+    handles_.erase(iter);
+    pending_requests.set(int64_t(handles_.size()));
+  }
+  handle.continuation(ec, OefSearchResponse{});
+}
+
+void OefSearchClient::fail_pending_(std::error_code ec)
+{
+  std::unordered_map<uint32_t, MsgHandle> handles;
+  {
+    std::lock_guard<std::mutex> lock(handles_lock_);
+    handles.swap(handles_);
+    pending_requests.set(0);
+  }
+  if (!handles.empty()) {
+    logger.warn("::fail_pending_ failing {} pending requests", handles.size());
+  }
+  for (auto& p : handles) {
+    p.second.continuation(ec, OefSearchResponse{});
+  }
+}
+
+
 /*
  * *********************************
  * Asynchronous helper functions
@@ -205,14 +348,24 @@ void OefSearchClient::send_(std::shared_ptr<Buffer> header, std::shared_ptr<Buff
   nbytes.emplace_back(header->size());
   nbytes.emplace_back(payload->size());
 
+  // the answer belongs to the trace of the agent frame which caused the request, if sampled
+  auto trace = Tracer::current();
+  if (trace) {
+    continuation = [trace,continuation=std::move(continuation)](std::error_code ec, std::size_t length) {
+      trace->mark(Trace::Stage::SearchSent);
+      TraceScope scope{trace};
+      continuation(ec, length);
+    };
+  }
+
   // send message
-  comm_->send_async(buffers, nbytes, continuation);
+  comm_->send_async(buffers, nbytes, std::move(continuation));
 }
 
 void OefSearchClient::schedule_rcv_callback_(uint32_t smsg_id, std::string operation, 
     AgentSessionContinuation continuation, uint32_t amsg_id, const std::string& agent) 
 {
-  msg_handle_save(smsg_id, MsgHandle{operation, continuation, amsg_id, agent});
+  msg_handle_save(smsg_id, MsgHandle{std::move(operation), std::move(continuation), amsg_id, agent});
   logger.debug("schedule_rcv_callback_ scheduled receive for message {} (aka {})", 
       smsg_id, amsg_id);
 }
@@ -237,18 +390,22 @@ void OefSearchClient::receive_(
           if (ec) {
             logger.error("receive_ Error while receiving header and payload : {}", ec.value());
             logger.error("receive_ message discarded"); // TOFIX don't know which msg it was supposed to answer
+            continuation(ec, pb::TransportHeader{}, nullptr);
           } else {
             uint8_t* data_ptr = (uint8_t*)data_buffer->data();
             std::vector<uint8_t> header_buffer(data_ptr, data_ptr+header_size);
             std::vector<uint8_t> payload_buffer(data_ptr+header_size, data_ptr+header_size+payload_size);
             // get header
             bool hstatus = false;
-            logger.error("receive_ received data (serialized) : header {} - payload {}", 
-                pbs::diagnostic(header_buffer.data(), header_buffer.size()),
-                pbs::diagnostic(payload_buffer.data(), payload_buffer.size()));
+            if(logger.enabled(LogLevel::trace)) {
+              logger.trace("receive_ received data (serialized) : header {} - payload {}", 
+                  pbs::diagnostic(header_buffer), pbs::diagnostic(payload_buffer));
+            }
             pb::TransportHeader header = pbs::deserialize<pb::TransportHeader>(header_buffer, hstatus);
             if(!hstatus) {
               logger.error("::receive__ failed to deserialize header, message discarded "); // TOFIX don't know which msg it was supposed to answer 
+              // framing can't be trusted anymore, the connection is reset and resynchronized
+              continuation(std::make_error_code(std::errc::bad_message), header, nullptr);
               return;
             }
             if(!payload_size) {
@@ -266,13 +423,20 @@ void OefSearchClient::process_message_(pb::TransportHeader header, std::shared_p
   // get msg id
   //TODO(AB): Do we need -1 here? In the master it wasn't present, but the header creator had +1
   uint32_t smsg_id = header.id()-1;
-  logger.debug("::search_process_message processing message with header {} ", pbs::to_string(header)); 
+  DEBUG(logger, "::search_process_message processing message with header {} ", pbs::text(header)); 
   // get msg payload type and continuation
-  auto msg_handle = msg_handle_get(smsg_id);
-  msg_handle_erase(smsg_id);
+  auto msg_handle = msg_handle_take(smsg_id);
   uint32_t amsg_id = msg_handle.amsg_id;
   std::string msg_operation = msg_handle.operation;
-  AgentSessionContinuation msg_continuation = msg_handle.continuation;
+  AgentSessionContinuation msg_continuation = std::move(msg_handle.continuation);
+  TraceScope scope{msg_handle.trace};
+  Histogram *rtt = msg_operation == "update" ? &rtt_update
+                 : msg_operation == "remove" ? &rtt_remove
+                 : msg_operation == "search-local" ? &rtt_search_local
+                 : msg_operation == "search-wide" ? &rtt_search_wide : nullptr;
+  if(rtt) {
+    rtt->observe_since(msg_handle.created);
+  }
   
   // answer to AgentSession
   std::error_code ec{};
@@ -291,32 +455,32 @@ void OefSearchClient::process_message_(pb::TransportHeader header, std::shared_p
   // get payload 
   if(msg_operation == "update") {
     auto update_resp = pbs::deserialize<pb::UpdateResponse>(*payload);
-    logger.debug("::process_message_ received update confirmation for msg {} (aka {})  : {} ",
-        smsg_id, amsg_id, pbs::to_string(update_resp));
+    Tracer::mark(Trace::Stage::SearchReplyParsed);
+    DEBUG(logger, "::process_message_ received update confirmation for msg {} (aka {})  : {} ",
+        smsg_id, amsg_id, pbs::text(update_resp));
     msg_continuation(ec, OefSearchResponse{});
     return;
   } else
 
   if(msg_operation == "remove") {
     auto remove_resp = pbs::deserialize<pb::RemoveResponse>(*payload);
-    logger.debug("::process_message_ received remove confirmation for msg {} (aka {}) : {} ", 
-        smsg_id, amsg_id, pbs::to_string(remove_resp));
+    Tracer::mark(Trace::Stage::SearchReplyParsed);
+    DEBUG(logger, "::process_message_ received remove confirmation for msg {} (aka {}) : {} ", 
+        smsg_id, amsg_id, pbs::text(remove_resp));
     msg_continuation(ec, OefSearchResponse{});
     return;
   } else
   
   if(msg_operation == "search-local") {
     auto search_resp = pbs::deserialize<pb::SearchResponse>(*payload);
-    logger.debug("::process_message_ received local search results for msg {} (aka {}) : {} ", 
-        smsg_id, amsg_id, pbs::to_string(search_resp));
+    Tracer::mark(Trace::Stage::SearchReplyParsed);
+    DEBUG(logger, "::process_message_ received local search results for msg {} (aka {}) : {} ", 
+        smsg_id, amsg_id, pbs::text(search_resp));
     // get agents
     std::vector<std::string> agents{};
-    auto items = search_resp.result();
-    for (auto& item : items) {
-      auto agts = item.agents();
-      for (auto& a : agts) {
-        std::string key{a.key()};
-        agents.emplace_back(key);
+    for (auto& item : search_resp.result()) {
+      for (auto& a : item.agents()) {
+        agents.emplace_back(a.key());
       }
     }
     msg_continuation(ec, OefSearchResponse{agents});
@@ -325,20 +489,19 @@ void OefSearchClient::process_message_(pb::TransportHeader header, std::shared_p
   
   if(msg_operation == "search-wide") {
     auto search_resp = pbs::deserialize<pb::SearchResponse>(*payload);
-    logger.debug("::process_message_ received wide search results for msg {} (aka {}) : {} ", 
-        smsg_id, amsg_id, pbs::to_string(search_resp));
+    Tracer::mark(Trace::Stage::SearchReplyParsed);
+    DEBUG(logger, "::process_message_ received wide search results for msg {} (aka {}) : {} ", 
+        smsg_id, amsg_id, pbs::text(search_resp));
     // get SearchResultWide
     pb::Server_SearchResultWide agents_wide;
-    auto items = search_resp.result();
-    for (auto& item : items) {
+    for (auto& item : search_resp.result()) {
       auto* aw_item = agents_wide.add_result();
       aw_item->set_key(item.key());
       aw_item->set_ip(item.ip());
       aw_item->set_port(item.port());
       aw_item->set_info(item.info());
       aw_item->set_distance(item.distance());
-      auto agts = item.agents();
-      for (auto& a : agts) {
+      for (auto& a : item.agents()) {
         auto *aw = aw_item->add_agents();
         aw->set_key(a.key());
         aw->set_score(a.score());
@@ -413,6 +576,21 @@ pb::Update OefSearchClient::generate_update_(const Instance& service, const std:
   return update;
 }
 
+pb::Update OefSearchClient::generate_bulk_update_(const std::vector<RegistrationLedger::Entry>& entries) {
+  fetch::oef::pb::Update update;
+  update.set_key(core_id_);
+
+  for (auto& entry : entries) {
+    fetch::oef::pb::Update_DataModelInstance* dm = update.add_data_models();
+    dm->set_key(entry.first);
+    dm->mutable_model()->CopyFrom(entry.second.model());
+    dm->mutable_values()->CopyFrom(entry.second.handle().values());
+  }
+
+  generate_update_add_naddr_(update);
+  return update;
+}
+
 pb::SearchQuery OefSearchClient::generate_search_(const QueryModel& query, uint32_t ttl) {
   pb::SearchQuery search_query;
   search_query.set_source_key(core_id_);
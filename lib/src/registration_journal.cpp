@@ -0,0 +1,178 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "registration_journal.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace fetch {
+namespace oef {
+
+namespace {
+  constexpr char journal_magic[] = "OEFJRNL1";
+
+  std::runtime_error journal_error(const std::string &what, const std::string &path) {
+    return std::runtime_error("RegistrationJournal: " + what + " " + path + " : " + std::strerror(errno));
+  }
+}
+
+RegistrationJournal::RegistrationJournal(std::string path)
+  : path_{std::move(path)}, fd_{-1}, data_{nullptr}, capacity_{0}, tail_{header_size}
+{
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+  if(fd_ < 0) {
+    throw journal_error("cannot open", path_);
+  }
+  struct stat st;
+  if(::fstat(fd_, &st) < 0) {
+    ::close(fd_);
+    throw journal_error("cannot stat", path_);
+  }
+  std::size_t file_size = static_cast<std::size_t>(st.st_size);
+  map_(file_size < min_capacity ? min_capacity : file_size);
+  if(file_size == 0) {
+    std::memcpy(data_, journal_magic, header_size);
+  } else if(std::memcmp(data_, journal_magic, header_size) != 0) {
+    unmap_();
+    ::close(fd_);
+    throw std::runtime_error("RegistrationJournal: " + path_ + " is not a registration journal");
+  }
+  tail_ = find_tail_();
+}
+
+RegistrationJournal::~RegistrationJournal() {
+  if(data_) {
+    ::msync(data_, tail_, MS_ASYNC);
+  }
+  unmap_();
+  if(fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+void RegistrationJournal::map_(std::size_t capacity) {
+  if(::ftruncate(fd_, static_cast<off_t>(capacity)) < 0) {
+    throw journal_error("cannot resize", path_);
+  }
+  void *addr = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if(addr == MAP_FAILED) {
+    throw journal_error("cannot map", path_);
+  }
+  data_ = static_cast<uint8_t*>(addr);
+  capacity_ = capacity;
+}
+
+void RegistrationJournal::unmap_() {
+  if(data_) {
+    ::munmap(data_, capacity_);
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+}
+
+std::size_t RegistrationJournal::find_tail_() const {
+  std::size_t pos = header_size;
+  while(pos + sizeof(uint32_t) <= capacity_) {
+    uint32_t len;
+    std::memcpy(&len, data_ + pos, sizeof(len));
+    if(len == 0 || pos + sizeof(len) + len > capacity_) {
+      break;
+    }
+    pos += sizeof(len) + len;
+  }
+  return pos;
+}
+
+void RegistrationJournal::append(Op op, const std::string &agent, const Buffer &instance) {
+  uint32_t agent_len = static_cast<uint32_t>(agent.size());
+  uint32_t len = static_cast<uint32_t>(sizeof(uint8_t) + sizeof(agent_len) + agent.size() + instance.size());
+  // keep room for the terminating zero length
+  std::size_t needed = tail_ + sizeof(len) + len + sizeof(len);
+  if(needed > capacity_) {
+    std::size_t capacity = capacity_ * 2;
+    while(capacity < needed) {
+      capacity *= 2;
+    }
+    std::size_t used = tail_;
+    unmap_();
+    map_(capacity);
+    tail_ = used;
+  }
+  // payload first, length last: a torn write leaves a zero length behind it
+  uint8_t *p = data_ + tail_ + sizeof(len);
+  *p++ = static_cast<uint8_t>(op);
+  std::memcpy(p, &agent_len, sizeof(agent_len));
+  p += sizeof(agent_len);
+  std::memcpy(p, agent.data(), agent.size());
+  p += agent.size();
+  if(!instance.empty()) {
+    std::memcpy(p, instance.data(), instance.size());
+  }
+  std::memcpy(data_ + tail_, &len, sizeof(len));
+  tail_ += sizeof(len) + len;
+}
+
+void RegistrationJournal::replay(const RecordVisitor &visitor) const {
+  std::size_t pos = header_size;
+  while(pos < tail_) {
+    uint32_t len;
+    std::memcpy(&len, data_ + pos, sizeof(len));
+    const uint8_t *p = data_ + pos + sizeof(len);
+    Op op = static_cast<Op>(*p);
+    uint32_t agent_len;
+    std::memcpy(&agent_len, p + sizeof(uint8_t), sizeof(agent_len));
+    std::size_t prefix = sizeof(uint8_t) + sizeof(agent_len);
+    if(prefix + agent_len <= len) {
+      std::string agent(reinterpret_cast<const char*>(p + prefix), agent_len);
+      visitor(op, agent, p + prefix + agent_len, len - prefix - agent_len);
+    }
+    pos += sizeof(len) + len;
+  }
+}
+
+void RegistrationJournal::sync() {
+  if(::msync(data_, capacity_, MS_SYNC) < 0 || ::fsync(fd_) < 0) {
+    throw journal_error("cannot sync", path_);
+  }
+}
+
+void RegistrationJournal::rename(const std::string &path) {
+  if(std::rename(path_.c_str(), path.c_str()) < 0) {
+    throw journal_error("cannot rename to " + path, path_);
+  }
+  path_ = path;
+  // the rename itself is durable once the directory is synced
+  auto slash = path_.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path_.substr(0, slash);
+  int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if(dir_fd >= 0) {
+    ::fsync(dir_fd);
+    ::close(dir_fd);
+  }
+}
+
+} // oef
+} // fetch
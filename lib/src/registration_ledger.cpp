@@ -0,0 +1,203 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "registration_ledger.hpp"
+#include "config.hpp"
+#include "serialization.hpp"
+
+#include <cstdio>
+
+namespace fetch {
+namespace oef {
+
+fetch::oef::Logger RegistrationLedger::logger = fetch::oef::Logger("registration-ledger");
+
+void RegistrationLedger::open_journal(const std::string &path) {
+  auto journal = std::make_unique<RegistrationJournal>(path);
+  std::lock_guard<std::mutex> lock(lock_);
+  std::size_t nb_records = 0;
+  auto now = Clock::now();
+  journal->replay(
+      [this,&nb_records,now](RegistrationJournal::Op op, const std::string &agent, const uint8_t *data, std::size_t size) {
+        ++nb_records;
+        pb::Query_Instance pb_instance;
+        if(!pb_instance.ParseFromArray(data, static_cast<int>(size))) {
+          logger.warn("::open_journal skipping unreadable record for agent {}", agent);
+          return;
+        }
+        Instance instance{pb_instance};
+        auto &record = agents_[agent];
+        record.detached_since = now;
+        if(op == RegistrationJournal::Op::Add) {
+          record.instances.insert(instance);
+        } else {
+          record.instances.erase(instance);
+        }
+      });
+  nb_live_ = 0;
+  for(auto iter = agents_.begin(); iter != agents_.end();) {
+    if(iter->second.instances.empty()) {
+      iter = agents_.erase(iter);
+      continue;
+    }
+    nb_live_ += iter->second.instances.size();
+    ++iter;
+  }
+  journal_path_ = path;
+  compact_();
+  logger.info("::open_journal replayed {} records from {}, {} registrations of {} agents restored",
+      nb_records, path, nb_live_, agents_.size());
+}
+
+void RegistrationLedger::compact_() {
+  // only keep what is still registered. The live entries go to a new journal, renamed over the
+  // current one once on disk, so that being killed midway leaves the current journal whole
+  std::string compacted_path = journal_path_ + ".tmp";
+  std::remove(compacted_path.c_str());
+  auto journal = std::make_unique<RegistrationJournal>(compacted_path);
+  for(auto &p : agents_) {
+    for(auto &instance : p.second.instances) {
+      journal->append(RegistrationJournal::Op::Add, p.first, *pbs::serialize(instance.handle()));
+    }
+  }
+  journal->sync();
+  journal->rename(journal_path_);
+  journal_ = std::move(journal);
+  nb_records_ = nb_live_;
+}
+
+void RegistrationLedger::maybe_compact_() {
+  if(!journal_) {
+    return;
+  }
+  std::size_t nb_dead = nb_records_ - nb_live_;
+  if(nb_dead <= config::ledger_compaction_min || nb_dead <= config::ledger_compaction_ratio * nb_live_) {
+    return;
+  }
+  try {
+    compact_();
+    logger.info("::maybe_compact_ compacted {} dead records of {}", nb_dead, journal_path_);
+  } catch(std::exception &e) {
+    // the current journal is still whole: keep appending to it
+    logger.error("::maybe_compact_ cannot compact {}: {}", journal_path_, e.what());
+  }
+}
+
+bool RegistrationLedger::journaled() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return journal_ != nullptr;
+}
+
+void RegistrationLedger::write_journal_(RegistrationJournal::Op op, const std::string &agent, const Instance &instance) {
+  if(journal_) {
+    journal_->append(op, agent, *pbs::serialize(instance.handle()));
+    ++nb_records_;
+  }
+}
+
+void RegistrationLedger::add(const std::string &agent, const Instance &instance) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto &record = agents_[agent];
+  record.attached = true;
+  if(record.instances.insert(instance).second) {
+    ++nb_live_;
+    write_journal_(RegistrationJournal::Op::Add, agent, instance);
+  }
+}
+
+void RegistrationLedger::remove(const std::string &agent, const Instance &instance) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto iter = agents_.find(agent);
+  if(iter == agents_.end()) {
+    return;
+  }
+  if(iter->second.instances.erase(instance) == 1) {
+    --nb_live_;
+    write_journal_(RegistrationJournal::Op::Remove, agent, instance);
+    maybe_compact_();
+  }
+}
+
+std::vector<Instance> RegistrationLedger::attach(const std::string &agent) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto &record = agents_[agent];
+  record.attached = true;
+  return std::vector<Instance>(record.instances.begin(), record.instances.end());
+}
+
+void RegistrationLedger::detach(const std::string &agent) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto iter = agents_.find(agent);
+  if(iter == agents_.end()) {
+    return;
+  }
+  if(iter->second.instances.empty()) {
+    agents_.erase(iter);
+  } else {
+    iter->second.attached = false;
+    iter->second.detached_since = Clock::now();
+  }
+}
+
+std::vector<RegistrationLedger::Entry> RegistrationLedger::snapshot() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::vector<Entry> entries;
+  for(auto &p : agents_) {
+    if(!p.second.attached) {
+      continue;
+    }
+    for(auto &instance : p.second.instances) {
+      entries.emplace_back(p.first, instance);
+    }
+  }
+  return entries;
+}
+
+std::size_t RegistrationLedger::expire(Clock::duration max_detached, Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::size_t nb_expired = 0;
+  for(auto iter = agents_.begin(); iter != agents_.end();) {
+    auto &record = iter->second;
+    if(record.attached || now - record.detached_since < max_detached) {
+      ++iter;
+      continue;
+    }
+    nb_live_ -= record.instances.size();
+    for(auto &instance : record.instances) {
+      write_journal_(RegistrationJournal::Op::Remove, iter->first, instance);
+    }
+    logger.info("::expire forgetting {} registrations of agent {}", record.instances.size(), iter->first);
+    iter = agents_.erase(iter);
+    ++nb_expired;
+  }
+  maybe_compact_();
+  return nb_expired;
+}
+
+std::size_t RegistrationLedger::size() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return nb_live_;
+}
+
+std::size_t RegistrationLedger::journal_records() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return nb_records_;
+}
+
+} // oef
+} // fetch
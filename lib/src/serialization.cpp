@@ -61,6 +61,20 @@ std::string diagnostic(void *p, size_t sz)
   //output << std::endl;
   return output.str();
 }
+
+static void append_varint(Buffer &frame, uint64_t value) {
+  while(value >= 0x80) {
+    frame.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  frame.push_back(static_cast<uint8_t>(value));
+}
+
+void append_field(Buffer &frame, uint32_t field, const Buffer &message) {
+  append_varint(frame, (field << 3) | 2); // wire type 2: length-delimited
+  append_varint(frame, message.size());
+  frame.insert(frame.end(), message.begin(), message.end());
+}
 } // pbs 
 
 std::shared_ptr<Buffer> serialize(uint32_t size) {
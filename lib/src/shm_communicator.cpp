@@ -0,0 +1,693 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "shm_communicator.hpp"
+#include "asio_acceptor.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <thread>
+
+namespace fetch {
+namespace oef {
+
+fetch::oef::Logger ShmComm::logger = fetch::oef::Logger("shm-comm");
+fetch::oef::Logger ShmAcceptor::logger = fetch::oef::Logger("shm-acceptor");
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, 
+    "the rings are shared between processes, their atomics must be lock-free");
+
+namespace {
+  std::error_code eof() {
+    return asio::error::make_error_code(asio::error::eof);
+  }
+  std::error_code broken_pipe() {
+    return asio::error::make_error_code(asio::error::broken_pipe);
+  }
+  std::error_code in_progress() {
+    return asio::error::make_error_code(asio::error::in_progress);
+  }
+  std::error_code message_size() {
+    return asio::error::make_error_code(asio::error::message_size);
+  }
+  std::error_code protocol_error() {
+    return std::make_error_code(std::errc::protocol_error);
+  }
+
+  [[noreturn]] void throw_errno(const char *what) {
+    throw std::system_error(errno, std::system_category(), what);
+  }
+
+  /* Closes the file descriptor unless released */
+  struct Fd {
+    int fd;
+    explicit Fd(int fd) : fd{fd} {}
+    Fd(const Fd &) = delete;
+    Fd operator=(const Fd &) = delete;
+    ~Fd() {
+      if(fd >= 0) {
+        ::close(fd);
+      }
+    }
+    int release() {
+      int released = fd;
+      fd = -1;
+      return released;
+    }
+  };
+
+  void copy_in(uint8_t *data, uint32_t capacity, uint64_t position, const void *source, std::size_t size) {
+    std::size_t offset = std::size_t(position & (capacity - 1));
+    std::size_t first = std::min<std::size_t>(size, capacity - offset);
+    std::memcpy(data + offset, source, first);
+    std::memcpy(data, static_cast<const uint8_t *>(source) + first, size - first);
+  }
+
+  void copy_out(const uint8_t *data, uint32_t capacity, uint64_t position, void *destination, std::size_t size) {
+    std::size_t offset = std::size_t(position & (capacity - 1));
+    std::size_t first = std::min<std::size_t>(size, capacity - offset);
+    std::memcpy(destination, data + offset, first);
+    std::memcpy(static_cast<uint8_t *>(destination) + first, data, size - first);
+  }
+
+  void ring_doorbell(int fd) {
+    uint64_t one = 1;
+    if(::write(fd, &one, sizeof(one)) < 0) {
+      // EAGAIN: the counter is saturated, the doorbell is rung anyway
+    }
+  }
+
+  constexpr uint32_t min_capacity = 4096;
+  constexpr uint32_t max_capacity = 1u << 30;
+  constexpr std::size_t nb_fds = 3; // segment, doorbell of the connecting end, of the accepting end
+}
+
+/*
+ * ShmComm
+ */
+
+std::shared_ptr<ShmComm> ShmComm::accept(asio::io_context &io_context, 
+    asio::local::stream_protocol::socket socket, Options options) {
+  uint32_t capacity = min_capacity;
+  while(capacity < options.capacity && capacity < max_capacity) {
+    capacity <<= 1;
+  }
+  std::size_t size = Segment::size(capacity);
+  Fd memfd{::memfd_create("oef-core-shm", MFD_CLOEXEC)};
+  if(memfd.fd < 0 || ::ftruncate(memfd.fd, off_t(size)) < 0) {
+    throw_errno("ShmComm::accept memfd");
+  }
+  Fd connecting{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+  Fd accepting{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+  if(connecting.fd < 0 || accepting.fd < 0) {
+    throw_errno("ShmComm::accept eventfd");
+  }
+  void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd.fd, 0);
+  if(memory == MAP_FAILED) {
+    throw_errno("ShmComm::accept mmap");
+  }
+  auto *segment = new (memory) Segment; // the memfd is zero filled
+  segment->closed.store(0);
+  segment->capacity = capacity;
+  for(auto &ring : segment->rings) {
+    ring.head.store(0);
+    ring.tail.store(0);
+    ring.reader_sleeping.store(0);
+    ring.writer_waiting.store(0);
+  }
+
+  int fds[nb_fds] = {memfd.fd, connecting.fd, accepting.fd};
+  union {
+    char buffer[CMSG_SPACE(sizeof(fds))];
+    cmsghdr align;
+  } control;
+  std::memset(&control, 0, sizeof(control));
+  iovec iov{&capacity, sizeof(capacity)};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(socket.native_handle(), &msg, MSG_NOSIGNAL);
+  } while(sent < 0 && errno == EINTR);
+  if(sent != ssize_t(sizeof(capacity))) {
+    int error = sent < 0 ? errno : EPROTO;
+    ::munmap(memory, size);
+    throw std::system_error(error, std::system_category(), "ShmComm::accept sendmsg");
+  }
+
+  auto comm = std::make_shared<ShmComm>(io_context, std::move(socket), segment, capacity, true, 
+      accepting.release(), connecting.release(), options);
+  comm->start();
+  return comm;
+}
+
+std::shared_ptr<ShmComm> ShmComm::connect(asio::io_context &io_context, const std::string &path, 
+    Options options) {
+  asio::local::stream_protocol::socket socket{io_context};
+  socket.connect(asio::local::stream_protocol::endpoint{path});
+
+  uint32_t capacity = 0;
+  union {
+    char buffer[CMSG_SPACE(nb_fds * sizeof(int))];
+    cmsghdr align;
+  } control;
+  std::memset(&control, 0, sizeof(control));
+  iovec iov{&capacity, sizeof(capacity)};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+  ssize_t received;
+  do {
+    received = ::recvmsg(socket.native_handle(), &msg, MSG_CMSG_CLOEXEC);
+  } while(received < 0 && errno == EINTR);
+  if(received < 0) {
+    throw_errno("ShmComm::connect recvmsg");
+  }
+  int fds[nb_fds] = {-1, -1, -1};
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if(cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+    std::memcpy(fds, CMSG_DATA(cmsg), std::min(sizeof(fds), std::size_t(cmsg->cmsg_len - CMSG_LEN(0))));
+  }
+  Fd memfd{fds[0]};
+  Fd connecting{fds[1]};
+  Fd accepting{fds[2]};
+  if(received != ssize_t(sizeof(capacity)) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) 
+      || memfd.fd < 0 || connecting.fd < 0 || accepting.fd < 0
+      || capacity < min_capacity || capacity > max_capacity || (capacity & (capacity - 1))) {
+    throw std::system_error(asio::error::make_error_code(asio::error::invalid_argument),
+        "ShmComm::connect unexpected set up from " + path);
+  }
+  std::size_t size = Segment::size(capacity);
+  void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd.fd, 0);
+  if(memory == MAP_FAILED) {
+    throw_errno("ShmComm::connect mmap");
+  }
+  auto *segment = static_cast<Segment *>(memory);
+  if(segment->capacity != capacity) {
+    ::munmap(memory, size);
+    throw std::system_error(asio::error::make_error_code(asio::error::invalid_argument),
+        "ShmComm::connect unexpected segment from " + path);
+  }
+
+  auto comm = std::make_shared<ShmComm>(io_context, std::move(socket), segment, capacity, false, 
+      connecting.release(), accepting.release(), options);
+  comm->start();
+  return comm;
+}
+
+ShmComm::ShmComm(asio::io_context &io_context, asio::local::stream_protocol::socket socket, Segment *segment,
+    uint32_t capacity, bool accepting, int doorbell, int peer_doorbell, Options options)
+  : io_context_(io_context)
+  , socket_{std::move(socket)}
+  , doorbell_{io_context, doorbell}
+  , peer_doorbell_{peer_doorbell}
+  , segment_{segment}
+  , capacity_{capacity}
+  , in_{accepting ? 0u : 1u}
+  , out_{accepting ? 1u : 0u}
+  , options_(options)
+{
+}
+
+ShmComm::~ShmComm() {
+  disconnect();
+  ::close(peer_doorbell_);
+  ::munmap(segment_, Segment::size(capacity_));
+}
+
+void ShmComm::start() {
+  wait_doorbell();
+  watch_peer();
+}
+
+void ShmComm::wait_doorbell() {
+  std::weak_ptr<ShmComm> weak = shared_from_this();
+  doorbell_.async_wait(asio::posix::stream_descriptor::wait_read, [weak](std::error_code ec) {
+      auto self = weak.lock();
+      if(!self || ec) {
+        return;
+      }
+      uint64_t count;
+      if(::read(self->doorbell_.native_handle(), &count, sizeof(count)) < 0) {
+        // EAGAIN: already cleared by receive_sync()
+      }
+      self->wake();
+      if(!self->closed_) {
+        self->wait_doorbell();
+      }
+    });
+}
+
+void ShmComm::watch_peer() {
+  // nothing is sent on the socket once the connection is set up: its end means the peer is gone
+  std::weak_ptr<ShmComm> weak = shared_from_this();
+  auto byte = std::make_shared<uint8_t>();
+  socket_.async_read_some(asio::buffer(byte.get(), 1), [weak,byte](std::error_code, std::size_t) {
+      auto self = weak.lock();
+      if(!self || self->closed_) {
+        return;
+      }
+      DEBUG(logger, "ShmComm::watch_peer peer gone");
+      self->peer_gone_ = true;
+      self->wake();
+    });
+}
+
+bool ShmComm::closed() const {
+  return closed_ || peer_gone_ || corrupt_ || segment_->closed.load(std::memory_order_acquire);
+}
+
+std::error_code ShmComm::read_error() const {
+  return corrupt_ ? protocol_error() : eof();
+}
+
+void ShmComm::corrupted(const char *what, uint64_t head, uint64_t tail) {
+  if(!corrupt_.exchange(true)) {
+    logger.error("ShmComm::corrupted {} (head {}, tail {}, capacity {}), disconnecting", what, head, tail, capacity_);
+  }
+}
+
+void ShmComm::disconnect() {
+  if(closed_.exchange(true)) {
+    return;
+  }
+  segment_->closed.store(1, std::memory_order_release);
+  ring_doorbell(peer_doorbell_);
+  std::error_code ec;
+  socket_.shutdown(asio::socket_base::shutdown_both, ec);
+  socket_.close(ec);
+  doorbell_.cancel(ec);
+  BufferContinuation reader;
+  {
+    std::lock_guard<std::mutex> lock(in_lock_);
+    reader = std::move(reader_);
+    reader_ = nullptr;
+  }
+  if(reader) {
+    auto ec = read_error();
+    asio::post(io_context_, [reader=std::move(reader),ec]() { reader(ec, std::make_shared<Buffer>()); });
+  }
+  flush();
+}
+
+bool ShmComm::pop(std::shared_ptr<Buffer> &frame, bool spin) {
+  auto &ring = segment_->rings[in_];
+  uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+  uint64_t head = ring.head.load(std::memory_order_acquire);
+  if(head == tail && spin && options_.spin_us) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(options_.spin_us);
+    do {
+      std::this_thread::yield(); // lets the producer run when it shares our core
+      head = ring.head.load(std::memory_order_acquire);
+    } while(head == tail && std::chrono::steady_clock::now() < deadline);
+  }
+  if(head == tail) {
+    // about to sleep: the producer rings our doorbell after its next push
+    ring.reader_sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    head = ring.head.load(std::memory_order_acquire);
+    if(head == tail) {
+      return false;
+    }
+    ring.reader_sleeping.store(0, std::memory_order_relaxed);
+  }
+  if(head - tail > capacity_ || head - tail < sizeof(uint32_t)) {
+    corrupted("ShmComm::pop inconsistent ring", head, tail);
+    return false;
+  }
+  const uint8_t *data = segment_->data(in_, capacity_);
+  uint32_t size;
+  copy_out(data, capacity_, tail, &size, sizeof(size));
+  if(size > head - tail - sizeof(size)) {
+    corrupted("ShmComm::pop frame larger than the ring", head, tail);
+    return false;
+  }
+  frame = std::make_shared<Buffer>(size);
+  copy_out(data, capacity_, tail + sizeof(size), frame->data(), size);
+  ring.tail.store(tail + sizeof(size) + size, std::memory_order_release);
+  notify_writer();
+  return true;
+}
+
+bool ShmComm::push(const Buffer &frame) {
+  auto &ring = segment_->rings[out_];
+  uint64_t length = sizeof(uint32_t) + frame.size();
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  uint64_t tail = ring.tail.load(std::memory_order_acquire);
+  if(tail > head || head - tail > capacity_) {
+    corrupted("ShmComm::push inconsistent ring", head, tail);
+    return false;
+  }
+  if(capacity_ - (head - tail) < length) {
+    // the consumer rings our doorbell once it made room
+    ring.writer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    tail = ring.tail.load(std::memory_order_acquire);
+    if(tail > head || head - tail > capacity_) {
+      corrupted("ShmComm::push inconsistent ring", head, tail);
+      return false;
+    }
+    if(capacity_ - (head - tail) < length) {
+      return false;
+    }
+    ring.writer_waiting.store(0, std::memory_order_relaxed);
+  }
+  uint8_t *data = segment_->data(out_, capacity_);
+  uint32_t size = uint32_t(frame.size());
+  copy_in(data, capacity_, head, &size, sizeof(size));
+  copy_in(data, capacity_, head + sizeof(size), frame.data(), frame.size());
+  ring.head.store(head + length, std::memory_order_release);
+  return true;
+}
+
+void ShmComm::notify_reader() {
+  auto &ring = segment_->rings[out_];
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(ring.reader_sleeping.load(std::memory_order_relaxed) && ring.reader_sleeping.exchange(0)) {
+    ring_doorbell(peer_doorbell_);
+  }
+}
+
+void ShmComm::notify_writer() {
+  auto &ring = segment_->rings[in_];
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(ring.writer_waiting.load(std::memory_order_relaxed) && ring.writer_waiting.exchange(0)) {
+    ring_doorbell(peer_doorbell_);
+  }
+}
+
+void ShmComm::wake() {
+  BufferContinuation reader;
+  std::shared_ptr<Buffer> frame;
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(in_lock_);
+    if(reader_) {
+      bool closed = this->closed(); // first, for what was sent before closing to be received
+      if(pop(frame, false)) {
+        reader = std::move(reader_);
+      } else if(closed || corrupt_) {
+        reader = std::move(reader_);
+        ec = read_error();
+        frame = std::make_shared<Buffer>();
+      }
+      if(reader) {
+        reader_ = nullptr;
+      }
+    }
+  }
+  if(corrupt_) {
+    disconnect();
+  }
+  if(reader) {
+    reader(ec, frame);
+  }
+  flush();
+}
+
+void ShmComm::flush() {
+  std::vector<std::pair<LengthContinuation,std::size_t>> sent;
+  std::vector<LengthContinuation> failed;
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    if(pending_.empty()) {
+      return;
+    }
+    if(closed()) {
+      for(auto &send : pending_) {
+        failed.emplace_back(std::move(send.second));
+      }
+      pending_.clear();
+    } else {
+      while(!pending_.empty() && push(*pending_.front().first)) {
+        sent.emplace_back(std::move(pending_.front().second), pending_.front().first->size() + sizeof(uint32_t));
+        pending_.pop_front();
+      }
+      if(!sent.empty()) {
+        notify_reader();
+      }
+    }
+  }
+  if(corrupt_) {
+    disconnect(); // fails the sends left
+  }
+  for(auto &send : sent) {
+    auto continuation = std::move(send.first);
+    std::size_t length = send.second;
+    asio::post(io_context_, [continuation=std::move(continuation),length]() { continuation(std::error_code{}, length); });
+  }
+  for(auto &continuation : failed) {
+    asio::post(io_context_, [continuation=std::move(continuation)]() { continuation(broken_pipe(), 0); });
+  }
+}
+
+std::error_code ShmComm::send_sync(std::shared_ptr<Buffer> buffer) {
+  for(;;) {
+    {
+      std::lock_guard<std::mutex> lock(out_lock_);
+      if(closed()) {
+        return broken_pipe();
+      }
+      if(buffer->size() + sizeof(uint32_t) > capacity_) {
+        return message_size();
+      }
+      if(pending_.empty() && push(*buffer)) {
+        notify_reader();
+        return {};
+      }
+    }
+    if(corrupt_) {
+      disconnect();
+      return broken_pipe();
+    }
+    // the doorbell is left set, for the io_context to serve the asynchronous sends too
+    pollfd fd{doorbell_.native_handle(), POLLIN, 0};
+    ::poll(&fd, 1, 1);
+  }
+}
+
+std::error_code ShmComm::send_sync(std::vector<std::shared_ptr<Buffer>> buffers) {
+  for(auto &buffer : buffers) {
+    auto ec = send_sync(std::move(buffer));
+    if(ec) {
+      return ec;
+    }
+  }
+  return {};
+}
+
+std::error_code ShmComm::receive_sync(std::shared_ptr<Buffer>& buffer) {
+  for(;;) {
+    std::error_code ec;
+    {
+      std::lock_guard<std::mutex> lock(in_lock_);
+      if(reader_) {
+        return in_progress();
+      }
+      bool closed = this->closed();
+      if(pop(buffer, !closed)) {
+        return {};
+      }
+      if(closed || corrupt_) {
+        ec = read_error();
+      }
+    }
+    if(ec) {
+      if(corrupt_) {
+        disconnect();
+      }
+      return ec;
+    }
+    // short timeout: the io_context may clear the doorbell first
+    pollfd fds[2] = {{doorbell_.native_handle(), POLLIN, 0}, {socket_.native_handle(), POLLIN, 0}};
+    ::poll(fds, 2, 1);
+    if(fds[0].revents & POLLIN) {
+      uint64_t count;
+      if(::read(fds[0].fd, &count, sizeof(count)) > 0) {
+        flush(); // the doorbell may have been rung for the sends as well
+      }
+    }
+    if(fds[1].revents) {
+      peer_gone_ = true;
+    }
+  }
+}
+
+void ShmComm::send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) {
+  std::size_t length = buffer->size() + sizeof(uint32_t); // as AsioComm reports it, size included
+  std::error_code ec;
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    if(closed()) {
+      ec = broken_pipe();
+    } else if(length > capacity_) {
+      ec = message_size();
+    } else if(pending_.empty() && push(*buffer)) {
+      notify_reader();
+    } else {
+      pending_.emplace_back(std::move(buffer), std::move(continuation));
+      queued = true;
+    }
+  }
+  if(corrupt_) {
+    disconnect(); // fails the queued sends
+  }
+  if(queued) {
+    return;
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec,length]() { continuation(ec, ec ? 0 : length); });
+}
+
+void ShmComm::send_async(std::shared_ptr<Buffer> buffer) {
+  send_async(std::move(buffer), [](std::error_code, std::size_t) {});
+}
+
+void ShmComm::send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) {
+  std::size_t length = 0;
+  std::error_code ec;
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    for(auto &buffer : buffers) {
+      length += buffer->size() + sizeof(uint32_t);
+      if(buffer->size() + sizeof(uint32_t) > capacity_) {
+        ec = message_size();
+      }
+    }
+    if(closed()) {
+      ec = broken_pipe();
+    }
+    if(!ec) {
+      std::size_t pushed = 0;
+      while(pending_.empty() && pushed < buffers.size() && push(*buffers[pushed])) {
+        ++pushed;
+      }
+      if(pushed > 0) {
+        notify_reader();
+      }
+      if(pushed < buffers.size()) {
+        // the last one answers for the group, flushed in order
+        for(std::size_t i = pushed; i + 1 < buffers.size(); ++i) {
+          pending_.emplace_back(std::move(buffers[i]), [](std::error_code, std::size_t) {});
+        }
+        pending_.emplace_back(std::move(buffers.back()), [continuation=std::move(continuation),length](std::error_code ec, std::size_t) {
+            continuation(ec, ec ? 0 : length);
+          });
+        queued = true;
+      }
+    }
+  }
+  if(corrupt_) {
+    disconnect(); // fails the queued sends
+  }
+  if(queued) {
+    return;
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec,length]() { continuation(ec, ec ? 0 : length); });
+}
+
+void ShmComm::receive_async(BufferContinuation continuation) {
+  std::shared_ptr<Buffer> frame;
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(in_lock_);
+    bool closed = this->closed();
+    if(reader_) {
+      ec = in_progress();
+    } else if(pop(frame, !closed)) {
+    } else if(closed || corrupt_) {
+      ec = read_error();
+    } else {
+      reader_ = std::move(continuation);
+      return;
+    }
+  }
+  if(corrupt_) {
+    disconnect();
+  }
+  if(!frame) {
+    frame = std::make_shared<Buffer>();
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec,frame]() { continuation(ec, frame); });
+}
+
+/*
+ * ShmAcceptor
+ */
+
+ShmAcceptor::ShmAcceptor(asio::io_context &io_context, std::string path, ShmComm::Options options, 
+    uint32_t backlog)
+  : io_context_(io_context)
+  , acceptor_{io_context}
+  , path_{std::move(path)}
+  , options_(options)
+{
+  AsioLocalAcceptor::listen(acceptor_, path_, backlog);
+}
+
+ShmAcceptor::~ShmAcceptor() {
+  std::error_code ec;
+  acceptor_.close(ec);
+  ::unlink(path_.c_str());
+}
+
+void ShmAcceptor::do_accept_async(CommunicatorContinuation continuation) {
+  acceptor_.async_accept([this,continuation](std::error_code ec, asio::local::stream_protocol::socket socket) {
+      if(ec) {
+        if(ec != asio::error::operation_aborted) {
+          logger.error("ShmAcceptor::do_accept_async error {}", ec.value());
+        }
+        return;
+      }
+      std::shared_ptr<communicator_t> comm;
+      try {
+        comm = ShmComm::accept(io_context_, std::move(socket), options_);
+      } catch(std::exception &e) {
+        // this connection failed, not the acceptor
+        logger.error("ShmAcceptor::do_accept_async cannot set up a connection: {}", e.what());
+        do_accept_async(continuation);
+        return;
+      }
+      continuation(ec, comm);
+    });
+}
+
+} // oef
+} // fetch
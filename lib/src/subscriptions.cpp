@@ -0,0 +1,152 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "subscriptions.hpp"
+
+namespace fetch {
+namespace oef {
+
+fetch::oef::Logger Subscriptions::logger = fetch::oef::Logger("subscriptions");
+
+bool Subscriptions::add(const std::string &agent, uint32_t id, const fetch::oef::pb::Query_Model &query) {
+  if(!QueryModel{query}.valid()) {
+    logger.debug("::add invalid query for subscription {} of agent {}", id, agent);
+    return false;
+  }
+  auto subscription = std::make_shared<const Subscription>(Subscription{agent, id, CompiledQuery{query}});
+  auto key = key_(agent, id);
+  std::lock_guard<std::mutex> lock(lock_);
+  auto &agent_subscriptions = agents_[agent];
+  if(agent_subscriptions.find(key) != agent_subscriptions.end()) {
+    return false;
+  }
+  agent_subscriptions[key] = subscription;
+  auto &bucket = buckets_[subscription->query.model_name()];
+  const auto &eq = subscription->query.equality_key();
+  if(eq.first.empty()) {
+    bucket.unindexed[key] = subscription;
+  } else {
+    bucket.equalities[eq.first][eq.second][key] = subscription;
+  }
+  ++size_;
+  return true;
+}
+
+void Subscriptions::erase_(const SubscriptionPtr &subscription) {
+  auto key = key_(subscription->agent, subscription->id);
+  auto bucket_iter = buckets_.find(subscription->query.model_name());
+  if(bucket_iter == buckets_.end()) {
+    return;
+  }
+  auto &bucket = bucket_iter->second;
+  const auto &eq = subscription->query.equality_key();
+  if(eq.first.empty()) {
+    bucket.unindexed.erase(key);
+  } else {
+    auto &values = bucket.equalities[eq.first];
+    auto &subscriptions = values[eq.second];
+    subscriptions.erase(key);
+    if(subscriptions.empty()) {
+      values.erase(eq.second);
+    }
+    if(values.empty()) {
+      bucket.equalities.erase(eq.first);
+    }
+  }
+  if(bucket.unindexed.empty() && bucket.equalities.empty()) {
+    buckets_.erase(bucket_iter);
+  }
+  --size_;
+}
+
+bool Subscriptions::remove(const std::string &agent, uint32_t id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto agent_iter = agents_.find(agent);
+  if(agent_iter == agents_.end()) {
+    return false;
+  }
+  auto iter = agent_iter->second.find(key_(agent, id));
+  if(iter == agent_iter->second.end()) {
+    return false;
+  }
+  erase_(iter->second);
+  agent_iter->second.erase(iter);
+  if(agent_iter->second.empty()) {
+    agents_.erase(agent_iter);
+  }
+  return true;
+}
+
+std::size_t Subscriptions::remove_all(const std::string &agent) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto agent_iter = agents_.find(agent);
+  if(agent_iter == agents_.end()) {
+    return 0;
+  }
+  std::size_t nb = agent_iter->second.size();
+  for(auto &p : agent_iter->second) {
+    erase_(p.second);
+  }
+  agents_.erase(agent_iter);
+  return nb;
+}
+
+void Subscriptions::match_(const Bucket &bucket, const Instance &instance, std::vector<Subscriber> &matches) const {
+  for(auto &p : bucket.unindexed) {
+    if(p.second->query.check(instance)) {
+      matches.emplace_back(p.second->agent, p.second->id);
+    }
+  }
+  for(auto &attribute : bucket.equalities) {
+    const VariantType *v = instance.find(attribute.first);
+    if(!v || !v->is<std::string>()) {
+      continue;
+    }
+    auto iter = attribute.second.find(v->get<std::string>());
+    if(iter == attribute.second.end()) {
+      continue;
+    }
+    for(auto &p : iter->second) {
+      if(p.second->query.check(instance)) {
+        matches.emplace_back(p.second->agent, p.second->id);
+      }
+    }
+  }
+}
+
+std::vector<Subscriptions::Subscriber> Subscriptions::match(const Instance &instance) const {
+  std::vector<Subscriber> matches;
+  std::lock_guard<std::mutex> lock(lock_);
+  auto iter = buckets_.find(instance.model().name());
+  if(iter != buckets_.end()) {
+    match_(iter->second, instance, matches);
+  }
+  iter = buckets_.find("");
+  if(iter != buckets_.end() && !instance.model().name().empty()) {
+    match_(iter->second, instance, matches);
+  }
+  return matches;
+}
+
+std::size_t Subscriptions::size() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return size_;
+}
+
+} // oef
+} // fetch
@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "tracing.hpp"
+
+#include <spdlog/details/os.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace fetch {
+namespace oef {
+
+std::atomic<uint32_t> Tracer::sample_every_{0};
+std::atomic<uint32_t> Tracer::counter_{0};
+std::atomic<uint64_t> Tracer::next_id_{1};
+thread_local std::shared_ptr<Trace> Tracer::current_;
+
+namespace {
+  struct Ring {
+    std::mutex lock;
+    std::vector<TraceRecord> records;
+    std::size_t next{0};
+  };
+
+  Ring &ring() {
+    static Ring r;
+    return r;
+  }
+
+  std::string json_escape(const std::string &s) {
+    std::string out;
+    for(char c : s) {
+      if(c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if(static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out += escaped;
+      } else {
+        out += c;
+      }
+    }
+    return out;
+  }
+}
+
+Trace::~Trace() {
+  Tracer::record(TraceRecord{id_, agent_, std::move(name_), std::move(marks_)});
+}
+
+void Trace::mark(Stage stage) {
+  auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  std::lock_guard<std::mutex> lock(lock_);
+  marks_.push_back(Mark{stage, uint64_t(now), uint64_t(spdlog::details::os::thread_id())});
+}
+
+void Trace::name(std::string name) {
+  std::lock_guard<std::mutex> lock(lock_);
+  name_ = std::move(name);
+}
+
+const char *Trace::stage_name(Stage stage) {
+  static const char *names[] = {"frame received", "parsed", "directory lookup", "search sent",
+    "search reply parsed", "response serialized", "write completed"};
+  return names[static_cast<uint8_t>(stage)];
+}
+
+void Tracer::record(TraceRecord record) {
+  if(record.marks.empty()) {
+    return;
+  }
+  auto &r = ring();
+  std::lock_guard<std::mutex> lock(r.lock);
+  if(r.records.size() < config::trace_ring_size) {
+    r.records.push_back(std::move(record));
+  } else {
+    r.records[r.next] = std::move(record);
+  }
+  r.next = (r.next + 1) % config::trace_ring_size;
+}
+
+std::vector<TraceRecord> Tracer::traces() {
+  auto &r = ring();
+  std::lock_guard<std::mutex> lock(r.lock);
+  if(r.records.size() < config::trace_ring_size) {
+    return r.records;
+  }
+  std::vector<TraceRecord> records{r.records.begin() + long(r.next), r.records.end()};
+  records.insert(records.end(), r.records.begin(), r.records.begin() + long(r.next));
+  return records;
+}
+
+void Tracer::clear() {
+  auto &r = ring();
+  std::lock_guard<std::mutex> lock(r.lock);
+  r.records.clear();
+  r.next = 0;
+}
+
+std::string Tracer::chrome_json() {
+  // one row (tid) per trace, each stage being a slice from the previous one
+  std::string out = "{\"traceEvents\":[";
+  bool first = true;
+  auto event = [&out,&first](const TraceRecord &t, const char *name, const char *phase, 
+      uint64_t start, uint64_t end, uint64_t thread) {
+    char times[96];
+    std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", double(start) / 1000., double(end - start) / 1000.);
+    out += first ? "\n" : ",\n";
+    first = false;
+    out += std::string("{\"name\":\"") + name + "\",\"cat\":\"oef\",\"ph\":\"" + phase + "\"," + times 
+      + ",\"pid\":1,\"tid\":" + std::to_string(t.id) + ",\"args\":{\"agent\":\"" + json_escape(t.agent) 
+      + "\",\"payload\":\"" + json_escape(t.name) + "\",\"thread\":" + std::to_string(thread) + "}}";
+  };
+  for(auto &t : traces()) {
+    auto marks = t.marks;
+    std::stable_sort(marks.begin(), marks.end(), [](const Trace::Mark &a, const Trace::Mark &b) { return a.time < b.time; });
+    event(t, "message", "X", marks.front().time, marks.back().time, marks.front().thread);
+    for(std::size_t i = 1; i < marks.size(); ++i) {
+      event(t, Trace::stage_name(marks[i].stage), "X", marks[i-1].time, marks[i].time, marks[i].thread);
+    }
+  }
+  out += "\n],\"displayTimeUnit\":\"ns\"}\n";
+  return out;
+}
+
+} // oef
+} // fetch
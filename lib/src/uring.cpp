@@ -0,0 +1,403 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "uring.hpp"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace fetch {
+namespace oef {
+
+fetch::oef::Logger IoUring::logger = fetch::oef::Logger("io-uring");
+fetch::oef::Counter IoUring::submissions{"oef_uring_submissions_total", "",
+  "io_uring_enter calls submitting operations"};
+fetch::oef::Counter IoUring::operations{"oef_uring_operations_total", "",
+  "Operations submitted to io_uring"};
+
+namespace {
+  constexpr uint16_t recv_group = 0;
+
+  int io_uring_setup(unsigned entries, io_uring_params *params) {
+    return int(::syscall(__NR_io_uring_setup, entries, params));
+  }
+  int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+  }
+  int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+  }
+
+  [[noreturn]] void throw_errno(const char *what, int error = errno) {
+    throw std::system_error(error, std::system_category(), what);
+  }
+
+  void *map(std::size_t size, int fd = -1, off_t offset = 0) {
+    int flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE;
+    void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, offset);
+    return memory == MAP_FAILED ? nullptr : memory;
+  }
+
+  template <typename T>
+  T *at(void *base, uint32_t offset) {
+    return reinterpret_cast<T *>(static_cast<uint8_t *>(base) + offset);
+  }
+
+  io_uring_sqe prepare(uint8_t opcode, int fd, uint64_t addr, uint32_t len) {
+    io_uring_sqe sqe;
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.addr = addr;
+    sqe.len = len;
+    return sqe;
+  }
+}
+
+std::shared_ptr<IoUring> IoUring::create(asio::io_context &io_context, Options options) {
+  auto uring = std::make_shared<IoUring>(io_context, options);
+  uring->wait();
+  return uring;
+}
+
+IoUring::IoUring(asio::io_context &io_context, Options options)
+  : io_context_(io_context)
+  , options_(options)
+  , ring_{io_context}
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = options.entries * 16;
+  fd_ = io_uring_setup(options.entries, &params);
+  if(fd_ < 0) {
+    throw_errno("IoUring io_uring_setup");
+  }
+  try {
+    const uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL;
+    if((params.features & required) != required) {
+      throw_errno("IoUring kernel features", ENOTSUP);
+    }
+    sq_ring_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    sq_ring_ = map(sq_ring_size_, fd_, IORING_OFF_SQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(map(sqes_size_, fd_, IORING_OFF_SQES));
+    if(!sq_ring_ || !sqes_) {
+      throw_errno("IoUring mmap");
+    }
+    sq_head_ = at<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = at<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_array_ = at<unsigned>(sq_ring_, params.sq_off.array);
+    sq_mask_ = *at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    cq_head_ = at<unsigned>(sq_ring_, params.cq_off.head);
+    cq_tail_ = at<unsigned>(sq_ring_, params.cq_off.tail);
+    cqes_ = at<io_uring_cqe>(sq_ring_, params.cq_off.cqes);
+    cq_mask_ = *at<unsigned>(sq_ring_, params.cq_off.ring_mask);
+
+    // registered send buffers
+    send_memory_ = static_cast<uint8_t *>(map(std::size_t(options.send_buffers) * options.send_buffer_size));
+    if(!send_memory_) {
+      throw_errno("IoUring send buffers");
+    }
+    std::vector<iovec> iovs;
+    for(uint32_t i = 0; i < options.send_buffers; ++i) {
+      iovs.push_back(iovec{send_buffer(i), options.send_buffer_size});
+      free_send_buffers_.push_back(options.send_buffers - 1 - i);
+    }
+    if(io_uring_register(fd_, IORING_REGISTER_BUFFERS, iovs.data(), unsigned(iovs.size())) < 0) {
+      throw_errno("IoUring IORING_REGISTER_BUFFERS");
+    }
+
+    // provided receive buffers, all at once and waiting for the kernel to take them
+    if(options.recv_buffers == 0 || options.recv_buffers > 65536) {
+      throw_errno("IoUring receive buffers", EINVAL);
+    }
+    recv_memory_ = static_cast<uint8_t *>(map(std::size_t(options.recv_buffers) * options.recv_buffer_size));
+    if(!recv_memory_) {
+      throw_errno("IoUring receive buffers");
+    }
+    auto sqe = prepare(IORING_OP_PROVIDE_BUFFERS, int(options.recv_buffers), reinterpret_cast<uint64_t>(recv_memory_),
+        options.recv_buffer_size);
+    sqe.buf_group = recv_group;
+    sqes_[0] = sqe;
+    sq_array_[0] = 0;
+    __atomic_store_n(sq_tail_, 1u, __ATOMIC_RELEASE);
+    if(io_uring_enter(fd_, 1, 1, IORING_ENTER_GETEVENTS) != 1) {
+      throw_errno("IoUring IORING_OP_PROVIDE_BUFFERS");
+    }
+    int32_t provided = cqes_[*cq_head_ & cq_mask_].res;
+    __atomic_store_n(cq_head_, *cq_head_ + 1, __ATOMIC_RELEASE);
+    if(provided < 0) {
+      throw_errno("IoUring IORING_OP_PROVIDE_BUFFERS", -provided);
+    }
+
+    ring_.assign(fd_);
+  } catch(...) {
+    close();
+    throw;
+  }
+}
+
+IoUring::~IoUring() {
+  close();
+}
+
+void IoUring::close() {
+  ring_.release();
+  if(fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  if(sq_ring_) {
+    ::munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = nullptr;
+  }
+  if(sqes_) {
+    ::munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if(send_memory_) {
+    ::munmap(send_memory_, std::size_t(options_.send_buffers) * options_.send_buffer_size);
+    send_memory_ = nullptr;
+  }
+  if(recv_memory_) {
+    ::munmap(recv_memory_, std::size_t(options_.recv_buffers) * options_.recv_buffer_size);
+    recv_memory_ = nullptr;
+  }
+}
+
+void IoUring::accept(int fd, Operation &operation) {
+  auto sqe = prepare(IORING_OP_ACCEPT, fd, 0, 0);
+  sqe.accept_flags = SOCK_CLOEXEC;
+  queue(sqe, &operation);
+}
+
+void IoUring::recv(int fd, Operation &operation) {
+  auto sqe = prepare(IORING_OP_RECV, fd, 0, options_.recv_buffer_size);
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = recv_group;
+  queue(sqe, &operation);
+}
+
+void IoUring::write_fixed(int fd, uint32_t index, uint32_t offset, uint32_t length, Operation &operation) {
+  auto sqe = prepare(IORING_OP_WRITE_FIXED, fd, reinterpret_cast<uint64_t>(send_buffer(index) + offset), length);
+  sqe.buf_index = uint16_t(index);
+  queue(sqe, &operation);
+}
+
+void IoUring::writev(int fd, const iovec *iov, uint32_t count, Operation &operation) {
+  queue(prepare(IORING_OP_WRITEV, fd, reinterpret_cast<uint64_t>(iov), count), &operation);
+}
+
+int32_t IoUring::acquire_send_buffer() {
+  std::lock_guard<std::mutex> lock(lock_);
+  if(free_send_buffers_.empty()) {
+    return -1;
+  }
+  uint32_t index = free_send_buffers_.back();
+  free_send_buffers_.pop_back();
+  return int32_t(index);
+}
+
+void IoUring::release_send_buffer(uint32_t index) {
+  std::lock_guard<std::mutex> lock(lock_);
+  free_send_buffers_.push_back(index);
+}
+
+const uint8_t *IoUring::recv_buffer(uint32_t flags) const {
+  if(!(flags & IORING_CQE_F_BUFFER)) {
+    return nullptr;
+  }
+  return recv_memory_ + std::size_t(flags >> IORING_CQE_BUFFER_SHIFT) * options_.recv_buffer_size;
+}
+
+void IoUring::release_recv_buffer(uint32_t flags) {
+  if(flags & IORING_CQE_F_BUFFER) {
+    provide(uint16_t(flags >> IORING_CQE_BUFFER_SHIFT));
+  }
+}
+
+void IoUring::provide(uint16_t id) {
+  auto sqe = prepare(IORING_OP_PROVIDE_BUFFERS, 1, reinterpret_cast<uint64_t>(recv_memory_ + std::size_t(id) * options_.recv_buffer_size),
+      options_.recv_buffer_size);
+  sqe.off = id;
+  sqe.buf_group = recv_group;
+  queue(sqe, nullptr);
+}
+
+void IoUring::queue(const io_uring_sqe &sqe, Operation *operation) {
+  bool flush = false;
+  bool closed;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    closed = closed_;
+    if(closed) {
+      flush = operation != nullptr;
+    } else {
+      pending_.push_back(sqe);
+      pending_.back().user_data = reinterpret_cast<uint64_t>(operation);
+      if(operation) {
+        operation->prev_ = nullptr;
+        operation->next_ = in_flight_;
+        if(in_flight_) {
+          in_flight_->prev_ = operation;
+        }
+        in_flight_ = operation;
+      }
+      if(!flushing_) {
+        flushing_ = true;
+        flush = true;
+      }
+    }
+  }
+  if(!flush) {
+    return;
+  }
+  if(closed) {
+    asio::post(io_context_, [operation]() { operation->complete(-ECANCELED, 0); });
+  } else {
+    asio::post(io_context_, [self = shared_from_this()]() { self->flush(); });
+  }
+}
+
+void IoUring::flush() {
+  std::lock_guard<std::mutex> lock(lock_);
+  flushing_ = false;
+  std::size_t queued = 0;
+  while(!closed_ && queued < pending_.size()) {
+    unsigned tail = *sq_tail_;
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    while(queued < pending_.size() && tail - head < sq_entries_) {
+      unsigned index = tail & sq_mask_;
+      sqes_[index] = pending_[queued++];
+      sq_array_[index] = index;
+      ++tail;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    unsigned to_submit = tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    int submitted;
+    do {
+      submitted = io_uring_enter(fd_, to_submit, 0, 0);
+    } while(submitted < 0 && errno == EINTR);
+    if(submitted < 0) {
+      // EAGAIN, EBUSY: the kernel is short of resources or has completions to reap first. What
+      // is in the submission queue is submitted by the next flush
+      logger.warn("IoUring::flush io_uring_enter failed: {}", std::strerror(errno));
+      flushing_ = true;
+      asio::post(io_context_, [self = shared_from_this()]() { self->flush(); });
+      break;
+    }
+    submissions.inc();
+    operations.inc(uint64_t(submitted));
+  }
+  pending_.erase(pending_.begin(), pending_.begin() + long(queued));
+}
+
+void IoUring::wait() {
+  std::weak_ptr<IoUring> weak = shared_from_this();
+  ring_.async_wait(asio::posix::stream_descriptor::wait_read, [weak](std::error_code ec) {
+      auto self = weak.lock();
+      if(!self || ec) {
+        return;
+      }
+      // waiting again first: the completions arriving while this thread runs its batch are reaped,
+      // and run, by another io thread. Those arrived before are in this batch
+      self->wait();
+      self->reap();
+    });
+}
+
+void IoUring::reap() {
+  // the completions are run outside reap_lock_, for the io threads to process their sessions in
+  // parallel. Each thread reaps into its own batch: reap() is not reentered from the completions
+  thread_local std::vector<std::pair<Operation*,io_uring_cqe>> reaped;
+  reaped.clear();
+  {
+    std::lock_guard<std::mutex> reap_lock(reap_lock_);
+    if(closed_) {
+      return;
+    }
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if(head == tail) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    for(; head != tail; ++head) {
+      const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      auto *operation = reinterpret_cast<Operation *>(cqe.user_data);
+      if(!operation) {
+        if(cqe.res < 0) {
+          logger.warn("IoUring::reap IORING_OP_PROVIDE_BUFFERS failed: {}", std::strerror(-cqe.res));
+        }
+        continue;
+      }
+      if(operation->prev_) {
+        operation->prev_->next_ = operation->next_;
+      } else {
+        in_flight_ = operation->next_;
+      }
+      if(operation->next_) {
+        operation->next_->prev_ = operation->prev_;
+      }
+      reaped.emplace_back(operation, cqe);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+  // taken out of in_flight_: shutdown() doesn't cancel them, they complete here only
+  for(auto &completion : reaped) {
+    completion.first->complete(completion.second.res, completion.second.flags);
+  }
+}
+
+void IoUring::shutdown() {
+  std::lock_guard<std::mutex> reap_lock(reap_lock_);
+  Operation *cancelled;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if(closed_) {
+      return;
+    }
+    closed_ = true;
+    pending_.clear();
+    cancelled = in_flight_;
+    in_flight_ = nullptr;
+  }
+  std::error_code ec;
+  ring_.cancel(ec);
+  // the kernel cancels what is in flight once the ring is closed, buffers are unmapped in the destructor
+  ring_.release();
+  ::close(fd_);
+  fd_ = -1;
+  while(cancelled) {
+    Operation *next = cancelled->next_;
+    cancelled->complete(-ECANCELED, 0);
+    cancelled = next;
+  }
+}
+
+} // oef
+} // fetch
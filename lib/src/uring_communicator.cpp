@@ -0,0 +1,477 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "uring_communicator.hpp"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace fetch {
+namespace oef {
+
+fetch::oef::Logger UringComm::logger = fetch::oef::Logger("uring-comm");
+fetch::oef::Logger UringAcceptor::logger = fetch::oef::Logger("uring-acceptor");
+
+namespace {
+  std::error_code eof() {
+    return asio::error::make_error_code(asio::error::eof);
+  }
+  std::error_code broken_pipe() {
+    return asio::error::make_error_code(asio::error::broken_pipe);
+  }
+  std::error_code in_progress() {
+    return asio::error::make_error_code(asio::error::in_progress);
+  }
+  std::error_code system_error(int32_t result) {
+    return std::error_code(-result, std::system_category());
+  }
+
+  constexpr std::size_t max_writev_frames = 64;
+}
+
+/*
+ * UringComm
+ */
+
+UringComm::UringComm(std::shared_ptr<IoUring> uring, asio::io_context &io_context, int fd)
+  : uring_{std::move(uring)}
+  , io_context_(io_context)
+  , fd_{fd}
+{
+}
+
+UringComm::~UringComm() {
+  disconnect();
+  ::close(fd_);
+}
+
+void UringComm::disconnect() {
+  if(closed_.exchange(true)) {
+    return;
+  }
+  // operations in flight complete with an error, or end of file
+  ::shutdown(fd_, SHUT_RDWR);
+}
+
+void UringComm::Receive::complete(int32_t result, uint32_t flags) {
+  auto comm = std::move(self);
+  comm->received(result, flags);
+}
+
+void UringComm::Write::complete(int32_t result, uint32_t) {
+  auto comm = std::move(self);
+  comm->written(result);
+}
+
+void UringComm::receive() {
+  receiving_ = true;
+  receive_.self = shared_from_this();
+  uring_->recv(fd_, receive_);
+}
+
+void UringComm::received(int32_t result, uint32_t flags) {
+  BufferContinuation reader;
+  std::shared_ptr<Buffer> frame;
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(in_lock_);
+    receiving_ = false;
+    if(result == -ENOBUFS) {
+      // all provided buffers were taken before this completion was reaped
+      receive();
+      return;
+    }
+    if(result > 0) {
+      append(uring_->recv_buffer(flags), std::size_t(result));
+    } else {
+      in_error_ = result == 0 ? eof() : system_error(result);
+    }
+    uring_->release_recv_buffer(flags);
+    if(!reader_) {
+      return;
+    }
+    if(!frames_.empty()) {
+      frame = std::move(frames_.front());
+      frames_.pop_front();
+    } else if(in_error_) {
+      ec = in_error_;
+      frame = std::make_shared<Buffer>();
+    } else {
+      receive(); // a frame is not entirely received yet
+      return;
+    }
+    reader = std::move(reader_);
+    reader_ = nullptr;
+  }
+  asio::post(io_context_, [reader=std::move(reader),ec,frame]() { reader(ec, frame); });
+}
+
+void UringComm::append(const uint8_t *data, std::size_t size) {
+  if(!partial_.empty()) {
+    partial_.insert(partial_.end(), data, data + size);
+    data = partial_.data();
+    size = partial_.size();
+  }
+  std::size_t offset = 0;
+  for(;;) {
+    uint32_t length;
+    if(size - offset < sizeof(length)) {
+      break;
+    }
+    std::memcpy(&length, data + offset, sizeof(length));
+    if(size - offset - sizeof(length) < length) {
+      break;
+    }
+    const uint8_t *begin = data + offset + sizeof(length);
+    frames_.push_back(std::make_shared<Buffer>(begin, begin + length));
+    offset += sizeof(length) + length;
+  }
+  if(data == partial_.data()) {
+    partial_.erase(partial_.begin(), partial_.begin() + long(offset));
+  } else {
+    partial_.assign(data + offset, data + size);
+  }
+}
+
+void UringComm::write() {
+  // out_lock_ held, no write in flight, frames queued
+  int32_t index = uring_->acquire_send_buffer();
+  uint32_t capacity = uring_->send_buffer_size();
+  if(index >= 0 && queued_.front().buffer->size() + sizeof(uint32_t) <= capacity) {
+    uint8_t *data = uring_->send_buffer(uint32_t(index));
+    uint32_t length = 0;
+    while(!queued_.empty() && length + sizeof(uint32_t) + queued_.front().buffer->size() <= capacity) {
+      const Buffer &buffer = *queued_.front().buffer;
+      uint32_t size = uint32_t(buffer.size());
+      std::memcpy(data + length, &size, sizeof(size));
+      std::memcpy(data + length + sizeof(size), buffer.data(), size);
+      length += uint32_t(sizeof(size)) + size;
+      sent_.push_back(std::move(queued_.front()));
+      queued_.pop_front();
+    }
+    send_buffer_ = index;
+    write_offset_ = 0;
+    write_length_ = length;
+  } else {
+    // too large for a registered buffer, or none available: written from the frames
+    if(index >= 0) {
+      uring_->release_send_buffer(uint32_t(index));
+    }
+    std::size_t count = std::min(queued_.size(), max_writev_frames);
+    lengths_.clear();
+    iov_.clear();
+    iov_first_ = 0;
+    for(std::size_t i = 0; i < count; ++i) {
+      lengths_.push_back(uint32_t(queued_[i].buffer->size()));
+    }
+    for(std::size_t i = 0; i < count; ++i) {
+      iov_.push_back(iovec{&lengths_[i], sizeof(uint32_t)});
+      iov_.push_back(iovec{queued_.front().buffer->data(), queued_.front().buffer->size()});
+      sent_.push_back(std::move(queued_.front()));
+      queued_.pop_front();
+    }
+  }
+  writing_ = true;
+  write_.self = shared_from_this();
+  if(send_buffer_ >= 0) {
+    uring_->write_fixed(fd_, uint32_t(send_buffer_), write_offset_, write_length_ - write_offset_, write_);
+  } else {
+    uring_->writev(fd_, iov_.data() + iov_first_, uint32_t(iov_.size() - iov_first_), write_);
+  }
+}
+
+void UringComm::written(int32_t result) {
+  std::vector<Send> sent;
+  std::vector<Send> failed;
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    writing_ = false;
+    if(result > 0 && send_buffer_ >= 0) {
+      write_offset_ += uint32_t(result);
+      if(write_offset_ < write_length_) {
+        writing_ = true;
+        write_.self = shared_from_this();
+        uring_->write_fixed(fd_, uint32_t(send_buffer_), write_offset_, write_length_ - write_offset_, write_);
+        return;
+      }
+    } else if(result > 0) {
+      std::size_t remaining = std::size_t(result);
+      while(iov_first_ < iov_.size() && remaining >= iov_[iov_first_].iov_len) {
+        remaining -= iov_[iov_first_++].iov_len;
+      }
+      if(iov_first_ < iov_.size()) {
+        iov_[iov_first_].iov_base = static_cast<uint8_t *>(iov_[iov_first_].iov_base) + remaining;
+        iov_[iov_first_].iov_len -= remaining;
+        writing_ = true;
+        write_.self = shared_from_this();
+        uring_->writev(fd_, iov_.data() + iov_first_, uint32_t(iov_.size() - iov_first_), write_);
+        return;
+      }
+    } else {
+      ec = result == 0 ? broken_pipe() : system_error(result);
+      out_error_ = ec;
+    }
+    if(send_buffer_ >= 0) {
+      uring_->release_send_buffer(uint32_t(send_buffer_));
+      send_buffer_ = -1;
+    }
+    sent.swap(sent_);
+    if(ec) {
+      logger.error("UringComm::written error while sending {} frames: {}", sent.size(), ec.value());
+      failed.assign(std::make_move_iterator(queued_.begin()), std::make_move_iterator(queued_.end()));
+      queued_.clear();
+    } else if(!queued_.empty()) {
+      write();
+    }
+  }
+  complete(std::move(sent), ec);
+  if(!failed.empty()) {
+    complete(std::move(failed), ec);
+  }
+}
+
+void UringComm::complete(std::vector<Send> sends, std::error_code ec) {
+  // one handler for all the frames of a write
+  auto completed = std::make_shared<std::vector<Send>>(std::move(sends));
+  asio::post(io_context_, [completed,ec]() {
+      for(auto &send : *completed) {
+        if(send.continuation) {
+          send.continuation(ec, ec ? 0 : send.buffer->size() + sizeof(uint32_t));
+        }
+      }
+    });
+}
+
+std::error_code UringComm::send_sync(std::shared_ptr<Buffer> buffer) {
+  return send_sync(std::vector<std::shared_ptr<Buffer>>{std::move(buffer)});
+}
+
+std::error_code UringComm::send_sync(std::vector<std::shared_ptr<Buffer>> buffers) {
+  std::vector<uint32_t> lengths;
+  lengths.reserve(buffers.size()); // iov points into it
+  std::vector<iovec> iov;
+  for(auto &buffer : buffers) {
+    lengths.push_back(uint32_t(buffer->size()));
+    iov.push_back(iovec{&lengths.back(), sizeof(uint32_t)});
+    iov.push_back(iovec{buffer->data(), buffer->size()});
+  }
+  std::size_t first = 0;
+  while(first < iov.size()) {
+    msghdr msg{};
+    msg.msg_iov = iov.data() + first;
+    msg.msg_iovlen = std::min<std::size_t>(iov.size() - first, 1024);
+    ssize_t written = ::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+    if(written < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      logger.error("UringComm::send_sync error {}", errno);
+      return std::error_code(errno, std::system_category());
+    }
+    std::size_t remaining = std::size_t(written);
+    while(first < iov.size() && remaining >= iov[first].iov_len) {
+      remaining -= iov[first++].iov_len;
+    }
+    if(first < iov.size()) {
+      iov[first].iov_base = static_cast<uint8_t *>(iov[first].iov_base) + remaining;
+      iov[first].iov_len -= remaining;
+    }
+  }
+  return {};
+}
+
+std::error_code UringComm::receive_sync(std::shared_ptr<Buffer>& buffer) {
+  std::lock_guard<std::mutex> lock(in_lock_);
+  if(reader_ || receiving_) {
+    return in_progress();
+  }
+  uint8_t data[16384];
+  while(frames_.empty() && !in_error_) {
+    ssize_t received = ::recv(fd_, data, sizeof(data), 0);
+    if(received > 0) {
+      append(data, std::size_t(received));
+    } else if(received == 0) {
+      in_error_ = eof();
+    } else if(errno != EINTR) {
+      in_error_ = std::error_code(errno, std::system_category());
+    }
+  }
+  if(frames_.empty()) {
+    logger.error("UringComm::receive_sync error {}", in_error_.value());
+    return in_error_;
+  }
+  buffer = std::move(frames_.front());
+  frames_.pop_front();
+  return {};
+}
+
+void UringComm::send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) {
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    if(out_error_ || closed_) {
+      ec = out_error_ ? out_error_ : broken_pipe();
+    } else {
+      queued_.push_back(Send{std::move(buffer), std::move(continuation)});
+      if(!writing_) {
+        write();
+      }
+      return;
+    }
+  }
+  if(continuation) {
+    asio::post(io_context_, [continuation=std::move(continuation),ec]() { continuation(ec, 0); });
+  }
+}
+
+void UringComm::send_async(std::shared_ptr<Buffer> buffer) {
+  send_async(std::move(buffer), nullptr);
+}
+
+void UringComm::send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) {
+  std::size_t length = 0;
+  for(auto &buffer : buffers) {
+    length += buffer->size() + sizeof(uint32_t);
+  }
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(out_lock_);
+    if(out_error_ || closed_) {
+      ec = out_error_ ? out_error_ : broken_pipe();
+    } else if(!buffers.empty()) {
+      // the last one answers for the group, written in order
+      for(std::size_t i = 0; i + 1 < buffers.size(); ++i) {
+        queued_.push_back(Send{std::move(buffers[i]), nullptr});
+      }
+      queued_.push_back(Send{std::move(buffers.back()), [continuation=std::move(continuation),length](std::error_code ec, std::size_t) {
+          continuation(ec, ec ? 0 : length);
+        }});
+      if(!writing_) {
+        write();
+      }
+      return;
+    }
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec]() { continuation(ec, 0); });
+}
+
+void UringComm::receive_async(BufferContinuation continuation) {
+  std::shared_ptr<Buffer> frame;
+  std::error_code ec;
+  {
+    std::lock_guard<std::mutex> lock(in_lock_);
+    if(reader_) {
+      ec = in_progress();
+    } else if(!frames_.empty()) {
+      frame = std::move(frames_.front());
+      frames_.pop_front();
+    } else if(in_error_) {
+      ec = in_error_;
+    } else {
+      reader_ = std::move(continuation);
+      if(!receiving_) {
+        receive();
+      }
+      return;
+    }
+  }
+  if(!frame) {
+    frame = std::make_shared<Buffer>();
+  }
+  asio::post(io_context_, [continuation=std::move(continuation),ec,frame]() { continuation(ec, frame); });
+}
+
+/*
+ * UringAcceptor
+ */
+
+UringAcceptor::UringAcceptor(std::shared_ptr<IoUring> uring, asio::io_context &io_context, uint32_t port,
+    uint32_t backlog)
+  : uring_{std::move(uring)}
+  , io_context_(io_context)
+  , fd_{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)}
+  , closed_{std::make_shared<std::atomic<bool>>(false)}
+{
+  if(fd_ < 0) {
+    throw std::system_error(errno, std::system_category(), "UringAcceptor socket");
+  }
+  int reuse = 1;
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(uint16_t(port));
+  if(::setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+      || ::bind(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0
+      || ::listen(fd_, int(backlog)) < 0) {
+    int error = errno;
+    ::close(fd_);
+    throw std::system_error(error, std::system_category(), "UringAcceptor port " + std::to_string(port));
+  }
+}
+
+UringAcceptor::~UringAcceptor() {
+  *closed_ = true;
+  ::shutdown(fd_, SHUT_RDWR); // completes the accept in flight
+  ::close(fd_);
+}
+
+uint32_t UringAcceptor::local_port() const {
+  sockaddr_in address{};
+  socklen_t length = sizeof(address);
+  ::getsockname(fd_, reinterpret_cast<sockaddr *>(&address), &length);
+  return ntohs(address.sin_port);
+}
+
+void UringAcceptor::do_accept_async(CommunicatorContinuation continuation) {
+  auto accept = std::make_shared<Accept>();
+  accept->uring = uring_;
+  accept->io_context = &io_context_;
+  accept->continuation = std::move(continuation);
+  accept->closed = closed_;
+  accept->self = accept;
+  uring_->accept(fd_, *accept);
+}
+
+void UringAcceptor::Accept::complete(int32_t result, uint32_t) {
+  auto accept = std::move(self);
+  auto accepted = std::move(continuation);
+  continuation = nullptr;
+  if(result < 0) {
+    if(!*closed && result != -ECANCELED) {
+      logger.error("UringAcceptor::do_accept_async error {}", -result);
+    }
+    return;
+  }
+  if(*closed) {
+    ::close(result);
+    return;
+  }
+  std::shared_ptr<communicator_t> comm = std::make_shared<UringComm>(uring, *io_context, result);
+  asio::post(*io_context, [accepted,comm]() { accepted(std::error_code{}, comm); });
+}
+
+} // oef
+} // fetch
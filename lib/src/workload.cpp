@@ -0,0 +1,215 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace fetch {
+namespace oef {
+
+namespace {
+  constexpr double km_per_degree = 111.2;
+  const Type attribute_types[] = {Type::String, Type::Int, Type::Double, Type::Bool, Type::Location};
+}
+
+Workload::Zipf::Zipf(std::size_t n, double s) {
+  cdf_.reserve(n);
+  double sum = 0.;
+  for(std::size_t k = 1; k <= n; ++k) {
+    sum += 1. / std::pow(double(k), s);
+    cdf_.push_back(sum);
+  }
+  for(auto &c : cdf_) {
+    c /= sum;
+  }
+}
+
+std::size_t Workload::Zipf::operator()(std::mt19937_64 &random) const {
+  double u = std::uniform_real_distribution<double>{0., 1.}(random);
+  auto iter = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+  return iter == cdf_.end() ? cdf_.size() - 1 : std::size_t(iter - cdf_.begin());
+}
+
+Workload::Workload(Options options)
+  : options_{options}
+  , random_{options.seed}
+  , models_zipf_{std::max(options.models, 1u), options.skew}
+  , values_zipf_{std::max(options.distinct_values, 1u), options.skew}
+  , cities_zipf_{std::max(options.cities, 1u), options.skew}
+{
+  std::uniform_real_distribution<double> lon{-180., 180.};
+  std::uniform_real_distribution<double> lat{-60., 70.};
+  for(uint32_t i = 0; i < std::max(options_.cities, 1u); ++i) {
+    cities_.emplace_back(Location{lon(random_), lat(random_)});
+  }
+  for(uint32_t m = 0; m < std::max(options_.models, 1u); ++m) {
+    // every type in every model, in a model dependent order
+    std::vector<Attribute> attributes;
+    uint32_t nb_types = sizeof(attribute_types) / sizeof(attribute_types[0]);
+    for(uint32_t a = 0; a < std::max(options_.attributes, 1u); ++a) {
+      Type type = attribute_types[(a + m) % nb_types];
+      attributes.emplace_back(Attribute{"attr_" + std::to_string(a), type, a % 2 == 0});
+    }
+    models_.emplace_back(DataModel{"model_" + std::to_string(m), attributes});
+  }
+}
+
+const DataModel &Workload::model_() {
+  return models_[models_zipf_(random_)];
+}
+
+std::string Workload::string_() {
+  return "value_" + std::to_string(values_zipf_(random_));
+}
+
+Location Workload::location_() {
+  const Location &city = cities_[cities_zipf_(random_)];
+  std::normal_distribution<double> offset{0., options_.city_radius_km / km_per_degree};
+  double lat = std::max(-90., std::min(90., city.lat + offset(random_)));
+  double lon = city.lon + offset(random_) / std::max(std::cos(degree_to_radian(lat)), .01);
+  return Location{std::remainder(lon, 360.), lat};
+}
+
+VariantType Workload::value_(const fetch::oef::pb::Query_Attribute &attribute) {
+  switch(attribute.type()) {
+  case fetch::oef::pb::Query_Attribute_Type_STRING:
+    return VariantType{string_()};
+  case fetch::oef::pb::Query_Attribute_Type_INT:
+    return VariantType{int(values_zipf_(random_))};
+  case fetch::oef::pb::Query_Attribute_Type_DOUBLE:
+    return VariantType{std::lognormal_distribution<double>{3., 1.}(random_)};
+  case fetch::oef::pb::Query_Attribute_Type_BOOL:
+    return VariantType{draw_(.2)};
+  case fetch::oef::pb::Query_Attribute_Type_LOCATION:
+    return VariantType{location_()};
+  }
+  return VariantType{string_()};
+}
+
+Instance Workload::instance() {
+  const DataModel &model = model_();
+  std::unordered_map<std::string,VariantType> values;
+  for(auto &attribute : model.handle().attributes()) {
+    if(attribute.required() || !draw_(options_.optional_rate)) {
+      values.emplace(attribute.name(), value_(attribute));
+    }
+  }
+  return Instance{model, values};
+}
+
+std::vector<Instance> Workload::instances(std::size_t n) {
+  std::vector<Instance> instances;
+  instances.reserve(n);
+  for(std::size_t i = 0; i < n; ++i) {
+    instances.emplace_back(instance());
+  }
+  return instances;
+}
+
+Constraint Workload::constraint_(const fetch::oef::pb::Query_Attribute &attribute) {
+  const std::string &name = attribute.name();
+  uint32_t kind = draw_(0u, 3u);
+  switch(attribute.type()) {
+  case fetch::oef::pb::Query_Attribute_Type_STRING:
+    if(kind < 2) {
+      return Constraint{name, Relation{kind == 0 ? Relation::Op::Eq : Relation::Op::NotEq, string_()}};
+    }
+    if(kind == 2) {
+      std::unordered_set<std::string> values;
+      for(uint32_t i = draw_(2u, 8u); i > 0; --i) {
+        values.insert(string_());
+      }
+      return Constraint{name, Set{draw_(.8) ? Set::Op::In : Set::Op::NotIn, values}};
+    } else {
+      auto first = string_(), second = string_();
+      return Constraint{name, Range{std::make_pair(std::min(first, second), std::max(first, second))}};
+    }
+  case fetch::oef::pb::Query_Attribute_Type_INT:
+    if(kind < 2) {
+      static const Relation::Op ops[] = {Relation::Op::Eq, Relation::Op::Lt, Relation::Op::Gt,
+                                         Relation::Op::LtEq, Relation::Op::GtEq, Relation::Op::NotEq};
+      return Constraint{name, Relation{ops[draw_(0u, 5u)], int(values_zipf_(random_))}};
+    }
+    if(kind == 2) {
+      std::unordered_set<int> values;
+      for(uint32_t i = draw_(2u, 8u); i > 0; --i) {
+        values.insert(int(values_zipf_(random_)));
+      }
+      return Constraint{name, Set{draw_(.8) ? Set::Op::In : Set::Op::NotIn, values}};
+    } else {
+      int first = int(values_zipf_(random_)), second = int(values_zipf_(random_));
+      return Constraint{name, Range{std::make_pair(std::min(first, second), std::max(first, second))}};
+    }
+  case fetch::oef::pb::Query_Attribute_Type_DOUBLE: {
+    std::lognormal_distribution<double> value{3., 1.};
+    if(kind < 2) {
+      return Constraint{name, Relation{kind == 0 ? Relation::Op::Lt : Relation::Op::GtEq, value(random_)}};
+    }
+    double first = value(random_), second = value(random_);
+    return Constraint{name, Range{std::make_pair(std::min(first, second), std::max(first, second))}};
+  }
+  case fetch::oef::pb::Query_Attribute_Type_BOOL:
+    return Constraint{name, Relation{Relation::Op::Eq, draw_(.5)}};
+  case fetch::oef::pb::Query_Attribute_Type_LOCATION:
+    return Constraint{name, Distance{location_(), std::uniform_real_distribution<double>{10., 500.}(random_)}};
+  }
+  return Constraint{name, Relation{Relation::Op::Eq, string_()}};
+}
+
+ConstraintExpr Workload::expr_(const DataModel &model, uint32_t depth) {
+  if(depth < options_.max_depth && draw_(.4)) {
+    uint32_t kind = draw_(0u, 4u);
+    if(kind == 4) {
+      return Not{expr_(model, depth + 1)};
+    }
+    std::vector<ConstraintExpr> children;
+    for(uint32_t i = draw_(2u, 3u); i > 0; --i) {
+      children.emplace_back(expr_(model, depth + 1));
+    }
+    if(kind < 2) {
+      return And{children};
+    }
+    return Or{children};
+  }
+  const auto &attributes = model.handle().attributes();
+  return constraint_(attributes.Get(int(draw_(0u, uint32_t(attributes.size() - 1)))));
+}
+
+QueryModel Workload::query() {
+  const DataModel &model = model_();
+  std::vector<ConstraintExpr> constraints;
+  for(uint32_t i = draw_(1u, std::max(options_.max_constraints, 1u)); i > 0; --i) {
+    constraints.emplace_back(expr_(model, 1));
+  }
+  return QueryModel{constraints, model};
+}
+
+std::vector<QueryModel> Workload::queries(std::size_t n) {
+  std::vector<QueryModel> queries;
+  queries.reserve(n);
+  for(std::size_t i = 0; i < n; ++i) {
+    queries.emplace_back(query());
+  }
+  return queries;
+}
+
+} // oef
+} // fetch
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "admin_server.hpp"
+
+#include <array>
+
+using namespace fetch::oef;
+using asio::ip::tcp;
+
+namespace Test {
+
+  static std::string command(tcp::socket &socket, const std::string &line) {
+    asio::write(socket, asio::buffer(line + "\n"));
+    asio::streambuf input;
+    asio::read_until(socket, input, "\n\n");
+    std::string answer{asio::buffers_begin(input.data()), asio::buffers_end(input.data())};
+    return answer.substr(0, answer.find("\n\n") + 1);
+  }
+
+  TEST_CASE("admin commands over plain TCP", "[admin]") {
+    AgentDirectory directory;
+    AdminServer admin{directory, nullptr, 0};
+    Counter requests{"test_admin_requests_total", "", "Test counter"};
+    Histogram latency{"test_admin_latency_us", "operation=\"test\""};
+    requests.inc(3);
+    latency.observe(100);
+
+    asio::io_context io_context;
+    tcp::socket socket{io_context};
+    socket.connect(tcp::endpoint(asio::ip::address::from_string("127.0.0.1"), uint16_t(admin.port())));
+
+    REQUIRE(command(socket, "agents") == "agents 0\n");
+    REQUIRE(command(socket, "search") == "connected no\npending 0\n");
+    auto metrics = command(socket, "metrics");
+    REQUIRE(metrics.find("# HELP test_admin_requests_total Test counter\n# TYPE test_admin_requests_total counter\n"
+          "test_admin_requests_total 3\n") != std::string::npos);
+    // buckets are exposed whether empty or not
+    REQUIRE(metrics.find("test_admin_latency_us_bucket{operation=\"test\",le=\"3\"} 0\n") != std::string::npos);
+    REQUIRE(metrics.find("test_admin_latency_us_bucket{operation=\"test\",le=\"95\"} 0\n") != std::string::npos);
+    REQUIRE(metrics.find("test_admin_latency_us_bucket{operation=\"test\",le=\"111\"} 1\n") != std::string::npos);
+    REQUIRE(metrics.find("test_admin_latency_us_bucket{operation=\"test\",le=\"127\"} 1\n") != std::string::npos);
+    REQUIRE(metrics.find("test_admin_latency_us_count{operation=\"test\"} 1\n") != std::string::npos);
+
+    REQUIRE(command(socket, "log-level admin-server=warn") == "ok\n");
+    REQUIRE(Logger::level("admin-server") == "warning");
+    REQUIRE(command(socket, "log-level admin-server").find("error") == 0);
+    REQUIRE(command(socket, "log-level no-such-section=info").find("error") == 0);
+    REQUIRE(command(socket, "log-level").find("admin-server warning\n") != std::string::npos);
+    REQUIRE(command(socket, "frobnicate").find("error") == 0);
+
+    tcp::socket http{io_context};
+    http.connect(socket.remote_endpoint());
+    asio::write(http, asio::buffer(std::string("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+    std::error_code ec;
+    asio::streambuf input;
+    asio::read(http, input, ec);
+    REQUIRE(ec == asio::error::eof);
+    std::string answer{asio::buffers_begin(input.data()), asio::buffers_end(input.data())};
+    REQUIRE(answer.find("HTTP/1.0 200 OK\r\n") == 0);
+    REQUIRE(answer.find("test_admin_requests_total 3\n") != std::string::npos);
+
+    // a command line longer than config::admin_max_request closes the connection
+    tcp::socket flood{io_context};
+    flood.connect(socket.remote_endpoint());
+    asio::write(flood, asio::buffer(std::string(2 * config::admin_max_request, 'x')), ec);
+    std::array<char, 16> data;
+    asio::read(flood, asio::buffer(data), ec);
+    REQUIRE((ec == asio::error::eof || ec == asio::error::connection_reset));
+    Logger::level("admin-server", LogLevel::info);
+  }
+}
@@ -0,0 +1,498 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "clientmsg.hpp"
+#include "core_server.hpp"
+#include "fake_agents.hpp"
+#include "mock_search.hpp"
+
+#include <future>
+#include <map>
+#include <thread>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  bool session_handshake(communicator_t &comm, const std::string &agent, bool batching = false) {
+    fetch::oef::pb::Agent_Server_ID id;
+    id.set_public_key(agent);
+    id.set_pipelined(true);
+    id.set_batching(batching);
+    fetch::oef::pb::Agent_Server_Answer answer;
+    answer.set_answer("secret");
+    std::shared_ptr<Buffer> buffer;
+    if(comm.send_sync(std::vector<std::shared_ptr<Buffer>>{pbs::serialize(id), pbs::serialize(answer)})
+        || comm.receive_sync(buffer)) {
+      return false;
+    }
+    return pbs::deserialize<fetch::oef::pb::Server_Connected>(*buffer).status();
+  }
+
+  TEST_CASE("grouped asynchronous sends", "[session]") {
+    asio::io_context io_context;
+    AsioAcceptor acceptor{io_context, 0};
+    std::shared_ptr<communicator_t> server;
+    acceptor.do_accept_async([&server](std::error_code, std::shared_ptr<communicator_t> comm) { server = comm; });
+    AsioComm client{io_context, "127.0.0.1", acceptor.local_port()};
+    while(!server && io_context.run_one()) {}
+    REQUIRE(server);
+
+    std::vector<std::shared_ptr<Buffer>> frames;
+    std::size_t total = 0;
+    for(uint32_t i = 0; i < 100; ++i) {
+      frames.push_back(std::make_shared<Buffer>(1 + i * 13, uint8_t(i)));
+      total += frames.back()->size() + sizeof(uint32_t);
+    }
+    std::size_t sent = 0;
+    server->send_async(frames, [&sent](std::error_code ec, std::size_t length) { sent = ec ? 0 : length; });
+    io_context.restart(); // out of work once accepted
+    io_context.run();
+    REQUIRE(sent == total);
+    for(auto &frame : frames) {
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!client.receive_sync(buffer));
+      REQUIRE(*buffer == *frame);
+    }
+  }
+
+  TEST_CASE("concurrent sends to a session", "[session]") {
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 13414, "127.0.0.1", search.port(), 4};
+    core.run();
+
+    asio::io_context io_context;
+    AsioComm sink{io_context, "127.0.0.1", 13414};
+    REQUIRE(session_handshake(sink, "sink"));
+
+    // senders routed by different io threads at the same time: frames must neither interleave
+    // nor be reordered
+    constexpr uint32_t nb_senders = 8;
+    constexpr uint32_t nb_messages = 500;
+    std::vector<std::thread> senders;
+    std::promise<void> go;
+    auto started = go.get_future().share();
+    std::atomic<uint32_t> handshakes{0};
+    std::atomic<uint32_t> connected{0};
+    for(uint32_t s = 0; s < nb_senders; ++s) {
+      senders.emplace_back([s,started,&handshakes,&connected]() {
+          asio::io_context io_context;
+          AsioComm comm{io_context, "127.0.0.1", 13414};
+          if(session_handshake(comm, "sender" + std::to_string(s))) {
+            ++connected;
+          }
+          ++handshakes;
+          started.wait();
+          for(uint32_t i = 0; i < nb_messages; ++i) {
+            comm.send_sync(pbs::serialize(Message{i, s, "sink", std::to_string(i) + std::string(i % 300, 'x')}.handle()));
+          }
+        });
+    }
+    while(handshakes < nb_senders) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    go.set_value();
+    if(connected < nb_senders) {
+      for(auto &sender : senders) {
+        sender.join();
+      }
+      FAIL("senders handshake");
+    }
+
+    std::vector<uint32_t> next(nb_senders, 0);
+    for(uint32_t n = 0; n < nb_senders * nb_messages; ++n) {
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!sink.receive_sync(buffer));
+      bool status = false;
+      auto message = pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer, status);
+      REQUIRE(status);
+      uint32_t s = message.content().dialogue_id();
+      REQUIRE(s < nb_senders);
+      REQUIRE(message.content().origin() == "sender" + std::to_string(s));
+      REQUIRE(message.content().content() == std::to_string(next[s]) + std::string(next[s] % 300, 'x'));
+      ++next[s];
+    }
+    sink.disconnect();
+    for(auto &sender : senders) {
+      sender.join();
+    }
+  }
+
+  constexpr uint32_t flood_messages = 64;
+
+  /*
+   * A sink agent reading nothing, flooded by a sender with messages larger than the socket buffers
+   * can hold: the core queues them until the sink is a slow consumer.
+   */
+  struct SlowConsumer {
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core;
+    asio::io_context io_context;
+    AsioComm sink;
+    AsioComm sender;
+    std::string content = std::string(256 << 10, 'x');
+
+    explicit SlowConsumer(OutboundLimits::Policy policy)
+      : core{"core", "127.0.0.1", 13415, "127.0.0.1", search.port(), 2}
+      , sink{io_context, "127.0.0.1", 13415}
+      , sender{io_context, "127.0.0.1", 13415}
+    {
+      OutboundLimits limits;
+      limits.high_bytes = 1 << 20;
+      limits.low_bytes = 256 << 10;
+      limits.policy = policy;
+      core.outbound_limits(limits);
+      core.run();
+      REQUIRE(session_handshake(sink, "sink"));
+      REQUIRE(session_handshake(sender, "sender"));
+    }
+
+    void flood() {
+      for(uint32_t i = 0; i < flood_messages; ++i) {
+        sender.send_sync(pbs::serialize(Message{i, i, "sink", content}.handle()));
+      }
+    }
+
+    static int64_t actions(const std::string &action) {
+      const auto *value = Metrics::snapshot().find("oef_backpressure_actions_total", "action=\"" + action + "\"");
+      return value ? value->value : 0;
+    }
+  };
+
+  TEST_CASE("slow consumers pause their senders", "[session][backpressure]") {
+    SlowConsumer agents{OutboundLimits::Policy::Pause};
+    auto paused = SlowConsumer::actions("pause");
+    // the core stops reading from the sender, whose writes then block until the sink reads
+    std::thread sender{[&agents]() { agents.flood(); }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    for(uint32_t i = 0; i < flood_messages; ++i) {
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!agents.sink.receive_sync(buffer));
+      auto message = pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer);
+      REQUIRE(message.content().dialogue_id() == i); // nothing lost
+    }
+    sender.join();
+    REQUIRE(SlowConsumer::actions("pause") > paused);
+    agents.sink.disconnect();
+    agents.sender.disconnect();
+  }
+
+  TEST_CASE("messages to slow consumers are dropped", "[session][backpressure]") {
+    SlowConsumer agents{OutboundLimits::Policy::Drop};
+    auto dropped = SlowConsumer::actions("drop");
+    agents.flood();
+    std::shared_ptr<Buffer> buffer;
+    REQUIRE(!agents.sender.receive_sync(buffer));
+    auto answer = pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer);
+    REQUIRE(answer.has_dialogue_error());
+    REQUIRE(answer.dialogue_error().origin() == "sink");
+    REQUIRE(SlowConsumer::actions("drop") > dropped);
+    agents.sink.disconnect();
+    agents.sender.disconnect();
+  }
+
+  TEST_CASE("slow consumers are disconnected", "[session][backpressure]") {
+    SlowConsumer agents{OutboundLimits::Policy::Disconnect};
+    auto disconnected = SlowConsumer::actions("disconnect");
+    agents.flood();
+    std::shared_ptr<Buffer> buffer;
+    REQUIRE(!agents.sender.receive_sync(buffer));
+    REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).has_dialogue_error());
+    REQUIRE(SlowConsumer::actions("disconnect") > disconnected);
+    uint32_t received = 0;
+    while(!agents.sink.receive_sync(buffer)) { // what was written before the disconnection
+      ++received;
+    }
+    REQUIRE(received < flood_messages);
+    agents.sender.disconnect();
+  }
+
+  int64_t paced_reads(const std::string &reason) {
+    const auto *value = Metrics::snapshot().find("oef_paced_reads_total", "reason=\"" + reason + "\"");
+    return value ? value->value : 0;
+  }
+
+  TEST_CASE("agents above their rate are delayed", "[session][pacing]") {
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 13416, "127.0.0.1", search.port(), 2};
+    RateLimits rates;
+    rates.messaging.rate = 100;
+    rates.messaging.burst = 10;
+    core.rate_limits(rates);
+    core.run();
+    asio::io_context io_context;
+    AsioComm sink{io_context, "127.0.0.1", 13416};
+    AsioComm sender{io_context, "127.0.0.1", 13416};
+    REQUIRE(session_handshake(sink, "sink"));
+    REQUIRE(session_handshake(sender, "sender"));
+
+    auto delayed = paced_reads("rate");
+    constexpr uint32_t nb_messages = 60;
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < nb_messages; ++i) {
+      REQUIRE(!sender.send_sync(pbs::serialize(Message{i, i, "sink", "hello"}.handle())));
+    }
+    for(uint32_t i = 0; i < nb_messages; ++i) {
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!sink.receive_sync(buffer));
+      REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().dialogue_id() == i);
+    }
+    // the burst goes through, the rest at 100 per second: nothing rejected, only delayed
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(400));
+    REQUIRE(paced_reads("rate") > delayed);
+    sink.disconnect();
+    sender.disconnect();
+  }
+
+  TEST_CASE("large batches yield to other agents", "[session][pacing]") {
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 13416, "127.0.0.1", search.port(), 2};
+    core.run();
+    asio::io_context io_context;
+    AsioComm sink{io_context, "127.0.0.1", 13416};
+    AsioComm sender{io_context, "127.0.0.1", 13416};
+    REQUIRE(session_handshake(sink, "sink"));
+    REQUIRE(session_handshake(sender, "sender", true));
+
+    auto yielded = paced_reads("fairness");
+    constexpr uint32_t nb_messages = 3 * config::session_fairness_budget + 1;
+    fetch::oef::pb::EnvelopeBatch batch;
+    for(uint32_t i = 0; i < nb_messages; ++i) {
+      batch.add_envelopes()->CopyFrom(Message{i, i, "sink", "hello"}.handle());
+    }
+    REQUIRE(!sender.send_sync(pbs::serialize(batch)));
+    for(uint32_t i = 0; i < nb_messages; ++i) {
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!sink.receive_sync(buffer));
+      REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().dialogue_id() == i);
+    }
+    REQUIRE(paced_reads("fairness") >= yielded + 3);
+    sink.disconnect();
+    sender.disconnect();
+  }
+
+  /* Frames sent to `comm`, connected to a core, when its agent pipelines its ID and `frames` */
+  std::vector<std::shared_ptr<Buffer>> pipelined_handshake(FakeComm &comm, const std::string &agent,
+      const std::vector<std::shared_ptr<Buffer>> &frames) {
+    fetch::oef::pb::Agent_Server_ID id;
+    id.set_public_key(agent);
+    id.set_pipelined(true);
+    comm.deliver(pbs::serialize(id));
+    for(auto &frame : frames) {
+      comm.deliver(frame);
+    }
+    comm.complete();
+    return comm.sent;
+  }
+
+  std::shared_ptr<Buffer> secret_answer() {
+    fetch::oef::pb::Agent_Server_Answer answer;
+    answer.set_answer("secret");
+    return pbs::serialize(answer);
+  }
+
+  void pipelined_handshake_then_envelope(bool coroutines) {
+    MockSearch mock{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 0, "127.0.0.1", mock.port(), 1};
+#ifdef OEF_CORE_COROUTINES
+    core.use_coroutines(coroutines);
+#endif
+    auto comm = std::make_shared<FakeComm>();
+    core.process_agent_connection(comm);
+    // the ID, the Answer and a first envelope are all sent before the agent reads anything
+    auto sent = pipelined_handshake(*comm, "alice",
+        {secret_answer(), pbs::serialize(Message{1, 7, "nobody", "hello"}.handle())});
+    REQUIRE(sent.size() == 2); // no Phrase
+    bool status = false;
+    auto connected = pbs::deserialize<pb::Server_Connected>(*sent[0], status);
+    REQUIRE(status);
+    REQUIRE(connected.status());
+    auto error = pbs::deserialize<pb::Server_AgentMessage>(*sent[1]);
+    REQUIRE(error.answer_id() == 1);
+    REQUIRE(error.dialogue_error().dialogue_id() == 7);
+    comm->close();
+  }
+
+  void pipelined_handshake_of_connected_agent(bool coroutines) {
+    MockSearch mock{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 0, "127.0.0.1", mock.port(), 1};
+#ifdef OEF_CORE_COROUTINES
+    core.use_coroutines(coroutines);
+#endif
+    auto first = std::make_shared<FakeComm>();
+    core.process_agent_connection(first);
+    REQUIRE(pipelined_handshake(*first, "alice", {secret_answer()}).size() == 1);
+    auto second = std::make_shared<FakeComm>();
+    core.process_agent_connection(second);
+    auto sent = pipelined_handshake(*second, "alice", {});
+    // refused with Connected, as the agent does not expect a Phrase
+    REQUIRE(sent.size() == 1);
+    bool status = false;
+    auto connected = pbs::deserialize<pb::Server_Connected>(*sent[0], status);
+    REQUIRE(status);
+    REQUIRE(!connected.status());
+    first->close();
+  }
+
+  TEST_CASE("envelopes pipelined with the handshake follow Connected", "[session][handshake]") {
+    pipelined_handshake_then_envelope(false);
+#ifdef OEF_CORE_COROUTINES
+    pipelined_handshake_then_envelope(true);
+#endif
+  }
+
+  TEST_CASE("pipelined handshakes of connected agents get Connected false", "[session][handshake]") {
+    pipelined_handshake_of_connected_agent(false);
+#ifdef OEF_CORE_COROUTINES
+    pipelined_handshake_of_connected_agent(true);
+#endif
+  }
+
+  TEST_CASE("broadcasts reach each destination once", "[session][broadcast]") {
+    MockSearch mock{MockSearch::Options{}};
+    Agents agents;
+    DataModel station{"weather_station", {Attribute{"id", Type::Int, true}}};
+    std::map<std::string,std::shared_ptr<FakeComm>> comms;
+    uint32_t id = 0;
+    for(std::string agent : {"alice", "bob", "carol", "dave"}) {
+      comms[agent] = agents.connect(agent);
+      if(agent != "dave") {
+        comms[agent]->deliver(pbs::serialize(Register{++id, Instance{station, {{"id", VariantType{int(id)}}}}}.handle()));
+        agents.answer_search(mock);
+      }
+      comms[agent]->complete();
+      comms[agent]->sent.clear();
+    }
+
+    // explicit destinations, listed twice, overlapping with the query results, which include alice
+    QueryModel stations{{Constraint{"id", Relation{Relation::Op::GtEq, 1}}}, station};
+    Broadcast broadcast{10, 42, stations, "hello"};
+    for(auto &destination : {"bob", "dave", "nobody", "dave"}) {
+      broadcast.handle().mutable_broadcast_message()->add_destinations(destination);
+    }
+    comms["alice"]->deliver(pbs::serialize(broadcast.handle()));
+    agents.answer_search(mock);
+    for(auto &comm : comms) {
+      comm.second->complete();
+    }
+    for(auto &agent : {"bob", "carol", "dave"}) {
+      REQUIRE(comms[agent]->sent.size() == 1);
+      auto message = pbs::deserialize<pb::Server_AgentMessage>(*comms[agent]->sent.front());
+      REQUIRE(message.content().origin() == "alice");
+      REQUIRE(message.content().dialogue_id() == 42);
+    }
+    // alice only gets the error for the unknown destination
+    REQUIRE(comms["alice"]->sent.size() == 1);
+    auto error = pbs::deserialize<pb::Server_AgentMessage>(*comms["alice"]->sent.front());
+    REQUIRE(error.has_dialogue_error());
+    REQUIRE(error.dialogue_error().dialogue_id() == 42);
+    REQUIRE(error.dialogue_error().origin() == "nobody");
+  }
+
+  TEST_CASE("replies to a batch come back in one batch", "[session][batching]") {
+    MockSearch mock{MockSearch::Options{}};
+    Agents agents;
+    DataModel station{"weather_station", {Attribute{"id", Type::Int, true}}};
+    auto bob = agents.connect("bob");
+    bob->deliver(pbs::serialize(Register{1, Instance{station, {{"id", VariantType{1}}}}}.handle()));
+    agents.answer_search(mock);
+    bob->complete();
+    bob->sent.clear();
+    auto alice = agents.connect("alice", false, true);
+    // searches are answered while the batch is processed, so that all replies are held
+    agents.search_comm->on_request = [&agents, &mock]() { agents.answer_search(mock); };
+
+    QueryModel stations{{Constraint{"id", Relation{Relation::Op::GtEq, 1}}}, station};
+    fetch::oef::pb::EnvelopeBatch batch;
+    batch.add_envelopes()->CopyFrom(SearchServices{1, stations}.handle());
+    batch.add_envelopes()->CopyFrom(Message{2, 2, "bob", "hello"}.handle());
+    batch.add_envelopes()->CopyFrom(Message{3, 3, "nobody", "hello"}.handle());
+    batch.add_envelopes()->CopyFrom(SearchServices{4, stations}.handle());
+    alice->deliver(pbs::serialize(batch));
+    alice->complete();
+    bob->complete();
+
+    REQUIRE(bob->sent.size() == 1);
+    REQUIRE(pbs::deserialize<pb::Server_AgentMessage>(*bob->sent.front()).content().dialogue_id() == 2);
+    REQUIRE(alice->sent.size() == 1);
+    auto replies = pbs::deserialize<pb::AgentMessageBatch>(*alice->sent.front());
+    REQUIRE(replies.messages_size() == 3);
+    REQUIRE(replies.messages(0).answer_id() == 1);
+    REQUIRE(replies.messages(0).agents().agents_size() == 1);
+    REQUIRE(replies.messages(0).agents().agents(0) == "bob");
+    REQUIRE(replies.messages(1).answer_id() == 3);
+    REQUIRE(replies.messages(1).has_dialogue_error());
+    REQUIRE(replies.messages(2).answer_id() == 4);
+    REQUIRE(replies.messages(2).agents().agents_size() == 1);
+  }
+
+  TEST_CASE("answers overtake the messages queued to an agent", "[session][priority]") {
+    Agents agents;
+    auto alice = agents.connect("alice");
+    auto bob = agents.connect("bob");
+    for(uint32_t i = 0; i < 3; ++i) {
+      alice->deliver(pbs::serialize(Message{i, i, "bob", "hello"}.handle()));
+    }
+    // the first message is being written, the others are queued, when bob gets a dialogue error
+    bob->deliver(pbs::serialize(Message{7, 7, "nobody", "hello"}.handle()));
+    bob->complete();
+    REQUIRE(bob->sent.size() == 4);
+    auto message = [&bob](std::size_t i) {
+      return pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*bob->sent[i]);
+    };
+    REQUIRE(message(0).content().dialogue_id() == 0);
+    REQUIRE(message(1).has_dialogue_error());
+    REQUIRE(message(2).content().dialogue_id() == 1);
+    REQUIRE(message(3).content().dialogue_id() == 2);
+  }
+
+  TEST_CASE("messages between agents are processed on the bulk lane", "[session][priority]") {
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 13417, "127.0.0.1", search.port(), 2};
+    core.bulk_lane(1);
+    core.run();
+    asio::io_context io_context;
+    AsioComm sink{io_context, "127.0.0.1", 13417};
+    AsioComm sender{io_context, "127.0.0.1", 13417};
+    REQUIRE(session_handshake(sink, "sink"));
+    REQUIRE(session_handshake(sender, "sender", true));
+
+    auto bulk_frames = [] {
+      const auto *value = Metrics::snapshot().find("oef_bulk_lane_frames_total", "");
+      return value ? value->value : 0;
+    };
+    auto before = bulk_frames();
+    // a registration alone is processed with the rest, along with a message it is not
+    DataModel station{"weather_station", {Attribute{"id", Type::Int, true}}};
+    fetch::oef::pb::EnvelopeBatch registration;
+    registration.add_envelopes()->CopyFrom(Register{1, Instance{station, {{"id", VariantType{1}}}}}.handle());
+    REQUIRE(!sender.send_sync(pbs::serialize(registration)));
+    fetch::oef::pb::EnvelopeBatch batch;
+    batch.add_envelopes()->CopyFrom(Register{2, Instance{station, {{"id", VariantType{2}}}}}.handle());
+    batch.add_envelopes()->CopyFrom(Message{3, 3, "sink", "hello"}.handle());
+    REQUIRE(!sender.send_sync(pbs::serialize(batch)));
+    std::shared_ptr<Buffer> buffer;
+    REQUIRE(!sink.receive_sync(buffer));
+    REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().dialogue_id() == 3);
+    REQUIRE(bulk_frames() == before + 1);
+    sink.disconnect();
+    sender.disconnect();
+  }
+} // Test
@@ -0,0 +1,165 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "allocations.hpp"
+#include "agent_session.hpp"
+#include "clientmsg.hpp"
+#include "core_server.hpp"
+#include "fake_agents.hpp"
+#include "mock_search.hpp"
+
+using namespace fetch::oef;
+
+namespace Test {
+  /*
+   * Allocation budgets of the agent message path, a little above what it takes today: lower them
+   * along with optimizations, raise them only knowingly.
+   */
+
+  /* Allocations made by one operation */
+  struct Usage {
+    uint64_t count;
+    uint64_t bytes;
+  };
+
+  TEST_CASE("allocation budget of a routed message", "[allocations]") {
+    Agents agents;
+    auto alice = agents.connect("alice");
+    auto bob = agents.connect("bob");
+    auto frame = pbs::serialize(Message{1, 7, "bob", std::string(128, 'x')}.handle());
+
+    auto route = [&]() {
+      Allocations allocations;
+      alice->deliver(frame);
+      bob->complete();
+      return Usage{allocations.count(), allocations.bytes()};
+    };
+    route(); // lazily created singletons, thread local metric shards, etc.
+    auto usage = route();
+    REQUIRE(bob->sent.size() == 2);
+    REQUIRE(alice->sent.empty());
+    REQUIRE(usage.count <= 12);
+    REQUIRE(usage.bytes <= 1024);
+  }
+
+  /* Second search of an agent, from the OEF Search reply to the answer sent to the agent */
+  Usage search_reply(bool coroutines) {
+    MockSearch::Options options;
+    options.extra_results = 4;
+    MockSearch mock{options};
+    Agents agents;
+    auto alice = agents.connect("alice", coroutines);
+    DataModel station{"weather_station", {Attribute{"wind", Type::Int, true}}};
+    QueryModel windy{{Constraint{"wind", Relation{Relation::Op::GtEq, 6}}}, station};
+
+    uint32_t msg_id = 0;
+    auto search = [&]() {
+      alice->deliver(pbs::serialize(SearchServices{++msg_id, windy}.handle()));
+      auto request = pbs::deserialize<pb::TransportHeader>(*agents.search_comm->header);
+      auto reply = mock.answer(request, std::string(agents.search_comm->payload->begin(), 
+            agents.search_comm->payload->end()));
+      std::string header;
+      reply.first.SerializeToString(&header);
+
+      Allocations allocations;
+      agents.search_comm->reply(header, reply.second);
+      alice->complete();
+      return Usage{allocations.count(), allocations.bytes()};
+    };
+    search();
+    auto usage = search();
+    REQUIRE(alice->sent.size() == 2);
+    auto answer = pbs::deserialize<pb::Server_AgentMessage>(*alice->sent.back());
+    REQUIRE(answer.answer_id() == 2);
+    REQUIRE(answer.agents().agents_size() == 4);
+    REQUIRE(agents.search.pending().empty());
+    return usage;
+  }
+
+  /* Second agent handshake, from its connection to its Connected answer */
+  Usage handshake(bool coroutines) {
+    MockSearch mock{MockSearch::Options{}};
+    CoreServer server{"core", "127.0.0.1", 0, "127.0.0.1", mock.port(), 1};
+#ifdef OEF_CORE_COROUTINES
+    server.use_coroutines(coroutines);
+#endif
+    std::vector<std::shared_ptr<FakeComm>> comms;
+
+    auto handshake = [&](const std::string &agent) {
+      fetch::oef::pb::Agent_Server_ID id;
+      id.set_public_key(agent);
+      fetch::oef::pb::Agent_Server_Answer answer;
+      answer.set_answer("secret");
+      auto id_frame = pbs::serialize(id);
+      auto answer_frame = pbs::serialize(answer);
+      auto comm = std::make_shared<FakeComm>();
+      comms.push_back(comm);
+
+      Allocations allocations;
+      server.process_agent_connection(comm);
+      comm->deliver(id_frame);
+      comm->deliver(answer_frame);
+      comm->complete();
+      Usage usage{allocations.count(), allocations.bytes()};
+      REQUIRE(comm->sent.size() == 2); // Phrase then Connected
+      REQUIRE(pbs::deserialize<pb::Server_Connected>(*comm->sent.back()).status());
+      return usage;
+    };
+    handshake("alice");
+    auto usage = handshake("bob");
+    REQUIRE(server.nb_agents() == 2);
+    for(auto &comm : comms) {
+      comm->close();
+    }
+    return usage;
+  }
+
+  TEST_CASE("allocation budget of a search reply", "[allocations]") {
+    auto usage = search_reply(false);
+    REQUIRE(usage.count <= 48);
+    REQUIRE(usage.bytes <= 3072);
+  }
+
+  TEST_CASE("allocation budget of a handshake", "[allocations]") {
+    auto usage = handshake(false);
+    REQUIRE(usage.count <= 10);
+    REQUIRE(usage.bytes <= 1664);
+  }
+
+  TEST_CASE("allocation budget of a coroutine search reply", "[allocations][coroutine]") {
+#ifndef OEF_CORE_COROUTINES
+    WARN("built without coroutines (ENABLE_COROUTINES)");
+#else
+    auto usage = search_reply(true);
+    REQUIRE(usage.count <= 48);
+    REQUIRE(usage.bytes <= 3072);
+#endif
+  }
+
+  TEST_CASE("allocation budget of a coroutine handshake", "[allocations][coroutine]") {
+#ifndef OEF_CORE_COROUTINES
+    WARN("built without coroutines (ENABLE_COROUTINES)");
+#else
+    auto usage = handshake(true);
+    REQUIRE(usage.count <= 10);
+    REQUIRE(usage.bytes <= 2048); // the session frame pool, and the frame of its read loop
+#endif
+  }
+} // Test
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "allocations.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+  // constant initialized: usable from operator new before any constructor ran
+  thread_local uint64_t thread_count = 0;
+  thread_local uint64_t thread_bytes = 0;
+
+  void *allocate(std::size_t size) noexcept {
+    ++thread_count;
+    thread_bytes += size;
+    return std::malloc(size ? size : 1);
+  }
+}
+
+void *operator new(std::size_t size) {
+  void *p = allocate(size);
+  if(!p) {
+    throw std::bad_alloc{};
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+namespace Test {
+
+  Allocations::Allocations() {
+    reset();
+  }
+
+  uint64_t Allocations::count() const {
+    return thread_count - count_;
+  }
+
+  uint64_t Allocations::bytes() const {
+    return thread_bytes - bytes_;
+  }
+
+  void Allocations::reset() {
+    count_ = thread_count;
+    bytes_ = thread_bytes;
+  }
+
+} // Test
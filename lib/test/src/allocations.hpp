@@ -0,0 +1,45 @@
+#pragma once
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include <cstdint>
+
+namespace Test {
+  /*
+   * Allocations made by the calling thread since construction. The test executable replaces
+   * the global operator new and delete with counting versions (see allocations.cpp), so that
+   * allocation budgets of the message path can be asserted:
+   *   Allocations allocations;
+   *   comm->deliver(envelope);
+   *   REQUIRE(allocations.count() <= 12);
+   */
+  class Allocations {
+  public:
+    Allocations();
+
+    uint64_t count() const;
+    uint64_t bytes() const;
+    /* Start counting again from now */
+    void reset();
+
+  private:
+    uint64_t count_;
+    uint64_t bytes_;
+  };
+} // Test
@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "catch.hpp"
+#include "logger.hpp"
+
+#include <cstdio>
+#include <thread>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("binary log records", "[logging]") {
+    logrec::Writer writer;
+    writer.begin(42, 7, uint8_t(spdlog::level::info), 3, 5);
+    writer.add(-12);
+    writer.add(std::size_t(12));
+    writer.add(true);
+    writer.add("agent");
+    writer.add(std::string{"x"});
+    writer.add(lazy([]() { return "rendered"; }));
+    auto data = writer.end();
+    logrec::Record record;
+    REQUIRE(logrec::read(data.data(), data.size(), record) == data.size());
+    REQUIRE(record.time == 42);
+    REQUIRE(record.section == 3);
+    REQUIRE(record.args.size() == 6);
+    REQUIRE(logrec::format("{} {} {{{}}} {}:{} {} {}", record.args) == "-12 12 {true} agent:x rendered {}");
+    REQUIRE(logrec::read(data.data(), data.size() - 1, record) == 0);
+
+    LogRing ring{100};
+    REQUIRE(ring.capacity() == 128);
+    std::vector<uint8_t> out;
+    for(int i = 0; i < 10; ++i) { // wraps around
+      REQUIRE(ring.try_write(data));
+      REQUIRE(!ring.try_write(std::vector<uint8_t>(128, 0)));
+      out.clear();
+      REQUIRE(ring.read(out) == data.size());
+      REQUIRE(out == data);
+    }
+  }
+
+  TEST_CASE("log formats are identified by contents", "[logging]") {
+    static const char first[] = "format {} of a test";
+    static const char second[] = "format {} of a test";
+    REQUIRE(AsyncLogger::format_id(first) == AsyncLogger::format_id(second));
+    REQUIRE(AsyncLogger::format_id(first) != AsyncLogger::format_id("another format {} of a test"));
+  }
+
+  TEST_CASE("asynchronous binary logging", "[logging]") {
+    std::string path = "async_logger_test.blog";
+    Logger logger{"async-logger-test"};
+    AsyncLogger::Options options;
+    options.text = false;
+    options.binary_path = path;
+    AsyncLogger::start(options);
+    std::thread t([&logger]() {
+          for(int i = 0; i < 100; ++i) {
+            logger.info("message {} from {}", i, "thread");
+          }
+        });
+    for(int i = 0; i < 100; ++i) {
+      logger.info("message {} from {}", i, "main");
+    }
+    t.join();
+    AsyncLogger::stop();
+
+    BinaryLogReader reader{path};
+    logrec::Record record;
+    std::string section, message;
+    int nb = 0;
+    while(reader.next(record, section, message)) {
+      REQUIRE(section == "async-logger-test");
+      REQUIRE(message.find("message ") == 0);
+      ++nb;
+    }
+    REQUIRE(nb == 200);
+    std::remove(path.c_str());
+  }
+}
@@ -0,0 +1,86 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "catch.hpp"
+#include "allocations.hpp"
+#include "coroutine.hpp"
+#include "api/continuation_t.hpp"
+
+#include <memory>
+#include <tuple>
+
+using namespace fetch::oef;
+
+namespace Test {
+#ifdef OEF_CORE_COROUTINES
+  namespace {
+    struct Owner {
+      std::shared_ptr<FramePool> frames{std::make_shared<FramePool>()};
+      LengthContinuation pending;
+      std::size_t length = 0;
+      int done = 0;
+
+      const std::shared_ptr<FramePool> &frame_pool() const { return frames; }
+
+      /* awaits a continuation, called at once when `now`, otherwise left in `pending` */
+      Detached run(bool now, std::shared_ptr<int> held) {
+        std::error_code ec;
+        std::tie(ec, length) = co_await completion<std::size_t>([this, now](LengthContinuation continuation) {
+              if(now) {
+                continuation(std::error_code{}, 7);
+              } else {
+                pending = std::move(continuation);
+              }
+            });
+        ++done;
+      }
+    };
+  }
+#endif
+
+  TEST_CASE("coroutines awaiting continuations", "[coroutine]") {
+#ifndef OEF_CORE_COROUTINES
+    WARN("built without coroutines (ENABLE_COROUTINES)");
+#else
+    Owner owner;
+    auto held = std::make_shared<int>(0);
+
+    owner.run(true, held);
+    REQUIRE(owner.done == 1);
+    REQUIRE(owner.length == 7);
+    REQUIRE(owner.frames->kept() == 1); // back in the pool
+
+    Allocations allocations;
+    owner.run(false, held);
+    REQUIRE(allocations.count() == 0); // frame from the pool, continuation inline
+    REQUIRE(owner.done == 1);
+    REQUIRE(held.use_count() == 2);
+    owner.pending(std::error_code{}, 42);
+    REQUIRE(owner.done == 2);
+    REQUIRE(owner.length == 42);
+    REQUIRE(held.use_count() == 1);
+
+    owner.run(false, held);
+    REQUIRE(held.use_count() == 2);
+    owner.pending = nullptr; // dropped: the coroutine is destroyed, as a dropped callback
+    REQUIRE(owner.done == 2);
+    REQUIRE(held.use_count() == 1);
+    REQUIRE(owner.frames->kept() == 1);
+#endif
+  }
+} // Test
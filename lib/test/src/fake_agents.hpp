@@ -0,0 +1,210 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "agent_session.hpp"
+#include "agent_directory.hpp"
+#include "asio_basic_communicator.hpp"
+#include "mock_search.hpp"
+#include "oef_search_client.hpp"
+#include "subscriptions.hpp"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <functional>
+
+namespace Test {
+  using namespace fetch::oef;
+
+  /*
+   * In process transport: frames are delivered and writes completed by the test itself, on its
+   * own thread, so that allocations are deterministic. Nothing here allocates once constructed,
+   * only the code under test is counted.
+   */
+  class FakeComm : public communicator_t {
+  public:
+    std::vector<std::shared_ptr<Buffer>> sent;
+
+    FakeComm() {
+      sent.reserve(64);
+      completions_.reserve(64);
+    }
+
+    void connect() override {}
+    void disconnect() override {}
+    std::error_code send_sync(std::shared_ptr<Buffer> buffer) override {
+      sent.push_back(std::move(buffer));
+      return {};
+    }
+    std::error_code send_sync(std::vector<std::shared_ptr<Buffer>> buffers) override {
+      for(auto &b : buffers) {
+        sent.push_back(std::move(b));
+      }
+      return {};
+    }
+    std::error_code receive_sync(std::shared_ptr<Buffer> &) override {
+      return std::make_error_code(std::errc::operation_not_supported);
+    }
+    void send_async(std::shared_ptr<Buffer> buffer, LengthContinuation continuation) override {
+      // completed later: the sender may hold a lock its continuation takes
+      completions_.emplace_back(std::move(continuation), buffer->size());
+      sent.push_back(std::move(buffer));
+    }
+    void send_async(std::shared_ptr<Buffer> buffer) override {
+      sent.push_back(std::move(buffer));
+    }
+    void send_async(std::vector<std::shared_ptr<Buffer>> buffers, LengthContinuation continuation) override {
+      std::size_t length = 0;
+      for(auto &b : buffers) {
+        length += b->size() + sizeof(uint32_t);
+        sent.push_back(std::move(b));
+      }
+      completions_.emplace_back(std::move(continuation), length);
+    }
+    void receive_async(BufferContinuation continuation) override {
+      receiver_ = std::move(continuation);
+    }
+
+    /* Hand `frame` to the pending read */
+    void deliver(const std::shared_ptr<Buffer> &frame) {
+      auto receiver = std::move(receiver_);
+      receiver_ = nullptr;
+      if(!receiver) {
+        FAIL("no pending read");
+      }
+      receiver(std::error_code{}, frame);
+    }
+    /* Fail the pending read, as a closed connection would */
+    void close() {
+      auto receiver = std::move(receiver_);
+      receiver_ = nullptr;
+      if(receiver) {
+        receiver(std::make_error_code(std::errc::connection_reset), std::make_shared<Buffer>());
+      }
+    }
+    /* Run the continuations of the writes done so far */
+    void complete() {
+      for(std::size_t i = 0; i < completions_.size(); ++i) {
+        auto completion = std::move(completions_[i]);
+        completion.first(std::error_code{}, completion.second);
+      }
+      completions_.clear();
+    }
+
+  private:
+    BufferContinuation receiver_;
+    std::vector<std::pair<LengthContinuation,std::size_t>> completions_;
+  };
+
+  /* OEF Search link of an OefSearchClient, answered by the test */
+  class FakeSearchComm : public AsioBasicComm {
+  public:
+    std::shared_ptr<Buffer> header;  // of the latest request
+    std::shared_ptr<Buffer> payload;
+    std::function<void()> on_request; // if set, run once a request is sent, to answer it right away
+
+    explicit FakeSearchComm(asio::io_context &io_context) : AsioBasicComm{io_context} {
+      inbound_.reserve(4096);
+    }
+
+    void connect() override {}
+    void disconnect() override {}
+    void send_async(std::vector<std::shared_ptr<Buffer>> buffers, std::vector<std::size_t> nbytes,
+                    LengthContinuation continuation) override {
+      // lengths, header, payload
+      header = buffers[2];
+      payload = buffers[3];
+      continuation(std::error_code{}, nbytes[0] + nbytes[1] + nbytes[2] + nbytes[3]);
+      if(on_request) {
+        on_request();
+      }
+    }
+    void send_async(std::shared_ptr<Buffer> buffer, std::size_t nbytes, LengthContinuation continuation) override {
+      continuation(std::error_code{}, nbytes);
+    }
+    void receive_async(std::size_t nbytes, BufferContinuation continuation) override {
+      receiver_ = std::move(continuation);
+    }
+    std::error_code receive_sync(void *buffer, const std::size_t &nbytes) override {
+      if(nbytes != inbound_.size()) {
+        return std::make_error_code(std::errc::message_size);
+      }
+      std::memcpy(buffer, inbound_.data(), nbytes);
+      return {};
+    }
+
+    /* Answer with a serialized header and payload, as the OEF Search would */
+    void reply(const std::string &reply_header, const std::string &reply_payload) {
+      inbound_.assign(reply_header.begin(), reply_header.end());
+      inbound_.insert(inbound_.end(), reply_payload.begin(), reply_payload.end());
+      auto lengths = std::make_shared<Buffer>(2*sizeof(uint32_t)); // as received by AsioBasicComm
+      uint32_t sizes[2] = {htonl(uint32_t(reply_header.size())), htonl(uint32_t(reply_payload.size()))};
+      std::memcpy(lengths->data(), sizes, sizeof(sizes));
+      auto receiver = std::move(receiver_);
+      receiver_ = nullptr;
+      if(!receiver) {
+        FAIL("no pending read");
+      }
+      receiver(std::error_code{}, lengths);
+    }
+
+  private:
+    BufferContinuation receiver_;
+    Buffer inbound_;
+  };
+
+  /* Sessions of agents connected through FakeComm, with a FakeSearchComm OEF Search link */
+  struct Agents {
+    asio::io_context io_context;
+    std::shared_ptr<FakeSearchComm> search_comm = std::make_shared<FakeSearchComm>(io_context);
+    OefSearchClient search{search_comm, "core", "127.0.0.1", 3333};
+    AgentDirectory directory;
+    Subscriptions subscriptions;
+    std::vector<std::shared_ptr<FakeComm>> comms;
+
+    ~Agents() {
+      for(auto &comm : comms) {
+        comm->close(); // the sessions leave the directory
+      }
+    }
+
+    std::shared_ptr<FakeComm> connect(const std::string &agent, bool coroutines = false, bool batching = false) {
+      auto comm = std::make_shared<FakeComm>();
+      auto session = std::make_shared<AgentSession>(agent, comm, directory, search, subscriptions, batching);
+#ifdef OEF_CORE_COROUTINES
+      session->use_coroutines(coroutines);
+#endif
+      REQUIRE(directory.add(agent, session));
+      session->start();
+      comms.push_back(comm);
+      return comm;
+    }
+
+    /* Answer the latest OEF Search request with `mock` */
+    void answer_search(MockSearch &mock) {
+      auto request = pbs::deserialize<pb::TransportHeader>(*search_comm->header);
+      auto reply = mock.answer(request, std::string(search_comm->payload->begin(), search_comm->payload->end()));
+      std::string header;
+      reply.first.SerializeToString(&header);
+      search_comm->reply(header, reply.second);
+    }
+  };
+} // Test
@@ -0,0 +1,169 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "clientmsg.hpp"
+#include "core_server.hpp"
+#include "loopback_communicator.hpp"
+#include "mock_search.hpp"
+#include "oef_search_client.hpp"
+
+#include <arpa/inet.h>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  std::shared_ptr<Buffer> frame(const std::string &s) {
+    return std::make_shared<Buffer>(s.begin(), s.end());
+  }
+
+  TEST_CASE("in process transport", "[loopback]") {
+    asio::io_context io_context;
+    auto ends = LoopbackComm::pair(io_context, io_context);
+    std::vector<std::string> received;
+    std::vector<std::size_t> sent;
+    std::function<void(std::error_code,std::shared_ptr<Buffer>)> read = [&](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+      if(ec) {
+        received.push_back(ec == asio::error::eof ? "eof" : ec.message());
+        return;
+      }
+      received.emplace_back(buffer->begin(), buffer->end());
+      ends.second->receive_async(read);
+    };
+    ends.second->receive_async(read);
+    ends.first->send_async(frame("hello"), [&](std::error_code ec, std::size_t length) { sent.push_back(length); });
+    ends.first->send_async(frame("world"));
+    REQUIRE(received.empty()); // continuations are posted
+    REQUIRE(sent.empty());
+    io_context.run();
+    REQUIRE(received == (std::vector<std::string>{"hello", "world"}));
+    REQUIRE(sent == (std::vector<std::size_t>{5 + sizeof(uint32_t)}));
+
+    std::shared_ptr<Buffer> buffer;
+    REQUIRE(!ends.second->send_sync(frame("sync")));
+    REQUIRE(!ends.first->receive_sync(buffer));
+    REQUIRE(std::string(buffer->begin(), buffer->end()) == "sync");
+
+    // what was sent before closing is still received
+    ends.first->send_async(frame("last"));
+    ends.first->disconnect();
+    std::error_code send_error;
+    ends.second->send_async(frame("lost"), [&](std::error_code ec, std::size_t) { send_error = ec; });
+    io_context.restart();
+    io_context.run();
+    REQUIRE(received == (std::vector<std::string>{"hello", "world", "last", "eof"}));
+    REQUIRE(send_error == asio::error::broken_pipe);
+    REQUIRE(ends.first->receive_sync(buffer) == asio::error::eof);
+  }
+
+  TEST_CASE("in process byte stream", "[loopback]") {
+    asio::io_context io_context;
+    auto ends = LoopbackBasicComm::pair(io_context, io_context);
+    std::shared_ptr<Buffer> header;
+    ends.second->receive_async(4, [&](std::error_code ec, std::shared_ptr<Buffer> buffer) { header = buffer; });
+    ends.first->send_async({frame("ab"), frame("cdefgh")}, {2, 6}, [](std::error_code, std::size_t) {});
+    io_context.run();
+    REQUIRE(std::string(header->begin(), header->end()) == "abcd");
+    char rest[4];
+    REQUIRE(!ends.second->receive_sync(rest, 4));
+    REQUIRE(std::string(rest, 4) == "efgh");
+    ends.first->disconnect();
+    REQUIRE(ends.second->receive_sync(rest, 1) == asio::error::eof);
+    REQUIRE_THROWS(ends.first->connect());
+  }
+
+  TEST_CASE("CoreServer over the in process transport", "[loopback]") {
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 0, "127.0.0.1", search.port(), 1};
+    core.run();
+    asio::io_context io_context;
+
+    auto connect = [&](const std::string &agent) {
+      auto comm = core.loopback()->connect(io_context);
+      fetch::oef::pb::Agent_Server_ID id;
+      id.set_public_key(agent);
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!comm->send_sync(pbs::serialize(id)));
+      REQUIRE(!comm->receive_sync(buffer));
+      REQUIRE(pbs::deserialize<fetch::oef::pb::Server_Phrase>(*buffer).has_phrase());
+      fetch::oef::pb::Agent_Server_Answer answer;
+      answer.set_answer("secret");
+      REQUIRE(!comm->send_sync(pbs::serialize(answer)));
+      REQUIRE(!comm->receive_sync(buffer));
+      REQUIRE(pbs::deserialize<fetch::oef::pb::Server_Connected>(*buffer).status());
+      return comm;
+    };
+    auto alice = connect("alice");
+    auto bob = connect("bob");
+    REQUIRE(core.nb_agents() == 2);
+
+    REQUIRE(!alice->send_sync(pbs::serialize(Message{1, 7, "bob", "hello"}.handle())));
+    std::shared_ptr<Buffer> buffer;
+    REQUIRE(!bob->receive_sync(buffer));
+    auto message = pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer);
+    REQUIRE(message.content().origin() == "alice");
+    REQUIRE(message.content().content() == "hello");
+
+    bob->disconnect();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while(core.nb_agents() > 1 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    REQUIRE(core.nb_agents() == 1);
+    alice->disconnect();
+  }
+
+  TEST_CASE("OefSearchClient over the in process transport", "[loopback]") {
+    MockSearch::Options options;
+    options.extra_results = 2;
+    MockSearch search{options};
+    asio::io_context io_context;
+    auto ends = LoopbackBasicComm::pair(io_context, io_context);
+    auto client = std::make_shared<OefSearchClient>(ends.first, "core", "127.0.0.1", 3333);
+
+    DataModel station{"weather_station", {Attribute{"wind", Type::Int, true}}};
+    std::error_code result{std::make_error_code(std::errc::timed_out)};
+    std::vector<std::string> agents;
+    client->search_service(QueryModel{{Constraint{"wind", Relation{Relation::Op::Gt, 0}}}, station}, "searcher", 1,
+        [&](std::error_code ec, OefSearchResponse response) { result = ec; agents = response.agents; });
+
+    // play the OEF Search on the other end
+    uint32_t sizes[2];
+    REQUIRE(!ends.second->receive_sync(sizes, sizeof(sizes)));
+    std::string request(ntohl(sizes[0]) + ntohl(sizes[1]), '\0');
+    REQUIRE(!ends.second->receive_sync(&request[0], request.size()));
+    fetch::oef::pb::TransportHeader header;
+    REQUIRE(header.ParseFromArray(request.data(), int(ntohl(sizes[0]))));
+    auto answer = search.answer(header, request.substr(ntohl(sizes[0])));
+    std::string answer_header = answer.first.SerializeAsString();
+    uint32_t answer_sizes[2] = {htonl(uint32_t(answer_header.size())), htonl(uint32_t(answer.second.size()))};
+    REQUIRE(!ends.second->send_sync({answer_sizes, &answer_header[0], &answer.second[0]},
+          {sizeof(answer_sizes), answer_header.size(), answer.second.size()}));
+    io_context.run();
+    REQUIRE(!result);
+    REQUIRE(agents.size() == 2);
+    REQUIRE(client->pending().empty());
+
+    ends.second->disconnect();
+    io_context.restart();
+    io_context.run();
+    REQUIRE(!client->connected());
+  }
+} // Test
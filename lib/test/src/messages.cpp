@@ -19,6 +19,7 @@
 #include "catch.hpp"
 #include "schema.hpp"
 #include "agent.pb.h"
+#include "serialization.hpp"
 #include <google/protobuf/text_format.h>
 
 namespace Test {
@@ -78,4 +79,23 @@ namespace Test {
     std::cout << toJsonString<Envelope>(e4) << "\n";
     */
   }
+
+  TEST_CASE("batch frame assembly", "[serialization]") {
+    fetch::oef::Buffer frame;
+    for(int i = 0; i < 200; ++i) {
+      fetch::oef::pb::Server_AgentMessage msg;
+      msg.set_answer_id(i);
+      auto *content = msg.mutable_content();
+      content->set_dialogue_id(i);
+      content->set_origin("Agent1");
+      content->set_content(std::string(i, 'x'));
+      fetch::oef::pbs::append_field(frame, 1, *fetch::oef::pbs::serialize(msg));
+    }
+    bool status = false;
+    auto batch = fetch::oef::pbs::deserialize<fetch::oef::pb::AgentMessageBatch>(frame, status);
+    REQUIRE(status);
+    REQUIRE(batch.messages_size() == 200);
+    REQUIRE(batch.messages(150).answer_id() == 150);
+    REQUIRE(batch.messages(150).content().content().size() == 150);
+  }
 }
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "catch.hpp"
+#include "metrics.hpp"
+
+#include <thread>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("metrics", "[metrics]") {
+    SECTION("histogram buckets") {
+      for(uint64_t v : {0ull, 1ull, 15ull, 16ull, 17ull, 100ull, 1000ull, 123456ull, 99999999ull}) {
+        auto b = Histogram::bucket(v);
+        REQUIRE(Histogram::upper_bound(b) >= v);
+        REQUIRE(Histogram::upper_bound(b) - v <= v / 16);
+        if(b > 0) {
+          REQUIRE(Histogram::upper_bound(b - 1) < v);
+        }
+      }
+      REQUIRE(Histogram::bucket(uint64_t(1) << 50) == Histogram::nb_buckets - 1);
+    }
+    SECTION("snapshots") {
+      Counter counter{"test_counter_total"};
+      Gauge gauge{"test_gauge"};
+      Histogram latency{"test_latency_us", "operation=\"test\""};
+
+      std::vector<std::thread> threads;
+      for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&counter,&latency]() {
+              for(uint64_t i = 1; i <= 1000; ++i) {
+                counter.inc();
+                latency.observe(i);
+              }
+            });
+      }
+      for(auto &t : threads) {
+        t.join();
+      }
+      gauge.set(7);
+      REQUIRE(counter.value() == 4000);
+
+      auto first = Metrics::snapshot();
+      REQUIRE(first.find("test_counter_total")->value == 4000);
+      REQUIRE(first.find("test_gauge")->value == 7);
+      REQUIRE(first.find("test_latency_us") == nullptr);
+      auto *h = first.find("test_latency_us", "operation=\"test\"");
+      REQUIRE(h->count == 4000);
+      REQUIRE(h->sum == 4 * 500500);
+      REQUIRE(h->quantile(0.5) >= 500);
+      REQUIRE(h->quantile(0.5) <= 500 + 500 / 16);
+      REQUIRE(h->quantile(1.0) >= 1000);
+
+      counter.inc(5);
+      gauge.add(-2);
+      latency.observe(42);
+      auto delta = Metrics::snapshot().since(first);
+      REQUIRE(delta.find("test_counter_total")->value == 5);
+      REQUIRE(delta.find("test_gauge")->value == 5);
+      h = delta.find("test_latency_us", "operation=\"test\"");
+      REQUIRE(h->count == 1);
+      REQUIRE(h->quantile(0.99) == Histogram::upper_bound(Histogram::bucket(42)));
+    }
+    REQUIRE(Metrics::snapshot().find("test_counter_total") == nullptr);
+  }
+}
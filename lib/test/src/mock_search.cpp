@@ -0,0 +1,157 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "mock_search.hpp"
+#include "oef_search_client.hpp"
+
+#include <future>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("OefSearchClient against MockSearch", "[search]") {
+    MockSearch::Options options;
+    options.latency = std::chrono::microseconds{200};
+    options.jitter = std::chrono::microseconds{500};
+    options.extra_results = 2;
+    MockSearch search{options};
+
+    asio::io_context io_context;
+    auto work = asio::make_work_guard(io_context);
+    std::thread io_thread{[&io_context]() { io_context.run(); }};
+    auto comm = std::make_shared<AsioBasicComm>(io_context, "127.0.0.1", search.port());
+    auto client = std::make_shared<OefSearchClient>(comm, "core", "127.0.0.1", 3333);
+
+    using Result = std::pair<std::error_code,OefSearchResponse>;
+    auto wait = [](std::function<void(AgentSessionContinuation)> request) {
+      auto promise = std::make_shared<std::promise<Result>>();
+      auto future = promise->get_future();
+      request([promise](std::error_code ec, OefSearchResponse response) { promise->set_value(Result{ec, response}); });
+      REQUIRE(future.wait_for(std::chrono::seconds{5}) == std::future_status::ready);
+      return future.get();
+    };
+
+    DataModel station{"weather_station", {Attribute{"wind", Type::Int, true}}};
+    for(int i = 0; i < 8; ++i) {
+      Instance instance{station, {{"wind", VariantType{i}}}};
+      auto result = wait([&](AgentSessionContinuation c) { client->register_service(instance, "agent" + std::to_string(i), 1, std::move(c)); });
+      REQUIRE(!result.first);
+    }
+    REQUIRE(search.size() == 8);
+
+    // concurrent searches, answered out of order
+    QueryModel windy{{Constraint{"wind", Relation{Relation::Op::GtEq, 6}}}, station};
+    std::vector<std::future<Result>> searches;
+    for(uint32_t i = 0; i < 20; ++i) {
+      auto promise = std::make_shared<std::promise<Result>>();
+      searches.push_back(promise->get_future());
+      client->search_service(windy, "searcher", i, 
+          [promise](std::error_code ec, OefSearchResponse response) { promise->set_value(Result{ec, response}); });
+    }
+    for(auto &f : searches) {
+      REQUIRE(f.wait_for(std::chrono::seconds{5}) == std::future_status::ready);
+      auto result = f.get();
+      REQUIRE(!result.first);
+      std::sort(result.second.agents.begin(), result.second.agents.end());
+      REQUIRE(result.second.agents == (std::vector<std::string>{"agent6", "agent7", "mock-agent-0", "mock-agent-1"}));
+    }
+    REQUIRE(client->pending().empty());
+
+    Instance removed{station, {{"wind", VariantType{0}}}};
+    REQUIRE(!wait([&](AgentSessionContinuation c) { client->unregister_service(removed, "agent0", 2, std::move(c)); }).first);
+    REQUIRE(search.size() == 0); // removes are per data model
+    REQUIRE(search.requests() == 8 + 20 + 1);
+
+    // the client's read handler outlives the connection: stop the io thread before releasing it
+    comm->disconnect();
+    work.reset();
+    io_thread.join();
+    client.reset();
+  }
+
+  TEST_CASE("OefSearchClient reconnects asynchronously", "[search]") {
+    MockSearch search{MockSearch::Options{}};
+    asio::io_context io_context;
+    auto work = asio::make_work_guard(io_context);
+    std::thread io_thread{[&io_context]() { io_context.run(); }};
+    auto comm = std::make_shared<AsioBasicComm>(io_context, "127.0.0.1", search.port());
+    auto client = std::make_shared<OefSearchClient>(comm, "core", "127.0.0.1", 3333);
+    auto wait_for = [](const std::function<bool()> &done) {
+      for(int i = 0; i < 500 && !done(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+      }
+      return done();
+    };
+
+    DataModel station{"weather_station", {Attribute{"wind", Type::Int, true}}};
+    std::promise<std::error_code> registered;
+    client->register_service(Instance{station, {{"wind", VariantType{1}}}}, "agent", 1,
+        [&registered](std::error_code ec, OefSearchResponse) { registered.set_value(ec); });
+    auto future = registered.get_future();
+    REQUIRE(future.wait_for(std::chrono::seconds{5}) == std::future_status::ready);
+    REQUIRE(!future.get());
+
+    comm->disconnect();
+    REQUIRE(wait_for([&client]() { return !client->connected(); }));
+    auto requests = search.requests();
+    // from an io thread, as the CoreServer watchdog does: must not block it
+    asio::post(io_context, [&client]() { client->connect_async(); });
+    REQUIRE(wait_for([&client]() { return client->connected(); }));
+    // the registration is resynced over the new connection
+    REQUIRE(wait_for([&search,requests]() { return search.requests() > requests; }));
+
+    comm->disconnect();
+    work.reset();
+    io_thread.join();
+    client.reset();
+  }
+
+  TEST_CASE("MockSearch failures", "[search]") {
+    MockSearch::Options options;
+    options.error_rate = 1.;
+    MockSearch search{options};
+    fetch::oef::pb::TransportHeader header;
+    header.set_uri("search");
+    header.set_id(1);
+    auto answer = search.answer(header, "not a query");
+    REQUIRE(!answer.first.status().success());
+
+    asio::io_context io_context;
+    auto work = asio::make_work_guard(io_context);
+    std::thread io_thread{[&io_context]() { io_context.run(); }};
+    auto comm = std::make_shared<AsioBasicComm>(io_context, "127.0.0.1", search.port());
+    auto client = std::make_shared<OefSearchClient>(comm, "core", "127.0.0.1", 3333);
+    std::promise<std::error_code> promise;
+    DataModel station{"weather_station", {Attribute{"wind", Type::Int, true}}};
+    client->search_service(QueryModel{{Constraint{"wind", Relation{Relation::Op::Gt, 0}}}, station}, "searcher", 1,
+        [&promise](std::error_code ec, OefSearchResponse) { promise.set_value(ec); });
+    auto future = promise.get_future();
+    REQUIRE(future.wait_for(std::chrono::seconds{5}) == std::future_status::ready);
+    REQUIRE(future.get());
+    REQUIRE(search.errors() == 1);
+
+    // the client's read handler outlives the connection: stop the io thread before releasing it
+    comm->disconnect();
+    work.reset();
+    io_thread.join();
+    client.reset();
+  }
+}
@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "catch.hpp"
+#include "config.hpp"
+#include "registration_ledger.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("registration journal replay", "[ledger]") {
+    std::string path = "/tmp/oef-ledger-test-" + std::to_string(::getpid()) + ".journal";
+    std::remove(path.c_str());
+
+    Attribute name{"name", Type::String, true};
+    Attribute price{"price", Type::Int, true};
+    DataModel weather{"weather", {name, price}};
+    Instance station1{weather, {{"name", VariantType{std::string{"station1"}}}, {"price", VariantType{10}}}};
+    Instance station2{weather, {{"name", VariantType{std::string{"station2"}}}, {"price", VariantType{20}}}};
+    {
+      RegistrationLedger ledger;
+      ledger.open_journal(path);
+      REQUIRE(ledger.journaled());
+      ledger.add("Agent1", station1);
+      ledger.add("Agent1", station2);
+      ledger.add("Agent2", station2);
+      ledger.remove("Agent1", station2);
+      REQUIRE(ledger.size() == 2);
+      REQUIRE(ledger.snapshot().size() == 2);
+      ledger.detach("Agent2");
+      REQUIRE(ledger.snapshot().size() == 1);
+    }
+    {
+      // core restart: registrations are restored but detached until their agents reconnect
+      RegistrationLedger ledger;
+      ledger.open_journal(path);
+      REQUIRE(ledger.size() == 2);
+      REQUIRE(ledger.snapshot().empty());
+      auto restored = ledger.attach("Agent1");
+      REQUIRE(restored.size() == 1);
+      REQUIRE(restored.front() == station1);
+      REQUIRE(ledger.snapshot().size() == 1);
+      REQUIRE(ledger.attach("Agent3").empty());
+    }
+    // the journal is compacted through a temporary file, renamed over it
+    REQUIRE(std::ifstream{path + ".tmp"}.fail());
+    std::remove(path.c_str());
+  }
+
+  TEST_CASE("registrations of agents not reconnecting expire", "[ledger]") {
+    std::string path = "/tmp/oef-ledger-expiry-test-" + std::to_string(::getpid()) + ".journal";
+    std::remove(path.c_str());
+
+    Attribute name{"name", Type::String, true};
+    DataModel weather{"weather", {name}};
+    Instance station1{weather, {{"name", VariantType{std::string{"station1"}}}}};
+    Instance station2{weather, {{"name", VariantType{std::string{"station2"}}}}};
+    auto later = RegistrationLedger::Clock::now() + std::chrono::hours{2};
+    {
+      RegistrationLedger ledger;
+      ledger.open_journal(path);
+      ledger.add("Agent1", station1);
+      ledger.add("Agent2", station2);
+      ledger.detach("Agent1");
+      REQUIRE(ledger.expire(std::chrono::hours{1}) == 0);
+      REQUIRE(ledger.expire(std::chrono::hours{1}, later) == 1);
+      REQUIRE(ledger.size() == 1);
+      // attached agents never expire
+      REQUIRE(ledger.attach("Agent1").empty());
+    }
+    {
+      // forgotten registrations are not restored, replayed ones expire from the restart on
+      RegistrationLedger ledger;
+      ledger.open_journal(path);
+      REQUIRE(ledger.size() == 1);
+      REQUIRE(ledger.expire(std::chrono::hours{1}) == 0);
+      REQUIRE(ledger.expire(std::chrono::hours{1}, later) == 1);
+      REQUIRE(ledger.size() == 0);
+    }
+    std::remove(path.c_str());
+  }
+
+  TEST_CASE("registration journal compacted while running", "[ledger]") {
+    std::string path = "/tmp/oef-ledger-compaction-test-" + std::to_string(::getpid()) + ".journal";
+    std::remove(path.c_str());
+
+    Attribute name{"name", Type::String, true};
+    DataModel weather{"weather", {name}};
+    Instance station{weather, {{"name", VariantType{std::string{"station"}}}}};
+    Instance kept{weather, {{"name", VariantType{std::string{"kept"}}}}};
+    {
+      RegistrationLedger ledger;
+      ledger.open_journal(path);
+      ledger.add("Keeper", kept);
+      // churning agents: every registration is removed, only its records are left in the journal
+      for(std::size_t i = 0; i < 4 * config::ledger_compaction_min; ++i) {
+        std::string agent = "Agent" + std::to_string(i);
+        ledger.add(agent, station);
+        ledger.remove(agent, station);
+        ledger.detach(agent);
+        REQUIRE(ledger.journal_records() <= config::ledger_compaction_min + 1);
+      }
+      REQUIRE(ledger.size() == 1);
+      REQUIRE(std::ifstream{path + ".tmp"}.fail());
+    }
+    {
+      RegistrationLedger ledger;
+      ledger.open_journal(path);
+      REQUIRE(ledger.size() == 1);
+      REQUIRE(ledger.journal_records() == 1);
+      REQUIRE(ledger.attach("Keeper").front() == kept);
+    }
+    std::remove(path.c_str());
+  }
+}
@@ -0,0 +1,222 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "clientmsg.hpp"
+#include "core_server.hpp"
+#include "mock_search.hpp"
+#include "shm_communicator.hpp"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <future>
+#include <thread>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  std::shared_ptr<Buffer> shm_frame(uint32_t i) {
+    return std::make_shared<Buffer>(1 + (i * 37) % 1500, uint8_t(i));
+  }
+
+  bool shm_handshake(communicator_t &comm, const std::string &agent) {
+    fetch::oef::pb::Agent_Server_ID id;
+    id.set_public_key(agent);
+    id.set_pipelined(true);
+    fetch::oef::pb::Agent_Server_Answer answer;
+    answer.set_answer("secret");
+    std::shared_ptr<Buffer> buffer;
+    if(comm.send_sync(std::vector<std::shared_ptr<Buffer>>{pbs::serialize(id), pbs::serialize(answer)})
+        || comm.receive_sync(buffer)) {
+      return false;
+    }
+    return pbs::deserialize<fetch::oef::pb::Server_Connected>(*buffer).status();
+  }
+
+  TEST_CASE("shared memory transport", "[shm]") {
+    std::string path = "/tmp/oef-core-test-" + std::to_string(::getpid()) + "-shm.sock";
+    asio::io_context io_context;
+    auto work = asio::make_work_guard(io_context);
+    std::thread runner([&io_context]() { io_context.run(); });
+    {
+      ShmComm::Options options;
+      options.capacity = 4096;
+      ShmAcceptor acceptor{io_context, path, options};
+      std::promise<std::shared_ptr<communicator_t>> accepted;
+      acceptor.do_accept_async([&accepted](std::error_code, std::shared_ptr<communicator_t> comm) {
+          accepted.set_value(comm);
+        });
+      auto client = ShmComm::connect(io_context, path, ShmComm::Options{});
+      auto server = accepted.get_future().get();
+      REQUIRE(server);
+
+      // many times what the rings hold: senders wait for room, frames wrap around
+      constexpr uint32_t nb_frames = 2000;
+      std::atomic<uint32_t> sent{0};
+      for(uint32_t i = 0; i < nb_frames; ++i) {
+        client->send_async(shm_frame(i), [&sent](std::error_code ec, std::size_t) {
+            if(!ec) {
+              ++sent;
+            }
+          });
+      }
+      for(uint32_t i = 0; i < nb_frames; ++i) {
+        std::shared_ptr<Buffer> buffer;
+        REQUIRE(!server->receive_sync(buffer));
+        REQUIRE(*buffer == *shm_frame(i));
+      }
+
+      std::promise<uint32_t> echoed;
+      std::function<void(uint32_t)> receive = [&](uint32_t i) {
+        client->receive_async([&,i](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+            if(ec || *buffer != *shm_frame(i) || i + 1 == nb_frames) {
+              echoed.set_value(ec ? i : i + 1);
+            } else {
+              receive(i + 1);
+            }
+          });
+      };
+      receive(0);
+      for(uint32_t i = 0; i < nb_frames; ++i) {
+        REQUIRE(!server->send_sync(shm_frame(i)));
+      }
+      REQUIRE(echoed.get_future().get() == nb_frames);
+      REQUIRE(sent == nb_frames);
+
+      REQUIRE(client->send_sync(std::make_shared<Buffer>(options.capacity)) == asio::error::message_size);
+
+      // what was sent before closing is received first
+      REQUIRE(!client->send_sync(shm_frame(1)));
+      client->disconnect();
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!server->receive_sync(buffer));
+      REQUIRE(*buffer == *shm_frame(1));
+      REQUIRE(server->receive_sync(buffer) == asio::error::eof);
+      REQUIRE(server->send_sync(shm_frame(2)) == asio::error::broken_pipe);
+
+      io_context.stop();
+      runner.join();
+    }
+    REQUIRE(::access(path.c_str(), F_OK) != 0);
+  }
+
+  TEST_CASE("agents over shared memory", "[shm]") {
+    std::string path = "/tmp/oef-core-test-" + std::to_string(::getpid()) + "-core-shm.sock";
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 13412, "127.0.0.1", search.port(), 1};
+    core.listen_shm(path);
+    core.run();
+
+    asio::io_context io_context;
+    AsioComm alice{io_context, "127.0.0.1", 13412};
+    auto bob = ShmComm::connect(io_context, path, ShmComm::Options{});
+    REQUIRE(shm_handshake(alice, "alice"));
+    REQUIRE(shm_handshake(*bob, "bob"));
+    REQUIRE(core.nb_agents() == 2);
+
+    std::shared_ptr<Buffer> buffer;
+    REQUIRE(!alice.send_sync(pbs::serialize(Message{1, 7, "bob", "over tcp"}.handle())));
+    REQUIRE(!bob->receive_sync(buffer));
+    REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().content() == "over tcp");
+    REQUIRE(!bob->send_sync(pbs::serialize(Message{1, 7, "alice", "over shared memory"}.handle())));
+    REQUIRE(!alice.receive_sync(buffer));
+    REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().content() == "over shared memory");
+    alice.disconnect();
+    bob->disconnect();
+  }
+
+  TEST_CASE("corrupt shared memory rings", "[shm]") {
+    std::string path = "/tmp/oef-core-test-" + std::to_string(::getpid()) + "-corrupt-shm.sock";
+    asio::io_context io_context;
+    auto work = asio::make_work_guard(io_context);
+    std::thread runner([&io_context]() { io_context.run(); });
+    {
+      ShmAcceptor acceptor{io_context, path, ShmComm::Options{}};
+      auto connect = [&]() {
+        std::promise<std::shared_ptr<communicator_t>> accepted;
+        acceptor.do_accept_async([&accepted](std::error_code, std::shared_ptr<communicator_t> comm) {
+            accepted.set_value(comm);
+          });
+        auto client = ShmComm::connect(io_context, path, ShmComm::Options{});
+        return std::make_pair(client, accepted.get_future().get());
+      };
+      std::shared_ptr<Buffer> buffer;
+
+      // more bytes in the ring than it holds
+      auto ends = connect();
+      auto &ring = ends.first->segment().rings[0]; // to the accepting end
+      ring.head.store(ring.tail.load() + 2 * ends.first->segment().capacity);
+      REQUIRE(ends.second->receive_sync(buffer) == std::errc::protocol_error);
+      REQUIRE(ends.second->send_sync(shm_frame(1)) == asio::error::broken_pipe);
+      REQUIRE(ends.first->receive_sync(buffer) == asio::error::eof);
+
+      // a frame larger than what is in the ring
+      ends = connect();
+      REQUIRE(!ends.first->send_sync(shm_frame(1)));
+      uint32_t size = 1 << 20;
+      std::memcpy(ends.first->segment().data(0, ends.first->segment().capacity), &size, sizeof(size));
+      REQUIRE(ends.second->receive_sync(buffer) == std::errc::protocol_error);
+
+      // the consumer ahead of the producer
+      ends = connect();
+      auto &back = ends.first->segment().rings[1]; // from the accepting end
+      back.tail.store(back.head.load() + 8);
+      REQUIRE(ends.second->send_sync(shm_frame(1)) == asio::error::broken_pipe);
+      REQUIRE(ends.second->receive_sync(buffer) == std::errc::protocol_error);
+
+      io_context.stop();
+      runner.join();
+    }
+  }
+
+  TEST_CASE("cores disconnect agents corrupting their rings", "[shm]") {
+    std::string path = "/tmp/oef-core-test-" + std::to_string(::getpid()) + "-core-corrupt-shm.sock";
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 0, "127.0.0.1", search.port(), 1};
+    core.listen_shm(path);
+    core.run();
+
+    asio::io_context io_context;
+    auto mallory = ShmComm::connect(io_context, path, ShmComm::Options{});
+    auto &ring = mallory->segment().rings[1]; // to mallory
+    ring.tail.store(uint64_t(1) << 40);
+    fetch::oef::pb::Agent_Server_ID id;
+    id.set_public_key("mallory");
+    id.set_pipelined(true);
+    fetch::oef::pb::Agent_Server_Answer answer;
+    answer.set_answer("secret");
+    REQUIRE(!mallory->send_sync(std::vector<std::shared_ptr<Buffer>>{pbs::serialize(id), pbs::serialize(answer)}));
+    // the core finds the ring corrupt as it writes Connected, and disconnects
+    auto wait = [](const std::function<bool()> &condition) {
+      for(int i = 0; i < 2000 && !condition(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+      }
+      return condition();
+    };
+    REQUIRE(wait([&mallory]() { return mallory->segment().closed.load() != 0; }));
+
+    auto bob = ShmComm::connect(io_context, path, ShmComm::Options{});
+    REQUIRE(shm_handshake(*bob, "bob"));
+    REQUIRE(wait([&core]() { return core.nb_agents() == 1; }));
+    bob->disconnect();
+    mallory->disconnect();
+  }
+} // Test
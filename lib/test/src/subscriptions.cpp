@@ -0,0 +1,77 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+#include "catch.hpp"
+#include "subscriptions.hpp"
+
+#include <algorithm>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("continuous query subscriptions", "[subscriptions]") {
+    DataModel station{"weather_station", {
+        Attribute{"manufacturer", Type::String, true},
+          Attribute{"model", Type::String, true},
+            Attribute{"wind", Type::Int, true}}};
+    Instance youshiko{station, {{"manufacturer", VariantType{std::string{"Youshiko"}}},
+                                {"model", VariantType{std::string{"YC9315"}}},
+                                {"wind", VariantType{12}}}};
+    Instance opes{station, {{"manufacturer", VariantType{std::string{"Opes"}}},
+                            {"model", VariantType{std::string{"17500"}}},
+                            {"wind", VariantType{3}}}};
+
+    Constraint youshiko_c{"manufacturer", Relation{Relation::Op::Eq, "Youshiko"}};
+    Constraint windy_c{"wind", Relation{Relation::Op::Gt, 5}};
+    Constraint models_c{"model", Set{Set::Op::NotIn, std::unordered_set<std::string>{"YC9315"}}};
+    QueryModel q_youshiko{{youshiko_c, windy_c}, station};
+    QueryModel q_any{{ConstraintExpr{youshiko_c} || ConstraintExpr{models_c}}};
+    QueryModel q_calm{{!ConstraintExpr{windy_c}}, station};
+
+    for(auto *q : {&q_youshiko, &q_any, &q_calm}) {
+      CompiledQuery compiled{q->handle()};
+      REQUIRE(compiled.check(youshiko) == q->check(youshiko));
+      REQUIRE(compiled.check(opes) == q->check(opes));
+    }
+    REQUIRE(CompiledQuery{q_youshiko.handle()}.equality_key().second == "Youshiko");
+    REQUIRE(CompiledQuery{q_any.handle()}.equality_key().first.empty());
+
+    Subscriptions subscriptions;
+    REQUIRE(subscriptions.add("alice", 1, q_youshiko.handle()));
+    REQUIRE(!subscriptions.add("alice", 1, q_youshiko.handle()));
+    REQUIRE(subscriptions.add("alice", 2, q_calm.handle()));
+    REQUIRE(subscriptions.add("bob", 1, q_any.handle()));
+    REQUIRE(!subscriptions.add("bob", 2, fetch::oef::pb::Query_Model{}));
+    REQUIRE(subscriptions.size() == 3);
+
+    auto matches = subscriptions.match(youshiko);
+    std::sort(matches.begin(), matches.end());
+    REQUIRE(matches == (std::vector<Subscriptions::Subscriber>{{"alice", 1}, {"bob", 1}}));
+    matches = subscriptions.match(opes);
+    std::sort(matches.begin(), matches.end());
+    REQUIRE(matches == (std::vector<Subscriptions::Subscriber>{{"alice", 2}, {"bob", 1}}));
+
+    REQUIRE(subscriptions.remove("bob", 1));
+    REQUIRE(!subscriptions.remove("bob", 1));
+    REQUIRE(subscriptions.match(opes).size() == 1);
+    REQUIRE(subscriptions.remove_all("alice") == 2);
+    REQUIRE(subscriptions.size() == 0);
+    REQUIRE(subscriptions.match(youshiko).empty());
+  }
+}
@@ -0,0 +1,48 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "token_bucket.hpp"
+
+using namespace fetch::oef;
+
+namespace Test {
+  TEST_CASE("token buckets", "[pacing]") {
+    using Clock = TokenBucket::Clock;
+    auto now = Clock::now();
+    TokenBucket unlimited;
+    REQUIRE(!unlimited.limited());
+    REQUIRE(unlimited.take(now) == Clock::duration::zero());
+
+    TokenBucket bucket{10, 2, now};
+    REQUIRE(bucket.limited());
+    REQUIRE(bucket.take(now) == Clock::duration::zero());
+    REQUIRE(bucket.take(now) == Clock::duration::zero());
+    // in debt of one token, then of two: 100 then 200 ms to pay it
+    REQUIRE(std::chrono::duration<double, std::milli>(bucket.take(now)).count() == Approx(100));
+    REQUIRE(std::chrono::duration<double, std::milli>(bucket.take(now)).count() == Approx(200));
+    now += std::chrono::milliseconds(300);
+    REQUIRE(bucket.take(now) == Clock::duration::zero());
+    // never more than the burst saved up
+    now += std::chrono::seconds(10);
+    REQUIRE(bucket.take(now) == Clock::duration::zero());
+    REQUIRE(bucket.take(now) == Clock::duration::zero());
+    REQUIRE(bucket.take(now) > Clock::duration::zero());
+  }
+} // Test
@@ -0,0 +1,88 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "tracing.hpp"
+
+#include <thread>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("sampled tracing", "[tracing]") {
+    Tracer::clear();
+    REQUIRE(Tracer::sample("alice") == nullptr); // disabled by default
+    Tracer::sample_every(2);
+    std::vector<std::shared_ptr<Trace>> traces;
+    for(int i = 0; i < 10; ++i) {
+      auto trace = Tracer::sample("alice");
+      if(trace) {
+        traces.push_back(trace);
+      }
+    }
+    REQUIRE(traces.size() == 5);
+
+    std::shared_ptr<Trace> search_reply;
+    {
+      TraceScope scope{traces.front()};
+      REQUIRE(Tracer::current() == traces.front());
+      Tracer::mark(Trace::Stage::FrameReceived);
+      Tracer::current()->name("search_services");
+      Tracer::mark(Trace::Stage::Parsed);
+      search_reply = Tracer::current(); // as kept by a pending search request
+    }
+    REQUIRE(Tracer::current() == nullptr);
+    Tracer::mark(Trace::Stage::Parsed); // no current trace, ignored
+    std::thread search_thread{[&search_reply]() {
+          TraceScope scope{search_reply};
+          Tracer::mark(Trace::Stage::SearchReplyParsed);
+        }};
+    search_thread.join();
+    traces.clear(); // unmarked traces are not recorded
+    REQUIRE(Tracer::traces().empty());
+    search_reply.reset();
+
+    auto recorded = Tracer::traces();
+    REQUIRE(recorded.size() == 1);
+    REQUIRE(recorded[0].agent == "alice");
+    REQUIRE(recorded[0].name == "search_services");
+    REQUIRE(recorded[0].marks.size() == 3);
+    REQUIRE(recorded[0].marks[2].stage == Trace::Stage::SearchReplyParsed);
+    REQUIRE(recorded[0].marks[2].thread != recorded[0].marks[0].thread);
+
+    auto json = Tracer::chrome_json();
+    REQUIRE(json.find("{\"traceEvents\":[") == 0);
+    REQUIRE(json.find("\"name\":\"search reply parsed\",\"cat\":\"oef\",\"ph\":\"X\"") != std::string::npos);
+    REQUIRE(json.find("\"payload\":\"search_services\"") != std::string::npos);
+
+    Tracer::sample_every(1);
+    for(std::size_t i = 0; i < fetch::oef::config::trace_ring_size + 10; ++i) {
+      auto trace = Tracer::sample("bob");
+      trace->name(std::to_string(i));
+      trace->mark(Trace::Stage::FrameReceived);
+    }
+    recorded = Tracer::traces();
+    REQUIRE(recorded.size() == fetch::oef::config::trace_ring_size);
+    REQUIRE(recorded.front().name == "10");
+    REQUIRE(recorded.back().name == std::to_string(fetch::oef::config::trace_ring_size + 9));
+    Tracer::sample_every(0);
+    Tracer::clear();
+  }
+}
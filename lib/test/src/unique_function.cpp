@@ -0,0 +1,60 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "allocations.hpp"
+#include "unique_function.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("move-only continuations", "[continuation]") {
+    auto owned = std::make_unique<std::string>("frame");
+    auto counter = std::make_shared<int>(0);
+
+    UniqueFunction<std::size_t(int)> small;
+    REQUIRE(!small);
+    Allocations allocations;
+    small = [owned = std::move(owned), counter](int n) { *counter += n; return owned->size(); };
+    REQUIRE(allocations.count() == 0); // stored inline
+    REQUIRE(small);
+    auto moved = std::move(small);
+    REQUIRE(!small);
+    REQUIRE(moved(2) == 5);
+    REQUIRE(*counter == 2);
+    REQUIRE(counter.use_count() == 2);
+    moved = nullptr;
+    REQUIRE(counter.use_count() == 1);
+
+    std::array<char, 128> big{};
+    big[0] = 'x';
+    allocations.reset();
+    UniqueFunction<char(int)> large{[big, counter](int i) { return big[std::size_t(i)]; }};
+    REQUIRE(allocations.count() == 1); // too large, on the heap
+    auto moved_large = std::move(large);
+    REQUIRE(allocations.count() == 1);
+    REQUIRE(moved_large(0) == 'x');
+    REQUIRE(counter.use_count() == 2);
+  }
+} // Test
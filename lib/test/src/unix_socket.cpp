@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "asio_acceptor.hpp"
+#include "clientmsg.hpp"
+#include "core_server.hpp"
+#include "mock_search.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  bool exists(const std::string &path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0;
+  }
+
+  bool handshake(AsioComm &comm, const std::string &agent) {
+    fetch::oef::pb::Agent_Server_ID id;
+    id.set_public_key(agent);
+    id.set_pipelined(true);
+    fetch::oef::pb::Agent_Server_Answer answer;
+    answer.set_answer("secret");
+    std::shared_ptr<Buffer> buffer;
+    if(comm.send_sync(std::vector<std::shared_ptr<Buffer>>{pbs::serialize(id), pbs::serialize(answer)})
+        || comm.receive_sync(buffer)) {
+      return false;
+    }
+    return pbs::deserialize<fetch::oef::pb::Server_Connected>(*buffer).status();
+  }
+
+  TEST_CASE("agents over TCP and Unix domain sockets", "[unix]") {
+    std::string path = "/tmp/oef-core-test-" + std::to_string(::getpid()) + ".sock";
+    MockSearch search{MockSearch::Options{}};
+    {
+      CoreServer core{"core", "127.0.0.1", 13411, "127.0.0.1", search.port(), 1};
+      core.listen_local(path);
+      core.run();
+
+      asio::io_context io_context;
+      AsioComm alice{io_context, "127.0.0.1", 13411};
+      AsioComm bob{io_context, path};
+      REQUIRE(handshake(alice, "alice"));
+      REQUIRE(handshake(bob, "bob"));
+      REQUIRE(core.nb_agents() == 2);
+
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!alice.send_sync(pbs::serialize(Message{1, 7, "bob", "over tcp"}.handle())));
+      REQUIRE(!bob.receive_sync(buffer));
+      REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().content() == "over tcp");
+      REQUIRE(!bob.send_sync(pbs::serialize(Message{1, 7, "alice", "over unix"}.handle())));
+      REQUIRE(!alice.receive_sync(buffer));
+      REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().content() == "over unix");
+      alice.disconnect();
+      bob.disconnect();
+    }
+    REQUIRE(!exists(path));
+  }
+
+  TEST_CASE("Unix domain socket files", "[unix]") {
+    std::string path = "/tmp/oef-core-test-" + std::to_string(::getpid()) + "-stale.sock";
+    asio::io_context io_context;
+    {
+      // left behind by a process which did not stop cleanly
+      asio::local::stream_protocol::acceptor stale{io_context, asio::local::stream_protocol::endpoint{path}};
+    }
+    REQUIRE(exists(path));
+    {
+      AsioLocalAcceptor acceptor{io_context, path};
+      REQUIRE_THROWS(AsioLocalAcceptor{io_context, path}); // still served
+      REQUIRE(exists(path));
+    }
+    REQUIRE(!exists(path));
+  }
+} // Test
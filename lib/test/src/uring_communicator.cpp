@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "clientmsg.hpp"
+#include "core_server.hpp"
+#include "mock_search.hpp"
+#include "uring_communicator.hpp"
+
+#include <future>
+#include <thread>
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  std::shared_ptr<Buffer> uring_frame(uint32_t i) {
+    // every 100th frame does not fit a registered buffer
+    return std::make_shared<Buffer>(i % 100 == 99 ? 10000 : 1 + (i * 37) % 1500, uint8_t(i));
+  }
+
+  bool uring_handshake(communicator_t &comm, const std::string &agent) {
+    fetch::oef::pb::Agent_Server_ID id;
+    id.set_public_key(agent);
+    id.set_pipelined(true);
+    fetch::oef::pb::Agent_Server_Answer answer;
+    answer.set_answer("secret");
+    std::shared_ptr<Buffer> buffer;
+    if(comm.send_sync(std::vector<std::shared_ptr<Buffer>>{pbs::serialize(id), pbs::serialize(answer)})
+        || comm.receive_sync(buffer)) {
+      return false;
+    }
+    return pbs::deserialize<fetch::oef::pb::Server_Connected>(*buffer).status();
+  }
+
+  TEST_CASE("io_uring transport", "[uring]") {
+    asio::io_context io_context;
+    auto work = asio::make_work_guard(io_context);
+    IoUring::Options options;
+    options.send_buffers = 4;
+    options.send_buffer_size = 4096;
+    options.recv_buffers = 4;
+    options.recv_buffer_size = 1024;
+    std::shared_ptr<IoUring> uring;
+    try {
+      uring = IoUring::create(io_context, options);
+    } catch(std::exception &e) {
+      WARN("io_uring is not available: " << e.what());
+      return;
+    }
+    std::thread runner([&io_context]() { io_context.run(); });
+    {
+      UringAcceptor acceptor{uring, io_context, 0};
+      std::promise<std::shared_ptr<communicator_t>> accepted;
+      acceptor.do_accept_async([&accepted](std::error_code, std::shared_ptr<communicator_t> comm) {
+          accepted.set_value(comm);
+        });
+      AsioComm client{io_context, "127.0.0.1", acceptor.local_port()};
+      auto server = accepted.get_future().get();
+      REQUIRE(server);
+
+      // frames split over provided buffers, several frames per receive
+      constexpr uint32_t nb_frames = 2000;
+      std::promise<uint32_t> received;
+      std::function<void(uint32_t)> receive = [&](uint32_t i) {
+        server->receive_async([&,i](std::error_code ec, std::shared_ptr<Buffer> buffer) {
+            if(ec || *buffer != *uring_frame(i) || i + 1 == nb_frames) {
+              received.set_value(ec ? i : i + 1);
+            } else {
+              receive(i + 1);
+            }
+          });
+      };
+      receive(0);
+      for(uint32_t i = 0; i < nb_frames; ++i) {
+        REQUIRE(!client.send_sync(uring_frame(i)));
+      }
+      REQUIRE(received.get_future().get() == nb_frames);
+
+      // many more frames than registered buffers: coalesced, or written from the frames
+      std::atomic<uint32_t> sent{0};
+      for(uint32_t i = 0; i < nb_frames; ++i) {
+        server->send_async(uring_frame(i), [&sent,i](std::error_code ec, std::size_t length) {
+            if(!ec && length == uring_frame(i)->size() + sizeof(uint32_t)) {
+              ++sent;
+            }
+          });
+      }
+      for(uint32_t i = 0; i < nb_frames; ++i) {
+        std::shared_ptr<Buffer> buffer;
+        REQUIRE(!client.receive_sync(buffer));
+        REQUIRE(*buffer == *uring_frame(i));
+      }
+
+      REQUIRE(!client.send_sync(uring_frame(1)));
+      client.disconnect();
+      std::shared_ptr<Buffer> buffer;
+      REQUIRE(!server->receive_sync(buffer));
+      REQUIRE(*buffer == *uring_frame(1));
+      REQUIRE(server->receive_sync(buffer) == asio::error::eof);
+      REQUIRE(sent == nb_frames);
+    }
+    uring->shutdown();
+    io_context.stop();
+    runner.join();
+  }
+
+  TEST_CASE("agents over io_uring", "[uring]") {
+    MockSearch search{MockSearch::Options{}};
+    CoreServer core{"core", "127.0.0.1", 13413, "127.0.0.1", search.port(), 1};
+    // falls back to asio where io_uring is not available, agents can't tell
+    core.use_io_uring();
+    core.run();
+
+    asio::io_context io_context;
+    AsioComm alice{io_context, "127.0.0.1", 13413};
+    AsioComm bob{io_context, "127.0.0.1", 13413};
+    REQUIRE(uring_handshake(alice, "alice"));
+    REQUIRE(uring_handshake(bob, "bob"));
+    REQUIRE(core.nb_agents() == 2);
+
+    std::shared_ptr<Buffer> buffer;
+    REQUIRE(!alice.send_sync(pbs::serialize(Message{1, 7, "bob", "hello bob"}.handle())));
+    REQUIRE(!bob.receive_sync(buffer));
+    REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().content() == "hello bob");
+    REQUIRE(!bob.send_sync(pbs::serialize(Message{1, 7, "alice", "hello alice"}.handle())));
+    REQUIRE(!alice.receive_sync(buffer));
+    REQUIRE(pbs::deserialize<fetch::oef::pb::Server_AgentMessage>(*buffer).content().content() == "hello alice");
+    alice.disconnect();
+    bob.disconnect();
+  }
+} // Test
@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+//
+//   Copyright 2018-2019 Fetch.AI Limited
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//------------------------------------------------------------------------------
+
+
+#include "catch.hpp"
+#include "compiled_query.hpp"
+#include "workload.hpp"
+
+using namespace fetch::oef;
+
+namespace Test {
+
+  TEST_CASE("synthetic schema workload", "[workload]") {
+    Workload::Options options;
+    options.seed = 7;
+    Workload workload{options};
+    REQUIRE(workload.models().size() == options.models);
+
+    auto instances = workload.instances(2000);
+    auto queries = workload.queries(200);
+
+    // reproducible
+    Workload again{options};
+    auto instances2 = again.instances(2000);
+    REQUIRE(instances2.front() == instances.front());
+    REQUIRE(instances2.back() == instances.back());
+
+    // skewed: a popular string value is shared by many instances of the same model
+    std::unordered_map<std::string,uint32_t> counts;
+    for(auto &instance : instances) {
+      auto *v = instance.find("attr_0");
+      if(v && v->is<std::string>()) {
+        ++counts[instance.model().name() + "/" + v->get<std::string>()];
+      }
+    }
+    uint32_t top = 0;
+    for(auto &c : counts) {
+      top = std::max(top, c.second);
+    }
+    REQUIRE(top > 2000 / options.distinct_values * 10);
+
+    // queries are valid, some but not all match, and the compiled evaluation agrees
+    uint32_t matching = 0;
+    std::size_t nb_checks = 0;
+    for(auto &query : queries) {
+      REQUIRE(query.valid());
+      CompiledQuery compiled{query.handle()};
+      bool any = false;
+      for(auto &instance : instances) {
+        bool match = query.check(instance);
+        REQUIRE(compiled.check(instance) == match);
+        any |= match;
+        ++nb_checks;
+      }
+      matching += any;
+    }
+    REQUIRE(nb_checks == 200 * 2000);
+    REQUIRE(matching > 0);
+    REQUIRE(matching < queries.size());
+  }
+
+  TEST_CASE("distance constraints", "[query]") {
+    DataModel station{"station", {Attribute{"location", Type::Location, true}}};
+    Instance paris{station, {{"location", VariantType{Location{2.35, 48.85}}}}};
+    Instance london{station, {{"location", VariantType{Location{-0.13, 51.51}}}}};
+    QueryModel near_paris{{Constraint{"location", Distance{Location{2.29, 48.86}, 50.}}}, station};
+    REQUIRE(near_paris.valid());
+    REQUIRE(near_paris.check(paris));
+    REQUIRE(!near_paris.check(london));
+    REQUIRE(CompiledQuery{near_paris.handle()}.check(paris));
+  }
+}